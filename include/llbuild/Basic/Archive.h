@@ -0,0 +1,85 @@
+//===- Archive.h ------------------------------------------------*- C++ -*-===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2020 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains a minimal writer for static library (`ar`) archives.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLBUILD_BASIC_ARCHIVE_H
+#define LLBUILD_BASIC_ARCHIVE_H
+
+#include "llbuild/Basic/LLVM.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+
+namespace llbuild {
+namespace basic {
+
+/// The layout of an archive.
+enum class ArchiveFormat {
+  /// The GNU (SysV) layout, with a "/" symbol index and a "//" long name
+  /// table.
+  GNU,
+
+  /// The BSD layout, with a "__.SYMDEF SORTED" symbol index and inline
+  /// ("#1/<length>") member names.
+  BSD
+};
+
+/// Get the conventional archive format for the host platform.
+ArchiveFormat getHostArchiveFormat();
+
+/// The outcome of writing an archive.
+enum class ArchiveWriteStatus {
+  /// A new archive was written, atomically replacing any existing one.
+  Written,
+
+  /// The existing archive had the expected layout, and was replaced by a copy
+  /// in which only the contents of the changed members were rewritten.
+  Updated,
+
+  /// The existing archive already had the expected contents.
+  Unchanged,
+
+  /// A member is an object file which cannot be indexed for the requested
+  /// format (e.g., LLVM bitcode), nothing was written.
+  Unsupported,
+
+  /// An error occurred.
+  Failed
+};
+
+/// Write a deterministic archive containing the given member files.
+///
+/// Member headers use zero timestamps, owner and group IDs, and a fixed mode,
+/// so the archive only depends on the member names and contents. Member
+/// contents are streamed into the archive using \see sys::copyFileRange().
+///
+/// A symbol index is built for ELF (GNU format) or Mach-O (BSD format) object
+/// members, other files are stored without symbols.
+///
+/// The archive is always written to a temporary file which is then renamed
+/// over \p archivePath, so it is never left partially written.
+///
+/// \param error_out [out] Error string if the status is \see
+/// ArchiveWriteStatus::Failed or \see ArchiveWriteStatus::Unsupported.
+ArchiveWriteStatus writeArchive(StringRef archivePath,
+                                ArrayRef<std::string> memberPaths,
+                                ArchiveFormat format, std::string* error_out);
+
+}
+}
+
+#endif
@@ -0,0 +1,47 @@
+//===- Compression.h --------------------------------------------*- C++ -*-===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLBUILD_BASIC_COMPRESSION_H
+#define LLBUILD_BASIC_COMPRESSION_H
+
+#include "llbuild/Basic/LLVM.h"
+
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+
+namespace llbuild {
+namespace basic {
+
+/// Compress a block of data.
+///
+/// This uses a simple LZ77 style scheme, which is fast and works well on the
+/// repetitive text typical of tool output (e.g., compiler diagnostics which
+/// repeat paths and source lines). Data which does not compress is stored as
+/// is, so the result is at most one byte larger than the input.
+///
+/// The encoding is stable, and may be persisted.
+std::string compressData(StringRef data);
+
+/// Decompress a block of data produced by \see compressData().
+///
+/// \param data The compressed data.
+///
+/// \param result_out [out] The decompressed data.
+///
+/// \returns False if the data was not a valid compressed block.
+bool decompressData(StringRef data, std::string* result_out);
+
+}
+}
+
+#endif
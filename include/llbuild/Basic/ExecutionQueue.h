@@ -64,6 +64,9 @@ namespace llbuild {
       typedef std::function<void(QueueJobContext*)> work_fn_ty;
       work_fn_ty work;
 
+      /// The scheduling priority of the job.
+      uint32_t priority = 0;
+
     public:
       /// Default constructor, for use as a sentinel.
       QueueJob() {}
@@ -74,6 +77,14 @@ namespace llbuild {
 
       JobDescriptor* getDescriptor() const { return desc; }
 
+      /// Get the scheduling priority of the job.
+      ///
+      /// Jobs with a higher priority are preferred by schedulers which honor
+      /// priorities. The build engine sets this to the number of tasks which
+      /// are (transitively) waiting on the task spawning the job.
+      uint32_t getPriority() const { return priority; }
+      void setPriority(uint32_t value) { priority = value; }
+
       void execute(QueueJobContext* context) { work(context); }
     };
 
@@ -213,18 +224,43 @@ namespace llbuild {
     // MARK: Lane Based Execution Queue
 
     enum class SchedulerAlgorithm {
-      /// Name priority queue based scheduling [default]
+      /// Priority queue based scheduling, ordered by the job priority and then
+      /// by name [default]
       NamePriority = 0,
 
       /// First in, first out
       FIFO = 1
     };
 
+    /// The placement of the threads of a lane based execution queue on the
+    /// host CPUs.
+    ///
+    /// These are only honored on platforms with CPU affinity support (currently
+    /// Linux), and have no effect on hosts with a single NUMA node.
+    struct LaneAffinityOptions {
+      /// Divide the lanes evenly across the NUMA nodes of the host, restricting
+      /// each lane thread (and the processes it spawns) to the CPUs of its
+      /// node.
+      bool partitionLanesByNUMANode = false;
+
+      /// Restrict the thread creating the queue (i.e., the build engine thread)
+      /// to the CPUs of the first NUMA node, for the lifetime of the queue.
+      ///
+      /// The queue must be destroyed on the same thread.
+      bool pinEngineThread = false;
+    };
+
     /// Create an execution queue that schedules jobs to individual lanes with a
     /// capped limit on the number of concurrent lanes.
+    ///
+    /// \param useJobServer If true, the queue acts as a GNU make jobserver
+    /// (advertised to subprocesses through MAKEFLAGS), so that parallel build
+    /// tools it runs borrow idle lanes instead of oversubscribing the host.
+    /// This is ignored on platforms without named FIFOs (Windows).
     ExecutionQueue* createLaneBasedExecutionQueue(
         ExecutionQueueDelegate& delegate, int numLanes, SchedulerAlgorithm alg,
-        const char* const* environment);
+        const char* const* environment, LaneAffinityOptions affinity = {},
+        bool useJobServer = false);
 
     /// Create an execution queue that executes all tasks serially on a single
     /// thread.
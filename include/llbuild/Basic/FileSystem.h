@@ -20,6 +20,8 @@
 #include "llvm/Support/ErrorOr.h"
 
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace llvm {
 
@@ -85,6 +87,31 @@ public:
   ///
   /// \returns True on success (the symlink was created)
   virtual bool createSymlink(const std::string& src, const std::string& target) = 0;
+
+  /// Copy the contents and permissions of the regular file at \p src to
+  /// \p target, replacing any existing file.
+  ///
+  /// The default implementation writes the contents returned by \see
+  /// getFileContents().
+  ///
+  /// \returns True on success (the file was copied)
+  virtual bool copyFile(const std::string& src, const std::string& target);
+
+  /// Get the names of the entries in the directory at \p path, in no
+  /// particular order.
+  ///
+  /// The default implementation lists the directory on the local file system.
+  ///
+  /// \returns True on success (the directory was read)
+  virtual bool getDirectoryContents(const std::string& path,
+                                    std::vector<std::string>& names_out);
+
+  /// Read the target of the symbolic link at \p path.
+  ///
+  /// The default implementation reads the link on the local file system.
+  ///
+  /// \returns True on success (the path is a symbolic link)
+  virtual bool readSymlink(const std::string& path, std::string& target_out);
 };
 
 /// Create a FileSystem instance suitable for accessing the local filesystem.
@@ -151,6 +178,20 @@ public:
   virtual bool createSymlink(const std::string& src, const std::string& target) override {
     return impl->createSymlink(src, target);
   }
+
+  virtual bool copyFile(const std::string& src, const std::string& target) override {
+    return impl->copyFile(src, target);
+  }
+
+  virtual bool getDirectoryContents(
+      const std::string& path, std::vector<std::string>& names_out) override {
+    return impl->getDirectoryContents(path, names_out);
+  }
+
+  virtual bool readSymlink(const std::string& path,
+                           std::string& target_out) override {
+    return impl->readSymlink(path, target_out);
+  }
 };
 
 }
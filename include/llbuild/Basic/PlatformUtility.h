@@ -19,9 +19,11 @@
 #define LLBUILD_BASIC_PLATFORMUTILITY_H
 
 #include "llbuild/Basic/CrossPlatformCompatibility.h"
+#include "llvm/ADT/ArrayRef.h"
 #include <cstdint>
 #include <cstdio>
 #include <string>
+#include <vector>
 #if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
 #include <unistd.h>
 #endif
@@ -44,6 +46,24 @@ int rmdir(const char *path);
 int symlink(const char *source, const char *target);
 int unlink(const char *fileName);
 int write(int fileHandle, void *destinationBuffer, unsigned int maxCharCount);
+
+/// Copy \p length bytes from \p inFD at \p inOffset to \p outFD at
+/// \p outOffset, without modifying the file offsets of either descriptor.
+///
+/// Where available, the copy is performed in the kernel (copy_file_range),
+/// otherwise it falls back to a userspace read/write loop.
+///
+/// \returns True on success, otherwise false with errno set.
+bool copyFileRange(int inFD, uint64_t inOffset, int outFD, uint64_t outOffset,
+                   uint64_t length);
+
+/// Make the contents of \p outFD a copy-on-write clone of \p inFD.
+///
+/// This is only supported on Linux file systems which implement reflinks
+/// (FICLONE, e.g. Btrfs and XFS).
+///
+/// \returns True on success, otherwise false with errno set.
+bool cloneFile(int inFD, int outFD);
 std::string strerror(int error);
 char *strsep(char **stringp, const char *delim);
 // Create a directory in the temporary folder which doesn't exist and return
@@ -63,6 +83,31 @@ llbuild_rlim_t getOpenFileLimit();
 /// Returns: 0 on success, -1 on failure (check errno).
 int raiseOpenFileLimit(llbuild_rlim_t limit = 2048);
 
+/// Parse a Linux CPU list (e.g., "0-3,8,10-11") into the list of CPU numbers.
+///
+/// \returns True on success, otherwise false if the list is malformed.
+bool parseCPUList(const std::string& list, std::vector<unsigned>& cpus_out);
+
+/// Get the CPUs of each NUMA node of the host which the current thread may run
+/// on.
+///
+/// Nodes without any such CPUs are omitted. The result is empty if the
+/// topology is not available (only Linux is currently supported).
+std::vector<std::vector<unsigned>> getNUMANodeCPUs();
+
+/// Get the set of CPUs the current thread may run on.
+///
+/// \returns True on success, otherwise false with errno set.
+bool getCurrentThreadAffinity(std::vector<unsigned>& cpus_out);
+
+/// Restrict the current thread to run on the given CPUs.
+///
+/// Processes spawned by the thread inherit the restriction.
+///
+/// \returns True on success, otherwise false with errno set (ENOTSUP on
+/// platforms without CPU affinity).
+bool setCurrentThreadAffinity(llvm::ArrayRef<unsigned> cpus);
+
 enum MATCH_RESULT { MATCH, NO_MATCH, MATCH_ERROR };
 // Test if a path or filename matches a wildcard pattern
 //
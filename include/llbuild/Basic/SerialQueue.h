@@ -13,24 +13,77 @@
 #ifndef LLBUILD_BASIC_SERIALQUEUE_H
 #define LLBUILD_BASIC_SERIALQUEUE_H
 
-#include <functional>
+#include "llvm/ADT/STLExtras.h"
+
+#include <atomic>
+#include <type_traits>
+#include <utility>
 
 namespace llbuild {
 namespace basic {
 
 /// A basic serial operation queue.
+///
+/// Serial queues do not own a thread, they are strands which execute their
+/// operations (one at a time, in order) on a thread pool shared by all queues.
+/// Operations should therefore avoid blocking for long periods of time.
 class SerialQueue {
+public:
+  /// An operation enqueued on a serial queue.
+  class Operation {
+    friend class SerialQueueImpl;
+
+    /// The next operation in the queue.
+    std::atomic<Operation*> next{ nullptr };
+
+  public:
+    virtual ~Operation();
+
+    /// Execute the operation.
+    ///
+    /// The operation is responsible for releasing itself once it is complete.
+    virtual void perform() = 0;
+  };
+
+private:
+  /// An operation which executes (and owns) a function object.
+  template <typename Fn>
+  class FunctionOperation : public Operation {
+    Fn fn;
+
+  public:
+    explicit FunctionOperation(Fn&& fn) : fn(std::move(fn)) {}
+    explicit FunctionOperation(const Fn& fn) : fn(fn) {}
+
+    virtual void perform() override {
+      fn();
+      delete this;
+    }
+  };
+
   void *impl;
 
+  /// Add an operation to the queue, and schedule the queue if it was idle.
+  void addOperation(Operation* operation);
+
 public:
   SerialQueue();
   ~SerialQueue();
 
   /// Add an operation and wait for it to complete.
-  void sync(std::function<void(void)> fn);
+  ///
+  /// If the queue is idle, the operation is executed directly on the calling
+  /// thread.
+  void sync(llvm::function_ref<void(void)> fn);
 
   /// Add an operation to the queue and return.
-  void async(std::function<void(void)> fn);
+  ///
+  /// The function object is moved into the queue, so it need not be copyable.
+  template <typename Fn>
+  void async(Fn&& fn) {
+    addOperation(new FunctionOperation<typename std::decay<Fn>::type>(
+                     std::forward<Fn>(fn)));
+  }
 };
 
 }
@@ -45,6 +45,22 @@ void appendShellEscapedString(llvm::raw_ostream& os, llvm::StringRef string);
 /// \returns escaped string.
 std::string shellEscaped(llvm::StringRef string);
 
+/// Replaces each occurrence of a path in a command line which forms a whole
+/// word, i.e., is bounded by whitespace, quotes, an '=' (as in `-MF=path`) or
+/// the ends of the string.
+///
+/// \param commandLine The command line (or single argument) to rewrite.
+///
+/// \param path The path to replace.
+///
+/// \param replacement The text to replace it with.
+///
+/// \param result [out] The rewritten command line.
+///
+/// \returns True if any occurrence was replaced.
+bool replacePathInCommandLine(llvm::StringRef commandLine, llvm::StringRef path,
+                              llvm::StringRef replacement, std::string& result);
+
 }
 }
 
@@ -18,11 +18,14 @@
 #include "llbuild/Basic/LLVM.h"
 #include "llbuild/Basic/POSIXEnvironment.h"
 
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/Optional.h"
+#include "llvm/Support/MemoryBuffer.h"
 
 #include <inttypes.h>
 #include <condition_variable>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <unordered_map>
 
@@ -244,6 +247,15 @@ namespace llbuild {
       /// If true, exposes a control file descriptor that may be used to
       /// communicate with the build system.
       bool controlEnabled = true;
+
+      /// If non-empty, the CPUs the spawned process is restricted to (support
+      /// not guaranteed on all platforms). The restriction is in place before
+      /// the process starts, so it covers all of its threads.
+      ArrayRef<unsigned> cpuAffinity = {};
+
+      /// Additional descriptors the spawned process inherits, under the same
+      /// numbers (support not guaranteed on all platforms).
+      ArrayRef<int> inheritedDescriptors = {};
     };
 
     /// Execute the given command line.
@@ -289,6 +301,53 @@ namespace llbuild {
 
     /// @}
 
+    // MARK: In-Memory Output Files
+
+    /// An anonymous file, held in memory where the platform allows, which a
+    /// spawned process can write an output to in place of a path on disk.
+    ///
+    /// The process is expected to inherit the descriptor (see
+    /// `ProcessAttributes::inheritedDescriptors`) and to open the file through
+    /// the path returned by `getPath()`; the contents are then read back once
+    /// the process has exited. The descriptor is closed on destruction.
+    class InMemoryOutputFile {
+      int descriptor;
+
+      explicit InMemoryOutputFile(int descriptor) : descriptor(descriptor) {}
+
+    public:
+      ~InMemoryOutputFile();
+
+      InMemoryOutputFile(const InMemoryOutputFile&) = delete;
+      InMemoryOutputFile& operator=(const InMemoryOutputFile&) = delete;
+
+      /// Create a new, empty file.
+      ///
+      /// \param name A name for the file, used for diagnostics only.
+      ///
+      /// \param error_out [out] On failure, a description of the error.
+      ///
+      /// \returns The file, or null if it could not be created (or the
+      /// platform does not support inheriting it).
+      static std::unique_ptr<InMemoryOutputFile> create(StringRef name,
+                                                        std::string* error_out);
+
+      /// Get the descriptor to be inherited by the process.
+      int getDescriptor() const { return descriptor; }
+
+      /// Get the path through which a process inheriting the descriptor can
+      /// open the file.
+      std::string getPath() const;
+
+      /// Read the current contents of the file.
+      ///
+      /// \param name The name to give the buffer.
+      ///
+      /// \param error_out [out] On failure, a description of the error.
+      std::unique_ptr<llvm::MemoryBuffer> getContents(StringRef name,
+                                                      std::string* error_out);
+    };
+
   }
 }
 
@@ -192,6 +192,21 @@ inline void TracingExecutionQueueDepth(uint64_t depth) {
   if (!TracingEnabled) return;
   LLBUILD_TRACE_POINT("execution_queue_depth", "depth:%llu", depth);
 }
+
+// Startup Phases
+struct TracingStartupPhase {
+  TracingStartupPhase(char const *phase) : phase(phase) {
+    if (!TracingEnabled) return;
+    LLBUILD_TRACE_INTERVAL_BEGIN("startup_phase", "phase:%s", phase);
+  }
+
+  ~TracingStartupPhase() {
+    if (!TracingEnabled) return;
+    LLBUILD_TRACE_INTERVAL_END("startup_phase", "phase:%s", phase);
+  }
+private:
+  char const *phase;
+};
   
 }
 
@@ -119,6 +119,20 @@ public:
   // FIXME: This is an inefficent map, the string is duplicated.
   typedef llvm::StringMap<std::unique_ptr<Tool>> tool_set;
 
+  /// The hashes of the definitions the description was loaded from, used to
+  /// find its unchanged parts when it is reloaded.
+  struct DefinitionHashes {
+    /// The hash of the 'client' and 'tools' sections.
+    uint64_t tools = 0;
+
+    /// The hashes of the nodes declared in the 'nodes' section; nodes which
+    /// were only created implicitly have no entry.
+    llvm::StringMap<uint64_t> nodes;
+
+    /// The hashes of the commands.
+    llvm::StringMap<uint64_t> commands;
+  };
+
 private:
   node_set nodes;
 
@@ -131,6 +145,8 @@ private:
   /// The default target.
   std::string defaultTarget;
 
+  DefinitionHashes definitionHashes;
+
 public:
   /// @name Accessors
   /// @{
@@ -165,6 +181,14 @@ public:
   /// Get the set of all tools used by the file.
   const tool_set& getTools() const { return tools; }
 
+  /// Get the hashes of the definitions the description was loaded from.
+  DefinitionHashes& getDefinitionHashes() { return definitionHashes; }
+
+  /// Get the hashes of the definitions the description was loaded from.
+  const DefinitionHashes& getDefinitionHashes() const {
+    return definitionHashes;
+  }
+
   /// @}
   /// @name Construction Helpers.
   /// @{
@@ -180,6 +204,25 @@ public:
   /// @}
 };
 
+/// The changes between a build description and the one it was reloaded from.
+struct BuildDescriptionDiff {
+  /// Whether the client or tools changed, in which case nothing was reused.
+  bool toolsChanged = false;
+
+  /// The names of the commands which were added.
+  std::vector<std::string> addedCommands;
+
+  /// The names of the commands which were removed.
+  std::vector<std::string> removedCommands;
+
+  /// The names of the commands which were reconstructed.
+  std::vector<std::string> changedCommands;
+
+  /// The names of the nodes which were added, removed or reconstructed, or
+  /// whose producers changed between having and not having any.
+  std::vector<std::string> changedNodes;
+};
+
 }
 }
 
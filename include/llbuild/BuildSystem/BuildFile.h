@@ -37,6 +37,7 @@ namespace buildsystem {
 typedef std::vector<std::pair<std::string, std::string>> property_list_type;
 
 class BuildDescription;
+struct BuildDescriptionDiff;
 class BuildFileDelegate;
 class BuildKey;
 class BuildSystem;
@@ -157,6 +158,20 @@ public:
   ///
   /// \returns A non-null build description on success.
   std::unique_ptr<BuildDescription> load();
+
+  /// Load the build file, reusing the parts of a description previously
+  /// loaded from it whose definitions are unchanged.
+  ///
+  /// Unchanged tools, nodes and commands are moved out of \arg previous into
+  /// the result instead of being reconstructed; commands are only reused if
+  /// the nodes they refer to are too. The remaining contents of \arg previous
+  /// must be kept alive while anything may still refer to them.
+  ///
+  /// \param diff_out [out] If given, the changes from \arg previous.
+  /// \returns A non-null build description on success. On failure, \arg
+  /// previous may have been partially moved from, and should be discarded.
+  std::unique_ptr<BuildDescription> reload(BuildDescription& previous,
+                                           BuildDescriptionDiff* diff_out);
 };
 
 }
@@ -0,0 +1,200 @@
+//===- BuildFileParser.h ----------------------------------------*- C++ -*-===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLBUILD_BUILDSYSTEM_BUILDFILEPARSER_H
+#define LLBUILD_BUILDSYSTEM_BUILDFILEPARSER_H
+
+#include "llbuild/Basic/LLVM.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/SMLoc.h"
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+namespace llvm {
+
+class MemoryBufferRef;
+class SourceMgr;
+
+}
+
+namespace llbuild {
+namespace buildsystem {
+namespace buildfile {
+
+class Parser;
+
+/// A node in a parsed build file document.
+///
+/// Nodes are stored in a single array in document order, each node followed
+/// by the nodes of its children, so the children of a mapping or sequence are
+/// found by walking forward from it. The nodes mirror the llvm::yaml node
+/// model: a mapping contains key-value nodes, each followed by its key and
+/// then its value.
+///
+/// Scalar nodes only refer to their text in the input buffer, their value is
+/// unescaped on demand by \see getValue().
+class Node {
+public:
+  enum NodeKind : uint8_t {
+    NK_Null,
+    NK_Scalar,
+    NK_BlockScalar,
+    NK_KeyValue,
+    NK_Mapping,
+    NK_Sequence,
+    NK_Alias
+  };
+
+  class iterator {
+    const Node* node;
+
+  public:
+    explicit iterator(const Node* node) : node(node) {}
+
+    const Node& operator*() const { return *node; }
+    const Node* operator->() const { return node; }
+
+    iterator& operator++() {
+      node += node->numNodes;
+      return *this;
+    }
+
+    bool operator==(const iterator& rhs) const { return node == rhs.node; }
+    bool operator!=(const iterator& rhs) const { return node != rhs.node; }
+  };
+
+private:
+  /// The source range of the node. For scalars, this is the exact text of the
+  /// scalar in the input, including any quotes.
+  const char* rangeStart;
+  const char* rangeEnd;
+
+  /// The number of nodes in the subtree rooted at this node.
+  uint32_t numNodes = 1;
+
+  NodeKind kind;
+
+  friend class Document;
+  friend class Parser;
+
+public:
+  Node(NodeKind kind, const char* start, const char* end)
+      : rangeStart(start), rangeEnd(end), kind(kind) {}
+
+  NodeKind getType() const { return kind; }
+
+  llvm::SMRange getSourceRange() const {
+    return llvm::SMRange(llvm::SMLoc::getFromPointer(rangeStart),
+                         llvm::SMLoc::getFromPointer(rangeEnd));
+  }
+
+  /// @name Scalar Nodes
+  /// @{
+
+  /// Get the text of the scalar as it appears in the input.
+  StringRef getRawValue() const {
+    assert(kind == NK_Scalar);
+    return StringRef(rangeStart, rangeEnd - rangeStart);
+  }
+
+  /// Get the value of the scalar.
+  ///
+  /// \param storage Used to store the value iff it has to be unescaped.
+  StringRef getValue(SmallVectorImpl<char>& storage) const;
+
+  /// @}
+
+  /// @name Key-Value Nodes
+  /// @{
+
+  const Node* getKey() const {
+    assert(kind == NK_KeyValue);
+    return this + 1;
+  }
+
+  const Node* getValue() const {
+    const Node* key = getKey();
+    return key + key->numNodes;
+  }
+
+  /// @}
+
+  /// @name Mapping and Sequence Nodes
+  /// @{
+
+  /// Iterate the key-value nodes of a mapping, or the items of a sequence.
+  iterator begin() const {
+    assert(kind == NK_Mapping || kind == NK_Sequence);
+    return iterator(this + 1);
+  }
+
+  iterator end() const {
+    return iterator(this + numNodes);
+  }
+
+  /// @}
+};
+
+/// A parsed build file.
+///
+/// Build files are YAML, but are almost always written by tools using only
+/// block mappings, flow sequences and single line scalars. The document
+/// parses that subset directly, without allocating per node, and otherwise
+/// relies on the general YAML parser.
+///
+/// The nodes refer into the input buffer, which must outlive the document.
+class Document {
+  std::vector<Node> nodes;
+
+  /// The range of the root of a second document in the stream, if present.
+  llvm::SMRange additionalDocumentRange;
+
+  friend class Parser;
+
+public:
+  /// Parse \p buffer, if it only uses the subset of YAML the document parses
+  /// directly.
+  ///
+  /// \returns False if the buffer uses any other YAML, or is malformed. The
+  /// document is then empty, and should be loaded with \see parseYAML().
+  bool parse(StringRef buffer);
+
+  /// Parse \p buffer with the general YAML parser.
+  ///
+  /// Any syntax errors are reported through \p sourceMgr, and the document
+  /// contains the nodes parsed before the error.
+  void parseYAML(llvm::MemoryBufferRef buffer, llvm::SourceMgr& sourceMgr);
+
+  /// Get the root node of the first document, or null if there was none.
+  const Node* getRoot() const {
+    return nodes.empty() ? nullptr : &nodes[0];
+  }
+
+  /// Get the range of the root of an additional document in the stream, which
+  /// is invalid if there was only one.
+  llvm::SMRange getAdditionalDocumentRange() const {
+    return additionalDocumentRange;
+  }
+
+  /// Get the number of nodes in the document.
+  size_t size() const { return nodes.size(); }
+};
+
+}
+}
+}
+
+#endif
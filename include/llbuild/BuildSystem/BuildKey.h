@@ -20,6 +20,7 @@
 #include "llbuild/Core/BuildEngine.h"
 #include "llbuild/BuildSystem/BuildDescription.h"
 
+#include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/StringRef.h"
 
 namespace llbuild {
@@ -76,7 +77,7 @@ private:
     encodedKey.reserve(1 + str.size());
     encodedKey.push_back(kindCode);
     encodedKey.append(str.begin(), str.end());
-    key = encodedKey;
+    key = std::move(encodedKey);
   }
 
   template<typename BinaryEncodable>
@@ -102,7 +103,7 @@ private:
     pos += dataSize;
     assert(encodedKey.size() == pos);
     (void)pos;
-    key = encodedKey;
+    key = std::move(encodedKey);
   }
 
 public:
@@ -301,6 +302,13 @@ public:
 
   const core::KeyType toData() const { return getKeyData(); }
 
+  /// Get a view of the key data, for passing to the engine without copying.
+  ///
+  /// The view is only valid for the lifetime of this key.
+  core::KeyRef toKeyRef() const {
+    return core::KeyRef(StringRef(key.str()));
+  }
+
   /// @}
 
   /// @name Debug Support
@@ -311,6 +319,69 @@ public:
   /// @}
 };
 
+/// A build key of one of the kinds identified by a single name, encoded into
+/// inline storage.
+///
+/// This is used on the hot paths which construct a key only to hand it to the
+/// engine, such as requesting the nodes of a command, where allocating a
+/// \see BuildKey for each one would dominate.
+class InlineBuildKey {
+  /// The encoded key, a kind code followed by the name.
+  SmallString<256> key;
+
+  InlineBuildKey(BuildKey::Kind kind, StringRef name) {
+    key.push_back(BuildKey::identifierForKind(kind));
+    key.append(name.begin(), name.end());
+  }
+
+public:
+  /// @name Construction Functions
+  /// @{
+
+  /// Create a key for computing a command result.
+  static InlineBuildKey makeCommand(StringRef name) {
+    return InlineBuildKey(BuildKey::Kind::Command, name);
+  }
+
+  /// Create a key for computing the contents of a directory.
+  static InlineBuildKey makeDirectoryContents(StringRef path) {
+    return InlineBuildKey(BuildKey::Kind::DirectoryContents, path);
+  }
+
+  /// Create a key for computing the structure of a directory.
+  static InlineBuildKey makeDirectoryTreeStructureSignature(StringRef path) {
+    return InlineBuildKey(BuildKey::Kind::DirectoryTreeStructureSignature,
+                          path);
+  }
+
+  /// Create a key for computing a node result.
+  static InlineBuildKey makeNode(StringRef path) {
+    return InlineBuildKey(BuildKey::Kind::Node, path);
+  }
+
+  /// Create a key for computing a node result.
+  static InlineBuildKey makeNode(const Node* node) {
+    return InlineBuildKey(BuildKey::Kind::Node, node->getName());
+  }
+
+  /// Create a key for computing a file system stat info result.
+  static InlineBuildKey makeStat(StringRef path) {
+    return InlineBuildKey(BuildKey::Kind::Stat, path);
+  }
+
+  /// Create a key for computing a target.
+  static InlineBuildKey makeTarget(StringRef name) {
+    return InlineBuildKey(BuildKey::Kind::Target, name);
+  }
+
+  /// @}
+
+  /// Get a view of the key data, for passing to the engine.
+  ///
+  /// The view is only valid for the lifetime of this key.
+  core::KeyRef toKeyRef() const { return core::KeyRef(key.str()); }
+};
+
 }
 }
 
@@ -16,6 +16,7 @@
 #include "llbuild/Basic/Compiler.h"
 #include "llbuild/Basic/LLVM.h"
 #include "llbuild/Basic/Subprocess.h"
+#include "llbuild/Core/BuildDB.h"
 
 #include "llvm/ADT/Optional.h"
 #include "llvm/ADT/StringRef.h"
@@ -43,6 +44,19 @@ class ShellCommandHandler;
 class Tool;
 
 bool pathIsPrefixedByPath(std::string path, std::string prefixPath);
+
+/// A command which a build would run, \see BuildSystem::predict().
+struct PredictedCommand {
+  /// The command.
+  Command* command;
+
+  /// Why the command would run.
+  core::PredictedRule::Reason reason;
+
+  /// The encoded \see BuildKey of the input responsible, for
+  /// core::PredictedRule::Reason::InputRebuilt.
+  core::KeyType input;
+};
   
 class BuildSystemDelegate {
   // DO NOT COPY
@@ -239,17 +253,39 @@ public:
 
   /// Load an explicit build description. from a file.
   void loadDescription(std::unique_ptr<BuildDescription> description);
+
+  /// Reload the build description from its file, if the file changed since
+  /// it was loaded.
+  ///
+  /// Only the tools, nodes and commands whose definitions changed are
+  /// reconstructed, and only the rules referring to them are replaced, so the
+  /// rest keep their results from earlier builds, \see BuildFile::reload().
+  ///
+  /// \returns True on success. On failure, the build system must not be used
+  /// for any further builds.
+  bool reloadDescription();
   
   /// Attach (or create) the database at the given path.
   ///
   /// \returns True on success.
   bool attachDB(StringRef path, std::string* error_out);
 
+  /// Attach (or create) the database at the given path, opened with the given
+  /// durability policy.
+  ///
+  /// \returns True on success.
+  bool attachDB(StringRef path, core::SQLiteBuildDBDurability durability,
+                std::string* error_out);
+
   /// Enable low-level engine tracing into the given output file.
   ///
   /// \returns True on success.
   bool enableTracing(StringRef path, std::string* error_out);
 
+  /// Limit the memory used by rule results kept between builds, \see
+  /// core::BuildEngine::setResultMemoryBudget().
+  void setResultMemoryBudget(uint64_t bytes);
+
   /// Build the named target.
   ///
   /// A build description *must* have been loaded before calling this method.
@@ -265,6 +301,31 @@ public:
   /// \returns The result of computing the value, or nil if the build failed.
   llvm::Optional<BuildValue> build(BuildKey target);
 
+  /// Predict which commands a build of the named target would run, without
+  /// running anything, \see core::BuildEngine::predict().
+  ///
+  /// A build description *must* have been loaded before calling this method.
+  ///
+  /// \param result_out [out] The commands which would run, in an order they
+  /// could run in.
+  /// \returns False if the target is not valid.
+  bool predict(StringRef target, std::vector<PredictedCommand>* result_out);
+
+  /// Persist the output a command printed when it was run, replacing that of
+  /// any earlier run, so it can be replayed while the command is up to date.
+  ///
+  /// \param output The output, an empty output removes any stored one.
+  /// \returns False if no database is attached, or the output could not be
+  /// stored.
+  bool setCommandOutput(Command* command, StringRef output,
+                        std::string* error_out);
+
+  /// Look up the output persisted for a command, \see setCommandOutput().
+  ///
+  /// \returns True if an output was found.
+  bool lookupCommandOutput(Command* command, std::string* output_out,
+                           std::string* error_out);
+
   /// Reset mutable build state before a new build operation.
   void resetForBuild();
 
@@ -22,6 +22,9 @@
 #include <mutex>
 
 namespace llbuild {
+namespace core {
+class BuildDB;
+}
 namespace buildsystem {
 
 class BuildSystemExtension;
@@ -31,17 +34,43 @@ class ShellCommand;
 ///
 /// NOTE: This class *is* thread-safe.
 class BuildSystemExtensionManager {
+  /// The discovery state for a single command path.
+  struct Entry {
+    /// Flag used to run (and coalesce) discovery exactly once.
+    std::once_flag discovered;
+
+    /// The discovered extension (or nullptr, for negative lookups).
+    std::unique_ptr<BuildSystemExtension> extension;
+  };
+
   /// Mutex to protect extensions map.
+  ///
+  /// This lock is never held while discovering an extension, discovery of
+  /// distinct command paths proceeds concurrently.
   std::mutex extensionsLock;
 
-  /// The map of discovered extensions (or nullptr, for negative lookups).
-  llvm::StringMap<std::unique_ptr<BuildSystemExtension>> extensions;
+  /// The map of discovery entries.
+  llvm::StringMap<std::unique_ptr<Entry>> extensions;
+
+  /// Discover the extension for the given command path.
+  ///
+  /// \param db If provided, a database used to persist the result of querying
+  /// the extension info tool across invocations.
+  static std::unique_ptr<BuildSystemExtension>
+  discover(StringRef path, core::BuildDB* db);
   
 public:
   BuildSystemExtensionManager() {}
 
   /// Find a registered extension for the given command path.
-  BuildSystemExtension* lookupByCommandPath(StringRef path);
+  ///
+  /// Concurrent lookups of the same path which has not yet been discovered
+  /// will wait for a single discovery to complete.
+  ///
+  /// \param db If provided, a database used to persist the result of querying
+  /// the extension info tool, keyed on the file information of that tool.
+  BuildSystemExtension* lookupByCommandPath(StringRef path,
+                                            core::BuildDB* db = nullptr);
 };
 
 /// A concrete build system extension.
@@ -79,6 +79,10 @@ public:
   
   /// Build the named target using the specified invocation parameters.
   ///
+  /// If the invocation only requested a prediction, the commands the build
+  /// would run are reported instead, \see
+  /// BuildSystemFrontendDelegate::commandWouldRun().
+  ///
   /// \returns True on success, or false if there were errors.
   bool build(StringRef targetToBuild);
 
@@ -158,10 +162,36 @@ public:
   ///
   /// @{
 
+  /// Called by the frontend to report that a phase of its initialization
+  /// (e.g. loading the build file or attaching the database) has completed.
+  ///
+  /// The default implementation reports the phase if the invocation requested
+  /// startup timing.
+  ///
+  /// \param phase The name of the phase.
+  /// \param duration The time spent in the phase, in seconds.
+  virtual void startupPhaseCompleted(StringRef phase, double duration);
+
+  /// Called by the frontend, when the invocation only requested a prediction,
+  /// to report a command the build would run.
+  ///
+  /// The default implementation reports the command and why it would run,
+  /// unless the command opted out of status reporting.
+  virtual void commandWouldRun(const PredictedCommand& prediction);
+
   /// Called by the build system to report that a declared command's state is
   /// changing.
+  ///
+  /// The default implementation replays the stored output of up-to-date
+  /// commands when the invocation requested it, \see commandOutputReplayed().
   virtual void commandStatusChanged(Command*, CommandStatusKind) override;
 
+  /// Called to replay the output a command printed the last time it was run,
+  /// when the command is up to date and the invocation requested replay.
+  ///
+  /// The default implementation writes the output to stdout.
+  virtual void commandOutputReplayed(Command*, StringRef output);
+
   /// Called by the build system to report that a declared command is preparing
   /// to run.
   ///
@@ -329,12 +359,26 @@ public:
   /// Whether to show verbose output.
   bool showVerboseStatus = false;
 
+  /// Whether to report the time spent in each phase of initialization.
+  bool showStartupTiming = false;
+
+  /// Whether to only report the commands a build would run, and why, without
+  /// running any of them.
+  bool predictOnly = false;
+
+  /// Whether to replay the stored output of commands which are up to date.
+  bool replayOutput = false;
+
   /// Whether to use a serial build.
   bool useSerialBuild = false;
   
   /// The path of the database file to use, if any.
   std::string dbPath = "build.db";
 
+  /// The journaling and sync policy of the database.
+  core::SQLiteBuildDBDurability dbDurability =
+      core::SQLiteBuildDBDurability::Strict;
+
   /// The path of a directory to change into before anything else, if any.
   std::string chdirPath = "";
 
@@ -349,6 +393,22 @@ public:
 
   uint32_t schedulerLanes = 0;
 
+  /// Whether to divide the lanes evenly across the NUMA nodes of the host,
+  /// \see basic::LaneAffinityOptions.
+  bool partitionLanesByNUMANode = false;
+
+  /// Whether to pin the build engine thread to the first NUMA node, \see
+  /// basic::LaneAffinityOptions.
+  bool pinEngineThread = false;
+
+  /// Whether to share the lanes with subprocesses through a GNU make
+  /// compatible jobserver.
+  bool useJobServer = false;
+
+  /// The memory budget for rule results kept between builds, or zero for no
+  /// limit, \see core::BuildEngine::setResultMemoryBudget().
+  uint64_t resultMemoryBudget = 0;
+
   /// The base environment to use when executing subprocesses.
   ///
   /// The format is expected to match that of `::main()`, i.e. a null-terminated
@@ -140,6 +140,13 @@ public:
   
   virtual void start(BuildSystem& system, core::TaskInterface ti) = 0;
 
+  /// Get the nodes \see start() is known to request as inputs, without
+  /// starting the command, for use in predicting a build.
+  ///
+  /// The default implementation provides none, in which case only the inputs
+  /// recorded when the command last ran are considered.
+  virtual void getKnownInputs(std::vector<Node*>& inputs) {}
+
   virtual void providePriorValue(BuildSystem& system, core::TaskInterface ti,
                                  const BuildValue& value) = 0;
 
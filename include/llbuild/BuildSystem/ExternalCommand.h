@@ -137,6 +137,8 @@ public:
 
   virtual void start(BuildSystem& system, core::TaskInterface ti) override;
 
+  virtual void getKnownInputs(std::vector<Node*>& inputs) override;
+
   virtual void providePriorValue(BuildSystem& system,
                                  core::TaskInterface,
                                  const BuildValue&) override;
@@ -29,6 +29,7 @@
 
 namespace llbuild {
   namespace basic {
+    class InMemoryOutputFile;
     class QueueJobContext;
   }
   namespace core {
@@ -71,6 +72,10 @@ class ShellCommand : public ExternalCommand {
   /// The style of dependencies used.
   DepsStyle depsStyle = DepsStyle::Unused;
 
+  /// Whether to hand the command in-memory files for its dependency outputs,
+  /// in place of the paths in `depsPaths`.
+  bool depsInMemory = false;
+
   /// Whether to inherit the base environment.
   bool inheritEnv = true;
 
@@ -96,9 +101,14 @@ class ShellCommand : public ExternalCommand {
   
   virtual basic::CommandSignature getSignature() const override;
 
-  bool processDiscoveredDependencies(BuildSystem& system,
-                                     core::TaskInterface ti,
-                                     basic::QueueJobContext* context);
+  /// Process the dependency outputs of a completed command.
+  ///
+  /// \param depsFiles The in-memory files the outputs were written to, if any,
+  /// indexed as `depsPaths`; null entries are read from disk.
+  bool processDiscoveredDependencies(
+      BuildSystem& system, core::TaskInterface ti,
+      basic::QueueJobContext* context,
+      ArrayRef<std::unique_ptr<basic::InMemoryOutputFile>> depsFiles);
   
   bool processMakefileDiscoveredDependencies(BuildSystem& system,
                                              core::TaskInterface ti,
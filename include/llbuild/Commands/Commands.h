@@ -37,6 +37,7 @@ const char* getProgramName();
 int executeNinjaCommand(const std::vector<std::string> &args);
 int executeBuildEngineCommand(const std::vector<std::string> &args);
 int executeBuildSystemCommand(const std::vector<std::string> &args);
+int executeQueryCommand(const std::vector<std::string> &args);
 
 }
 }
@@ -21,6 +21,7 @@
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace llbuild {
 namespace core {
@@ -138,21 +139,137 @@ public:
   /// \note The number of keys and results added to the out parameters is always
   /// the same.
   virtual bool getKeysWithResult(std::vector<KeyType> &keys_out, std::vector<Result> &results_out, std::string* error_out) = 0;
-  
+
+  /// Look up an auxiliary value stored by a client of the database.
+  ///
+  /// Auxiliary values are not associated with any rule, they allow clients to
+  /// persist small amounts of state (e.g., discovery caches) with the same
+  /// lifetime as the build results. Databases are not required to support
+  /// them, in which case lookups always miss.
+  ///
+  /// \param key The client defined key for the value.
+  /// \param value_out [out] The stored value, if found.
+  /// \param error_out [out] Error string if an error occurred.
+  /// \returns True if the database had a stored value for the key.
+  virtual bool lookupAuxiliaryValue(StringRef key, std::string* value_out,
+                                    std::string* error_out) {
+    (void)key; (void)value_out; (void)error_out;
+    return false;
+  }
+
+  /// Update the stored auxiliary value for a client defined key.
+  ///
+  /// \param error_out [out] Error string if return value is false.
+  virtual bool setAuxiliaryValue(StringRef key, StringRef value,
+                                 std::string* error_out) {
+    (void)key; (void)value; (void)error_out;
+    return false;
+  }
+
+  /// Look up the output a command printed the last time it was run.
+  ///
+  /// This allows clients to replay the diagnostics of commands which are up to
+  /// date. Databases are not required to support command outputs, in which
+  /// case lookups always miss.
+  ///
+  /// \param key The key of the rule which ran the command.
+  /// \param output_out [out] The stored output, if found.
+  /// \param error_out [out] Error string if an error occurred.
+  /// \returns True if the database had a stored output for the key.
+  virtual bool lookupCommandOutput(const KeyType& key, std::string* output_out,
+                                   std::string* error_out) {
+    (void)key; (void)output_out; (void)error_out;
+    return false;
+  }
+
+  /// Update the stored output of the command for a rule.
+  ///
+  /// The database is only modified if the stored output changes.
+  ///
+  /// \param output The output of the command, an empty output removes any
+  /// stored one.
+  /// \param error_out [out] Error string if return value is false.
+  virtual bool setCommandOutput(const KeyType& key, StringRef output,
+                                std::string* error_out) {
+    (void)key; (void)output; (void)error_out;
+    return false;
+  }
+
   /// Dump a debug view of the database contents
   virtual void dump(raw_ostream& os) { (void)os; }
 };
 
+/// The durability policy of a SQLite3 backed BuildDB.
+enum class SQLiteBuildDBDurability {
+  /// Use a rollback journal, and sync every transaction to disk.
+  Strict,
+
+  /// Use a write-ahead log, and sync every transaction to disk.
+  Normal,
+
+  /// Use a write-ahead log which is only synced at checkpoints, and read
+  /// through a memory map. The most recent builds may be lost on power failure,
+  /// but the database is never corrupted.
+  Fast,
+};
+
 /// Create a BuildDB instance backed by a SQLite3 database.
 ///
 /// \param clientSchemaVersion An uninterpreted version number for use by the
 /// client to allow batch changes to the stored build results; if the stored
 /// schema does not match the provided version the database will be cleared upon
 /// opening; to avoid this behavior, pass `false` for `recreateUnmatchedVersion`.
-std::unique_ptr<BuildDB> createSQLiteBuildDB(StringRef path,
-                                             uint32_t clientSchemaVersion,
-                                             bool recreateUnmatchedVersion,
-                                             std::string* error_out);
+/// \param durability The journaling and sync policy to open the database with.
+std::unique_ptr<BuildDB> createSQLiteBuildDB(
+    StringRef path, uint32_t clientSchemaVersion, bool recreateUnmatchedVersion,
+    std::string* error_out,
+    SQLiteBuildDBDurability durability = SQLiteBuildDBDurability::Strict);
+
+/// Create a read-only BuildDB instance for an existing SQLite3 database.
+///
+/// All reads see a consistent snapshot of the database, which is taken on first
+/// access and held until \see BuildDB::buildComplete() is called; the next
+/// access then takes a new snapshot. Mutations fail. The database is never
+/// recreated: a schema or client version mismatch is an error.
+///
+/// The reader only runs concurrently with a build if the database is written
+/// with a write-ahead log, i.e. with the Normal or Fast \see
+/// SQLiteBuildDBDurability; it then neither blocks nor is blocked by the build.
+/// The default, Strict, uses a rollback journal: a build in progress holds an
+/// exclusive lock, and reads fail once the busy timeout expires.
+std::unique_ptr<BuildDB> createReadOnlySQLiteBuildDB(StringRef path,
+                                                     uint32_t clientSchemaVersion,
+                                                     std::string* error_out);
+
+/// Parse the name of a durability policy ("strict", "normal" or "fast").
+///
+/// \returns True on success.
+bool parseSQLiteBuildDBDurability(StringRef name,
+                                  SQLiteBuildDBDurability* durability_out);
+
+/// Create a BuildDB instance which partitions rule results across \p shards.
+///
+/// Rules are assigned to a shard by a hash of their key. The first shard holds
+/// the build iteration and the auxiliary values, and is committed before the
+/// others when a build completes.
+///
+/// NOTE: This is not used by the build system, since the engine accesses its
+/// database from a single thread there is nothing to gain from the separate
+/// locks, while each shard adds a commit to every build.
+std::unique_ptr<BuildDB> createShardedBuildDB(
+    std::vector<std::unique_ptr<BuildDB>>&& shards);
+
+/// Create a BuildDB instance which partitions rule results across several
+/// SQLite3 databases, each with its own connection and lock.
+///
+/// The shards are stored alongside \p path, in files named for their index
+/// and \p numShards; changing the number of shards starts from an empty set of
+/// databases. If \p numShards is one or less, this is equivalent to \see
+/// createSQLiteBuildDB().
+std::unique_ptr<BuildDB> createShardedSQLiteBuildDB(
+    StringRef path, unsigned numShards, uint32_t clientSchemaVersion,
+    bool recreateUnmatchedVersion, std::string* error_out,
+    SQLiteBuildDBDurability durability = SQLiteBuildDBDurability::Strict);
 
 }
 }
@@ -21,6 +21,8 @@
 #include "llbuild/Core/AttributedKeyIDs.h"
 #include "llbuild/Core/KeyID.h"
 
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/Twine.h"
 
@@ -41,6 +43,7 @@ private:
 public:
   KeyType() { }
   KeyType(const std::string& key) : key(key) { }
+  KeyType(std::string&& key) : key(std::move(key)) { }
   KeyType(const char* key) : key(key) { }
   KeyType(llvm::StringRef ref) : key(ref) { }
   KeyType(const char* data, size_t length) : key(data, length) { }
@@ -54,6 +57,37 @@ public:
   size_t size() const { return key.size(); }
 };
 
+/// A non-owning view of the bytes of a key, together with the hash the engine
+/// uses to intern them.
+///
+/// Clients which construct keys on hot paths can compute the hash once, while
+/// the bytes are being produced, and pass the view to the engine, which will
+/// then resolve it to a \see KeyID without copying or rehashing it.
+class KeyRef {
+private:
+  llvm::StringRef bytes;
+  uint32_t hashValue;
+
+public:
+  KeyRef(llvm::StringRef bytes, uint32_t hashValue)
+      : bytes(bytes), hashValue(hashValue) {
+    assert(hashValue == hash(bytes) && "invalid key hash");
+  }
+  explicit KeyRef(llvm::StringRef bytes)
+      : bytes(bytes), hashValue(hash(bytes)) { }
+  explicit KeyRef(const KeyType& key) : KeyRef(llvm::StringRef(key.str())) { }
+
+  /// Compute the hash of the given key bytes.
+  static uint32_t hash(llvm::StringRef bytes) {
+    return llvm::StringMapImpl::hash(bytes);
+  }
+
+  llvm::StringRef str() const { return bytes; }
+  const char* data() const { return bytes.data(); }
+  size_t size() const { return bytes.size(); }
+  uint32_t getHash() const { return hashValue; }
+};
+
 typedef std::vector<uint8_t> ValueType;
 
 class BuildDB;
@@ -136,6 +170,9 @@ public:
   /// by the engine.
   void request(const KeyType& key, uintptr_t inputID);
 
+  /// Request an input using a key view, see \see request() above.
+  void request(KeyRef key, uintptr_t inputID);
+
   /// Specify that the task must be built subsequent to the
   /// computation of \arg Key.
   ///
@@ -143,6 +180,7 @@ public:
   /// the only guarantee the engine provides is that if \arg Key is computed
   /// during a build, then task will not be computed until after it.
   void mustFollow(const KeyType& key);
+  void mustFollow(KeyRef key);
 
   /// Inform the engine of an input dependency that was discovered by the task
   /// during its execution, a la compiler generated dependency files.
@@ -165,6 +203,7 @@ public:
   /// responsible for ensuring that it is never called concurrently for the same
   /// task.
   void discoveredDependency(const KeyType& key);
+  void discoveredDependency(KeyRef key);
 
   /// Called by a task to indicate it has completed and to provide its value.
   ///
@@ -178,6 +217,9 @@ public:
   void complete(ValueType&& value, bool forceChange = false);
 
   /// Called by a task to run an asynchronous computation
+  ///
+  /// The priority of the job is set to the number of tasks which are
+  /// (transitively) waiting on this one.
   void spawn(basic::QueueJob&&);
 
   /// Called by a task to spawn an external process.
@@ -335,6 +377,18 @@ public:
 
   /// Called to indicate a change in the rule status.
   virtual void updateStatus(BuildEngine&, StatusKind);
+
+  /// Called by \see BuildEngine::predict() to get the inputs the task for
+  /// this rule is known to request, without running it.
+  ///
+  /// These are considered in addition to the dependencies recorded with the
+  /// prior result, so that a prediction also covers inputs which are new since
+  /// the rule last ran. The default implementation provides none.
+  ///
+  /// \param inputs [out] The inputs, each paired with whether it is only an
+  /// ordering dependency (\see TaskInterface::mustFollow()).
+  virtual void getKnownInputs(BuildEngine&,
+                              std::vector<std::pair<KeyType, bool>>& inputs);
 };
 
 /// Delegate interface for use with the build engine.
@@ -387,6 +441,35 @@ public:
 
 };
 
+/// A rule which a build would run, as predicted by \see BuildEngine::predict().
+struct PredictedRule {
+  /// Why the rule would run; these mirror the reasons the engine traces while
+  /// scanning a rule.
+  enum class Reason {
+    /// The rule has no prior result.
+    NeverBuilt,
+
+    /// The rule's signature differs from the one of its prior result.
+    SignatureChanged,
+
+    /// The rule reported its prior result is no longer valid.
+    InvalidValue,
+
+    /// An input of the rule would run, or was computed after the rule's
+    /// prior result was built.
+    InputRebuilt
+  };
+
+  /// The key of the rule.
+  KeyType key;
+
+  /// The first reason found for running the rule.
+  Reason reason;
+
+  /// The input responsible, for \see Reason::InputRebuilt.
+  KeyType input;
+};
+
 /// A build engine supports fast, incremental, persistent, and parallel
 /// execution of computational graphs.
 ///
@@ -435,6 +518,15 @@ public:
   /// Add a rule which the engine can use to produce outputs.
   void addRule(std::unique_ptr<Rule>&& rule);
 
+  /// Replace the rules for which \arg shouldReplace returns true with the ones
+  /// the delegate looks up for their keys, e.g. because the definitions they
+  /// were created from changed.
+  ///
+  /// The results of the replaced rules are kept, and are checked against the
+  /// new rules as if they had been loaded from the database. This must not be
+  /// called while a build is running.
+  void replaceRules(llvm::function_ref<bool(const KeyType&)> shouldReplace);
+
   /// @}
 
   /// @name Client API
@@ -444,8 +536,24 @@ public:
   ///
   /// \returns The result of computing the key, or the empty value if the key
   /// could not be computed; the latter case only happens if a cycle was
-  /// discovered currently.
-  const ValueType& build(const KeyType& key);
+  /// discovered currently. The result is returned by value, since the engine
+  /// may page out its copy on a later build (\see setResultMemoryBudget()).
+  ValueType build(const KeyType& key);
+
+  /// Predict which rules a build of \p key would run, without running any.
+  ///
+  /// This performs only the checks the engine makes while scanning: whether a
+  /// prior result exists, whether its signature matches, whether the rule
+  /// considers it valid, and whether any of its recorded inputs would run. No
+  /// tasks are created, and the engine's state is left as it was.
+  ///
+  /// The prediction is an upper bound: a rule is assumed to change its value
+  /// whenever it runs, so a dependent is reported even though the real build
+  /// might find the input's value unchanged and skip it.
+  ///
+  /// \returns The rules which would run, ordered such that each rule follows
+  /// the inputs it is reported because of.
+  std::vector<PredictedRule> predict(const KeyType& key);
 
   /// Cancel the currently running build.
   ///
@@ -480,6 +588,16 @@ public:
   /// \returns True on success.
   bool enableTracing(const std::string& path, std::string* error_out);
 
+  /// Limit the memory used by rule results kept between builds.
+  ///
+  /// When a database is attached, the engine pages out the values and
+  /// dependencies of the least recently built rules at the start of each
+  /// build, until the remaining results fit in \arg bytes. Paged out results
+  /// are reloaded from the database when the rule is next scanned.
+  ///
+  /// \param bytes The memory budget, or zero for no limit (the default).
+  void setResultMemoryBudget(uint64_t bytes);
+
   /// Dump the build state to a file in Graphviz DOT format.
   void dumpGraphToFile(const std::string &path);
 
@@ -0,0 +1,146 @@
+//===- DependencyGraphIndex.h -----------------------------------*- C++ -*-===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLBUILD_CORE_DEPENDENCYGRAPHINDEX_H
+#define LLBUILD_CORE_DEPENDENCYGRAPHINDEX_H
+
+#include "llbuild/Basic/LLVM.h"
+#include "llbuild/Core/BuildEngine.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llbuild {
+namespace core {
+
+class BuildDB;
+
+/// A compact, immutable index of the dependency graph recorded in a build
+/// database.
+///
+/// Every key known to the database (whether or not it has a result of its own)
+/// is assigned a dense node number, in key order. The edges are stored in
+/// compressed sparse row form in both directions, so the dependencies and the
+/// dependents of a node are each a contiguous slice of a single array.
+///
+/// The index is a snapshot: it is not updated as the database changes, but
+/// records the build iteration it was taken at so that a persisted copy can be
+/// checked for staleness.
+class DependencyGraphIndex {
+public:
+  typedef uint32_t NodeID;
+
+private:
+  /// The build iteration of the database the index was built from.
+  Epoch epoch = 0;
+
+  /// The key names, concatenated in sorted order.
+  std::string keyData;
+
+  /// The offset of each key in \see keyData, plus a final end offset.
+  std::vector<uint32_t> keyOffsets;
+
+  /// The offset of each node's slice of \see dependencies, plus a final end
+  /// offset.
+  std::vector<uint32_t> dependencyOffsets;
+  std::vector<NodeID> dependencies;
+
+  /// The offset of each node's slice of \see dependents, plus a final end
+  /// offset.
+  std::vector<uint32_t> dependentOffsets;
+  std::vector<NodeID> dependents;
+
+  DependencyGraphIndex() {}
+
+public:
+  /// Build an index of the dependencies recorded in \p db.
+  ///
+  /// The index attaches a delegate of its own to \p db, so the database must
+  /// not be shared with a build engine.
+  ///
+  /// \param error_out [out] Error string if return value is null.
+  static std::unique_ptr<DependencyGraphIndex> build(BuildDB& db,
+                                                     std::string* error_out);
+
+  /// Load an index previously written by \see write().
+  ///
+  /// \param error_out [out] Error string if return value is null.
+  static std::unique_ptr<DependencyGraphIndex> load(StringRef path,
+                                                    std::string* error_out);
+
+  /// Write the index to \p path, replacing it atomically.
+  ///
+  /// The file is in host byte order; it is a cache, and is rejected by \see
+  /// load() on a host which does not match.
+  ///
+  /// \param error_out [out] Error string if return value is false.
+  bool write(StringRef path, std::string* error_out) const;
+
+  /// Get the build iteration of the database the index was built from.
+  Epoch getEpoch() const { return epoch; }
+
+  /// Get the number of nodes in the graph.
+  unsigned getNumNodes() const { return keyOffsets.size() - 1; }
+
+  /// Get the number of dependency edges in the graph.
+  size_t getNumEdges() const { return dependencies.size(); }
+
+  /// Find the node for \p key.
+  ///
+  /// \param id_out [out] The node, if found.
+  /// \returns True if the key is in the graph.
+  bool lookup(StringRef key, NodeID* id_out) const;
+
+  /// Get the key of a node.
+  StringRef getKey(NodeID id) const {
+    return StringRef(keyData.data() + keyOffsets[id],
+                     keyOffsets[id + 1] - keyOffsets[id]);
+  }
+
+  /// Get the direct dependencies of a node, in the order they were recorded.
+  ArrayRef<NodeID> getDependencies(NodeID id) const {
+    return ArrayRef<NodeID>(dependencies.data() + dependencyOffsets[id],
+                            dependencies.data() + dependencyOffsets[id + 1]);
+  }
+
+  /// Get the nodes which directly depend on a node, in node order.
+  ArrayRef<NodeID> getDependents(NodeID id) const {
+    return ArrayRef<NodeID>(dependents.data() + dependentOffsets[id],
+                            dependents.data() + dependentOffsets[id + 1]);
+  }
+
+  /// Get every node, other than the roots, which \p roots transitively depend
+  /// on, in node order.
+  std::vector<NodeID> getTransitiveDependencies(ArrayRef<NodeID> roots) const;
+
+  /// Get every node, other than the roots, which transitively depends on \p
+  /// roots, in node order.
+  ///
+  /// These are the results which would be recomputed if the roots changed.
+  std::vector<NodeID> getTransitiveDependents(ArrayRef<NodeID> roots) const;
+
+  /// Find a shortest chain of dependencies from \p from to \p to.
+  ///
+  /// \returns The nodes on the path, starting with \p from and ending with \p
+  /// to, or an empty vector if \p from does not depend on \p to.
+  std::vector<NodeID> findPath(NodeID from, NodeID to) const;
+};
+
+}
+}
+
+#endif
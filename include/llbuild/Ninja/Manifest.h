@@ -17,6 +17,7 @@
 #include "llbuild/Basic/LLVM.h"
 
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
@@ -25,15 +26,28 @@
 #include <cassert>
 #include <cstdint>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 namespace llbuild {
 namespace ninja {
 
+class CommandSignatureCache;
 class Pool;
 class Rule;
 
+/// Evaluate a string template, expanding escapes and variable references.
+///
+/// \param lookup Called to append the value of each referenced variable to the
+/// result.
+/// \param error Called with a diagnostic for each malformed escape or variable
+/// reference.
+void evalString(StringRef string, raw_ostream& result,
+                llvm::function_ref<void(StringRef, raw_ostream&)> lookup,
+                llvm::function_ref<void(const std::string&)> error);
+
 /// This class represents a Ninja manifest scope (used to contain variable
 /// bindings).
 class Scope {
@@ -174,8 +188,17 @@ private:
 
   Pool* executionPool;
 
-  std::string commandString;
-  std::string description;
+  /// The scope the command was declared in, used to evaluate the command
+  /// string and description on first use.
+  const Scope* scope = nullptr;
+
+  /// The evaluated command string and description, which are materialized
+  /// lazily (most commands in a large manifest never run).
+  mutable std::once_flag commandStringFlag;
+  mutable std::once_flag descriptionFlag;
+  mutable std::string commandString;
+  mutable std::string description;
+
   std::string depsFile;
   std::string rspFile;
   std::string rspFileContent;
@@ -183,6 +206,7 @@ private:
   unsigned depsStyle: 2;
   unsigned isGenerator: 1;
   unsigned shouldRestat: 1;
+  unsigned isCommandStringFixed: 1;
 
 public:
   // FIXME: Use an rvalue reference for the outputs and inputs here to avoid
@@ -196,7 +220,7 @@ public:
       numExplicitInputs(numExplicitInputs),
       numImplicitInputs(numImplicitInputs),
       executionPool(nullptr), depsStyle(unsigned(DepsStyleKind::None)),
-      isGenerator(0), shouldRestat(0)
+      isGenerator(0), shouldRestat(0), isCommandStringFixed(0)
   {
     assert(outputs.size() > 0);
     assert(numExplicitInputs + numImplicitInputs <= inputs.size());
@@ -208,6 +232,16 @@ public:
 
   const std::vector<Node*>& getInputs() const { return inputs; }
 
+  /// Get the scope the command was declared in, if known.
+  const Scope* getScope() const { return scope; }
+
+  /// Set the scope the command was declared in.
+  ///
+  /// Once set, the command string and description are evaluated against the
+  /// scope on first use, unless they were explicitly assigned. The scope must
+  /// not be modified afterwards.
+  void setScope(const Scope* value) { scope = value; }
+
   const std::vector<Node*>::const_iterator explicitInputs_begin() const {
     return inputs.begin();
   }
@@ -242,6 +276,16 @@ public:
     return parameters;
   }
 
+  /// Evaluate the named build parameter, in the context of the command
+  /// parameters, the rule templates and the declaring scope.
+  ///
+  /// \param shellEscapeInAndOut Whether to shell escape the paths substituted
+  /// for "$in", "$in_newline" and "$out".
+  /// \param error Called with a diagnostic for each malformed rule template.
+  void evalParameter(StringRef name, bool shellEscapeInAndOut,
+                     raw_ostream& result,
+                     llvm::function_ref<void(const std::string&)> error) const;
+
   /// @name Attributes
   /// @{
 
@@ -252,18 +296,38 @@ public:
 
   /// Get the shell command to execute to run this command.
   const std::string& getCommandString() const {
+    std::call_once(commandStringFlag, [this]() {
+        materializeAttribute("command", commandString);
+      });
     return commandString;
   }
   void setCommandString(StringRef value) {
     commandString = value;
+    std::call_once(commandStringFlag, []() {});
+    isCommandStringFixed = 1;
   }
 
+  /// Evaluate the command string now, against the current bindings of the
+  /// scope (which is about to be modified).
+  void fixCommandString() {
+    getCommandString();
+    isCommandStringFixed = 1;
+  }
+
+  /// Whether the command string was evaluated while the command was loaded,
+  /// rather than against the final bindings of its scope.
+  bool hasFixedCommandString() const { return isCommandStringFixed; }
+
   /// Get the description to use when running this command.
   const std::string& getDescription() const {
+    std::call_once(descriptionFlag, [this]() {
+        materializeAttribute("description", description);
+      });
     return description;
   }
   void setDescription(StringRef value) {
     description = value;
+    std::call_once(descriptionFlag, []() {});
   }
 
   /// Get the style of implicit dependencies used by this command.
@@ -331,6 +395,10 @@ public:
   void getVerboseDescription(SmallVectorImpl<char> &result) const override {}
 
   /// @}
+
+private:
+  /// Evaluate a lazily materialized attribute into \arg storage.
+  void materializeAttribute(StringRef name, std::string& storage) const;
 };
 
 /// A rule represents a template which can be expanded to produce a particular
@@ -397,8 +465,13 @@ class Manifest {
   /// The built-in phony rule.
   Rule* phonyRule;
 
+  /// The memoized templates used to compute command signatures, per rule and
+  /// scope.
+  std::unique_ptr<CommandSignatureCache> signatureCache;
+
 public:
   explicit Manifest();
+  ~Manifest();
 
   /// Get the allocator to use for manifest objects.
   llvm::BumpPtrAllocator& getAllocator() { return allocator; }
@@ -448,6 +521,17 @@ public:
     return phonyRule;
   }
 
+  /// Get a signature of the command string of the given command.
+  ///
+  /// The signature is computed structurally from the rule templates, the
+  /// command parameters and paths, and the scope bindings, so the command
+  /// string is not materialized. It changes whenever the command string does,
+  /// but is not a hash of the command string itself.
+  ///
+  /// This method is thread safe, but the manifest must not be modified after
+  /// the first call.
+  uint64_t getCommandSignature(const Command* command) const;
+
   /// Make the node path absolute and syntactically remove . and .. components.
   /// Returns false if normalization did not succeed.
   static bool normalize_path(StringRef workingDirectory, SmallVectorImpl<char>& path);
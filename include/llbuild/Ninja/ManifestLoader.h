@@ -68,6 +68,17 @@ public:
   /// Load the manifest.
   std::unique_ptr<Manifest> load();
 
+  /// Reload the manifest after its files may have changed.
+  ///
+  /// Only the files which changed since the last load are re-parsed, when
+  /// they can be re-parsed independently (files loaded by "subninja" decls
+  /// which do not declare pools or default targets), and their commands are
+  /// replaced in \arg manifest. Otherwise, the manifest is loaded again.
+  ///
+  /// \param manifest The manifest returned by the last load (or reload).
+  /// \returns The reloaded manifest, or null if a file could not be read.
+  std::unique_ptr<Manifest> reload(std::unique_ptr<Manifest> manifest);
+
   /// Get the current underlying manifest parser.
   const Parser* getCurrentParser() const;
 };
@@ -0,0 +1,751 @@
+//===-- Archive.cpp -------------------------------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2020 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Basic/Archive.h"
+
+#include "llbuild/Basic/PlatformUtility.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace llbuild;
+using namespace llbuild::basic;
+
+ArchiveFormat basic::getHostArchiveFormat() {
+#if defined(__APPLE__)
+  return ArchiveFormat::BSD;
+#else
+  return ArchiveFormat::GNU;
+#endif
+}
+
+#if defined(_WIN32)
+
+ArchiveWriteStatus basic::writeArchive(StringRef archivePath,
+                                       ArrayRef<std::string> memberPaths,
+                                       ArchiveFormat format,
+                                       std::string* error_out) {
+  *error_out = "archive writing is not supported on this platform";
+  return ArchiveWriteStatus::Unsupported;
+}
+
+#else
+
+namespace {
+
+/// The kind of an archive member, as determined by scanning its contents.
+enum class MemberKind {
+  /// An object file which was indexed.
+  Object,
+
+  /// A file which is not an object file, and has no symbols.
+  Data,
+
+  /// An object file which cannot be indexed.
+  Unsupported
+};
+
+/// A member of an archive being written.
+struct ArchiveMember {
+  /// The path of the member file.
+  std::string path;
+
+  /// The name of the member in the archive.
+  std::string name;
+
+  /// The name field of the member header.
+  std::string nameField;
+
+  /// The size of the member file.
+  uint64_t size = 0;
+
+  /// The size field of the member header.
+  uint64_t sizeField = 0;
+
+  /// The symbols defined by the member.
+  std::vector<std::string> symbols;
+
+  /// The offset of the member contents in the archive.
+  uint64_t dataOffset = 0;
+};
+
+/// A literal range of the archive (the headers, indices and padding).
+struct ArchiveChunk {
+  uint64_t offset;
+  std::string bytes;
+};
+
+/// Read an integer of the given byte order at \arg offset.
+template<typename T>
+static bool readInt(StringRef data, uint64_t offset, bool isLittleEndian,
+                    T& value) {
+  if (offset > data.size() || data.size() - offset < sizeof(T))
+    return false;
+  uint64_t result = 0;
+  for (unsigned i = 0; i != sizeof(T); ++i) {
+    unsigned index = isLittleEndian ? sizeof(T) - 1 - i : i;
+    result = (result << 8) | uint8_t(data[offset + index]);
+  }
+  value = T(result);
+  return true;
+}
+
+/// Get the table of the given range of \arg data, if it is in bounds.
+static bool getTable(StringRef data, uint64_t offset, uint64_t size,
+                     StringRef& table) {
+  if (offset > data.size() || data.size() - offset < size)
+    return false;
+  table = data.substr(offset, size);
+  return true;
+}
+
+/// Read a NUL terminated string from a string table.
+static bool readString(StringRef table, uint64_t offset, StringRef& value) {
+  if (offset >= table.size())
+    return false;
+  StringRef rest = table.substr(offset);
+  value = rest.substr(0, rest.find('\0'));
+  return true;
+}
+
+static MemberKind scanELFSymbols(StringRef data,
+                                 std::vector<std::string>& symbols) {
+  if (data.size() < 6 || (data[4] != 1 && data[4] != 2) ||
+      (data[5] != 1 && data[5] != 2))
+    return MemberKind::Unsupported;
+  bool is64 = data[4] == 2;
+  bool isLE = data[5] == 1;
+
+  // Read the section header table location.
+  uint64_t shoff;
+  uint16_t shentsize, shnum;
+  if (is64) {
+    if (!readInt(data, 0x28, isLE, shoff) ||
+        !readInt(data, 0x3A, isLE, shentsize) ||
+        !readInt(data, 0x3C, isLE, shnum))
+      return MemberKind::Unsupported;
+  } else {
+    uint32_t shoff32;
+    if (!readInt(data, 0x20, isLE, shoff32) ||
+        !readInt(data, 0x2E, isLE, shentsize) ||
+        !readInt(data, 0x30, isLE, shnum))
+      return MemberKind::Unsupported;
+    shoff = shoff32;
+  }
+
+  // Reads the offset, size and link fields of the given section.
+  auto readSection = [&](uint32_t index, uint32_t& type, uint64_t& offset,
+                         uint64_t& size, uint32_t& link) -> bool {
+    uint64_t base = shoff + uint64_t(index) * shentsize;
+    if (!readInt(data, base + 4, isLE, type))
+      return false;
+    if (is64) {
+      return (readInt(data, base + 24, isLE, offset) &&
+              readInt(data, base + 32, isLE, size) &&
+              readInt(data, base + 40, isLE, link));
+    }
+    uint32_t offset32, size32;
+    if (!readInt(data, base + 16, isLE, offset32) ||
+        !readInt(data, base + 20, isLE, size32) ||
+        !readInt(data, base + 24, isLE, link))
+      return false;
+    offset = offset32;
+    size = size32;
+    return true;
+  };
+
+  const uint32_t SHT_SYMTAB = 2;
+  for (uint32_t i = 0; i != shnum; ++i) {
+    uint32_t type, link;
+    uint64_t offset, size;
+    if (!readSection(i, type, offset, size, link))
+      return MemberKind::Unsupported;
+    if (type != SHT_SYMTAB)
+      continue;
+
+    // Find the associated string table.
+    uint32_t strType, strLink;
+    uint64_t strOffset, strSize;
+    StringRef strtab, symtab;
+    if (link >= shnum ||
+        !readSection(link, strType, strOffset, strSize, strLink) ||
+        !getTable(data, strOffset, strSize, strtab) ||
+        !getTable(data, offset, size, symtab))
+      return MemberKind::Unsupported;
+
+    // Collect the defined global symbols (skipping the null symbol).
+    uint64_t entrySize = is64 ? 24 : 16;
+    for (uint64_t j = 1, e = size / entrySize; j < e; ++j) {
+      uint64_t base = j * entrySize;
+      uint32_t nameOffset;
+      uint8_t info;
+      uint16_t sectionIndex;
+      if (!readInt(symtab, base, isLE, nameOffset) ||
+          !readInt(symtab, base + (is64 ? 4 : 12), isLE, info) ||
+          !readInt(symtab, base + (is64 ? 6 : 14), isLE, sectionIndex))
+        return MemberKind::Unsupported;
+
+      // Only index global, weak and unique symbols which are defined.
+      uint8_t binding = info >> 4;
+      if (binding != 1 && binding != 2 && binding != 10)
+        continue;
+      if (sectionIndex == 0)
+        continue;
+
+      StringRef name;
+      if (!readString(strtab, nameOffset, name))
+        return MemberKind::Unsupported;
+      if (!name.empty())
+        symbols.push_back(name);
+    }
+  }
+
+  return MemberKind::Object;
+}
+
+static MemberKind scanMachOSymbols(StringRef data, bool is64, bool isLE,
+                                   std::vector<std::string>& symbols) {
+  uint32_t ncmds;
+  if (!readInt(data, 16, isLE, ncmds))
+    return MemberKind::Unsupported;
+
+  const uint32_t LC_SYMTAB = 0x2;
+  uint64_t cmdOffset = is64 ? 32 : 28;
+  for (uint32_t i = 0; i != ncmds; ++i) {
+    uint32_t cmd, cmdsize;
+    if (!readInt(data, cmdOffset, isLE, cmd) ||
+        !readInt(data, cmdOffset + 4, isLE, cmdsize) || cmdsize < 8)
+      return MemberKind::Unsupported;
+
+    if (cmd == LC_SYMTAB) {
+      uint32_t symoff, nsyms, stroff, strsize;
+      StringRef strtab;
+      if (!readInt(data, cmdOffset + 8, isLE, symoff) ||
+          !readInt(data, cmdOffset + 12, isLE, nsyms) ||
+          !readInt(data, cmdOffset + 16, isLE, stroff) ||
+          !readInt(data, cmdOffset + 20, isLE, strsize) ||
+          !getTable(data, stroff, strsize, strtab))
+        return MemberKind::Unsupported;
+
+      uint64_t entrySize = is64 ? 16 : 12;
+      for (uint32_t j = 0; j != nsyms; ++j) {
+        uint64_t base = symoff + j * entrySize;
+        uint32_t nameOffset;
+        uint8_t type;
+        uint64_t value;
+        if (!readInt(data, base, isLE, nameOffset) ||
+            !readInt(data, base + 4, isLE, type))
+          return MemberKind::Unsupported;
+        if (is64) {
+          if (!readInt(data, base + 8, isLE, value))
+            return MemberKind::Unsupported;
+        } else {
+          uint32_t value32;
+          if (!readInt(data, base + 8, isLE, value32))
+            return MemberKind::Unsupported;
+          value = value32;
+        }
+
+        // Only index external symbols which are not debugging entries, and
+        // which are defined (or common).
+        const uint8_t N_STAB = 0xe0, N_TYPE = 0x0e, N_EXT = 0x01;
+        if ((type & N_STAB) || !(type & N_EXT))
+          continue;
+        if ((type & N_TYPE) == 0 && value == 0)
+          continue;
+
+        StringRef name;
+        if (!readString(strtab, nameOffset, name))
+          return MemberKind::Unsupported;
+        if (!name.empty())
+          symbols.push_back(name);
+      }
+    }
+
+    cmdOffset += cmdsize;
+  }
+
+  return MemberKind::Object;
+}
+
+/// Determine the kind of an archive member, and collect its symbols.
+static MemberKind scanMemberSymbols(StringRef data, ArchiveFormat format,
+                                    std::vector<std::string>& symbols) {
+  if (data.startswith("\x7f" "ELF")) {
+    if (format != ArchiveFormat::GNU)
+      return MemberKind::Unsupported;
+    return scanELFSymbols(data, symbols);
+  }
+
+  uint32_t magic;
+  if (readInt(data, 0, /*isLittleEndian=*/true, magic)) {
+    switch (magic) {
+    case 0xfeedface: case 0xfeedfacf: case 0xcefaedfe: case 0xcffaedfe:
+      if (format != ArchiveFormat::BSD)
+        return MemberKind::Unsupported;
+      return scanMachOSymbols(
+          data, /*is64=*/magic == 0xfeedfacf || magic == 0xcffaedfe,
+          /*isLE=*/magic == 0xfeedface || magic == 0xfeedfacf, symbols);
+
+    // Universal binaries and LLVM bitcode (bare, or with a wrapper header)
+    // cannot be indexed.
+    case 0xbebafeca: case 0xcafebabe:
+    case 0xdec04342: case 0x0b17c0de:
+      return MemberKind::Unsupported;
+    }
+  }
+
+  return MemberKind::Data;
+}
+
+/// Append a member header.
+static bool appendHeader(std::string& out, StringRef name, uint64_t size) {
+  // The size field is 10 decimal digits.
+  if (name.size() > 16 || size > 9999999999ULL)
+    return false;
+  char buffer[61];
+  snprintf(buffer, sizeof(buffer), "%-16s%-12s%-6s%-6s%-8s%-10llu`\n",
+           name.str().c_str(), "0", "0", "0", "644", (unsigned long long)size);
+  out.append(buffer, 60);
+  return true;
+}
+
+/// Append a 32-bit integer in the given byte order.
+static void appendInt32(std::string& out, uint32_t value, bool isLittleEndian) {
+  for (unsigned i = 0; i != 4; ++i) {
+    unsigned shift = isLittleEndian ? 8 * i : 8 * (3 - i);
+    out.push_back(char((value >> shift) & 0xFF));
+  }
+}
+
+/// Compute the layout of a GNU format archive.
+static bool layoutGNUArchive(std::vector<ArchiveMember>& members,
+                             std::vector<ArchiveChunk>& chunks,
+                             uint64_t& size_out) {
+  // Compute the size of the symbol index.
+  uint64_t numSymbols = 0, symbolNamesSize = 0;
+  for (const auto& member: members) {
+    numSymbols += member.symbols.size();
+    for (const auto& symbol: member.symbols)
+      symbolNamesSize += symbol.size() + 1;
+  }
+  uint64_t symtabSize = 4 + 4 * numSymbols + symbolNamesSize;
+
+  // Compute the name table.
+  std::string longNames;
+  for (auto& member: members) {
+    if (member.name.size() > 15) {
+      member.nameField = "/" + std::to_string(longNames.size());
+      longNames += member.name + "/\n";
+    } else {
+      member.nameField = member.name + "/";
+    }
+  }
+
+  // Assign the member offsets.
+  uint64_t offset = 8;
+  if (numSymbols)
+    offset += 60 + symtabSize + (symtabSize & 1);
+  if (!longNames.empty())
+    offset += 60 + longNames.size() + (longNames.size() & 1);
+  std::vector<uint64_t> headerOffsets;
+  for (auto& member: members) {
+    headerOffsets.push_back(offset);
+    member.sizeField = member.size;
+    member.dataOffset = offset + 60;
+    offset += 60 + member.size + (member.size & 1);
+  }
+  if (numSymbols && offset > UINT32_MAX)
+    return false;
+  size_out = offset;
+
+  // Emit the archive prologue.
+  std::string prologue = "!<arch>\n";
+  if (numSymbols) {
+    if (!appendHeader(prologue, "/", symtabSize))
+      return false;
+    appendInt32(prologue, numSymbols, /*isLittleEndian=*/false);
+    for (unsigned i = 0, e = members.size(); i != e; ++i) {
+      for (unsigned j = 0, je = members[i].symbols.size(); j != je; ++j)
+        appendInt32(prologue, headerOffsets[i], /*isLittleEndian=*/false);
+    }
+    for (const auto& member: members) {
+      for (const auto& symbol: member.symbols) {
+        prologue += symbol;
+        prologue.push_back('\0');
+      }
+    }
+    if (symtabSize & 1)
+      prologue.push_back('\n');
+  }
+  if (!longNames.empty()) {
+    if (!appendHeader(prologue, "//", longNames.size()))
+      return false;
+    prologue += longNames;
+    if (longNames.size() & 1)
+      prologue.push_back('\n');
+  }
+  chunks.push_back({0, std::move(prologue)});
+
+  // Emit the member headers and padding.
+  for (unsigned i = 0, e = members.size(); i != e; ++i) {
+    const auto& member = members[i];
+    std::string header;
+    if (!appendHeader(header, member.nameField, member.sizeField))
+      return false;
+    chunks.push_back({headerOffsets[i], std::move(header)});
+    if (member.size & 1)
+      chunks.push_back({member.dataOffset + member.size, "\n"});
+  }
+
+  return true;
+}
+
+/// Compute the layout of a BSD format archive.
+///
+/// Member contents are aligned to 8 bytes, as expected by the Darwin linker.
+static bool layoutBSDArchive(std::vector<ArchiveMember>& members,
+                             std::vector<ArchiveChunk>& chunks,
+                             uint64_t& size_out) {
+  // Collect the symbols, sorted by name.
+  struct SymbolEntry {
+    StringRef name;
+    unsigned member;
+  };
+  std::vector<SymbolEntry> symbols;
+  for (unsigned i = 0, e = members.size(); i != e; ++i) {
+    for (const auto& symbol: members[i].symbols)
+      symbols.push_back({symbol, i});
+  }
+  std::stable_sort(symbols.begin(), symbols.end(),
+                   [](const SymbolEntry& lhs, const SymbolEntry& rhs) {
+                     return lhs.name < rhs.name;
+                   });
+
+  // Compute the string table, and the size of the symbol index.
+  const StringRef symdefName("__.SYMDEF SORTED\0\0\0\0", 20);
+  std::string strtab;
+  std::vector<uint32_t> nameOffsets;
+  for (const auto& symbol: symbols) {
+    nameOffsets.push_back(strtab.size());
+    strtab += symbol.name;
+    strtab.push_back('\0');
+  }
+  uint64_t symdefSize = 0;
+  if (!symbols.empty()) {
+    symdefSize = symdefName.size() + 4 + 8 * symbols.size() + 4;
+    while ((symdefSize + strtab.size()) % 8 != 0)
+      strtab.push_back('\0');
+    symdefSize += strtab.size();
+  }
+
+  // Assign the member offsets.
+  uint64_t offset = 8;
+  if (!symbols.empty())
+    offset += 60 + symdefSize;
+  std::vector<uint64_t> headerOffsets;
+  std::vector<uint64_t> nameSizes;
+  for (auto& member: members) {
+    headerOffsets.push_back(offset);
+    uint64_t nameSize = member.name.size() + 1;
+    while ((offset + 60 + nameSize) % 8 != 0)
+      ++nameSize;
+    nameSizes.push_back(nameSize);
+    member.nameField = "#1/" + std::to_string(nameSize);
+    member.dataOffset = offset + 60 + nameSize;
+    uint64_t padding = (8 - (member.dataOffset + member.size) % 8) % 8;
+    member.sizeField = nameSize + member.size + padding;
+    offset = member.dataOffset + member.size + padding;
+  }
+  if (!symbols.empty() && offset > UINT32_MAX)
+    return false;
+  size_out = offset;
+
+  // Emit the archive prologue.
+  std::string prologue = "!<arch>\n";
+  if (!symbols.empty()) {
+    if (!appendHeader(prologue, "#1/20", symdefSize))
+      return false;
+    prologue += symdefName;
+    appendInt32(prologue, 8 * symbols.size(), /*isLittleEndian=*/true);
+    for (unsigned i = 0, e = symbols.size(); i != e; ++i) {
+      appendInt32(prologue, nameOffsets[i], /*isLittleEndian=*/true);
+      appendInt32(prologue, headerOffsets[symbols[i].member],
+                  /*isLittleEndian=*/true);
+    }
+    appendInt32(prologue, strtab.size(), /*isLittleEndian=*/true);
+    prologue += strtab;
+  }
+  chunks.push_back({0, std::move(prologue)});
+
+  // Emit the member headers, names and padding.
+  for (unsigned i = 0, e = members.size(); i != e; ++i) {
+    const auto& member = members[i];
+    std::string header;
+    if (!appendHeader(header, member.nameField, member.sizeField))
+      return false;
+    header += member.name;
+    header.resize(60 + nameSizes[i], '\0');
+    chunks.push_back({headerOffsets[i], std::move(header)});
+    uint64_t padding = member.sizeField - nameSizes[i] - member.size;
+    if (padding)
+      chunks.push_back({member.dataOffset + member.size,
+                        std::string(padding, '\n')});
+  }
+
+  return true;
+}
+
+/// Write a buffer at the given offset.
+static bool writeAt(int fd, StringRef bytes, uint64_t offset) {
+  while (!bytes.empty()) {
+    ssize_t n = ::pwrite(fd, bytes.data(), bytes.size(), offset);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    bytes = bytes.drop_front(n);
+    offset += n;
+  }
+  return true;
+}
+
+/// Check if the file contains the given bytes at the given offset.
+static bool containsAt(int fd, StringRef bytes, uint64_t offset) {
+  char buffer[64 * 1024];
+  while (!bytes.empty()) {
+    size_t count = std::min(bytes.size(), sizeof(buffer));
+    ssize_t n = ::pread(fd, buffer, count, offset);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0 || memcmp(buffer, bytes.data(), n) != 0)
+      return false;
+    bytes = bytes.drop_front(n);
+    offset += n;
+  }
+  return true;
+}
+
+/// Write the archive with the given layout to \arg fd.
+static bool writeArchiveContents(int fd,
+                                 const std::vector<ArchiveMember>& members,
+                                 const std::vector<ArchiveChunk>& chunks,
+                                 std::string* error_out) {
+  for (const auto& chunk: chunks) {
+    if (!writeAt(fd, chunk.bytes, chunk.offset)) {
+      *error_out = "unable to write archive: " + sys::strerror(errno);
+      return false;
+    }
+  }
+  for (const auto& member: members) {
+    int memberFD = ::open(member.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (memberFD < 0) {
+      *error_out = "unable to open '" + member.path + "': " +
+        sys::strerror(errno);
+      return false;
+    }
+    bool success = sys::copyFileRange(memberFD, 0, fd, member.dataOffset,
+                                      member.size);
+    int savedErrno = errno;
+    ::close(memberFD);
+    if (!success) {
+      *error_out = "unable to copy '" + member.path + "' into archive: " +
+        sys::strerror(savedErrno);
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Create a temporary file next to the archive, to be moved into place with
+/// \see commitArchive().
+static bool createArchiveTemporary(StringRef archivePath, int& fd_out,
+                                   SmallVectorImpl<char>& tmpPath_out,
+                                   std::string* error_out) {
+  if (auto ec = llvm::sys::fs::createUniqueFile(
+          archivePath + "-%%%%%%%%.tmp", fd_out, tmpPath_out)) {
+    *error_out = "unable to create archive: " + ec.message();
+    return false;
+  }
+  return true;
+}
+
+/// Close a temporary archive, and if it was written successfully, atomically
+/// replace the archive with it. Otherwise, the temporary file is removed.
+static bool commitArchive(int fd, StringRef tmpPath, StringRef archivePath,
+                          bool success, std::string* error_out) {
+  ::close(fd);
+  if (success) {
+    if (auto ec = llvm::sys::fs::rename(tmpPath, archivePath)) {
+      *error_out = "unable to create archive: " + ec.message();
+      success = false;
+    }
+  }
+  if (!success)
+    (void)llvm::sys::fs::remove(tmpPath);
+  return success;
+}
+
+/// Attempt to update an existing archive.
+///
+/// This succeeds only if the existing archive has exactly the expected layout
+/// (i.e., the same members, of the same sizes, defining the same symbols). The
+/// existing archive is then cloned (or copied) to a temporary file, only the
+/// members whose contents differ are rewritten in it, and it is moved over the
+/// archive, so an interrupted update never leaves a partially written archive.
+static bool updateExistingArchive(StringRef archivePath,
+                                  const std::vector<ArchiveMember>& members,
+                                  const std::vector<ArchiveChunk>& chunks,
+                                  uint64_t archiveSize,
+                                  ArchiveWriteStatus& status_out,
+                                  std::string* error_out) {
+  int fd = ::open(archivePath.str().c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  struct ::stat statbuf;
+  if (::fstat(fd, &statbuf) != 0 || !S_ISREG(statbuf.st_mode) ||
+      uint64_t(statbuf.st_size) != archiveSize) {
+    ::close(fd);
+    return false;
+  }
+  for (const auto& chunk: chunks) {
+    if (!containsAt(fd, chunk.bytes, chunk.offset)) {
+      ::close(fd);
+      return false;
+    }
+  }
+
+  // The layout matches, find the members with differing contents.
+  std::vector<std::unique_ptr<llvm::MemoryBuffer>> changedContents;
+  std::vector<const ArchiveMember*> changedMembers;
+  for (const auto& member: members) {
+    auto buffer = llvm::MemoryBuffer::getFile(member.path, /*FileSize=*/-1,
+                                              /*RequiresNullTerminator=*/false);
+    if (!buffer || (*buffer)->getBufferSize() != member.size) {
+      *error_out = "unable to read '" + member.path + "'";
+      status_out = ArchiveWriteStatus::Failed;
+      ::close(fd);
+      return true;
+    }
+    if (containsAt(fd, (*buffer)->getBuffer(), member.dataOffset))
+      continue;
+    changedContents.push_back(std::move(*buffer));
+    changedMembers.push_back(&member);
+  }
+  if (changedMembers.empty()) {
+    status_out = ArchiveWriteStatus::Unchanged;
+    ::close(fd);
+    return true;
+  }
+
+  // Rewrite the changed members in a copy of the archive.
+  int tmpFD;
+  SmallString<256> tmpPath;
+  if (!createArchiveTemporary(archivePath, tmpFD, tmpPath, error_out)) {
+    status_out = ArchiveWriteStatus::Failed;
+    ::close(fd);
+    return true;
+  }
+  bool success = (sys::cloneFile(fd, tmpFD) ||
+                  sys::copyFileRange(fd, 0, tmpFD, 0, archiveSize));
+  if (!success)
+    *error_out = "unable to copy archive: " + sys::strerror(errno);
+  ::close(fd);
+  for (unsigned i = 0, e = changedMembers.size(); success && i != e; ++i) {
+    if (!writeAt(tmpFD, changedContents[i]->getBuffer(),
+                 changedMembers[i]->dataOffset)) {
+      *error_out = "unable to write archive: " + sys::strerror(errno);
+      success = false;
+    }
+  }
+  success = commitArchive(tmpFD, tmpPath, archivePath, success, error_out);
+  status_out = (success ? ArchiveWriteStatus::Updated :
+                ArchiveWriteStatus::Failed);
+  return true;
+}
+
+}
+
+ArchiveWriteStatus basic::writeArchive(StringRef archivePath,
+                                       ArrayRef<std::string> memberPaths,
+                                       ArchiveFormat format,
+                                       std::string* error_out) {
+  // Scan the members.
+  std::vector<ArchiveMember> members;
+  for (const auto& path: memberPaths) {
+    ArchiveMember member;
+    member.path = path;
+    member.name = llvm::sys::path::filename(path);
+
+    auto buffer = llvm::MemoryBuffer::getFile(path, /*FileSize=*/-1,
+                                              /*RequiresNullTerminator=*/false);
+    if (!buffer) {
+      *error_out = "unable to read '" + path + "': " +
+        buffer.getError().message();
+      return ArchiveWriteStatus::Failed;
+    }
+    member.size = (*buffer)->getBufferSize();
+    if (scanMemberSymbols((*buffer)->getBuffer(), format, member.symbols) ==
+        MemberKind::Unsupported) {
+      *error_out = "unable to index archive member '" + path + "'";
+      return ArchiveWriteStatus::Unsupported;
+    }
+    members.push_back(std::move(member));
+  }
+
+  // Compute the archive layout.
+  std::vector<ArchiveChunk> chunks;
+  uint64_t archiveSize = 0;
+  bool success = (format == ArchiveFormat::GNU ?
+                  layoutGNUArchive(members, chunks, archiveSize) :
+                  layoutBSDArchive(members, chunks, archiveSize));
+  if (!success) {
+    *error_out = "archive is too large";
+    return ArchiveWriteStatus::Unsupported;
+  }
+
+  // If the archive exists with the same layout, only update the members which
+  // changed.
+  ArchiveWriteStatus status;
+  if (updateExistingArchive(archivePath, members, chunks, archiveSize, status,
+                            error_out))
+    return status;
+
+  // Otherwise, write a new archive and move it into place.
+  int fd;
+  SmallString<256> tmpPath;
+  if (!createArchiveTemporary(archivePath, fd, tmpPath, error_out))
+    return ArchiveWriteStatus::Failed;
+  success = writeArchiveContents(fd, members, chunks, error_out);
+  if (!commitArchive(fd, tmpPath, archivePath, success, error_out))
+    return ArchiveWriteStatus::Failed;
+
+  return ArchiveWriteStatus::Written;
+}
+
+#endif
@@ -0,0 +1,178 @@
+//===-- Compression.cpp ---------------------------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Basic/Compression.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace llbuild;
+using namespace llbuild::basic;
+
+// The compressed format is a method byte, followed by either the data itself
+// (for stored blocks) or the uncompressed size and a sequence of tokens. Each
+// token is a run of literal bytes followed, unless the block is complete, by a
+// match which copies previously decompressed bytes. All integers are unsigned
+// LEB128 values.
+//
+//   block   := method:byte (data | size tokens*)
+//   token   := literalLength literal:byte* [matchLength - kMinMatch, offset]
+
+namespace {
+
+enum : uint8_t {
+  kStoredMethod = 0,
+  kLZMethod = 1,
+};
+
+/// The shortest match which is encoded; shorter ones cost more than they save.
+const unsigned kMinMatch = 4;
+
+/// The number of bits in the match finder's hash table index.
+const unsigned kHashBits = 14;
+
+void writeVarInt(std::string& out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(char((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(char(value));
+}
+
+bool readVarInt(StringRef data, size_t& pos, uint64_t& value_out) {
+  uint64_t value = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    if (pos == data.size())
+      return false;
+    uint8_t byte = data[pos++];
+    value |= uint64_t(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      value_out = value;
+      return true;
+    }
+  }
+  return false;
+}
+
+uint32_t hashSequence(const char* p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return (value * 2654435761U) >> (32 - kHashBits);
+}
+
+}
+
+std::string llbuild::basic::compressData(StringRef data) {
+  const char* bytes = data.data();
+  size_t size = data.size();
+
+  std::string result;
+  result.push_back(char(kLZMethod));
+  writeVarInt(result, size);
+
+  // Greedily match against the most recent position with the same hash.
+  std::vector<size_t> table(size_t(1) << kHashBits, SIZE_MAX);
+  size_t literalStart = 0;
+  size_t pos = 0;
+  while (pos + kMinMatch <= size) {
+    uint32_t hash = hashSequence(bytes + pos);
+    size_t candidate = table[hash];
+    table[hash] = pos;
+    if (candidate == SIZE_MAX ||
+        memcmp(bytes + candidate, bytes + pos, kMinMatch) != 0) {
+      ++pos;
+      continue;
+    }
+
+    size_t length = kMinMatch;
+    while (pos + length < size &&
+           bytes[candidate + length] == bytes[pos + length])
+      ++length;
+
+    writeVarInt(result, pos - literalStart);
+    result.append(bytes + literalStart, pos - literalStart);
+    writeVarInt(result, length - kMinMatch);
+    writeVarInt(result, pos - candidate);
+
+    // Index the matched positions, so later matches can start within them.
+    for (size_t i = pos + 1, e = pos + length; i != e && i + kMinMatch <= size;
+         ++i) {
+      table[hashSequence(bytes + i)] = i;
+    }
+    pos += length;
+    literalStart = pos;
+  }
+  if (literalStart != size) {
+    writeVarInt(result, size - literalStart);
+    result.append(bytes + literalStart, size - literalStart);
+  }
+
+  // Store the data as is if it did not compress.
+  if (result.size() > size) {
+    result.clear();
+    result.push_back(char(kStoredMethod));
+    result.append(bytes, size);
+  }
+  return result;
+}
+
+bool llbuild::basic::decompressData(StringRef data, std::string* result_out) {
+  result_out->clear();
+  if (data.empty())
+    return false;
+
+  if (uint8_t(data[0]) == kStoredMethod) {
+    result_out->assign(data.data() + 1, data.size() - 1);
+    return true;
+  }
+  if (uint8_t(data[0]) != kLZMethod)
+    return false;
+
+  size_t pos = 1;
+  uint64_t size;
+  if (!readVarInt(data, pos, size))
+    return false;
+  // Long runs compress to a few bytes, so the size can't be bounded by the
+  // input; the tokens are checked against it instead. Only the reservation is
+  // bounded, so a corrupt size does not allocate up front.
+  std::string& result = *result_out;
+  result.reserve(std::min(size, uint64_t(data.size()) * 64));
+
+  while (result.size() != size) {
+    uint64_t literalLength;
+    if (!readVarInt(data, pos, literalLength) ||
+        literalLength > data.size() - pos ||
+        literalLength > size - result.size())
+      return false;
+    result.append(data.data() + pos, literalLength);
+    pos += literalLength;
+    if (result.size() == size)
+      break;
+
+    uint64_t matchLength, offset;
+    if (!readVarInt(data, pos, matchLength) || !readVarInt(data, pos, offset))
+      return false;
+    matchLength += kMinMatch;
+    if (offset == 0 || offset > result.size() ||
+        matchLength > size - result.size())
+      return false;
+
+    // The match may overlap the bytes it produces, so copy byte by byte.
+    size_t from = result.size() - offset;
+    for (uint64_t i = 0; i != matchLength; ++i)
+      result.push_back(result[from + i]);
+  }
+
+  return pos == data.size();
+}
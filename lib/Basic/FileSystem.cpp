@@ -15,13 +15,20 @@
 #include "llbuild/Basic/Stat.h"
 
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
 
 #include <cassert>
 #include <cstring>
 
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 // Cribbed from llvm, where it's been since removed.
 namespace {
   using namespace std;
@@ -132,6 +139,68 @@ bool FileSystem::createDirectories(const std::string& path) {
   return createDirectories(parent) && createDirectory(path);
 }
 
+bool FileSystem::copyFile(const std::string& src, const std::string& target) {
+  auto contents = getFileContents(src);
+  if (!contents)
+    return false;
+
+  // Write to a temporary file beside the target and move it into place, so
+  // readers never observe a partially written file.
+  int fd;
+  SmallString<256> tmpPath;
+  if (llvm::sys::fs::createUniqueFile(target + "-%%%%%%%%.tmp", fd, tmpPath))
+    return false;
+  {
+    llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+    os << contents->getBuffer();
+    os.close();
+    if (os.has_error()) {
+      os.clear_error();
+      (void)llvm::sys::fs::remove(tmpPath);
+      return false;
+    }
+  }
+
+  auto info = getFileInfo(src);
+  (void)llvm::sys::fs::setPermissions(
+      tmpPath, llvm::sys::fs::perms(info.mode & llvm::sys::fs::all_perms));
+  if (llvm::sys::fs::rename(tmpPath, target)) {
+    (void)llvm::sys::fs::remove(tmpPath);
+    return false;
+  }
+  return true;
+}
+
+bool FileSystem::getDirectoryContents(const std::string& path,
+                                      std::vector<std::string>& names_out) {
+  std::error_code ec;
+  for (auto it = llvm::sys::fs::directory_iterator(path, ec),
+         end = llvm::sys::fs::directory_iterator(); it != end;
+       it = it.increment(ec)) {
+    names_out.push_back(llvm::sys::path::filename(it->path()));
+  }
+  return !ec;
+}
+
+bool FileSystem::readSymlink(const std::string& path,
+                             std::string& target_out) {
+#if defined(_WIN32)
+  return false;
+#else
+  SmallString<256> buffer;
+  for (;;) {
+    buffer.resize(buffer.capacity());
+    ssize_t n = ::readlink(path.c_str(), buffer.data(), buffer.size());
+    if (n < 0)
+      return false;
+    if (size_t(n) < buffer.size()) {
+      target_out.assign(buffer.data(), n);
+      return true;
+    }
+    buffer.reserve(buffer.size() * 2);
+  }
+#endif
+}
 
 std::unique_ptr<llvm::MemoryBuffer>
 DeviceAgnosticFileSystem::getFileContents(const std::string& path) {
@@ -223,6 +292,46 @@ public:
                              const std::string& target) override {
     return (llbuild::basic::sys::symlink(src.c_str(), target.c_str()) == 0);
   }
+
+  virtual bool copyFile(const std::string& src,
+                        const std::string& target) override {
+#if defined(_WIN32)
+    return FileSystem::copyFile(src, target);
+#else
+    int inFD = ::open(src.c_str(), O_RDONLY | O_CLOEXEC);
+    if (inFD < 0)
+      return false;
+    llbuild::basic::sys::StatStruct statbuf;
+    if (::fstat(inFD, &statbuf) != 0 || !S_ISREG(statbuf.st_mode)) {
+      ::close(inFD);
+      return false;
+    }
+
+    // Write to a temporary file beside the target and move it into place, so
+    // readers never observe a partially copied file. Prefer sharing the
+    // extents of the source (a reflink), and otherwise copy in the kernel.
+    int outFD;
+    SmallString<256> tmpPath;
+    if (llvm::sys::fs::createUniqueFile(target + "-%%%%%%%%.tmp", outFD,
+                                        tmpPath)) {
+      ::close(inFD);
+      return false;
+    }
+    bool success =
+        (llbuild::basic::sys::cloneFile(inFD, outFD) ||
+         llbuild::basic::sys::copyFileRange(inFD, 0, outFD, 0,
+                                            statbuf.st_size)) &&
+        ::fchmod(outFD, statbuf.st_mode & 07777) == 0;
+    ::close(inFD);
+    if (::close(outFD) != 0)
+      success = false;
+    if (success && !llvm::sys::fs::rename(tmpPath, target))
+      return true;
+
+    ::unlink(tmpPath.c_str());
+    return false;
+#endif
+  }
 };
   
 }
@@ -16,7 +16,9 @@
 #include "llbuild/Basic/Tracing.h"
 
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
 #include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/Twine.h"
@@ -25,11 +27,20 @@
 #include <future>
 #include <queue>
 #include <random>
+#include <tuple>
 #include <unordered_map>
 #include <vector>
 
 #include <signal.h>
 
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #ifdef __APPLE__
 #include <pthread/spawn.h>
 #endif
@@ -40,6 +51,8 @@ using namespace llbuild::basic;
 struct QueueJobLess {
   bool operator()(const llbuild::basic::QueueJob &__x,
                   const llbuild::basic::QueueJob &__y) const {
+    if (__x.getPriority() != __y.getPriority())
+      return __x.getPriority() < __y.getPriority();
     return __x.getDescriptor()->getOrdinalName() <
             __y.getDescriptor()->getOrdinalName();
   }
@@ -47,6 +60,124 @@ struct QueueJobLess {
 
 namespace {
 
+#if !defined(_WIN32)
+/// A GNU make compatible jobserver, shared with subprocesses through inherited
+/// descriptors (see "--jobserver-auth" in the GNU make manual).
+///
+/// Each token in the jobserver is the capacity of an idle lane. Parallel build
+/// tools run by the queue take tokens to run additional jobs, and return them
+/// once those jobs are complete.
+///
+/// The jobserver is a named FIFO, so that the queue can use a non-blocking
+/// descriptor while the clients are given a blocking one (the mode is shared by
+/// all users of a descriptor).
+class JobServer {
+  /// The temporary directory containing the FIFO.
+  std::string dirPath;
+
+  /// The path of the FIFO.
+  std::string fifoPath;
+
+  /// The non-blocking descriptor used by the queue.
+  int fd = -1;
+
+  /// The blocking descriptor inherited by subprocesses.
+  int clientFD = -1;
+
+public:
+  ~JobServer() {
+    if (fd >= 0)
+      ::close(fd);
+    if (clientFD >= 0)
+      ::close(clientFD);
+    if (!fifoPath.empty())
+      ::unlink(fifoPath.c_str());
+    if (!dirPath.empty())
+      ::rmdir(dirPath.c_str());
+  }
+
+  /// Create the jobserver FIFO.
+  ///
+  /// \returns False if the FIFO could not be created.
+  bool open() {
+    dirPath = sys::makeTmpDir();
+    if (dirPath.empty())
+      return false;
+    fifoPath = dirPath + "/jobserver";
+    if (::mkfifo(fifoPath.c_str(), 0600) != 0) {
+      fifoPath.clear();
+      return false;
+    }
+
+    // Open for reading and writing, so that neither open blocks and the FIFO
+    // remains available while no client has it open.
+    fd = ::open(fifoPath.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    clientFD = ::open(fifoPath.c_str(), O_RDWR | O_CLOEXEC);
+    return fd >= 0 && clientFD >= 0;
+  }
+
+  /// Get the descriptor to pass on to subprocesses.
+  int getClientDescriptor() const { return clientFD; }
+
+  /// Get the MAKEFLAGS value advertising the jobserver to a subprocess.
+  ///
+  /// \param makeFlags The MAKEFLAGS the subprocess would otherwise see. Its
+  /// job count and jobserver are replaced, since the latter could name
+  /// descriptors the process will not have, while other flags and variable
+  /// overrides are kept.
+  std::string getMakeFlags(unsigned numLanes, StringRef makeFlags) const {
+    // Flags precede any variable overrides, which follow a "--" word.
+    SmallString<256> result;
+    StringRef overrides;
+    while (!makeFlags.empty()) {
+      StringRef word;
+      std::tie(word, makeFlags) = makeFlags.split(' ');
+      if (word == "--") {
+        overrides = makeFlags;
+        break;
+      }
+      if (word.empty() || word.startswith("-j") ||
+          word.startswith("--jobs") || word.startswith("--jobserver-"))
+        continue;
+      result += word;
+      result += ' ';
+    }
+
+    // Name the jobserver with both the current option, and the one used before
+    // GNU make 4.2, which is all older versions understand.
+    result += (Twine("-j") + Twine(numLanes) + " --jobserver-auth=" +
+               Twine(clientFD) + "," + Twine(clientFD) + " --jobserver-fds=" +
+               Twine(clientFD) + "," + Twine(clientFD)).str();
+    if (!overrides.empty()) {
+      result += " -- ";
+      result += overrides;
+    }
+    return result.str();
+  }
+
+  /// Make the capacity of an idle lane available to clients.
+  void lendToken() {
+    // Use the token byte written by GNU make.
+    const char token = '+';
+    while (::write(fd, &token, 1) < 0 && errno == EINTR) {}
+  }
+
+  /// Take back a token, if one is available.
+  bool tryReclaimToken() {
+    char byte;
+    ssize_t result;
+    while ((result = ::read(fd, &byte, 1)) < 0 && errno == EINTR) {}
+    return result == 1;
+  }
+
+  /// Wait (up to \p timeoutMs) for a token to be returned.
+  void waitForToken(int timeoutMs) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    (void)::poll(&pfd, 1, timeoutMs);
+  }
+};
+#endif
+
 struct LaneBasedExecutionQueueJobContext : public QueueJobContext {
   uint64_t jobID;
   uint64_t laneNumber;
@@ -86,6 +217,21 @@ class LaneBasedExecutionQueue : public ExecutionQueue {
   /// A thread for each lane.
   std::vector<std::unique_ptr<std::thread>> lanes;
 
+  /// The CPUs each lane (and its subprocesses) is restricted to, if the lanes
+  /// are partitioned across NUMA nodes, otherwise empty.
+  std::vector<std::vector<unsigned>> laneCPUs;
+
+  /// The affinity to restore on the engine thread, if it was pinned.
+  std::vector<unsigned> engineThreadAffinity;
+
+#if !defined(_WIN32)
+  /// The jobserver shared with subprocesses, if enabled.
+  std::unique_ptr<JobServer> jobServer;
+#endif
+
+  /// The number of subprocesses which have not yet completed.
+  std::atomic<unsigned> activeProcessCount{0};
+
   /// The ready queue of jobs to execute.
   std::unique_ptr<Scheduler> readyJobs;
   std::mutex readyJobsMutex;
@@ -126,6 +272,11 @@ class LaneBasedExecutionQueue : public ExecutionQueue {
     // Set the QoS class, if available.
     setCurrentThreadQualityOfService(getDefaultQualityOfService());
 
+    // Restrict the lane to its NUMA node, if requested. Processes spawned from
+    // this thread inherit the restriction.
+    if (!laneCPUs.empty())
+      (void)sys::setCurrentThreadAffinity(laneCPUs[laneNumber]);
+
     // Lane ID, used in creating reasonably unique task IDs, stores the buildID
     // in the top 32 bits.  The laneID is stored in bits 16:31, and the job
     // count is placed in the lower order 16 bits. These are not strictly
@@ -133,6 +284,10 @@ class LaneBasedExecutionQueue : public ExecutionQueue {
     uint32_t jobCount = 0;
     uint64_t laneID = (((uint64_t)buildID & 0xFFFF) << 32) + (((uint64_t)laneNumber & 0xFFFF) << 16);
 
+    // Whether the lane holds its jobserver token, lanes start idle with their
+    // tokens lent to the jobserver.
+    bool holdsToken = false;
+
     // Execute items from the queue until shutdown.
     while (true) {
       // Take a job from the ready queue.
@@ -143,6 +298,10 @@ class LaneBasedExecutionQueue : public ExecutionQueue {
 
         // While the queue is empty, wait for an item.
         while (!shutdown && readyJobs->empty()) {
+          if (holdsToken) {
+            lendJobServerToken();
+            holdsToken = false;
+          }
           readyJobsCondition.wait(lock);
         }
         if (shutdown && readyJobs->empty())
@@ -157,6 +316,12 @@ class LaneBasedExecutionQueue : public ExecutionQueue {
       if (!job.getDescriptor())
         break;
 
+      // Take back the lane's capacity from the jobserver clients.
+      if (!holdsToken) {
+        reclaimJobServerToken();
+        holdsToken = true;
+      }
+
       // Process the job.
       jobCount++;
       uint64_t jobID = laneID + jobCount;
@@ -175,6 +340,28 @@ class LaneBasedExecutionQueue : public ExecutionQueue {
     }
   }
 
+  void lendJobServerToken() {
+#if !defined(_WIN32)
+    if (jobServer)
+      jobServer->lendToken();
+#endif
+  }
+
+  /// Wait until a token can be taken back from the jobserver.
+  void reclaimJobServerToken() {
+#if !defined(_WIN32)
+    if (!jobServer)
+      return;
+    while (!jobServer->tryReclaimToken()) {
+      // Only subprocesses can hold tokens, if there are none, the token was
+      // lost (e.g., with a client which crashed) and the lane can proceed.
+      if (activeProcessCount == 0)
+        return;
+      jobServer->waitForToken(/*timeoutMs=*/100);
+    }
+#endif
+  }
+
   void killAfterTimeout() {
     std::unique_lock<std::mutex> lock(queueCompleteMutex);
 
@@ -197,7 +384,8 @@ class LaneBasedExecutionQueue : public ExecutionQueue {
 public:
   LaneBasedExecutionQueue(ExecutionQueueDelegate& delegate,
                           unsigned numLanesSuggestion, SchedulerAlgorithm alg,
-                          const char* const* environment)
+                          const char* const* environment,
+                          LaneAffinityOptions affinity, bool useJobServer)
   : ExecutionQueue(delegate), buildID(std::random_device()()),
         readyJobs(Scheduler::make(alg)), environment(environment)
   {
@@ -206,11 +394,44 @@ public:
     numLanes = taskLimits.first;
     backgroundTaskMax = taskLimits.second;
 
+#if !defined(_WIN32)
+    // Create the jobserver before the lanes, which lend their tokens to it.
+    if (useJobServer) {
+      jobServer.reset(new JobServer);
+      if (!jobServer->open()) {
+        jobServer.reset();
+      } else {
+        for (unsigned i = 0; i != numLanes; ++i)
+          jobServer->lendToken();
+      }
+    }
+#endif
+
+    std::vector<std::vector<unsigned>> nodes;
+    if (affinity.partitionLanesByNUMANode || affinity.pinEngineThread)
+      nodes = sys::getNUMANodeCPUs();
+
+    // Assign contiguous blocks of lanes to each node, so lanes are spread
+    // evenly even when there are fewer lanes than nodes.
+    if (affinity.partitionLanesByNUMANode && nodes.size() > 1) {
+      for (unsigned i = 0; i != numLanes; ++i) {
+        laneCPUs.push_back(nodes[uint64_t(i) * nodes.size() / numLanes]);
+      }
+    }
+
     for (unsigned i = 0; i != numLanes; ++i) {
       lanes.push_back(std::unique_ptr<std::thread>(
                           new std::thread(
                               &LaneBasedExecutionQueue::executeLane, this, buildID, i)));
     }
+
+    // Pin the engine thread only once the lanes exist, since new threads
+    // inherit the affinity of their creator.
+    if (affinity.pinEngineThread && nodes.size() > 1) {
+      if (sys::getCurrentThreadAffinity(engineThreadAffinity) &&
+          !sys::setCurrentThreadAffinity(nodes[0]))
+        engineThreadAffinity.clear();
+    }
   }
 
   virtual ~LaneBasedExecutionQueue() {
@@ -225,6 +446,9 @@ public:
       lanes[i]->join();
     }
 
+    if (!engineThreadAffinity.empty())
+      (void)sys::setCurrentThreadAffinity(engineThreadAffinity);
+
     {
       std::lock_guard<std::mutex> guard(killAfterTimeoutThreadMutex);
       if (killAfterTimeoutThread) {
@@ -350,6 +574,39 @@ public:
     posixEnv.setIfMissing("LLBUILD_BUILD_ID", Twine(buildID).str());
     posixEnv.setIfMissing("LLBUILD_LANE_ID", Twine(context.laneNumber).str());
 
+#if !defined(_WIN32)
+    // Advertise the jobserver to parallel build tools, by amending the
+    // MAKEFLAGS set for the command or inherited.
+    //
+    // The descriptor is passed alongside any the client asked to be inherited.
+    SmallVector<int, 4> inheritedDescriptors;
+    if (jobServer) {
+      llvm::Optional<StringRef> makeFlags;
+      for (const auto& entry: environment) {
+        if (entry.first == "MAKEFLAGS") {
+          makeFlags = entry.second;
+          break;
+        }
+      }
+      if (!makeFlags.hasValue() && attributes.inheritEnvironment) {
+        for (const char* const* p = this->environment; *p != nullptr; ++p) {
+          auto pair = StringRef(*p).split('=');
+          if (pair.first == "MAKEFLAGS") {
+            makeFlags = pair.second;
+            break;
+          }
+        }
+      }
+      posixEnv.setIfMissing(
+          "MAKEFLAGS",
+          jobServer->getMakeFlags(numLanes, makeFlags.getValueOr("")));
+      inheritedDescriptors.append(attributes.inheritedDescriptors.begin(),
+                                  attributes.inheritedDescriptors.end());
+      inheritedDescriptors.push_back(jobServer->getClientDescriptor());
+      attributes.inheritedDescriptors = inheritedDescriptors;
+    }
+#endif
+
     // Add the requested environment.
     for (const auto& entry: environment) {
       posixEnv.setIfMissing(entry.first, entry.second);
@@ -387,14 +644,21 @@ public:
     };
 
     ProcessCompletionFn laneCompletionFn{
-      [completionFn, lane=context.laneNumber](ProcessResult result) mutable {
+      [this, completionFn, lane=context.laneNumber](ProcessResult result) mutable {
         TracingExecutionQueueSubprocessResult(lane, result.pid, result.utime,
                                               result.stime, result.maxrss);
+        --activeProcessCount;
         if (completionFn.hasValue())
           completionFn.getValue()(result);
       }
     };
 
+    // Keep the process on the node of its lane, even if it is not being
+    // spawned from the lane thread itself.
+    if (!laneCPUs.empty())
+      attributes.cpuAffinity = laneCPUs[context.laneNumber];
+
+    ++activeProcessCount;
     spawnProcess(
         delegate ? *delegate : getDelegate(),
         reinterpret_cast<ProcessContext*>(context.job.getDescriptor()),
@@ -479,11 +743,13 @@ extern "C" {
 
 ExecutionQueue* llbuild::basic::createLaneBasedExecutionQueue(
     ExecutionQueueDelegate& delegate, int numLanes, SchedulerAlgorithm alg,
-    const char* const* environment
+    const char* const* environment, LaneAffinityOptions affinity,
+    bool useJobServer
 ) {
   if (!environment) {
     environment = const_cast<const char* const*>(environ);
   }
-  return new LaneBasedExecutionQueue(delegate, numLanes, alg, environment);
+  return new LaneBasedExecutionQueue(delegate, numLanes, alg, environment,
+                                     affinity, useJobServer);
 }
 
@@ -10,7 +10,10 @@
 #include "llbuild/Basic/PlatformUtility.h"
 #include "llbuild/Basic/Stat.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/Twine.h"
 #include "llvm/Support/ConvertUTF.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 
 #if defined(_WIN32)
@@ -22,12 +25,20 @@
 #else
 #include <fnmatch.h>
 #include <unistd.h>
+#include <errno.h>
+#if defined(__linux__)
+#include <linux/fs.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#endif
 #if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
 #include <dlfcn.h>
 #endif
 #endif
 #include <stdio.h>
 
+#include <algorithm>
+
 #if defined(_WIN32)
 const HANDLE llbuild::basic::sys::FileDescriptorTraits<HANDLE>::InvalidDescriptor =
     INVALID_HANDLE_VALUE;
@@ -217,6 +228,80 @@ int sys::write(int fileHandle, void *destinationBuffer,
 #endif
 }
 
+bool sys::copyFileRange(int inFD, uint64_t inOffset, int outFD,
+                        uint64_t outOffset, uint64_t length) {
+#if defined(_WIN32)
+  errno = ENOSYS;
+  return false;
+#else
+#if defined(__linux__) && defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+  // Copy in the kernel, falling back to the userspace loop if this is not
+  // supported for the given file descriptors.
+  while (length != 0) {
+    loff_t inOff = inOffset, outOff = outOffset;
+    ssize_t n = ::copy_file_range(inFD, &inOff, outFD, &outOff, length, 0);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+          errno == EOPNOTSUPP)
+        break;
+      return false;
+    }
+    if (n == 0) {
+      // Unexpected end of the input.
+      errno = EIO;
+      return false;
+    }
+    inOffset += n;
+    outOffset += n;
+    length -= n;
+  }
+  if (length == 0)
+    return true;
+#endif
+
+  char buffer[64 * 1024];
+  while (length != 0) {
+    ssize_t n = ::pread(inFD, buffer,
+                        std::min<uint64_t>(length, sizeof(buffer)), inOffset);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    if (n == 0) {
+      errno = EIO;
+      return false;
+    }
+    for (ssize_t written = 0; written != n;) {
+      ssize_t w = ::pwrite(outFD, buffer + written, n - written,
+                           outOffset + written);
+      if (w < 0) {
+        if (errno == EINTR)
+          continue;
+        return false;
+      }
+      written += w;
+    }
+    inOffset += n;
+    outOffset += n;
+    length -= n;
+  }
+  return true;
+#endif
+}
+
+bool sys::cloneFile(int inFD, int outFD) {
+#if defined(__linux__) && defined(FICLONE)
+  return ::ioctl(outFD, FICLONE, inFD) == 0;
+#else
+  errno = ENOTSUP;
+  return false;
+#endif
+}
+
 // Get the current process' open file limit. Returns -1 on failure.
 llbuild_rlim_t sys::getOpenFileLimit() {
 #if defined(_WIN32)
@@ -261,6 +346,100 @@ int sys::raiseOpenFileLimit(llbuild_rlim_t limit) {
 #endif
 }
 
+bool sys::parseCPUList(const std::string& list,
+                       std::vector<unsigned>& cpus_out) {
+  cpus_out.clear();
+  llvm::SmallVector<llvm::StringRef, 8> ranges;
+  llvm::StringRef(list).trim().split(ranges, ',', -1, /*KeepEmpty=*/false);
+  for (auto range: ranges) {
+    range = range.trim();
+    auto bounds = range.split('-');
+    unsigned first, last;
+    if (bounds.first.getAsInteger(10, first))
+      return false;
+    last = first;
+    if (bounds.first.size() != range.size() &&
+        bounds.second.getAsInteger(10, last))
+      return false;
+    if (last < first)
+      return false;
+    for (unsigned cpu = first; cpu <= last; ++cpu)
+      cpus_out.push_back(cpu);
+  }
+  return true;
+}
+
+std::vector<std::vector<unsigned>> sys::getNUMANodeCPUs() {
+  std::vector<std::vector<unsigned>> nodes;
+#if defined(__linux__)
+  // Node numbers may be sparse, so check each of the possible nodes reported
+  // by the kernel, skipping those which are absent.
+  unsigned maxNode = 0;
+  if (auto buffer = llvm::MemoryBuffer::getFileAsStream(
+          "/sys/devices/system/node/possible")) {
+    std::vector<unsigned> possible;
+    if (parseCPUList((*buffer)->getBuffer().str(), possible) &&
+        !possible.empty())
+      maxNode = possible.back();
+  }
+
+  // Only report the CPUs we may actually run on (e.g., inside a cpuset).
+  cpu_set_t allowed;
+  bool haveAllowed = ::sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+  for (unsigned node = 0; node <= maxNode; ++node) {
+    auto buffer = llvm::MemoryBuffer::getFileAsStream(
+        "/sys/devices/system/node/node" + llvm::Twine(node) + "/cpulist");
+    if (!buffer)
+      continue;
+    std::vector<unsigned> cpus;
+    if (!parseCPUList((*buffer)->getBuffer().str(), cpus))
+      continue;
+    if (haveAllowed) {
+      cpus.erase(std::remove_if(cpus.begin(), cpus.end(), [&](unsigned cpu) {
+            return cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed);
+          }), cpus.end());
+    }
+    if (!cpus.empty())
+      nodes.push_back(std::move(cpus));
+  }
+#endif
+  return nodes;
+}
+
+bool sys::getCurrentThreadAffinity(std::vector<unsigned>& cpus_out) {
+  cpus_out.clear();
+#if defined(__linux__)
+  cpu_set_t set;
+  if (::sched_getaffinity(0, sizeof(set), &set) != 0)
+    return false;
+  for (unsigned cpu = 0; cpu != CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &set))
+      cpus_out.push_back(cpu);
+  }
+  return true;
+#else
+  errno = ENOTSUP;
+  return false;
+#endif
+}
+
+bool sys::setCurrentThreadAffinity(llvm::ArrayRef<unsigned> cpus) {
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto cpu: cpus) {
+    if (cpu < CPU_SETSIZE)
+      CPU_SET(cpu, &set);
+  }
+  // A pid of zero refers to the calling thread.
+  return ::sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+  errno = ENOTSUP;
+  return false;
+#endif
+}
+
 sys::MATCH_RESULT sys::filenameMatch(const std::string& pattern,
                                      const std::string& filename) {
 #if defined(_WIN32)
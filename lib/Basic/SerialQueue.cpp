@@ -20,6 +20,7 @@
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/Twine.h"
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 #include <condition_variable>
@@ -27,136 +28,335 @@
 #include <mutex>
 #include <random>
 #include <thread>
+#include <vector>
 
 #include <signal.h>
 
 using namespace llbuild;
 using namespace llbuild::basic;
 
+SerialQueue::Operation::~Operation() {}
+
 namespace {
 
-/// A basic serial queue.
+class SerialQueueExecutor;
+
+}
+
+namespace llbuild {
+namespace basic {
+
+/// A serial queue (strand).
 ///
-/// This implementation has been optimized for simplicity over performance.
-//
-// FIXME: Optimize.
+/// Operations are kept in an intrusive, lock-free, multiple producer single
+/// consumer queue. A count of the pending operations determines which thread
+/// schedules the queue on its executor: the one whose operation made the queue
+/// non-empty. Only one thread drains the queue at any time.
 class SerialQueueImpl {
-  /// The thread executing the operations.
-  std::unique_ptr<std::thread> operationsThread;
-  
-  /// The queue of operations.
-  std::deque<std::function<void(void)>> operations;
-
-  /// The mutex protecting access to the queue.
-  std::mutex operationsMutex;
-
-  /// Condition variable used to signal when operations are available.
-  std::condition_variable readyOperationsCondition;
-  
-  /// Thread function to execute operations.
-  void run() {
-    while (true) {
-      // Get the next operation from the queue.
-      std::function<void(void)> fn;
-      {
-        std::unique_lock<std::mutex> lock(operationsMutex);
+  /// A placeholder operation, used to mark the queue as empty.
+  class StubOperation : public SerialQueue::Operation {
+    virtual void perform() override {
+      assert(0 && "unexpected API call");
+    }
+  };
+
+  /// An operation waiting on the calling thread for its completion.
+  class SyncOperation : public SerialQueue::Operation {
+    /// A per-thread waiter, to avoid creating a condition variable per call.
+    struct Waiter {
+      std::mutex mutex;
+      std::condition_variable condition;
+    };
+    static Waiter& getWaiter() {
+      static thread_local Waiter waiter;
+      return waiter;
+    }
 
-        // While the queue is empty, wait for an item.
-        while (operations.empty()) {
-          readyOperationsCondition.wait(lock);
-        }
+    llvm::function_ref<void(void)> fn;
+    Waiter& waiter;
+    bool isComplete = false;
 
-        fn = operations.front();
-        operations.pop_front();
-      }
+  public:
+    explicit SyncOperation(llvm::function_ref<void(void)> fn)
+        : fn(fn), waiter(getWaiter()) {}
 
-      // If we got a nil function, the queue is shutting down.
-      if (!fn)
-        break;
-      
-      // Execute the operation.
+    virtual void perform() override {
       fn();
+      std::lock_guard<std::mutex> guard(waiter.mutex);
+      isComplete = true;
+      waiter.condition.notify_one();
+    }
+
+    void wait() {
+      std::unique_lock<std::mutex> lock(waiter.mutex);
+      while (!isComplete) {
+        waiter.condition.wait(lock);
+      }
     }
+  };
+
+  /// The maximum number of operations to execute before yielding the thread
+  /// to other scheduled queues.
+  static constexpr unsigned maxOperationsPerDrain = 1024;
+
+  /// The executor this queue runs on.
+  SerialQueueExecutor& executor;
+
+  /// The number of references to this queue; held by its owner, and while the
+  /// queue is scheduled on the executor.
+  std::atomic<unsigned> refCount{ 1 };
+
+  /// The number of operations which have been added, and not completed.
+  std::atomic<uint64_t> numPendingOperations{ 0 };
+
+  /// The most recently added operation (written by producers).
+  std::atomic<SerialQueue::Operation*> head;
+
+  /// The least recently added operation (only accessed by the consumer).
+  SerialQueue::Operation* tail;
+
+  /// The placeholder operation.
+  StubOperation stub;
+
+  void push(SerialQueue::Operation* operation) {
+    operation->next.store(nullptr, std::memory_order_relaxed);
+    auto previous = head.exchange(operation, std::memory_order_acq_rel);
+    previous->next.store(operation, std::memory_order_release);
   }
 
-  void addOperation(std::function<void(void)>&& fn) {
-    std::lock_guard<std::mutex> guard(operationsMutex);
-    operations.push_back(fn);
-    readyOperationsCondition.notify_one();
+  /// Remove the least recently added operation, if available.
+  ///
+  /// This may spuriously return null while a producer is in the middle of
+  /// adding an operation.
+  SerialQueue::Operation* pop() {
+    auto first = tail;
+    auto next = first->next.load(std::memory_order_acquire);
+    if (first == &stub) {
+      if (!next)
+        return nullptr;
+      tail = next;
+      first = next;
+      next = next->next.load(std::memory_order_acquire);
+    }
+    if (next) {
+      tail = next;
+      return first;
+    }
+    if (first != head.load(std::memory_order_acquire))
+      return nullptr;
+    push(&stub);
+    next = first->next.load(std::memory_order_acquire);
+    if (next) {
+      tail = next;
+      return first;
+    }
+    return nullptr;
   }
-  
+
+  void schedule();
+
 public:
-  SerialQueueImpl() {
-    // Ensure the queue is fully initialized before creating the worker thread.
-    operationsThread = llvm::make_unique<std::thread>(
-        &SerialQueueImpl::run, this);
+  explicit SerialQueueImpl(SerialQueueExecutor& executor)
+      : executor(executor), head(&stub), tail(&stub) {}
+
+  void retain() { refCount.fetch_add(1, std::memory_order_relaxed); }
+
+  void release() {
+    if (refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      delete this;
   }
 
-  ~SerialQueueImpl() {
-    // Signal the worker to shut down.
-    addOperation({});
+  void addOperation(SerialQueue::Operation* operation) {
+    assert(operation);
+    push(operation);
 
-    // Wait for the worker to complete.
-    operationsThread->join();
+    // If the queue was idle, schedule it.
+    if (numPendingOperations.fetch_add(1, std::memory_order_acq_rel) == 0) {
+      retain();
+      schedule();
+    }
   }
-  
-  void sync(std::function<void(void)> fn) {
-    assert(fn);
-    
-    // Add an operation which will execute the function and signal its
-    // completion.
-    std::condition_variable cv{};
-    std::mutex isCompleteMutex{};
-    bool isComplete = false;
-    addOperation([&]() {
-        fn();
-        {
-          std::unique_lock<std::mutex> lock(isCompleteMutex);
-          isComplete = true;
-          cv.notify_one();
-        }
-      });
-
-    // Wait for the operation to complete.
-    std::unique_lock<std::mutex> lock(isCompleteMutex);
-    while (!isComplete) {
-      cv.wait(lock);
+
+  /// Execute pending operations, called by the executor.
+  void drain() {
+    // Completed operations are accounted for in batches, once the queue
+    // appears empty, to avoid an atomic update per operation.
+    uint64_t numCompleted = 0;
+    for (unsigned i = 0;; ++i) {
+      if (auto operation = pop()) {
+        operation->perform();
+        ++numCompleted;
+
+        // Requeue ourselves periodically, so that a busy queue does not
+        // monopolize a thread.
+        if (i + 1 < maxOperationsPerDrain)
+          continue;
+      }
+
+      // If the queue is now empty, give up the executor's reference.
+      if (numPendingOperations.fetch_sub(numCompleted,
+                                         std::memory_order_acq_rel) ==
+          numCompleted) {
+        release();
+        return;
+      }
+      if (i + 1 >= maxOperationsPerDrain) {
+        schedule();
+        return;
+      }
+      numCompleted = 0;
+
+      // Otherwise, an operation is being added but is not fully linked into
+      // the queue yet.
+      std::this_thread::yield();
     }
   }
 
-  void async(std::function<void(void)> fn) {
-    assert(fn);
-    
-    // Add the operation.
-    addOperation(std::move(fn));
+  void sync(llvm::function_ref<void(void)> fn) {
+    // If the queue is idle, claim it and execute the operation directly.
+    uint64_t expected = 0;
+    if (numPendingOperations.compare_exchange_strong(
+            expected, 1, std::memory_order_acq_rel)) {
+      fn();
+
+      // Hand any operations added meanwhile off to the executor.
+      if (numPendingOperations.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        retain();
+        schedule();
+      }
+      return;
+    }
+
+    // Otherwise, add an operation which will signal its completion.
+    SyncOperation operation(fn);
+    addOperation(&operation);
+    operation.wait();
   }
 };
 
 }
+}
+
+namespace {
+
+/// A pool of threads executing scheduled serial queues.
+///
+/// Threads are created on demand, up to the given maximum.
+class SerialQueueExecutor {
+  /// The maximum number of threads.
+  const unsigned maxThreads;
+
+  /// The threads executing queues.
+  std::vector<std::thread> threads;
+
+  /// The number of threads waiting for a queue to be scheduled.
+  unsigned numIdleThreads = 0;
+
+  /// Whether the executor is shutting down.
+  bool isShutdown = false;
+
+  /// The scheduled queues.
+  std::deque<SerialQueueImpl*> readyQueues;
+
+  /// The mutex protecting access to the executor state.
+  std::mutex readyQueuesMutex;
+
+  /// Condition variable used to signal when queues are scheduled.
+  std::condition_variable readyQueuesCondition;
+
+  /// Thread function to execute queues.
+  void run() {
+    std::unique_lock<std::mutex> lock(readyQueuesMutex);
+    while (true) {
+      // While there are no queues, wait for one.
+      while (readyQueues.empty() && !isShutdown) {
+        ++numIdleThreads;
+        readyQueuesCondition.wait(lock);
+        --numIdleThreads;
+      }
+      if (readyQueues.empty())
+        return;
+
+      auto queue = readyQueues.front();
+      readyQueues.pop_front();
+
+      lock.unlock();
+      queue->drain();
+      lock.lock();
+    }
+  }
+
+public:
+  explicit SerialQueueExecutor(unsigned maxThreads)
+      : maxThreads(std::max(1u, maxThreads)) {}
+
+  ~SerialQueueExecutor() {
+    {
+      std::lock_guard<std::mutex> guard(readyQueuesMutex);
+      isShutdown = true;
+      readyQueuesCondition.notify_all();
+    }
+    for (auto& thread: threads) {
+      thread.join();
+    }
+  }
+
+  /// Get the executor shared by all serial queues.
+  static SerialQueueExecutor& getShared() {
+    // The shared executor is intentionally leaked, so queues remain usable
+    // during static destruction.
+    static SerialQueueExecutor* executor = new SerialQueueExecutor(
+        std::max(2u, std::thread::hardware_concurrency()));
+    return *executor;
+  }
+
+  /// Schedule a queue to be drained; the executor takes over the caller's
+  /// reference to the queue.
+  void schedule(SerialQueueImpl* queue) {
+    std::lock_guard<std::mutex> guard(readyQueuesMutex);
+    readyQueues.push_back(queue);
+    if (numIdleThreads == 0 && threads.size() < maxThreads) {
+      threads.emplace_back(&SerialQueueExecutor::run, this);
+    } else {
+      readyQueuesCondition.notify_one();
+    }
+  }
+};
+
+}
+
+void SerialQueueImpl::schedule() {
+  executor.schedule(this);
+}
 
 SerialQueue::SerialQueue()
-    : impl(new SerialQueueImpl())
+    : impl(new SerialQueueImpl(SerialQueueExecutor::getShared()))
 {
 }
 
 SerialQueue::~SerialQueue() {
-  delete static_cast<SerialQueueImpl*>(impl);
+  // Wait for all of the operations to complete.
+  auto queue = static_cast<SerialQueueImpl*>(impl);
+  queue->sync([] {});
+  queue->release();
 }
 
-void SerialQueue::sync(std::function<void(void)> fn) {
+void SerialQueue::sync(llvm::function_ref<void(void)> fn) {
   static_cast<SerialQueueImpl*>(impl)->sync(fn);
 }
 
-void SerialQueue::async(std::function<void(void)> fn) {
-  static_cast<SerialQueueImpl*>(impl)->async(fn);
+void SerialQueue::addOperation(Operation* operation) {
+  static_cast<SerialQueueImpl*>(impl)->addOperation(operation);
 }
 
-
 /// An execution queue based on a serial operation queue.
 class SerialExecutionQueue : public ExecutionQueue {
   /// (Random) build identifier
   uint32_t buildID;
 
+  /// The executor providing the queue's thread.
+  SerialQueueExecutor executor{ 1 };
+
   /// Underlying queue implementation
   SerialQueueImpl* queue;
 
@@ -173,6 +373,24 @@ class SerialExecutionQueue : public ExecutionQueue {
     unsigned laneID() const override { return 0; }
   };
 
+  /// An operation executing a job.
+  class JobOperation : public SerialQueue::Operation {
+    uint64_t jobID;
+    QueueJob job;
+
+  public:
+    JobOperation(uint64_t jobID, QueueJob&& job)
+      : jobID(jobID), job(std::move(job)) { }
+
+    virtual void perform() override {
+      {
+        SerialContext ctx(jobID, job);
+        job.execute(&ctx);
+      }
+      delete this;
+    }
+  };
+
   uint64_t jobCount{0};
   std::atomic<bool> cancelled { false };
 
@@ -206,13 +424,15 @@ class SerialExecutionQueue : public ExecutionQueue {
 public:
   SerialExecutionQueue(ExecutionQueueDelegate& delegate,
                        const char* const* environment)
-  : ExecutionQueue(delegate), buildID(std::random_device()()), queue(new SerialQueueImpl), environment(environment)
+  : ExecutionQueue(delegate), buildID(std::random_device()()), queue(new SerialQueueImpl(executor)), environment(environment)
   {
   }
 
   virtual ~SerialExecutionQueue()
   {
-    delete queue;
+    // Wait for all of the jobs to complete.
+    queue->sync([] {});
+    queue->release();
     queue = nullptr;
 
     std::lock_guard<std::mutex> guard(killAfterTimeoutThreadMutex);
@@ -229,10 +449,7 @@ public:
 
   virtual void addJob(QueueJob job) override {
     uint64_t jobID = ++jobCount;
-    queue->async([jobID, job]() mutable {
-      SerialContext ctx(jobID, job);
-      job.execute(&ctx);
-    });
+    queue->addOperation(new JobOperation(jobID, std::move(job)));
   }
 
   virtual void cancelAllJobs() override {
@@ -13,6 +13,8 @@
 #include "llbuild/Basic/ShellUtility.h"
 #include "llvm/ADT/SmallString.h"
 
+#include <cctype>
+
 using namespace llvm;
 namespace llbuild {
 namespace basic {
@@ -128,5 +130,39 @@ std::string shellEscaped(StringRef string) {
   return out.str();
 }
 
+static bool isPathDelimiter(char c) {
+  return ::isspace((unsigned char)c) || c == '\'' || c == '"' || c == '=';
+}
+
+bool replacePathInCommandLine(StringRef commandLine, StringRef path,
+                              StringRef replacement, std::string& result) {
+  result.clear();
+  if (path.empty())
+    return false;
+
+  bool replaced = false;
+  size_t pos = 0;
+  while (true) {
+    size_t match = commandLine.find(path, pos);
+    if (match == StringRef::npos)
+      break;
+
+    size_t end = match + path.size();
+    if ((match != 0 && !isPathDelimiter(commandLine[match - 1])) ||
+        (end != commandLine.size() && !isPathDelimiter(commandLine[end]))) {
+      result += commandLine.slice(pos, match + 1);
+      pos = match + 1;
+      continue;
+    }
+
+    result += commandLine.slice(pos, match);
+    result += replacement;
+    pos = end;
+    replaced = true;
+  }
+  result += commandLine.substr(pos);
+  return replaced;
+}
+
 }
 }
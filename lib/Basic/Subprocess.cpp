@@ -17,6 +17,7 @@
 #include "llbuild/Basic/ShellUtility.h"
 
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/Twine.h"
 #include "llvm/Support/ConvertUTF.h"
@@ -41,6 +42,9 @@
 #include <spawn.h>
 #include <sys/resource.h>
 #include <sys/wait.h>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
 #include <unistd.h>
 #endif
 
@@ -627,6 +631,15 @@ static std::pair<CommunicationPipesCreationError, int> createCommunicationPipes(
 #endif
   }
 
+  // Pass through any additional descriptors.
+  for (int fd: attr.inheritedDescriptors) {
+#ifdef __APPLE__
+    posix_spawn_file_actions_addinherit_np(&fileActions, fd);
+#else
+    posix_spawn_file_actions_adddup2(&fileActions, fd, fd);
+#endif
+  }
+
 #endif
 
   return std::make_pair(CommunicationPipesCreationError::ERROR_NONE, 0);
@@ -881,10 +894,21 @@ void llbuild::basic::spawnProcess(
                                                   : (LPWSTR)u16Cwd.data(),
             &startupInfo, &processInfo);
 #else
+        // The process inherits the affinity of the spawning thread, so apply
+        // the requested affinity around the spawn. Applying it afterwards
+        // would miss any threads the process had already started.
+        std::vector<unsigned> spawningThreadAffinity;
+        bool restoreAffinity = false;
+        if (!attr.cpuAffinity.empty() &&
+            sys::getCurrentThreadAffinity(spawningThreadAffinity) &&
+            ArrayRef<unsigned>(spawningThreadAffinity) != attr.cpuAffinity)
+          restoreAffinity = sys::setCurrentThreadAffinity(attr.cpuAffinity);
         result =
             posix_spawn(&pid, args[0], /*file_actions=*/&fileActions,
                         /*attrp=*/&attributes, const_cast<char**>(args.data()),
                         const_cast<char* const*>(environment.getEnvp()));
+        if (restoreAffinity)
+          (void)sys::setCurrentThreadAffinity(spawningThreadAffinity);
 #endif
       }
 
@@ -1089,3 +1113,62 @@ void llbuild::basic::spawnProcess(
   cleanUpExecutedProcess(delegate, pgrp, pid, handle, ctx,
                          std::move(completionFn), controlPipeParentEnd);
 }
+
+InMemoryOutputFile::~InMemoryOutputFile() {
+#if !defined(_WIN32)
+  if (descriptor >= 0)
+    ::close(descriptor);
+#endif
+}
+
+std::unique_ptr<InMemoryOutputFile>
+InMemoryOutputFile::create(StringRef name, std::string* error_out) {
+#if defined(_WIN32)
+  *error_out = "in-memory output files are unsupported on this platform";
+  return nullptr;
+#else
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+  int memoryFD = ::memfd_create(name.str().c_str(), MFD_CLOEXEC);
+  if (memoryFD >= 0) {
+    return std::unique_ptr<InMemoryOutputFile>(
+        new InMemoryOutputFile(memoryFD));
+  }
+  if (errno != ENOSYS) {
+    *error_out = "unable to create in-memory file: " + sys::strerror(errno);
+    return nullptr;
+  }
+#endif
+
+  // Otherwise, fall back to a temporary file which is unlinked immediately, so
+  // it is never visible to the build and only reaches the disk under memory
+  // pressure.
+  SmallString<256> path;
+  llvm::sys::path::system_temp_directory(/*erasedOnReboot=*/true, path);
+  llvm::sys::path::append(path, "llbuild-output-XXXXXX");
+  int fd = ::mkstemp(&path[0]);
+  if (fd < 0) {
+    *error_out = "unable to create temporary file: " + sys::strerror(errno);
+    return nullptr;
+  }
+  ::unlink(path.c_str());
+  ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+  return std::unique_ptr<InMemoryOutputFile>(new InMemoryOutputFile(fd));
+#endif
+}
+
+std::string InMemoryOutputFile::getPath() const {
+  return "/dev/fd/" + std::to_string(descriptor);
+}
+
+std::unique_ptr<llvm::MemoryBuffer>
+InMemoryOutputFile::getContents(StringRef name, std::string* error_out) {
+  // The process may have written through its own descriptor, so read the
+  // whole file regardless of the shared offset.
+  auto buffer = llvm::MemoryBuffer::getOpenFile(descriptor, name,
+                                                /*FileSize=*/-1);
+  if (!buffer) {
+    *error_out = buffer.getError().message();
+    return nullptr;
+  }
+  return std::move(*buffer);
+}
@@ -0,0 +1,645 @@
+//===-- BuildFileParser.cpp -----------------------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/BuildSystem/BuildFileParser.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/YAMLParser.h"
+
+#include <cstring>
+
+using namespace llbuild;
+using namespace llbuild::buildsystem;
+using namespace llbuild::buildsystem::buildfile;
+
+// Scalar values are computed exactly as llvm::yaml::ScalarNode::getValue()
+// does, so that they do not depend on which parser produced the node.
+
+/// Encode \p value in UTF-8 and append it to \p result.
+static void encodeUTF8(uint32_t value, SmallVectorImpl<char>& result) {
+  if (value <= 0x7F) {
+    result.push_back(value & 0x7F);
+  } else if (value <= 0x7FF) {
+    result.push_back(0xC0 | ((value & 0x7C0) >> 6));
+    result.push_back(0x80 | (value & 0x3F));
+  } else if (value <= 0xFFFF) {
+    result.push_back(0xE0 | ((value & 0xF000) >> 12));
+    result.push_back(0x80 | ((value & 0xFC0) >> 6));
+    result.push_back(0x80 | (value & 0x3F));
+  } else if (value <= 0x10FFFF) {
+    result.push_back(0xF0 | ((value & 0x1F0000) >> 18));
+    result.push_back(0x80 | ((value & 0x3F000) >> 12));
+    result.push_back(0x80 | ((value & 0xFC0) >> 6));
+    result.push_back(0x80 | (value & 0x3F));
+  }
+}
+
+/// Append the code point written as \p numDigits hex digits at the start of
+/// \p value, and consume them.
+static void unescapeCodePoint(StringRef& value, unsigned numDigits,
+                              SmallVectorImpl<char>& storage) {
+  if (value.size() < numDigits + 1)
+    return;
+  unsigned codePoint;
+  if (value.substr(1, numDigits).getAsInteger(16, codePoint))
+    codePoint = 0xFFFD;
+  encodeUTF8(codePoint, storage);
+  value = value.substr(numDigits);
+}
+
+static StringRef unescapeDoubleQuoted(StringRef value, size_t i,
+                                      SmallVectorImpl<char>& storage) {
+  storage.clear();
+  storage.reserve(value.size());
+  for (; i != StringRef::npos; i = value.find_first_of("\\\r\n")) {
+    storage.append(value.begin(), value.begin() + i);
+    value = value.substr(i);
+
+    // Line breaks are folded to a single newline.
+    if (value[0] == '\r' || value[0] == '\n') {
+      storage.push_back('\n');
+      if (value.size() > 1 && (value[1] == '\r' || value[1] == '\n'))
+        value = value.substr(1);
+      value = value.substr(1);
+      continue;
+    }
+
+    if (value.size() == 1)
+      break;
+    value = value.substr(1);
+    switch (value[0]) {
+    default:
+      // An unrecognized escape, which the YAML parser diagnoses.
+      return "";
+    case '\r':
+    case '\n':
+      // An escaped line break is removed.
+      if (value.size() > 1 && (value[1] == '\r' || value[1] == '\n'))
+        value = value.substr(1);
+      break;
+    case '0': storage.push_back(0x00); break;
+    case 'a': storage.push_back(0x07); break;
+    case 'b': storage.push_back(0x08); break;
+    case 't':
+    case 0x09: storage.push_back(0x09); break;
+    case 'n': storage.push_back(0x0A); break;
+    case 'v': storage.push_back(0x0B); break;
+    case 'f': storage.push_back(0x0C); break;
+    case 'r': storage.push_back(0x0D); break;
+    case 'e': storage.push_back(0x1B); break;
+    case ' ': storage.push_back(0x20); break;
+    case '"': storage.push_back(0x22); break;
+    case '/': storage.push_back(0x2F); break;
+    case '\\': storage.push_back(0x5C); break;
+    case 'N': encodeUTF8(0x85, storage); break;
+    case '_': encodeUTF8(0xA0, storage); break;
+    case 'L': encodeUTF8(0x2028, storage); break;
+    case 'P': encodeUTF8(0x2029, storage); break;
+    case 'x': unescapeCodePoint(value, 2, storage); break;
+    case 'u': unescapeCodePoint(value, 4, storage); break;
+    case 'U': unescapeCodePoint(value, 8, storage); break;
+    }
+    value = value.substr(1);
+  }
+  storage.append(value.begin(), value.end());
+  return StringRef(storage.data(), storage.size());
+}
+
+StringRef Node::getValue(SmallVectorImpl<char>& storage) const {
+  StringRef value = getRawValue();
+  if (value.empty())
+    return value;
+
+  if (value[0] == '"') {
+    value = value.substr(1, value.size() - 2);
+    size_t i = value.find_first_of("\\\r\n");
+    if (i == StringRef::npos)
+      return value;
+    return unescapeDoubleQuoted(value, i, storage);
+  }
+
+  if (value[0] == '\'') {
+    value = value.substr(1, value.size() - 2);
+    size_t i = value.find('\'');
+    if (i == StringRef::npos)
+      return value;
+    storage.clear();
+    storage.reserve(value.size());
+    for (; i != StringRef::npos; i = value.find('\'')) {
+      storage.append(value.begin(), value.begin() + i);
+      storage.push_back('\'');
+      value = value.substr(i + 2);
+    }
+    storage.append(value.begin(), value.end());
+    return StringRef(storage.data(), storage.size());
+  }
+
+  return value.rtrim(' ');
+}
+
+#pragma mark - Parser
+
+namespace llbuild {
+namespace buildsystem {
+namespace buildfile {
+
+/// Parser for the subset of YAML used by build files.
+///
+/// The subset is block mappings indented with spaces, whose keys and values
+/// are single line plain or quoted scalars, flow sequences or empty flow
+/// mappings. Only flow sequences may span several lines. The parser gives up
+/// on anything else, including any input the YAML parser would diagnose, so
+/// that it never accepts a document the YAML parser would read differently.
+/// The source ranges of the nodes match those of the YAML parser, so
+/// diagnostics do not depend on which parser was used.
+class Parser {
+  std::vector<Node>& nodes;
+
+  const char* cur;
+  const char* end;
+
+  /// The start of the line containing \see cur.
+  const char* lineStart;
+
+  /// The longest key the YAML parser accepts.
+  static constexpr unsigned maximumKeyLength = 1024;
+
+  unsigned getColumn() const { return cur - lineStart; }
+
+  /// Get the length of the printable character at \p p, or zero if it is not
+  /// one the YAML parser accepts.
+  unsigned getPrintableLength(const char* p) const {
+    unsigned char c = *p;
+    if (c == 0x09 || (c >= 0x20 && c <= 0x7E))
+      return 1;
+    if (!(c & 0x80))
+      return 0;
+
+    // Decode the UTF-8 sequence.
+    uint32_t codePoint = 0;
+    unsigned length = 0;
+    auto isContinuation = [&](unsigned i) {
+      return p + i < end && (p[i] & 0xC0) == 0x80;
+    };
+    if ((c & 0xE0) == 0xC0 && isContinuation(1)) {
+      codePoint = ((c & 0x1F) << 6) | (p[1] & 0x3F);
+      length = codePoint >= 0x80 ? 2 : 0;
+    } else if ((c & 0xF0) == 0xE0 && isContinuation(1) && isContinuation(2)) {
+      codePoint = ((c & 0x0F) << 12) | ((p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+      length = (codePoint >= 0x800 &&
+                (codePoint < 0xD800 || codePoint > 0xDFFF)) ? 3 : 0;
+    } else if ((c & 0xF8) == 0xF0 && isContinuation(1) && isContinuation(2) &&
+               isContinuation(3)) {
+      codePoint = ((c & 0x07) << 18) | ((p[1] & 0x3F) << 12) |
+        ((p[2] & 0x3F) << 6) | (p[3] & 0x3F);
+      length = (codePoint >= 0x10000 && codePoint <= 0x10FFFF) ? 4 : 0;
+    }
+    if (length == 0 || codePoint == 0xFEFF)
+      return 0;
+    if (codePoint == 0x85 || (codePoint >= 0xA0 && codePoint <= 0xD7FF) ||
+        (codePoint >= 0xE000 && codePoint <= 0xFFFD) || codePoint >= 0x10000)
+      return length;
+    return 0;
+  }
+
+  /// Skip the spaces at the current position.
+  ///
+  /// \returns False if there is a tab, which the subset does not allow.
+  bool skipSpaces() {
+    while (cur != end && *cur == ' ')
+      ++cur;
+    return cur == end || *cur != '\t';
+  }
+
+  /// Check whether the current position ends a line, after a token.
+  bool atLineEnd() const {
+    return cur == end || *cur == '\n' || (*cur == '#' && cur[-1] == ' ');
+  }
+
+  /// Skip the comment at the current position, up to the end of the line.
+  bool skipComment() {
+    while (cur != end && *cur != '\n') {
+      unsigned length = getPrintableLength(cur);
+      if (length == 0)
+        return false;
+      cur += length;
+    }
+    return true;
+  }
+
+  /// Skip to the next content, past any blank lines and comments.
+  ///
+  /// \param firstColumn [out] If given, the column of the first character
+  /// which is not whitespace, including that of a comment.
+  /// \returns False if the input is outside of the subset.
+  bool skipToContent(unsigned* firstColumn = nullptr) {
+    bool sawNonBlank = false;
+    for (;;) {
+      if (!skipSpaces())
+        return false;
+      if (cur == end)
+        return true;
+      if (!sawNonBlank && *cur != '\n') {
+        sawNonBlank = true;
+        if (firstColumn)
+          *firstColumn = getColumn();
+      }
+      if (*cur == '#' && !skipComment())
+        return false;
+      if (cur == end)
+        return true;
+      if (*cur != '\n')
+        break;
+      lineStart = ++cur;
+    }
+
+    return !atDocumentMarker();
+  }
+
+  /// Check for a marker starting a new document, which the subset excludes.
+  bool atDocumentMarker() const {
+    return cur == lineStart && end - cur >= 3 &&
+      (StringRef(cur, 3) == "---" || StringRef(cur, 3) == "...");
+  }
+
+  /// Parse a scalar, flow sequence or empty flow mapping.
+  bool parseFlowNode(bool inFlow, bool* isPlain = nullptr) {
+    if (isPlain)
+      *isPlain = false;
+    switch (*cur) {
+    case '"':
+      return parseDoubleQuotedScalar();
+    case '\'':
+      return parseSingleQuotedScalar();
+    case '[':
+      return parseFlowSequence();
+    case '{':
+      return parseEmptyFlowMapping();
+    default:
+      if (isPlain)
+        *isPlain = true;
+      return parsePlainScalar(inFlow);
+    }
+  }
+
+  bool parsePlainScalar(bool inFlow) {
+    auto isBlankOrBreak = [&](const char* p) {
+      return p != end && (*p == ' ' || *p == '\t' || *p == '\n' ||
+                          *p == '\r');
+    };
+
+    // Reject indicators, which start other kinds of nodes. Only '-' may start
+    // a plain scalar, when it is not followed by a blank.
+    const char* start = cur;
+    if (strchr("?:,]}#&*!|>%@`", *cur))
+      return false;
+    if (*cur == '-' && (cur + 1 == end || isBlankOrBreak(cur + 1) ||
+                        (inFlow && strchr(",[]{}", cur[1]))))
+      return false;
+
+    for (;;) {
+      while (cur != end && !isBlankOrBreak(cur)) {
+        if (*cur == ':') {
+          // In a flow, this starts a flow mapping or is an error.
+          if (inFlow)
+            return false;
+          if (isBlankOrBreak(cur + 1))
+            goto done;
+        }
+        if (inFlow && strchr(",?[]{}", *cur)) {
+          if (*cur == '?')
+            return false;
+          goto done;
+        }
+        unsigned length = getPrintableLength(cur);
+        if (length == 0 || *cur == '\t')
+          return false;
+        cur += length;
+      }
+      if (cur == end)
+        break;
+
+      // Blanks are part of the scalar, unless they end the line.
+      const char* next = cur;
+      while (next != end && *next == ' ')
+        ++next;
+      if (next != end && (*next == '\t' || *next == '\r'))
+        return false;
+      if (next != end && *next == '\n') {
+        if (inFlow)
+          return false;
+        break;
+      }
+      cur = next;
+      if (cur != end && *cur == '#')
+        break;
+    }
+
+  done:
+    if (cur == start)
+      return false;
+    nodes.emplace_back(Node::NK_Scalar, start, cur);
+    return true;
+  }
+
+  bool parseDoubleQuotedScalar() {
+    const char* start = cur++;
+    for (;;) {
+      if (cur == end || *cur == '\n' || *cur == '\r')
+        return false;
+      if (*cur == '"')
+        break;
+      if (*cur == '\\') {
+        // Only accept the escapes the YAML parser recognizes, and not escaped
+        // line breaks.
+        if (cur + 1 == end || cur[1] == '\0' ||
+            !strchr("0abt\tnvfre \"/\\N_LPxuU", cur[1]))
+          return false;
+        ++cur;
+      }
+      ++cur;
+    }
+    ++cur;
+    nodes.emplace_back(Node::NK_Scalar, start, cur);
+    return true;
+  }
+
+  bool parseSingleQuotedScalar() {
+    const char* start = cur++;
+    for (;;) {
+      if (cur == end || *cur == '\n' || *cur == '\r')
+        return false;
+      if (*cur == '\'') {
+        if (cur + 1 != end && cur[1] == '\'') {
+          cur += 2;
+          continue;
+        }
+        break;
+      }
+      unsigned length = getPrintableLength(cur);
+      if (length == 0)
+        return false;
+      cur += length;
+    }
+    ++cur;
+    nodes.emplace_back(Node::NK_Scalar, start, cur);
+    return true;
+  }
+
+  /// Skip the whitespace and comments within a flow, which may continue onto
+  /// the following lines.
+  bool skipFlowSpaces() {
+    for (;;) {
+      if (!skipSpaces() || cur == end || *cur == '\r')
+        return false;
+      if (*cur == '#') {
+        if (cur != lineStart && cur[-1] != ' ')
+          return false;
+        if (!skipComment() || cur == end)
+          return false;
+      }
+      if (*cur != '\n')
+        break;
+      lineStart = ++cur;
+    }
+    return !atDocumentMarker();
+  }
+
+  bool parseFlowSequence() {
+    ++cur;
+    if (!skipFlowSpaces())
+      return false;
+
+    // The range of a collection is the empty range at its first token.
+    size_t index = nodes.size();
+    nodes.emplace_back(Node::NK_Sequence, cur, cur);
+    if (*cur != ']') {
+      for (;;) {
+        if (!parseFlowNode(/*inFlow=*/true) || !skipFlowSpaces())
+          return false;
+        if (*cur == ']')
+          break;
+        if (*cur != ',')
+          return false;
+        ++cur;
+        if (!skipFlowSpaces() || *cur == ']')
+          return false;
+      }
+    }
+    ++cur;
+    nodes[index].numNodes = nodes.size() - index;
+    return true;
+  }
+
+  bool parseEmptyFlowMapping() {
+    ++cur;
+    if (!skipFlowSpaces() || *cur != '}')
+      return false;
+    nodes.emplace_back(Node::NK_Mapping, cur, cur);
+    ++cur;
+    return true;
+  }
+
+  /// Parse a block mapping whose first key is at the current position.
+  bool parseBlockMapping() {
+    unsigned indent = getColumn();
+    size_t index = nodes.size();
+    nodes.emplace_back(Node::NK_Mapping, cur, cur);
+    for (;;) {
+      size_t entry = nodes.size();
+      nodes.emplace_back(Node::NK_KeyValue, cur, cur);
+
+      // Parse the key, which must be on a single line.
+      const char* keyStart = cur;
+      const char* keyLineStart = lineStart;
+      if (!parseFlowNode(/*inFlow=*/false) || !skipSpaces())
+        return false;
+      if (cur == end || *cur != ':' || lineStart != keyLineStart ||
+          cur - keyStart > maximumKeyLength)
+        return false;
+      ++cur;
+      if (cur == end || (*cur != ' ' && *cur != '\n'))
+        return false;
+      if (!skipSpaces())
+        return false;
+
+      // Parse the value.
+      if (atLineEnd()) {
+        // The value is either a nested mapping or null.
+        if (!skipToContent())
+          return false;
+        if (cur != end && getColumn() > indent) {
+          if (!parseBlockMapping())
+            return false;
+        } else {
+          nodes.emplace_back(Node::NK_Null, cur, cur);
+        }
+      } else {
+        bool isPlain;
+        if (!parseFlowNode(/*inFlow=*/false, &isPlain) || !skipSpaces() ||
+            !atLineEnd())
+          return false;
+
+        // A plain scalar would continue onto any more indented line, even one
+        // with a comment, and nothing else can.
+        unsigned firstColumn = 0;
+        if (cur != end && *cur == '#' && !skipComment())
+          return false;
+        if (!skipToContent(&firstColumn))
+          return false;
+        if (cur != end && getColumn() > indent)
+          return false;
+        if (isPlain && firstColumn > indent)
+          return false;
+      }
+      nodes[entry].numNodes = nodes.size() - entry;
+
+      // Continue with the next key, at the same indentation.
+      if (cur == end || getColumn() < indent)
+        break;
+      if (getColumn() != indent)
+        return false;
+    }
+    nodes[index].numNodes = nodes.size() - index;
+    return true;
+  }
+
+public:
+  Parser(std::vector<Node>& nodes, StringRef buffer)
+      : nodes(nodes), cur(buffer.begin()), end(buffer.end()),
+        lineStart(buffer.begin()) {}
+
+  bool parseDocument() {
+    // Leave byte order marks and documents other than a mapping to the YAML
+    // parser.
+    if (end - cur >= 3 && StringRef(cur, 3) == "\xEF\xBB\xBF")
+      return false;
+    if (!skipToContent() || cur == end)
+      return false;
+    if (!parseBlockMapping())
+      return false;
+    return cur == end;
+  }
+
+  /// Add the nodes for a node from the YAML parser.
+  static void addYAMLNode(std::vector<Node>& nodes, llvm::yaml::Node* node) {
+    auto range = node->getSourceRange();
+    size_t index = nodes.size();
+    switch (node->getType()) {
+    case llvm::yaml::Node::NK_Scalar: {
+      auto scalar = static_cast<llvm::yaml::ScalarNode*>(node);
+      StringRef value = scalar->getRawValue();
+
+      // Diagnose any invalid escapes, which only the YAML parser reports.
+      if (value.startswith("\"") && value.find('\\') != StringRef::npos) {
+        SmallString<256> storage;
+        (void)scalar->getValue(storage);
+      }
+      nodes.emplace_back(Node::NK_Scalar, value.begin(), value.end());
+      return;
+    }
+
+    case llvm::yaml::Node::NK_Mapping: {
+      nodes.emplace_back(Node::NK_Mapping, range.Start.getPointer(),
+                         range.End.getPointer());
+      for (auto& entry: *static_cast<llvm::yaml::MappingNode*>(node)) {
+        auto entryRange = entry.getSourceRange();
+        size_t entryIndex = nodes.size();
+        auto key = entry.getKey();
+        if (!key)
+          break;
+        nodes.emplace_back(Node::NK_KeyValue, entryRange.Start.getPointer(),
+                           entryRange.End.getPointer());
+        addYAMLNode(nodes, key);
+        if (auto value = entry.getValue()) {
+          addYAMLNode(nodes, value);
+        } else {
+          nodes.emplace_back(Node::NK_Null, entryRange.Start.getPointer(),
+                             entryRange.Start.getPointer());
+        }
+        nodes[entryIndex].numNodes = nodes.size() - entryIndex;
+      }
+      break;
+    }
+
+    case llvm::yaml::Node::NK_Sequence: {
+      nodes.emplace_back(Node::NK_Sequence, range.Start.getPointer(),
+                         range.End.getPointer());
+      for (auto& item: *static_cast<llvm::yaml::SequenceNode*>(node))
+        addYAMLNode(nodes, &item);
+      break;
+    }
+
+    case llvm::yaml::Node::NK_BlockScalar:
+      nodes.emplace_back(Node::NK_BlockScalar, range.Start.getPointer(),
+                         range.End.getPointer());
+      return;
+
+    case llvm::yaml::Node::NK_Alias:
+      nodes.emplace_back(Node::NK_Alias, range.Start.getPointer(),
+                         range.End.getPointer());
+      return;
+
+    default:
+      nodes.emplace_back(Node::NK_Null, range.Start.getPointer(),
+                         range.End.getPointer());
+      return;
+    }
+    nodes[index].numNodes = nodes.size() - index;
+  }
+};
+
+}
+}
+}
+
+#pragma mark - Document
+
+bool Document::parse(StringRef buffer) {
+  nodes.clear();
+  additionalDocumentRange = llvm::SMRange();
+
+  // Build files average a node for every ten or so bytes.
+  nodes.reserve(buffer.size() / 12);
+  if (!Parser(nodes, buffer).parseDocument()) {
+    nodes.clear();
+    return false;
+  }
+  return true;
+}
+
+void Document::parseYAML(llvm::MemoryBufferRef buffer,
+                         llvm::SourceMgr& sourceMgr) {
+  nodes.clear();
+  additionalDocumentRange = llvm::SMRange();
+
+  // Read the stream, we only expect a single document.
+  llvm::yaml::Stream stream(buffer, sourceMgr);
+  auto it = stream.begin();
+  if (it == stream.end())
+    return;
+  auto root = it->getRoot();
+  if (!root)
+    return;
+  Parser::addYAMLNode(nodes, root);
+
+  if (++it != stream.end()) {
+    if (auto root = it->getRoot()) {
+      additionalDocumentRange = root->getSourceRange();
+    } else {
+      auto at = llvm::SMLoc::getFromPointer(buffer.getBufferEnd());
+      additionalDocumentRange = llvm::SMRange(at, at);
+    }
+  }
+}
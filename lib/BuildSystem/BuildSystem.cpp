@@ -15,6 +15,7 @@
 #include "llbuild/BuildSystem/BuildSystemFrontend.h"
 #include "llbuild/BuildSystem/BuildSystemHandlers.h"
 
+#include "llbuild/Basic/Archive.h"
 #include "llbuild/Basic/CrossPlatformCompatibility.h"
 #include "llbuild/Basic/ExecutionQueue.h"
 #include "llbuild/Basic/FileInfo.h"
@@ -24,6 +25,7 @@
 #include "llbuild/Basic/LLVM.h"
 #include "llbuild/Basic/PlatformUtility.h"
 #include "llbuild/Basic/ShellUtility.h"
+#include "llbuild/Basic/Stat.h"
 #include "llbuild/BuildSystem/BuildFile.h"
 #include "llbuild/BuildSystem/BuildKey.h"
 #include "llbuild/BuildSystem/BuildNode.h"
@@ -45,10 +47,12 @@
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <memory>
 #include <mutex>
 #include <set>
@@ -185,6 +189,9 @@ private:
   /// The name of the main input file.
   std::string mainFilename;
 
+  /// The information of the main input file when it was loaded.
+  FileInfo mainFileInfo;
+
   /// The delegate used for the loading the build file.
   BuildSystemFileDelegate fileDelegate;
 
@@ -197,6 +204,9 @@ private:
   /// The build engine.
   BuildEngine buildEngine;
 
+  /// The attached build database, if any (owned by the build engine).
+  core::BuildDB* attachedDB = nullptr;
+
   /// Flag indicating if the build has been aborted.
   bool buildWasAborted = false;
 
@@ -215,7 +225,8 @@ public:
     if (it != shellHandlers.end()) return it->second.get();
 
     // If missing, check for an extension which can provide it.
-    auto* extension = extensionManager.lookupByCommandPath(toolPath);
+    auto* extension = extensionManager.lookupByCommandPath(toolPath,
+                                                           attachedDB);
     if (!extension) {
       shellHandlers[toolPath] = nullptr; // Negative caching
       return nullptr;
@@ -295,6 +306,7 @@ public:
 
   bool loadDescription(StringRef filename) {
     this->mainFilename = filename;
+    mainFileInfo = getFileSystem().getFileInfo(filename);
 
     auto description = BuildFile(filename, fileDelegate).load();
     if (!description) {
@@ -310,26 +322,102 @@ public:
     buildDescription = std::move(description);
   }
 
-  bool attachDB(StringRef filename, std::string* error_out) {
+  bool reloadDescription() {
+    // Explicit descriptions have no file to reload.
+    if (mainFilename.empty())
+      return true;
+    assert(buildDescription && "invalid reloadDescription() call");
+
+    // Nothing needs to be done if the file is unchanged.
+    auto info = getFileSystem().getFileInfo(mainFilename);
+    if (info == mainFileInfo)
+      return true;
+
+    BuildDescriptionDiff diff;
+    auto description =
+      BuildFile(mainFilename, fileDelegate).reload(*buildDescription, &diff);
+    if (!description) {
+      error(getMainFilename(), "unable to load build file");
+      return false;
+    }
+
+    // The previous description must outlive the rules referring to it.
+    auto previous = std::move(buildDescription);
+    buildDescription = std::move(description);
+    mainFileInfo = info;
+
+    // Replace the rules for the reconstructed parts of the description. The
+    // rules for targets are cheap to create, and always replaced.
+    llvm::StringMap<bool> changedCommands, changedNodes;
+    for (const auto& name: diff.changedCommands)
+      changedCommands[name] = true;
+    for (const auto& name: diff.removedCommands)
+      changedCommands[name] = true;
+    for (const auto& name: diff.changedNodes)
+      changedNodes[name] = true;
+    buildEngine.replaceRules([&](const KeyType& keyData) {
+      auto key = BuildKey::fromData(keyData);
+      switch (key.getKind()) {
+      case BuildKey::Kind::Command:
+        return diff.toolsChanged ||
+          changedCommands.count(key.getCommandName()) != 0;
+      case BuildKey::Kind::CustomTask:
+        return diff.toolsChanged;
+      case BuildKey::Kind::Node:
+        return diff.toolsChanged || changedNodes.count(key.getNodeName()) != 0;
+      case BuildKey::Kind::Target:
+        return true;
+      default:
+        return false;
+      }
+    });
+
+    return true;
+  }
+
+  bool attachDB(StringRef filename, core::SQLiteBuildDBDurability durability,
+                std::string* error_out) {
     // FIXME: How do we pass the client schema version here, if we haven't
     // loaded the file yet.
     std::unique_ptr<core::BuildDB> db(
-                                      core::createSQLiteBuildDB(filename, getMergedSchemaVersion(), /* recreateUnmatchedVersion = */ true, error_out));
+        core::createSQLiteBuildDB(
+            filename, getMergedSchemaVersion(),
+            /* recreateUnmatchedVersion = */ true, error_out, durability));
     if (!db)
       return false;
 
-    return buildEngine.attachDB(std::move(db), error_out);
+    auto* dbPtr = db.get();
+    if (!buildEngine.attachDB(std::move(db), error_out))
+      return false;
+
+    attachedDB = dbPtr;
+    return true;
   }
 
+  core::BuildDB* getAttachedDB() const { return attachedDB; }
+
   bool enableTracing(StringRef filename, std::string* error_out) {
     return buildEngine.enableTracing(filename, error_out);
   }
 
+  void setResultMemoryBudget(uint64_t bytes) {
+    buildEngine.setResultMemoryBudget(bytes);
+  }
+
   /// Build the given key, and return the result and an indication of success.
   llvm::Optional<BuildValue> build(BuildKey key);
   
   bool build(StringRef target);
 
+  /// Resolve the name of a target to build, substituting the default target
+  /// for an empty name, and diagnosing unknown targets.
+  ///
+  /// \returns True if the target is valid.
+  bool resolveTarget(StringRef& target);
+
+  /// Predict the commands a build of the given target would run.
+  bool predict(StringRef target, std::vector<PredictedCommand>* result_out);
+
   void setBuildWasAborted(bool value) {
     buildWasAborted = value;
   }
@@ -393,7 +481,7 @@ class TargetTask : public Task {
     unsigned id = 0;
     for (auto it = target.getNodes().begin(),
            ie = target.getNodes().end(); it != ie; ++it, ++id) {
-      ti.request(BuildKey::makeNode(*it).toData(), id);
+      ti.request(InlineBuildKey::makeNode(*it).toKeyRef(), id);
     }
   }
 
@@ -528,7 +616,7 @@ class StatTask : public Task {
     // Create a weak link on any potential producer nodes so that we get up to
     // date stat information. We always run (see isResultValid) so this should
     // be safe (unlike directory contents where it may not run).
-    ti.mustFollow(BuildKey::makeNode(statnode.getName()).toData());
+    ti.mustFollow(InlineBuildKey::makeNode(statnode.getName()).toKeyRef());
   }
 
   virtual void providePriorValue(TaskInterface,
@@ -580,7 +668,7 @@ class DirectoryInputNodeTask : public Task {
     }
 
     ti.request(BuildKey::makeDirectoryTreeSignature(path,
-                 node.contentExclusionPatterns()).toData(),
+                 node.contentExclusionPatterns()).toKeyRef(),
                /*inputID=*/0);
   }
 
@@ -622,8 +710,9 @@ class DirectoryStructureInputNodeTask : public Task {
     if (path.endswith("/") && path != "/") {
       path = path.substr(0, path.size() - 1);
     }
-    ti.request(BuildKey::makeDirectoryTreeStructureSignature(path).toData(),
-               /*inputID=*/0);
+    ti.request(
+        InlineBuildKey::makeDirectoryTreeStructureSignature(path).toKeyRef(),
+        /*inputID=*/0);
   }
 
   virtual void providePriorValue(TaskInterface,
@@ -698,8 +787,9 @@ class ProducedNodeTask : public Task {
     // Request the producer command.
     if (node.getProducers().size() == 1) {
       producingCommand = node.getProducers()[0];
-      ti.request(BuildKey::makeCommand(producingCommand->getName()).toData(),
-                 /*InputID=*/0);
+      ti.request(
+          InlineBuildKey::makeCommand(producingCommand->getName()).toKeyRef(),
+          /*InputID=*/0);
       return;
     }
 
@@ -793,7 +883,7 @@ class DirectoryContentsTask : public Task {
     // not the second, in particular if rules are added in subsequent builds.
     // Related rdar://problem/30638921
     //
-    ti.request(BuildKey::makeNode(path).toData(), /*inputID=*/0);
+    ti.request(InlineBuildKey::makeNode(path).toKeyRef(), /*inputID=*/0);
   }
 
   virtual void providePriorValue(TaskInterface,
@@ -829,7 +919,7 @@ class DirectoryContentsTask : public Task {
     }
 
     std::vector<std::string> filenames;
-    getContents(path, filenames);
+    getContents(getBuildSystem(ti).getFileSystem(), path, filenames);
 
     // Create the result.
     ti.complete(BuildValue::makeDirectoryContents(directoryValue.getOutputInfo(),
@@ -837,17 +927,10 @@ class DirectoryContentsTask : public Task {
   }
 
 
-  static void getContents(StringRef path, std::vector<std::string>& filenames) {
+  static void getContents(FileSystem& fs, StringRef path,
+                          std::vector<std::string>& filenames) {
     // Get the list of files in the directory.
-    // FIXME: This is not going through the filesystem object. Indeed the fs
-    // object does not currently support directory listing/iteration, but
-    // probably should so that clients may override it.
-    std::error_code ec;
-    for (auto it = llvm::sys::fs::directory_iterator(path, ec),
-         end = llvm::sys::fs::directory_iterator(); it != end;
-         it = it.increment(ec)) {
-      filenames.push_back(llvm::sys::path::filename(it->path()));
-    }
+    (void)fs.getDirectoryContents(path, filenames);
 
     // Order the filenames.
     std::sort(filenames.begin(), filenames.end(),
@@ -884,7 +967,7 @@ public:
       // With filters, we list the current filtered contents and then compare
       // the lists.
       std::vector<std::string> cur;
-      getContents(path, cur);
+      getContents(getBuildSystem(engine).getFileSystem(), path, cur);
       auto prev = value.getDirectoryContents();
 
       if (cur.size() != prev.size())
@@ -941,8 +1024,8 @@ class FilteredDirectoryContentsTask : public Task {
     // Having a 'must scan after' would help with the first rule (mkdir), but
     // not the second, in particular if rules are added in subsequent builds.
     // Related rdar://problem/30638921
-    ti.request(BuildKey::makeNode(path).toData(), /*inputID=*/0);
-    ti.request(BuildKey::makeStat(path).toData(), /*inputID=*/1);
+    ti.request(InlineBuildKey::makeNode(path).toKeyRef(), /*inputID=*/0);
+    ti.request(InlineBuildKey::makeStat(path).toKeyRef(), /*inputID=*/1);
   }
 
   virtual void providePriorValue(TaskInterface,
@@ -978,26 +1061,23 @@ class FilteredDirectoryContentsTask : public Task {
 
     // Collect the filtered contents
     std::vector<std::string> filenames;
-    getFilteredContents(path, filters, filenames);
+    getFilteredContents(getBuildSystem(ti).getFileSystem(), path, filters,
+                        filenames);
 
     // Create the result.
     ti.complete(BuildValue::makeFilteredDirectoryContents(filenames).toData());
   }
 
 
-  static void getFilteredContents(StringRef path, const StringList& filters,
+  static void getFilteredContents(FileSystem& fs, StringRef path,
+                                  const StringList& filters,
                                   std::vector<std::string>& filenames) {
     auto filterStrings = filters.getValues();
 
     // Get the list of files in the directory.
-    // FIXME: This is not going through the filesystem object. Indeed the fs
-    // object does not currently support directory listing/iteration, but
-    // probably should so that clients may override it.
-    std::error_code ec;
-    for (auto it = llvm::sys::fs::directory_iterator(path, ec),
-         end = llvm::sys::fs::directory_iterator(); it != end;
-         it = it.increment(ec)) {
-      std::string filename = llvm::sys::path::filename(it->path());
+    std::vector<std::string> entries;
+    (void)fs.getDirectoryContents(path, entries);
+    for (auto& filename: entries) {
       bool excluded = false;
       for (auto pattern : filterStrings) {
         if (llbuild::basic::sys::filenameMatch(pattern.data(),
@@ -1008,7 +1088,7 @@ class FilteredDirectoryContentsTask : public Task {
         }
       }
       if (!excluded)
-        filenames.push_back(filename);
+        filenames.push_back(std::move(filename));
     }
 
     // Order the filenames.
@@ -1074,10 +1154,12 @@ class DirectoryTreeSignatureTask : public Task {
   virtual void start(TaskInterface ti) override {
     // Ask for the base directory directory contents.
     if (filters.isEmpty()) {
-      ti.request(BuildKey::makeDirectoryContents(path).toData(), /*inputID=*/0);
-    } else {
-      ti.request(BuildKey::makeFilteredDirectoryContents(path, filters).toData(),
+      ti.request(InlineBuildKey::makeDirectoryContents(path).toKeyRef(),
                  /*inputID=*/0);
+    } else {
+      ti.request(
+          BuildKey::makeFilteredDirectoryContents(path, filters).toKeyRef(),
+          /*inputID=*/0);
     }
   }
 
@@ -1105,7 +1187,8 @@ class DirectoryTreeSignatureTask : public Task {
         SmallString<256> childPath{ path };
         llvm::sys::path::append(childPath, filenames[i]);
         childResults.emplace_back(SubpathInfo{ filenames[i], {}, None });
-        ti.request(BuildKey::makeNode(childPath).toData(), /*inputID=*/1 + i);
+        ti.request(InlineBuildKey::makeNode(childPath).toKeyRef(),
+                   /*inputID=*/1 + i);
       }
       return;
     }
@@ -1125,7 +1208,7 @@ class DirectoryTreeSignatureTask : public Task {
           llvm::sys::path::append(childPath, childResult.filename);
 
           ti.request(BuildKey::makeDirectoryTreeSignature(childPath,
-                                                          filters).toData(),
+                                                          filters).toKeyRef(),
                      /*inputID=*/1 + childResults.size() + index);
         }
       }
@@ -1215,7 +1298,8 @@ class DirectoryTreeStructureSignatureTask : public Task {
   
   virtual void start(TaskInterface ti) override {
     // Ask for the base directory directory contents.
-    ti.request(BuildKey::makeDirectoryContents(path).toData(), /*inputID=*/0);
+    ti.request(InlineBuildKey::makeDirectoryContents(path).toKeyRef(),
+               /*inputID=*/0);
   }
 
   virtual void providePriorValue(TaskInterface,
@@ -1240,7 +1324,8 @@ class DirectoryTreeStructureSignatureTask : public Task {
         SmallString<256> childPath{ path };
         llvm::sys::path::append(childPath, filenames[i]);
         childResults.emplace_back(SubpathInfo{ filenames[i], {}, None });
-        ti.request(BuildKey::makeNode(childPath).toData(), /*inputID=*/1 + i);
+        ti.request(InlineBuildKey::makeNode(childPath).toKeyRef(),
+                   /*inputID=*/1 + i);
       }
       return;
     }
@@ -1260,7 +1345,8 @@ class DirectoryTreeStructureSignatureTask : public Task {
           llvm::sys::path::append(childPath, childResult.filename);
         
           ti.request(
-            BuildKey::makeDirectoryTreeStructureSignature(childPath).toData(),
+            InlineBuildKey::makeDirectoryTreeStructureSignature(
+                childPath).toKeyRef(),
             /*inputID=*/1 + childResults.size() + index);
         }
       }
@@ -1457,14 +1543,20 @@ private:
   /// Called to indicate a change in the rule status.
   std::function<void(BuildEngine&, StatusKind)> update;
 
+  /// Called to get the inputs the task is known to request.
+  std::function<void(std::vector<std::pair<KeyType, bool>>&)> knownInputs;
+
 public:
   BuildSystemRule(
     const KeyType& key,
     const basic::CommandSignature& signature,
     std::function<Task*(BuildEngine&)> action,
     std::function<bool(BuildEngine&, const Rule&, const ValueType&)> valid = nullptr,
-    std::function<void(BuildEngine&, StatusKind)> update = nullptr)
-  : Rule(key, signature), action(action), resultValid(valid), update(update)
+    std::function<void(BuildEngine&, StatusKind)> update = nullptr,
+    std::function<void(std::vector<std::pair<KeyType, bool>>&)> knownInputs
+      = nullptr)
+  : Rule(key, signature), action(action), resultValid(valid), update(update),
+    knownInputs(knownInputs)
   { }
 
 public:
@@ -1480,6 +1572,11 @@ public:
   void updateStatus(BuildEngine& engine, Rule::StatusKind status) override {
     if (update) update(engine, status);
   }
+
+  void getKnownInputs(BuildEngine&,
+                      std::vector<std::pair<KeyType, bool>>& inputs) override {
+    if (knownInputs) knownInputs(inputs);
+  }
 };
 
 
@@ -1529,6 +1626,13 @@ std::unique_ptr<Rule> BuildSystemEngineDelegate::lookupRule(const KeyType& keyDa
                                   core::Rule::StatusKind status) {
         return ::getBuildSystem(engine).getDelegate().commandStatusChanged(
             command, convertStatusKind(status));
+      },
+      /*KnownInputs=*/ [command](
+          std::vector<std::pair<KeyType, bool>>& inputs) {
+        std::vector<Node*> nodes;
+        command->getKnownInputs(nodes);
+        for (auto* node: nodes)
+          inputs.push_back({ BuildKey::makeNode(node).toData(), false });
       }
     ));
   }
@@ -1732,6 +1836,15 @@ std::unique_ptr<Rule> BuildSystemEngineDelegate::lookupRule(const KeyType& keyDa
                           const ValueType& value) -> bool {
         return ProducedNodeTask::isResultValid(
             engine, *node, BuildValue::fromData(value));
+      },
+      /*UpdateStatus=*/ nullptr,
+      /*KnownInputs=*/ [node](
+          std::vector<std::pair<KeyType, bool>>& inputs) {
+        // Only nodes with a single producer can be built.
+        if (node->getProducers().size() == 1)
+          inputs.push_back({ BuildKey::makeCommand(
+                               node->getProducers()[0]->getName()).toData(),
+                             false });
       }
     ));
   }
@@ -1783,6 +1896,12 @@ std::unique_ptr<Rule> BuildSystemEngineDelegate::lookupRule(const KeyType& keyDa
                             const ValueType& value) -> bool {
         return TargetTask::isResultValid(
             engine, *target, BuildValue::fromData(value));
+      },
+      /*UpdateStatus=*/ nullptr,
+      /*KnownInputs=*/ [target](
+          std::vector<std::pair<KeyType, bool>>& inputs) {
+        for (auto* node: target->getNodes())
+          inputs.push_back({ BuildKey::makeNode(node).toData(), false });
       }
     ));
   }
@@ -1843,7 +1962,7 @@ llvm::Optional<BuildValue> BuildSystemImpl::build(BuildKey key) {
   return BuildValue::fromData(result);
 }
 
-bool BuildSystemImpl::build(StringRef target) {
+bool BuildSystemImpl::resolveTarget(StringRef& target) {
   // The build description must have been loaded.
   if (!buildDescription) {
     error(getMainFilename(), "no build description loaded");
@@ -1863,9 +1982,37 @@ bool BuildSystemImpl::build(StringRef target) {
     return false;
   }
 
+  return true;
+}
+
+bool BuildSystemImpl::build(StringRef target) {
+  if (!resolveTarget(target))
+    return false;
+
   return build(BuildKey::makeTarget(target)).hasValue();
 }
 
+bool BuildSystemImpl::predict(StringRef target,
+                              std::vector<PredictedCommand>* result_out) {
+  if (!resolveTarget(target))
+    return false;
+
+  // Only command rules run anything; the other rules are bookkeeping.
+  auto& commands = getBuildDescription().getCommands();
+  result_out->clear();
+  for (auto& rule: buildEngine.predict(BuildKey::makeTarget(target).toData())) {
+    auto key = BuildKey::fromData(rule.key);
+    if (!key.isCommand())
+      continue;
+    auto it = commands.find(key.getCommandName());
+    if (it == commands.end())
+      continue;
+    result_out->push_back({ it->second.get(), rule.reason,
+                            std::move(rule.input) });
+  }
+  return true;
+}
+
 #pragma mark - PhonyTool implementation
 
 class PhonyCommand : public ExternalCommand {
@@ -2042,7 +2189,8 @@ class ClangShellCommand : public ExternalCommand {
       virtual void actOnRuleDependency(const char* dependency,
                                        uint64_t length,
                                        const StringRef unescapedWord) override {
-        ti.discoveredDependency(BuildKey::makeNode(unescapedWord).toData());
+        ti.discoveredDependency(
+            InlineBuildKey::makeNode(unescapedWord).toKeyRef());
       }
 
       virtual void actOnRuleStart(const char* name, uint64_t length,
@@ -2608,7 +2756,8 @@ public:
         // Only process dependencies for the first rule (the output file), the
         // rest are identical.
         if (ruleNumber == 0) {
-          ti.discoveredDependency(BuildKey::makeNode(unescapedWord).toData());
+          ti.discoveredDependency(
+              InlineBuildKey::makeNode(unescapedWord).toKeyRef());
         }
       }
 
@@ -2640,7 +2789,8 @@ public:
     // cheap.
     auto getVersionKey = BuildKey::makeCustomTask(
         "swift-get-version", executable);
-    ti.request(getVersionKey.toData(), core::BuildEngine::kMaximumInputID - 1);
+    ti.request(getVersionKey.toKeyRef(),
+               core::BuildEngine::kMaximumInputID - 1);
   }
 
   /// Overridden to access the Swift compiler version.
@@ -3073,7 +3223,7 @@ class SymlinkCommand : public Command {
     // FIXME: We should make this explicit once we have actual support for must
     // follow inputs.
     for (auto it = inputs.begin(), ie = inputs.end(); it != ie; ++it) {
-      ti.mustFollow(BuildKey::makeNode(*it).toData());
+      ti.mustFollow(InlineBuildKey::makeNode(*it).toKeyRef());
     }
   }
 
@@ -3173,12 +3323,258 @@ public:
   }
 };
 
+#pragma mark - CopyTool implementation
+
+class CopyCommand : public ExternalCommand {
+  /// The path of the file or directory to copy.
+  std::string sourcePath;
+
+  /// The path to copy the source to.
+  std::string destinationPath;
+
+  virtual void startExternalCommand(BuildSystem&, TaskInterface ti) override {
+    return;
+  }
+
+  virtual void provideValueExternalCommand(
+      BuildSystem&,
+      TaskInterface ti,
+      uintptr_t inputID,
+      const BuildValue& value) override {
+    // Should never get here, since we're not requesting inputs in start.
+    assert(0 && "unexpected API call");
+    return;
+  }
+
+  /// Check whether the file at \p destination already has the same
+  /// permissions and contents as the regular file at \p source.
+  ///
+  /// The contents are only read once the stat information matches, but the
+  /// timestamps are not trusted, since a source may be replaced by different
+  /// contents with an older timestamp (e.g., restored from an archive).
+  static bool isUpToDateCopy(FileSystem& fs, const std::string& source,
+                             const FileInfo& sourceInfo,
+                             const std::string& destination) {
+    auto destinationInfo = fs.getFileInfo(destination);
+    if (destinationInfo.isMissing() ||
+        destinationInfo.mode != sourceInfo.mode ||
+        destinationInfo.size != sourceInfo.size)
+      return false;
+
+    // The stat information matches, confirm the contents do too.
+    auto getDigest = [&](const std::string& path,
+                         llvm::MD5::MD5Result& result) {
+      auto contents = fs.getFileContents(path);
+      if (!contents)
+        return false;
+      llvm::MD5 hasher;
+      hasher.update(contents->getBuffer());
+      hasher.final(result);
+      return true;
+    };
+    llvm::MD5::MD5Result sourceDigest, destinationDigest;
+    return getDigest(source, sourceDigest) &&
+           getDigest(destination, destinationDigest) &&
+           sourceDigest == destinationDigest;
+  }
+
+  /// Recreate the symbolic link at \p source as \p destination.
+  static bool copySymlink(FileSystem& fs, const std::string& source,
+                          const std::string& destination,
+                          std::string* error_out) {
+    std::string target;
+    if (!fs.readSymlink(source, target)) {
+      *error_out = "unable to read symbolic link '" + source + "'";
+      return false;
+    }
+
+    // Leave an identical link untouched.
+    std::string existingTarget;
+    if (fs.readSymlink(destination, existingTarget) &&
+        existingTarget == target)
+      return true;
+
+    (void) fs.remove(destination);
+    if (!fs.createSymlink(target, destination)) {
+      *error_out = "unable to create symbolic link '" + destination + "'";
+      return false;
+    }
+    return true;
+  }
+
+  /// Copy the item at \p source to \p destination, recursing into
+  /// directories.
+  ///
+  /// A symbolic link given as \p source is followed, but symbolic links
+  /// found inside a copied directory are copied as links, so a link cycle
+  /// cannot cause unbounded recursion.
+  static bool copyItem(FileSystem& fs, const std::string& source,
+                       const std::string& destination,
+                       std::string* error_out) {
+    auto info = fs.getFileInfo(source);
+    if (info.isMissing()) {
+      *error_out = "unable to copy missing input '" + source + "'";
+      return false;
+    }
+
+    if (!info.isDirectory()) {
+      // Leave the destination untouched if it is already a copy, so its
+      // timestamp does not invalidate downstream commands.
+      if (isUpToDateCopy(fs, source, info, destination))
+        return true;
+      if (!fs.copyFile(source, destination)) {
+        *error_out = "unable to copy '" + source + "' to '" + destination + "'";
+        return false;
+      }
+      return true;
+    }
+
+    if (!fs.createDirectories(destination)) {
+      *error_out = "unable to create directory '" + destination + "'";
+      return false;
+    }
+    std::vector<std::string> names;
+    if (!fs.getDirectoryContents(source, names)) {
+      *error_out = "unable to read directory '" + source + "'";
+      return false;
+    }
+    std::sort(names.begin(), names.end());
+    for (const auto& name: names) {
+      SmallString<256> childSource(source);
+      llvm::sys::path::append(childSource, name);
+      SmallString<256> childDestination(destination);
+      llvm::sys::path::append(childDestination, name);
+
+      if (S_ISLNK(fs.getLinkInfo(childSource.str()).mode)) {
+        if (!copySymlink(fs, childSource.str(), childDestination.str(),
+                         error_out))
+          return false;
+        continue;
+      }
+      if (!copyItem(fs, childSource.str(), childDestination.str(), error_out))
+        return false;
+    }
+    return true;
+  }
+
+  virtual void executeExternalCommand(
+      BuildSystem& system,
+      TaskInterface ti,
+      QueueJobContext* context,
+      llvm::Optional<ProcessCompletionFn> completionFn) override {
+    // Copy in process, on the lane executing this command.
+    std::string error;
+    if (!copyItem(system.getFileSystem(), sourcePath, destinationPath,
+                  &error)) {
+      system.getDelegate().commandHadError(this, error);
+      if (completionFn.hasValue())
+        completionFn.getValue()(ProcessStatus::Failed);
+      return;
+    }
+    if (completionFn.hasValue())
+      completionFn.getValue()(ProcessStatus::Succeeded);
+  }
+
+  virtual void getShortDescription(SmallVectorImpl<char> &result) const override {
+    if (getDescription().empty()) {
+      llvm::raw_svector_ostream(result) << "Copying " << destinationPath;
+    } else {
+      llvm::raw_svector_ostream(result) << getDescription();
+    }
+  }
+
+  virtual void getVerboseDescription(SmallVectorImpl<char> &result) const override {
+    llvm::raw_svector_ostream os(result);
+    os << "cp -R ";
+    appendShellEscapedString(os, sourcePath);
+    os << ' ';
+    appendShellEscapedString(os, destinationPath);
+  }
+
+  virtual void configureInputs(const ConfigureContext& ctx,
+                               const std::vector<Node*>& value) override {
+    ExternalCommand::configureInputs(ctx, value);
+
+    // The first concrete input is the item to copy, any others are only used
+    // for ordering.
+    for (const auto& input: getInputs()) {
+      if (!input->isVirtual()) {
+        sourcePath = input->getName();
+        break;
+      }
+    }
+    if (sourcePath.empty()) {
+      ctx.error("missing expected input");
+    }
+  }
+
+  virtual void configureOutputs(const ConfigureContext& ctx,
+                                const std::vector<Node*>& value) override {
+    ExternalCommand::configureOutputs(ctx, value);
+
+    for (const auto& output: getOutputs()) {
+      if (!output->isVirtual()) {
+        if (destinationPath.empty()) {
+          destinationPath = output->getName();
+        } else {
+          ctx.error("unexpected explicit output: " + output->getName());
+        }
+      }
+    }
+    if (destinationPath.empty()) {
+      ctx.error("missing expected output");
+    }
+  }
+
+public:
+  using ExternalCommand::ExternalCommand;
+};
+
+class CopyTool : public Tool {
+public:
+  using Tool::Tool;
+
+  virtual bool configureAttribute(const ConfigureContext& ctx, StringRef name,
+                                  StringRef value) override {
+    // No supported attributes.
+    ctx.error("unexpected attribute: '" + name + "'");
+    return false;
+  }
+  virtual bool configureAttribute(const ConfigureContext& ctx, StringRef name,
+                                  ArrayRef<StringRef> values) override {
+    // No supported attributes.
+    ctx.error("unexpected attribute: '" + name + "'");
+    return false;
+  }
+  virtual bool configureAttribute(
+      const ConfigureContext& ctx, StringRef name,
+      ArrayRef<std::pair<StringRef, StringRef>> values) override {
+    // No supported attributes.
+    ctx.error("unexpected attribute: '" + name + "'");
+    return false;
+  }
+
+  virtual std::unique_ptr<Command> createCommand(StringRef name) override {
+    return llvm::make_unique<CopyCommand>(name);
+  }
+};
+
 #pragma mark - ArchiveTool implementation
 
 class ArchiveShellCommand : public ExternalCommand {
 
   std::string archiveName;
   std::vector<std::string> archiveInputs;
+  /// The external archiver to run, if the archive is not written in process.
+  std::string archiver;
+  /// The archiver to fall back to if an input cannot be indexed in process and
+  /// no \see archiver is set, from the environment.
+  std::string defaultArchiver = getDefaultArchiver();
+
+  static std::string getDefaultArchiver() {
+    const char* ar = std::getenv("AR");
+    return ar && *ar ? ar : "ar";
+  }
 
   virtual void startExternalCommand(BuildSystem&, TaskInterface ti) override {
     return;
@@ -3195,10 +3591,32 @@ class ArchiveShellCommand : public ExternalCommand {
   }
 
   virtual void executeExternalCommand(
-      BuildSystem&,
+      BuildSystem& system,
       TaskInterface ti,
       QueueJobContext* context,
       llvm::Optional<ProcessCompletionFn> completionFn) override {
+    // Write the archive in process, unless a specific archiver was requested.
+    if (archiver.empty()) {
+      std::string error;
+      switch (writeArchive(archiveName, archiveInputs, getHostArchiveFormat(),
+                           &error)) {
+      case ArchiveWriteStatus::Written:
+      case ArchiveWriteStatus::Updated:
+      case ArchiveWriteStatus::Unchanged:
+        if (completionFn.hasValue())
+          completionFn.getValue()(ProcessStatus::Succeeded);
+        return;
+      case ArchiveWriteStatus::Failed:
+        system.getDelegate().commandHadError(this, error);
+        if (completionFn.hasValue())
+          completionFn.getValue()(ProcessStatus::Failed);
+        return;
+      case ArchiveWriteStatus::Unsupported:
+        // Fall back to the external archiver.
+        break;
+      }
+    }
+
     // First delete the current archive
     // TODO instead insert, update and remove files from the archive
     if (llvm::sys::fs::remove(archiveName, /*IgnoreNonExisting*/ true)) {
@@ -3228,6 +3646,13 @@ class ArchiveShellCommand : public ExternalCommand {
 
   virtual void getVerboseDescription(SmallVectorImpl<char> &result) const override {
     llvm::raw_svector_ostream stream(result);
+    if (archiver.empty()) {
+      stream << "archive " << archiveName;
+      for (const auto& input: archiveInputs)
+        stream << " " << input;
+      stream << " (in-process)";
+      return;
+    }
     bool first = true;
     for (const auto& arg: getArgs()) {
       if (!first) {
@@ -3237,6 +3662,20 @@ class ArchiveShellCommand : public ExternalCommand {
       stream << arg;
     }
   }
+
+  virtual CommandSignature getSignature() const override {
+    return ExternalCommand::getSignature().combine(archiver)
+      .combine(defaultArchiver);
+  }
+
+  virtual bool configureAttribute(const ConfigureContext& ctx, StringRef name,
+                                  StringRef value) override {
+    if (name == "archiver") {
+      archiver = value;
+      return true;
+    }
+    return ExternalCommand::configureAttribute(ctx, name, value);
+  }
   
   virtual void configureInputs(const ConfigureContext& ctx,
                                 const std::vector<Node*>& value) override {
@@ -3270,12 +3709,11 @@ class ArchiveShellCommand : public ExternalCommand {
     }
   }
 
+  /// Get the arguments of the external archiver, which is also used if an
+  /// input cannot be indexed in process.
   std::vector<std::string> getArgs() const {
     std::vector<std::string> args;
-    if (const char *ar = std::getenv("AR"))
-      args.push_back(std::string(ar));
-    else
-      args.push_back("ar");
+    args.push_back(archiver.empty() ? defaultArchiver : archiver);
     args.push_back("cr");
     args.push_back(archiveName);
     args.insert(args.end(), archiveInputs.begin(), archiveInputs.end());
@@ -3793,6 +4231,8 @@ BuildSystemFileDelegate::lookupTool(StringRef name) {
     return llvm::make_unique<MkdirTool>(name);
   } else if (name == "symlink") {
     return llvm::make_unique<SymlinkTool>(name);
+  } else if (name == "copy") {
+    return llvm::make_unique<CopyTool>(name);
   } else if (name == "archive") {
     return llvm::make_unique<ArchiveTool>(name);
   } else if (name == "shared-library") {
@@ -3848,6 +4288,10 @@ bool BuildSystem::loadDescription(StringRef mainFilename) {
   return static_cast<BuildSystemImpl*>(impl)->loadDescription(mainFilename);
 }
 
+bool BuildSystem::reloadDescription() {
+  return static_cast<BuildSystemImpl*>(impl)->reloadDescription();
+}
+
 void BuildSystem::loadDescription(
     std::unique_ptr<BuildDescription> description) {
   return static_cast<BuildSystemImpl*>(impl)->loadDescription(
@@ -3856,7 +4300,15 @@ void BuildSystem::loadDescription(
 
 bool BuildSystem::attachDB(StringRef path,
                                 std::string* error_out) {
-  return static_cast<BuildSystemImpl*>(impl)->attachDB(path, error_out);
+  return static_cast<BuildSystemImpl*>(impl)->attachDB(
+      path, core::SQLiteBuildDBDurability::Strict, error_out);
+}
+
+bool BuildSystem::attachDB(StringRef path,
+                           core::SQLiteBuildDBDurability durability,
+                           std::string* error_out) {
+  return static_cast<BuildSystemImpl*>(impl)->attachDB(path, durability,
+                                                       error_out);
 }
 
 bool BuildSystem::enableTracing(StringRef path,
@@ -3864,6 +4316,10 @@ bool BuildSystem::enableTracing(StringRef path,
   return static_cast<BuildSystemImpl*>(impl)->enableTracing(path, error_out);
 }
 
+void BuildSystem::setResultMemoryBudget(uint64_t bytes) {
+  static_cast<BuildSystemImpl*>(impl)->setResultMemoryBudget(bytes);
+}
+
 llvm::Optional<BuildValue> BuildSystem::build(BuildKey key) {
   return static_cast<BuildSystemImpl*>(impl)->build(key);
 }
@@ -3872,6 +4328,31 @@ bool BuildSystem::build(StringRef name) {
   return static_cast<BuildSystemImpl*>(impl)->build(name);
 }
 
+bool BuildSystem::predict(StringRef name,
+                          std::vector<PredictedCommand>* result_out) {
+  return static_cast<BuildSystemImpl*>(impl)->predict(name, result_out);
+}
+
+bool BuildSystem::setCommandOutput(Command* command, StringRef output,
+                                   std::string* error_out) {
+  auto* db = static_cast<BuildSystemImpl*>(impl)->getAttachedDB();
+  if (!db)
+    return false;
+  return db->setCommandOutput(
+      BuildKey::makeCommand(command->getName()).toData(), output, error_out);
+}
+
+bool BuildSystem::lookupCommandOutput(Command* command,
+                                      std::string* output_out,
+                                      std::string* error_out) {
+  auto* db = static_cast<BuildSystemImpl*>(impl)->getAttachedDB();
+  if (!db)
+    return false;
+  return db->lookupCommandOutput(
+      BuildKey::makeCommand(command->getName()).toData(), output_out,
+      error_out);
+}
+
 void BuildSystem::cancel() {
   if (impl) {
     static_cast<BuildSystemImpl*>(impl)->cancel();
@@ -12,9 +12,13 @@
 
 #include "llbuild/BuildSystem/BuildSystemExtensions.h"
 
+#include "llbuild/Basic/BinaryCoding.h"
+#include "llbuild/Basic/FileInfo.h"
 #include "llbuild/Basic/Subprocess.h"
 #include "llbuild/Basic/PlatformUtility.h"
+#include "llbuild/Core/BuildDB.h"
 
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/raw_ostream.h"
 
@@ -29,30 +33,35 @@ BuildSystemExtension::~BuildSystemExtension() {}
 #pragma mark - BuildSystemExtensionManager implementation
 
 BuildSystemExtension*
-BuildSystemExtensionManager::lookupByCommandPath(StringRef path) {
-  std::lock_guard<std::mutex> guard(extensionsLock);
-
-  // Check the cache.
-  auto it = extensions.find(path);
-  if (it != extensions.end()) return it->second.get();
-
-  // Register negative hit, unless we succeed.
-  extensions[path] = nullptr;
-
-  // If missing, look for an extension for this path.
-  //
-  // Currently, extensions are discovered by expecting that a command has an
-  // adjacent "...-for-llbuild" binary which can be queried for info.
-  SmallString<256> infoPath{ path };
-  infoPath += "-for-llbuild";
-  if (!llvm::sys::fs::exists(infoPath)) {
-    return {};
+BuildSystemExtensionManager::lookupByCommandPath(StringRef path,
+                                                 core::BuildDB* db) {
+  // Find or create the entry for this path, without performing any discovery
+  // while holding the lock.
+  Entry* entry;
+  {
+    std::lock_guard<std::mutex> guard(extensionsLock);
+    auto& slot = extensions[path];
+    if (!slot)
+      slot = llvm::make_unique<Entry>();
+    entry = slot.get();
   }
 
-  // If the path exists, then query it to find the actual extension library.
+  // Discover the extension, if necessary. Concurrent lookups of the same path
+  // block here until the first one completes.
+  std::call_once(entry->discovered, [&]() {
+      entry->extension = discover(path, db);
+    });
+  return entry->extension.get();
+}
+
+/// Query an extension info tool for the path to its extension library.
+///
+/// \returns True on success, with the path in \arg extensionPath_out.
+static bool queryExtensionPath(StringRef infoPath,
+                               std::string& extensionPath_out) {
   struct CapturingProcessDelegate: ProcessDelegate {
     SmallString<1024> output;
-    bool success;
+    bool success = false;
     
     virtual void processStarted(ProcessContext* ctx, ProcessHandle handle) {}
 
@@ -86,11 +95,109 @@ BuildSystemExtensionManager::lookupByCommandPath(StringRef path) {
 
   // The output is expected to be the exact path to the extension (no extra
   // whitespace, etc.).
-  auto extensionPath = delegate.output;
   if (!delegate.success || !llvm::sys::fs::exists(infoPath)) {
+    return false;
+  }
+
+  extensionPath_out = delegate.output.str();
+  return true;
+}
+
+/// The version of the persisted extension query results, which must be bumped
+/// whenever their encoding changes.
+static const uint32_t extensionInfoVersion = 1;
+
+/// Decode a persisted extension query result.
+///
+/// The value may have been written by another version of llbuild, or be
+/// truncated, so its layout is validated before anything is decoded.
+///
+/// \returns True on success, or false if the value should be treated as a
+/// cache miss.
+static bool decodeExtensionInfo(StringRef value, FileInfo& info_out,
+                                bool& success_out,
+                                std::string& extensionPath_out) {
+  // The value is the version, the tool file info, the success flag and the
+  // length of the extension path, followed by the path.
+  BinaryEncoder header;
+  header.write(extensionInfoVersion);
+  header.write(FileInfo());
+  header.write(false);
+  header.write(uint32_t(0));
+  if (value.size() < header.size())
+    return false;
+
+  BinaryDecoder decoder(value);
+  uint32_t version, pathLength;
+  decoder.read(version);
+  if (version != extensionInfoVersion)
+    return false;
+  decoder.read(info_out);
+  decoder.read(success_out);
+  decoder.read(pathLength);
+  if (value.size() - header.size() != pathLength)
+    return false;
+  StringRef extensionPath;
+  decoder.readBytes(pathLength, extensionPath);
+  decoder.finish();
+  extensionPath_out = extensionPath;
+  return true;
+}
+
+std::unique_ptr<BuildSystemExtension>
+BuildSystemExtensionManager::discover(StringRef path, core::BuildDB* db) {
+  // Look for an extension for this path.
+  //
+  // Currently, extensions are discovered by expecting that a command has an
+  // adjacent "...-for-llbuild" binary which can be queried for info.
+  SmallString<256> infoPath{ path };
+  infoPath += "-for-llbuild";
+  auto infoFileInfo = FileInfo::getInfoForPath(infoPath.str().str());
+  if (infoFileInfo.isMissing()) {
     return {};
   }
 
+  // Check if we have a persisted query result for this exact info tool, this
+  // avoids spawning the tool on every build invocation.
+  //
+  // The persisted value is the encoded file info of the tool, a success flag,
+  // and the extension path. A value which cannot be decoded is ignored, and
+  // replaced once the tool has been queried.
+  std::string extensionPath;
+  bool found = false;
+  std::string cacheKey = (Twine("extension-info:") + infoPath).str();
+  if (db) {
+    std::string value, error;
+    FileInfo cachedInfo;
+    bool cachedSuccess;
+    if (db->lookupAuxiliaryValue(cacheKey, &value, &error) &&
+        decodeExtensionInfo(value, cachedInfo, cachedSuccess, extensionPath)) {
+      if (cachedInfo == infoFileInfo) {
+        if (!cachedSuccess)
+          return {};
+        found = true;
+      }
+    }
+  }
+
+  // If the path exists, then query it to find the actual extension library.
+  if (!found) {
+    bool success = queryExtensionPath(infoPath, extensionPath);
+    if (db) {
+      BinaryEncoder encoder;
+      encoder.write(extensionInfoVersion);
+      encoder.write(infoFileInfo);
+      encoder.write(success);
+      encoder.write(success ? extensionPath : std::string());
+      std::string error;
+      (void)db->setAuxiliaryValue(
+          cacheKey, StringRef((const char*)encoder.data(), encoder.size()),
+          &error);
+    }
+    if (!success)
+      return {};
+  }
+
   // Load the plugin.
   auto handle = sys::OpenLibrary(extensionPath.c_str());
   if (handle == nullptr)
@@ -114,7 +221,5 @@ BuildSystemExtensionManager::lookupByCommandPath(StringRef path) {
     return {};
   }
 
-  extensions[path] = std::unique_ptr<BuildSystemExtension>(extension);
-  return extension;
+  return std::unique_ptr<BuildSystemExtension>(extension);
 }
-
@@ -12,11 +12,13 @@
 
 #include "llbuild/BuildSystem/BuildSystemFrontend.h"
 
+#include "llbuild/Basic/Clock.h"
 #include "llbuild/Basic/Defer.h"
 #include "llbuild/Basic/ExecutionQueue.h"
 #include "llbuild/Basic/FileSystem.h"
 #include "llbuild/Basic/LLVM.h"
 #include "llbuild/Basic/PlatformUtility.h"
+#include "llbuild/Basic/Tracing.h"
 #include "llbuild/BuildSystem/BuildDescription.h"
 #include "llbuild/BuildSystem/BuildFile.h"
 #include "llbuild/BuildSystem/BuildKey.h"
@@ -51,11 +53,19 @@ void BuildSystemInvocation::getUsage(int optionWidth, raw_ostream& os) {
     { "-C <PATH>, --chdir <PATH>", "change directory to PATH before building" },
     { "--no-db", "disable use of a build database" },
     { "--db <PATH>", "enable building against the database at PATH" },
+    { "--db-durability <POLICY>",
+      "set the database durability (strict, normal or fast)" },
     { "-f <PATH>", "load the build task file at PATH" },
     { "--serial", "do not build in parallel" },
     { "--scheduler <SCHEDULER>", "set scheduler algorithm" },
     { "-j,--jobs <JOBS>", "set how many concurrent jobs (lanes) to run" },
+    { "--numa-lanes", "divide the lanes across the host NUMA nodes" },
+    { "--pin-engine-thread", "pin the build engine to the first NUMA node" },
+    { "--jobserver", "share the lanes with subprocesses as a make jobserver" },
     { "-v, --verbose", "show verbose status information" },
+    { "--time-startup", "report the time spent in each startup phase" },
+    { "--predict", "report the commands the build would run, and why" },
+    { "--replay-output", "replay the stored output of up-to-date commands" },
     { "--trace <PATH>", "trace build engine operation to PATH" },
   };
   
@@ -103,6 +113,16 @@ void BuildSystemInvocation::parse(llvm::ArrayRef<std::string> args,
       }
       dbPath = args[0];
       args = args.slice(1);
+    } else if (option == "--db-durability") {
+      if (args.empty()) {
+        error("missing argument to '" + option + "'");
+        break;
+      }
+      if (!core::parseSQLiteBuildDBDurability(args[0], &dbDurability)) {
+        error("unknown database durability '" + args[0] + "'");
+        break;
+      }
+      args = args.slice(1);
     } else if (option == "-C" || option == "--chdir") {
       if (args.empty()) {
         error("missing argument to '" + option + "'");
@@ -151,8 +171,20 @@ void BuildSystemInvocation::parse(llvm::ArrayRef<std::string> args,
       if (*end != '\0') {
         error("invalid argument to '-j'");
       }
+    } else if (option == "--numa-lanes") {
+      partitionLanesByNUMANode = true;
+    } else if (option == "--pin-engine-thread") {
+      pinEngineThread = true;
+    } else if (option == "--jobserver") {
+      useJobServer = true;
     } else if (option == "-v" || option == "--verbose") {
       showVerboseStatus = true;
+    } else if (option == "--time-startup") {
+      showStartupTiming = true;
+    } else if (option == "--predict") {
+      predictOnly = true;
+    } else if (option == "--replay-output") {
+      replayOutput = true;
     } else if (option == "--trace") {
       if (args.empty()) {
         error("missing argument to '" + option + "'");
@@ -167,6 +199,45 @@ void BuildSystemInvocation::parse(llvm::ArrayRef<std::string> args,
   }
 }
 
+/// Write a description of a build key, for use in diagnostics.
+static void describeKey(raw_ostream& os, const BuildKey& key) {
+  switch (key.getKind()) {
+    case BuildKey::Kind::Unknown:
+      os << "((unknown))";
+      break;
+    case BuildKey::Kind::Command:
+      os << "command '" << key.getCommandName() << "'";
+      break;
+    case BuildKey::Kind::CustomTask:
+      os << "custom task '" << key.getCustomTaskName() << "'";
+      break;
+    case BuildKey::Kind::DirectoryContents:
+      os << "directory-contents '" << key.getDirectoryPath() << "'";
+      break;
+    case BuildKey::Kind::FilteredDirectoryContents:
+      os << "filtered-directory-contents '"
+      << key.getFilteredDirectoryPath() << "'";
+      break;
+    case BuildKey::Kind::DirectoryTreeSignature:
+      os << "directory-tree-signature '"
+      << key.getDirectoryTreeSignaturePath() << "'";
+      break;
+    case BuildKey::Kind::DirectoryTreeStructureSignature:
+      os << "directory-tree-structure-signature '"
+      << key.getDirectoryPath() << "'";
+      break;
+    case BuildKey::Kind::Node:
+      os << "node '" << key.getNodeName() << "'";
+      break;
+    case BuildKey::Kind::Stat:
+      os << "stat '" << key.getStatName() << "'";
+      break;
+    case BuildKey::Kind::Target:
+      os << "target '" << key.getTargetName() << "'";
+      break;
+  }
+}
+
 std::string BuildSystemInvocation::formatDetectedCycle(const std::vector<core::Rule*>& cycle) {
   // Compute a description of the cycle path.
   SmallString<256> message;
@@ -178,42 +249,7 @@ std::string BuildSystemInvocation::formatDetectedCycle(const std::vector<core::R
       os << " -> ";
 
     // Convert to a build key.
-    auto key = BuildKey::fromData(rule->key);
-    switch (key.getKind()) {
-      case BuildKey::Kind::Unknown:
-        os << "((unknown))";
-        break;
-      case BuildKey::Kind::Command:
-        os << "command '" << key.getCommandName() << "'";
-        break;
-      case BuildKey::Kind::CustomTask:
-        os << "custom task '" << key.getCustomTaskName() << "'";
-        break;
-      case BuildKey::Kind::DirectoryContents:
-        os << "directory-contents '" << key.getDirectoryPath() << "'";
-        break;
-      case BuildKey::Kind::FilteredDirectoryContents:
-        os << "filtered-directory-contents '"
-        << key.getFilteredDirectoryPath() << "'";
-        break;
-      case BuildKey::Kind::DirectoryTreeSignature:
-        os << "directory-tree-signature '"
-        << key.getDirectoryTreeSignaturePath() << "'";
-        break;
-      case BuildKey::Kind::DirectoryTreeStructureSignature:
-        os << "directory-tree-structure-signature '"
-        << key.getDirectoryPath() << "'";
-        break;
-      case BuildKey::Kind::Node:
-        os << "node '" << key.getNodeName() << "'";
-        break;
-      case BuildKey::Kind::Stat:
-        os << "stat '" << key.getStatName() << "'";
-        break;
-      case BuildKey::Kind::Target:
-        os << "target '" << key.getTargetName() << "'";
-        break;
-    }
+    describeKey(os, BuildKey::fromData(rule->key));
     first = false;
   }
 
@@ -234,6 +270,10 @@ class BuildSystemFrontendExecutionQueueDelegate
   bool showVerboseOutput() const;
 
   BuildSystem& getSystem() const;
+
+  void captureOutput(Command* command, StringRef data);
+
+  void persistOutput(Command* command);
     
 public:
   BuildSystemFrontendExecutionQueueDelegate(
@@ -269,6 +309,7 @@ public:
   
   virtual void processHadOutput(ProcessContext* command, ProcessHandle handle,
                                 StringRef data) override {
+    captureOutput(reinterpret_cast<Command*>(command), data);
     static_cast<BuildSystemFrontendDelegate*>(&getSystem().getDelegate())->
       commandProcessHadOutput(
           reinterpret_cast<Command*>(command),
@@ -278,6 +319,10 @@ public:
 
   virtual void processFinished(ProcessContext* command, ProcessHandle handle,
                                const ProcessResult& result) override {
+    // Persist the output of the command, so it can be replayed while the
+    // command stays up to date. The output of cancelled processes is partial.
+    if (result.status != ProcessStatus::Cancelled)
+      persistOutput(reinterpret_cast<Command*>(command));
     static_cast<BuildSystemFrontendDelegate*>(&getSystem().getDelegate())->
       commandProcessFinished(
           reinterpret_cast<Command*>(command),
@@ -303,6 +348,13 @@ struct BuildSystemFrontendDelegateImpl {
   /// The lock protecting `processOutputBuffers`.
   std::mutex processOutputBuffersMutex;
 
+  /// The output captured from each command run by the current build, to be
+  /// persisted for replay.
+  llvm::DenseMap<Command*, std::string> capturedOutputs;
+
+  /// The lock protecting `capturedOutputs`.
+  std::mutex capturedOutputsMutex;
+
 
 public:
   BuildSystemFrontendDelegateImpl(llvm::SourceMgr& sourceMgr)
@@ -350,10 +402,31 @@ public:
   }
 
   void resetAfterBuild() {
+    {
+      std::lock_guard<std::mutex> lock(delegateImpl->capturedOutputsMutex);
+      delegateImpl->capturedOutputs.clear();
+    }
     std::lock_guard<std::mutex> lock(stateMutex);
     cancelled = false;
   }
 
+  /// Measures one phase of initialization, which is traced and reported to
+  /// the delegate when the phase goes out of scope.
+  class StartupPhase {
+    BuildSystemFrontendDelegate& delegate;
+    const char* name;
+    TracingStartupPhase tracing;
+    Clock::Timestamp start;
+
+  public:
+    StartupPhase(BuildSystemFrontendDelegate& delegate, const char* name)
+        : delegate(delegate), name(name), tracing(name), start(Clock::now()) {}
+
+    ~StartupPhase() {
+      delegate.startupPhaseCompleted(name, Clock::now() - start);
+    }
+  };
+
   bool initialize() {
     std::lock_guard<std::mutex> lock(stateMutex);
 
@@ -364,7 +437,15 @@ public:
       return false;
 
     if (system) {
-      // Already exists, just reset state
+      // Already exists, just pick up any changes to the build file and reset
+      // state.
+      {
+        StartupPhase phase(delegate, "reload-build-file");
+        if (!system->reloadDescription()) {
+          system = nullptr;
+          return false;
+        }
+      }
       system->resetForBuild();
       return true;
     }
@@ -383,16 +464,23 @@ public:
     }
 
     // Create the build system.
-    system = std::make_unique<BuildSystem>(delegate, std::move(fileSystem));
+    {
+      StartupPhase phase(delegate, "create-build-system");
+      system = std::make_unique<BuildSystem>(delegate, std::move(fileSystem));
+    }
 
     // Load the build file.
-    if (!system->loadDescription(invocation.buildFilePath)) {
-      system = nullptr;
-      return false;
+    {
+      StartupPhase phase(delegate, "load-build-file");
+      if (!system->loadDescription(invocation.buildFilePath)) {
+        system = nullptr;
+        return false;
+      }
     }
 
     // Enable tracing, if requested.
     if (!invocation.traceFilePath.empty()) {
+      StartupPhase phase(delegate, "enable-tracing");
       const auto dir = llvm::sys::path::parent_path(invocation.traceFilePath);
       if (!system->getFileSystem().createDirectories(dir) &&
           !system->getFileSystem().getFileInfo(dir).isDirectory()) {
@@ -409,8 +497,11 @@ public:
       }
     }
 
-    // Attach the database.
+    system->setResultMemoryBudget(invocation.resultMemoryBudget);
+
+    // Attach the database, which opens it and checks its schema.
     if (!invocation.dbPath.empty()) {
+      StartupPhase phase(delegate, "attach-database");
       // If the database path is relative, always make it relative to the input
       // file.
       SmallString<256> tmp;
@@ -424,7 +515,7 @@ public:
       }
 
       std::string error;
-      if (!system->attachDB(dbPath, &error)) {
+      if (!system->attachDB(dbPath, invocation.dbDurability, &error)) {
         delegate.error(Twine("unable to attach DB: ") + error);
         system = nullptr;
         return false;
@@ -468,6 +559,16 @@ public:
       return false;
     }
 
+    // If only a prediction was requested, report the commands which would run.
+    if (invocation.predictOnly) {
+      std::vector<PredictedCommand> predicted;
+      if (!system->predict(targetToBuild, &predicted))
+        return false;
+      for (const auto& prediction: predicted)
+        delegate.commandWouldRun(prediction);
+      return delegate.getNumErrors() == 0;
+    }
+
     // Build the target; if something unspecified failed about the build, return
     // an error.
     if (!system->build(targetToBuild))
@@ -496,6 +597,31 @@ BuildSystem& BuildSystemFrontendExecutionQueueDelegate::getSystem() const {
   return *delegateImpl.frontend->system;
 }
 
+void BuildSystemFrontendExecutionQueueDelegate::captureOutput(
+    Command* command, StringRef data) {
+  std::lock_guard<std::mutex> lock(delegateImpl.capturedOutputsMutex);
+  delegateImpl.capturedOutputs[command].append(data.begin(), data.end());
+}
+
+void BuildSystemFrontendExecutionQueueDelegate::persistOutput(
+    Command* command) {
+  // Commands running several processes accumulate the output of all of them.
+  std::string output;
+  {
+    std::lock_guard<std::mutex> lock(delegateImpl.capturedOutputsMutex);
+    auto it = delegateImpl.capturedOutputs.find(command);
+    if (it != delegateImpl.capturedOutputs.end())
+      output = it->second;
+  }
+
+  // This is done even without output, to drop any previously stored output
+  // which would otherwise be replayed, the database only writes when the
+  // stored output changes. A failure to store the output only loses the
+  // replay, not the build.
+  std::string error;
+  (void)getSystem().setCommandOutput(command, output, &error);
+}
+
 }
 
 BuildSystemFrontendDelegate::
@@ -585,12 +711,16 @@ std::unique_ptr<ExecutionQueue>
 BuildSystemFrontendDelegate::createExecutionQueue() {
   auto impl = static_cast<BuildSystemFrontendDelegateImpl*>(this->impl);
   auto invocation = impl->frontend->invocation;
+  LaneAffinityOptions affinity;
+  affinity.partitionLanesByNUMANode = invocation.partitionLanesByNUMANode;
+  affinity.pinEngineThread = invocation.pinEngineThread;
   
   if (invocation.useSerialBuild) {
     return std::unique_ptr<ExecutionQueue>(
         createLaneBasedExecutionQueue(impl->executionQueueDelegate, 1,
                                       invocation.schedulerAlgorithm,
-                                      invocation.environment));
+                                      invocation.environment, affinity,
+                                      invocation.useJobServer));
   }
     
   // Get the number of CPUs to use.
@@ -608,7 +738,8 @@ BuildSystemFrontendDelegate::createExecutionQueue() {
   return std::unique_ptr<ExecutionQueue>(
       createLaneBasedExecutionQueue(impl->executionQueueDelegate, numLanes,
                                     invocation.schedulerAlgorithm,
-                                    invocation.environment));
+                                    invocation.environment, affinity,
+                                    invocation.useJobServer));
 }
 
 void BuildSystemFrontendDelegate::cancel() {
@@ -623,8 +754,29 @@ void BuildSystemFrontendDelegate::hadCommandFailure() {
   ++impl->numFailedCommands;
 }
 
-void BuildSystemFrontendDelegate::commandStatusChanged(Command*,
-                                                       CommandStatusKind) {
+void BuildSystemFrontendDelegate::commandStatusChanged(
+    Command* command, CommandStatusKind kind) {
+  auto impl = static_cast<BuildSystemFrontendDelegateImpl*>(this->impl);
+
+  // Replay the stored output of commands which are up to date, if requested.
+  if (kind != CommandStatusKind::IsUpToDate ||
+      !impl->frontend->invocation.replayOutput)
+    return;
+
+  std::string output, error;
+  if (impl->frontend->system->lookupCommandOutput(command, &output, &error)) {
+    if (!output.empty())
+      commandOutputReplayed(command, output);
+  } else if (!error.empty()) {
+    commandHadWarning(command, "warning: unable to replay command output (" +
+                      error + ")\n");
+  }
+}
+
+void BuildSystemFrontendDelegate::commandOutputReplayed(Command*,
+                                                        StringRef output) {
+  fwrite(output.data(), output.size(), 1, stdout);
+  fflush(stdout);
 }
 
 void BuildSystemFrontendDelegate::commandPreparing(Command*) {
@@ -678,6 +830,55 @@ void BuildSystemFrontendDelegate::commandHadWarning(Command* command, StringRef
 void BuildSystemFrontendDelegate::commandFinished(Command*, ProcessStatus) {
 }
 
+void BuildSystemFrontendDelegate::startupPhaseCompleted(StringRef phase,
+                                                        double duration) {
+  auto impl = static_cast<BuildSystemFrontendDelegateImpl*>(this->impl);
+  if (!impl->frontend->invocation.showStartupTiming)
+    return;
+
+  fprintf(stdout, "startup: %s: %.3fms\n", phase.str().c_str(),
+          duration * 1000.0);
+  fflush(stdout);
+}
+
+void BuildSystemFrontendDelegate::commandWouldRun(
+    const PredictedCommand& prediction) {
+  // Don't report status if opted out by the command.
+  if (!prediction.command->shouldShowStatus()) {
+    return;
+  }
+
+  SmallString<64> description;
+  prediction.command->getShortDescription(description);
+  if (description.empty()) {
+    prediction.command->getVerboseDescription(description);
+  }
+
+  std::string message;
+  llvm::raw_string_ostream os(message);
+  os << "would run: " << description << " (";
+  switch (prediction.reason) {
+  case core::PredictedRule::Reason::NeverBuilt:
+    os << "never built";
+    break;
+  case core::PredictedRule::Reason::SignatureChanged:
+    os << "signature changed";
+    break;
+  case core::PredictedRule::Reason::InvalidValue:
+    os << "result is out of date";
+    break;
+  case core::PredictedRule::Reason::InputRebuilt:
+    os << "input rebuilt: ";
+    describeKey(os, BuildKey::fromData(prediction.input));
+    break;
+  }
+  os << ")\n";
+  os.flush();
+
+  fwrite(message.data(), message.size(), 1, stdout);
+  fflush(stdout);
+}
+
 void BuildSystemFrontendDelegate::commandCannotBuildOutputDueToMissingInputs(
      Command * command, Node *output, SmallPtrSet<Node *, 1> inputs) {
   std::string message;
@@ -212,13 +212,17 @@ void ExternalCommand::start(BuildSystem& system,
   // Request all of the inputs.
   unsigned id = 0;
   for (auto it = inputs.begin(), ie = inputs.end(); it != ie; ++it, ++id) {
-    ti.request(BuildKey::makeNode(*it).toData(), id);
+    ti.request(InlineBuildKey::makeNode(*it).toKeyRef(), id);
   }
 
   // Delegate to the subclass in case it needs more custom inputs.
   startExternalCommand(system, ti);
 }
 
+void ExternalCommand::getKnownInputs(std::vector<Node*>& result) {
+  result.insert(result.end(), inputs.begin(), inputs.end());
+}
+
 void ExternalCommand::providePriorValue(BuildSystem& system,
                                         core::TaskInterface,
                                         const BuildValue& value) {
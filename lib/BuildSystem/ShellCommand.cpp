@@ -13,6 +13,8 @@
 #include "llbuild/BuildSystem/ShellCommand.h"
 
 #include "llbuild/Basic/FileSystem.h"
+#include "llbuild/Basic/ShellUtility.h"
+#include "llbuild/Basic/Subprocess.h"
 #include "llbuild/BuildSystem/BuildFile.h"
 #include "llbuild/BuildSystem/BuildKey.h"
 #include "llbuild/Core/DependencyInfoParser.h"
@@ -59,6 +61,7 @@ CommandSignature ShellCommand::getSignature() const {
       code = code.combine(path);
     }
     code = code.combine(int(depsStyle));
+    code = code.combine(int(depsInMemory));
     code = code.combine(int(inheritEnv));
     code = code.combine(int(canSafelyInterrupt));
   }
@@ -70,9 +73,9 @@ CommandSignature ShellCommand::getSignature() const {
   return signature;
 }
 
-bool ShellCommand::processDiscoveredDependencies(BuildSystem& system,
-                                                 core::TaskInterface ti,
-                                                 QueueJobContext* context) {
+bool ShellCommand::processDiscoveredDependencies(
+    BuildSystem& system, core::TaskInterface ti, QueueJobContext* context,
+    ArrayRef<std::unique_ptr<InMemoryOutputFile>> depsFiles) {
   // It is an error if the dependencies style is not specified.
   //
   // FIXME: Diagnose this sooner.
@@ -82,13 +85,26 @@ bool ShellCommand::processDiscoveredDependencies(BuildSystem& system,
     return false;
   }
 
-  for (const auto& depsPath: depsPaths) {
-    // Read the dependencies file.
-    auto input = system.getFileSystem().getFileContents(depsPath);
-    if (!input) {
-      system.getDelegate().commandHadError(
-          this, "unable to open dependencies file (" + depsPath + ")");
-      return false;
+  for (unsigned i = 0, e = depsPaths.size(); i != e; ++i) {
+    const auto& depsPath = depsPaths[i];
+
+    // Read the dependencies, from memory if the command was given a file.
+    std::unique_ptr<llvm::MemoryBuffer> input;
+    if (i < depsFiles.size() && depsFiles[i]) {
+      std::string error;
+      input = depsFiles[i]->getContents(depsPath, &error);
+      if (!input) {
+        system.getDelegate().commandHadError(
+            this, "unable to read dependencies (" + depsPath + "): " + error);
+        return false;
+      }
+    } else {
+      input = system.getFileSystem().getFileContents(depsPath);
+      if (!input) {
+        system.getDelegate().commandHadError(
+            this, "unable to open dependencies file (" + depsPath + ")");
+        return false;
+      }
     }
 
     switch (depsStyle) {
@@ -148,7 +164,8 @@ bool ShellCommand::processMakefileDiscoveredDependencies(BuildSystem& system,
                                      uint64_t length,
                                      const StringRef unescapedWord) override {
       if (llvm::sys::path::is_absolute(unescapedWord)) {
-        ti.discoveredDependency(BuildKey::makeNode(unescapedWord).toData());
+        ti.discoveredDependency(
+            InlineBuildKey::makeNode(unescapedWord).toKeyRef());
         return;
       }
 
@@ -161,7 +178,7 @@ bool ShellCommand::processMakefileDiscoveredDependencies(BuildSystem& system,
       llvm::sys::path::append(absPath, unescapedWord);
       llvm::sys::fs::make_absolute(absPath);
 
-      ti.discoveredDependency(BuildKey::makeNode(absPath).toData());
+      ti.discoveredDependency(InlineBuildKey::makeNode(absPath).toKeyRef());
     }
 
     virtual void actOnRuleStart(const char* name, uint64_t length,
@@ -210,7 +227,7 @@ ShellCommand::processDependencyInfoDiscoveredDependencies(BuildSystem& system,
     virtual void actOnOutput(StringRef) override { }
 
     virtual void actOnInput(StringRef name) override {
-      ti.discoveredDependency(BuildKey::makeNode(name).toData());
+      ti.discoveredDependency(InlineBuildKey::makeNode(name).toKeyRef());
     }
   };
 
@@ -249,6 +266,13 @@ bool ShellCommand::configureAttribute(const ConfigureContext& ctx, StringRef nam
       return false;
     }
     return true;
+  } else if (name == "deps-in-memory") {
+    if (value != "true" && value != "false") {
+      ctx.error("invalid value: '" + value + "' for attribute '" +
+                name + "'");
+      return false;
+    }
+    depsInMemory = value == "true";
   } else if (name == "can-safely-interrupt") {
     if (value != "true" && value != "false") {
       ctx.error("invalid value: '" + value + "' for attribute '" +
@@ -332,7 +356,12 @@ void ShellCommand::executeExternalCommand(
     TaskInterface ti,
     QueueJobContext* context,
     llvm::Optional<ProcessCompletionFn> completionFn) {
-  auto commandCompletionFn = [this, &system, ti, completionFn](ProcessResult result) mutable {
+  // The in-memory files given to the command for its dependency outputs, if
+  // any; these are shared with the completion, which reads them back.
+  auto depsFiles =
+    std::make_shared<std::vector<std::unique_ptr<InMemoryOutputFile>>>();
+
+  auto commandCompletionFn = [this, &system, ti, completionFn, depsFiles](ProcessResult result) mutable {
     if (result.status != ProcessStatus::Succeeded) {
       // If the command failed, there is no need to gather dependencies.
       if (completionFn.hasValue())
@@ -344,8 +373,9 @@ void ShellCommand::executeExternalCommand(
     if (!depsPaths.empty()) {
       // FIXME: Really want this job to go into a high priority fifo queue
       // so as to not hold up downstream tasks.
-      ti.spawn(QueueJob{ this, [this, &system, ti, completionFn, result](QueueJobContext* context) mutable {
-            if (!processDiscoveredDependencies(system, ti, context)) {
+      ti.spawn(QueueJob{ this, [this, &system, ti, completionFn, result, depsFiles](QueueJobContext* context) mutable {
+            if (!processDiscoveredDependencies(system, ti, context,
+                                               *depsFiles)) {
               // If we were unable to process the dependencies output, report a
               // failure.
               if (completionFn.hasValue())
@@ -378,10 +408,45 @@ void ShellCommand::executeExternalCommand(
   }
 
   bool connectToConsole = false;
+  ProcessAttributes attributes{canSafelyInterrupt, connectToConsole,
+                               workingDirectory, inheritEnv, controlEnabled};
+
+  // If requested, replace each dependencies path in the arguments with an
+  // in-memory file. Paths which do not appear as a whole word in any argument,
+  // or for which no file can be created, are still read from disk.
+  ArrayRef<StringRef> spawnArgs = args;
+  std::vector<std::string> depsArgsStorage;
+  std::vector<StringRef> depsArgs;
+  SmallVector<int, 1> depsDescriptors;
+  if (depsInMemory) {
+    depsArgsStorage.assign(args.begin(), args.end());
+    for (const auto& depsPath: depsPaths) {
+      std::string error;
+      auto file = InMemoryOutputFile::create(depsPath, &error);
+      bool used = false;
+      if (file) {
+        std::string filePath = file->getPath();
+        for (auto& arg: depsArgsStorage) {
+          std::string rewritten;
+          if (replacePathInCommandLine(arg, depsPath, filePath, rewritten)) {
+            arg = std::move(rewritten);
+            used = true;
+          }
+        }
+      }
+      if (used) {
+        depsDescriptors.push_back(file->getDescriptor());
+        depsFiles->push_back(std::move(file));
+      } else {
+        depsFiles->push_back(nullptr);
+      }
+    }
+    depsArgs.assign(depsArgsStorage.begin(), depsArgsStorage.end());
+    spawnArgs = depsArgs;
+    attributes.inheritedDescriptors = depsDescriptors;
+  }
 
   // Execute the command.
   ti.spawn(
-      context, args, env,
-      {canSafelyInterrupt, connectToConsole, workingDirectory, inheritEnv, controlEnabled},
-      /*completionFn=*/{commandCompletionFn});
+      context, spawnArgs, env, attributes, /*completionFn=*/{commandCompletionFn});
 }
@@ -18,6 +18,7 @@
 #include "llbuild/Core/BuildDB.h"
 #include "llbuild/BuildSystem/BuildDescription.h"
 #include "llbuild/BuildSystem/BuildFile.h"
+#include "llbuild/BuildSystem/BuildKey.h"
 #include "llbuild/BuildSystem/BuildSystem.h"
 #include "llbuild/BuildSystem/BuildSystemFrontend.h"
 #include "llbuild/BuildSystem/BuildValue.h"
@@ -619,6 +620,8 @@ static void dbUsage(int exitCode) {
           "get the build value of the specified key");
   fprintf(stderr, "  %-*s %s\n", optionWidth, "list-keys",
           "list build keys known by the database");
+  fprintf(stderr, "  %-*s %s\n", optionWidth, "output <command>...",
+          "print the stored output of the specified commands");
   fprintf(stderr, "  %-*s %s\n", optionWidth, "dump",
           "dump debug database contents");
   ::exit(exitCode);
@@ -677,9 +680,10 @@ static int executeDBCommand(std::vector<std::string> args) {
     dbUsage(1);
   }
 
-  // Load database
+  // Load database; this is only ever read, so use a snapshot which can be
+  // taken while a build is running.
   std::string error;
-  std::unique_ptr<BuildDB> buildDB = createSQLiteBuildDB(dbPath, BuildSystem::getSchemaVersion(), /* recreateUnmatchedVersion = */ true, &error);
+  std::unique_ptr<BuildDB> buildDB = createReadOnlySQLiteBuildDB(dbPath, BuildSystem::getSchemaVersion(), &error);
   if (!buildDB) {
     fprintf(stderr, "error: failed to load build db: %s\n\n", error.c_str());
     ::exit(1);
@@ -729,6 +733,20 @@ static int executeDBCommand(std::vector<std::string> args) {
     for (auto key: keys) {
       printf("%s\n", key.c_str());
     }
+  } else if (action == "output") {
+    for (const auto& name : args) {
+      std::string error, output;
+      if (!buildDB->lookupCommandOutput(BuildKey::makeCommand(name).toData(),
+                                        &output, &error)) {
+        if (error.length()) {
+          fprintf(stderr, "error: failed to lookup output: %s\n\n",
+                  error.c_str());
+          ::exit(1);
+        }
+        continue;
+      }
+      fwrite(output.data(), output.size(), 1, stdout);
+    }
   } else if (action == "dump") {
     buildDB->dump(llvm::outs());
   } else {
@@ -14,6 +14,7 @@
 
 #include "llvm/Support/Process.h"
 
+#include <atomic>
 #include <cassert>
 #include <cstdio>
 
@@ -38,6 +39,22 @@ struct CommandLineStatusOutputImpl {
   /// The number of characters written to the current line.
   int numCurrentCharacters{0};
 
+  /// The minimum interval between coalesced rewrites of the current line.
+  const std::chrono::milliseconds redrawInterval{100};
+
+  /// The source of the current time.
+  llbuild::commands::CommandLineStatusOutput::Clock clock{
+    std::chrono::steady_clock::now};
+
+  /// The time the current line was last rewritten.
+  std::chrono::steady_clock::time_point lastRedrawTime{};
+
+  /// The text pending to be written to the current line.
+  std::string pendingLine;
+
+  /// Whether there is pending text.
+  std::atomic<bool> hasPendingLine{false};
+
   CommandLineStatusOutputImpl() {}
 
   ~CommandLineStatusOutputImpl() {
@@ -77,7 +94,16 @@ struct CommandLineStatusOutputImpl {
     return true;
   }
 
+  bool open(FILE* fp, bool canUpdateCurrentLine, std::string* error_out) {
+    assert(!isOpen() && !isClosed);
+    this->fp = fp;
+    termHonorsCarriageReturn = canUpdateCurrentLine;
+    stripColor = !canUpdateCurrentLine;
+    return true;
+  }
+
   bool close(std::string* error_out) {
+    flushPendingLine();
     if (hasOutput) {
       fprintf(fp, "\n");
       fflush(fp);
@@ -155,9 +181,16 @@ struct CommandLineStatusOutputImpl {
     assert(attributedText.find('\r') == std::string::npos);
     assert(attributedText.find('\n') == std::string::npos);
 
+    // Any pending text is superseded.
+    if (hasPendingLine) {
+      pendingLine.clear();
+      hasPendingLine = false;
+    }
+
     // Clear the line before writing, this tends to produce better results than
     // clearing the unwritten tail of the line written below.
     clearOutput();
+    lastRedrawTime = clock();
 
     std::string text = attributedText;
     stripColorCodes(text);
@@ -191,9 +224,34 @@ struct CommandLineStatusOutputImpl {
     writeText(text + "\n");
   }
 
+  void setOrWriteLineCoalesced(const std::string& text) {
+    if (!canUpdateCurrentLine())
+      return writeText(text + "\n");
+
+    // If the line was rewritten recently, just record the latest text.
+    if (clock() - lastRedrawTime < redrawInterval) {
+      pendingLine = text;
+      hasPendingLine = true;
+      return;
+    }
+
+    setCurrentLine(text);
+  }
+
+  void flushPendingLine() {
+    if (!hasPendingLine)
+      return;
+
+    std::string text = std::move(pendingLine);
+    setCurrentLine(text);
+  }
+
   void finishLine() {
     assert(isOpen());
 
+    // Write any pending text, so the finished line reflects the latest status.
+    flushPendingLine();
+
     // Finish the current line, if necessary.
     if (canUpdateCurrentLine() && hasOutput) {
       fputc('\n', fp);
@@ -234,6 +292,12 @@ bool CommandLineStatusOutput::open(std::string* error_out) {
   return static_cast<CommandLineStatusOutputImpl*>(impl)->open(error_out);
 }
 
+bool CommandLineStatusOutput::open(FILE* fp, bool canUpdateCurrentLine,
+                                   std::string* error_out) {
+  return static_cast<CommandLineStatusOutputImpl*>(impl)->open(
+      fp, canUpdateCurrentLine, error_out);
+}
+
 bool CommandLineStatusOutput::close(std::string* error_out) {
   return static_cast<CommandLineStatusOutputImpl*>(impl)->close(error_out);
 }
@@ -257,6 +321,27 @@ void CommandLineStatusOutput::setOrWriteLine(const std::string& text) {
     static_cast<CommandLineStatusOutputImpl*>(impl)->setOrWriteLine(text);
 }
 
+void CommandLineStatusOutput::setOrWriteLineCoalesced(const std::string& text) {
+  return static_cast<CommandLineStatusOutputImpl*>(impl)->
+    setOrWriteLineCoalesced(text);
+}
+
+bool CommandLineStatusOutput::hasPendingLine() const {
+  return static_cast<CommandLineStatusOutputImpl*>(impl)->hasPendingLine;
+}
+
+void CommandLineStatusOutput::flushPendingLine() {
+  return static_cast<CommandLineStatusOutputImpl*>(impl)->flushPendingLine();
+}
+
+std::chrono::milliseconds CommandLineStatusOutput::getRedrawInterval() const {
+  return static_cast<CommandLineStatusOutputImpl*>(impl)->redrawInterval;
+}
+
+void CommandLineStatusOutput::setClock(Clock clock) {
+  static_cast<CommandLineStatusOutputImpl*>(impl)->clock = std::move(clock);
+}
+
 void CommandLineStatusOutput::finishLine() {
   return static_cast<CommandLineStatusOutputImpl*>(impl)->finishLine();
 }
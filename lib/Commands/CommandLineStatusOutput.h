@@ -13,6 +13,9 @@
 #ifndef LLBUILD_COMMANDS_COMMANDLINESTATUSOUTPUT_H
 #define LLBUILD_COMMANDS_COMMANDLINESTATUSOUTPUT_H
 
+#include <chrono>
+#include <cstdio>
+#include <functional>
 #include <string>
 
 namespace llbuild {
@@ -20,6 +23,9 @@ namespace commands {
 
 /// Utility class for writing out progress or status information to a terminal
 /// which abstracts out support for ANSI compliant terminals.
+///
+/// Except where noted, the methods are not thread safe, clients are expected
+/// to serialize all output (e.g., on a serial queue).
 class CommandLineStatusOutput {
   void *impl;
 
@@ -31,6 +37,13 @@ public:
   /// Open the output stream for writing.
   bool open(std::string* error_out);
 
+  /// Open the given stream for writing, instead of detecting the features of
+  /// the standard output (e.g., for testing).
+  ///
+  /// \param canUpdateCurrentLine Whether the stream honors '\r', and should
+  /// be treated as a color terminal.
+  bool open(FILE* fp, bool canUpdateCurrentLine, std::string* error_out);
+
   /// Close the output stream and clear any incomplete output.
   bool close(std::string* error_out);
 
@@ -51,7 +64,36 @@ public:
   /// The text should be a single line with no newlines or carriage returns.
   void setOrWriteLine(const std::string& text);
 
+  /// Update the current line of output text like \see setOrWriteLine(), but
+  /// limit the rate at which the current line is rewritten.
+  ///
+  /// If the current line was rewritten less than \see getRedrawInterval() ago,
+  /// the text is held pending (replacing any previously pending text) until
+  /// \see flushPendingLine() is called, or the line is finished. If the current
+  /// line cannot be updated, the text is always written out.
+  void setOrWriteLineCoalesced(const std::string& text);
+
+  /// Check if there is pending text for the current line.
+  ///
+  /// This method is thread safe.
+  bool hasPendingLine() const;
+
+  /// Write the pending text for the current line, if any.
+  void flushPendingLine();
+
+  /// Get the minimum interval between rewrites of the current line by \see
+  /// setOrWriteLineCoalesced().
+  std::chrono::milliseconds getRedrawInterval() const;
+
+  /// The source of the current time used to limit redraws.
+  typedef std::function<std::chrono::steady_clock::time_point()> Clock;
+
+  /// Replace the clock used to limit redraws (e.g., for testing).
+  void setClock(Clock clock);
+
   /// Finish writing the current line, if necessary.
+  ///
+  /// Any pending text for the current line is written first.
   void finishLine();
 
   /// Write a non-overwritable block of text to the output.
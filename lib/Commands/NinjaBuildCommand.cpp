@@ -19,6 +19,8 @@
 #include "llbuild/Basic/Hashing.h"
 #include "llbuild/Basic/PlatformUtility.h"
 #include "llbuild/Basic/SerialQueue.h"
+#include "llbuild/Basic/ShellUtility.h"
+#include "llbuild/Basic/Subprocess.h"
 #include "llbuild/Basic/Version.h"
 
 #include "llbuild/Commands/Commands.h"
@@ -30,6 +32,7 @@
 #include "llbuild/Ninja/ManifestLoader.h"
 
 #include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/raw_ostream.h"
@@ -37,6 +40,7 @@
 #include "CommandLineStatusOutput.h"
 #include "CommandUtil.h"
 
+#include <algorithm>
 #include <atomic>
 #include <future>
 #include <cerrno>
@@ -110,12 +114,16 @@ static void usage(int exitCode=1) {
           "print the Ninja compatible version number");
   fprintf(stderr, "  %-*s %s\n", optionWidth, "--simulate",
           "simulate the build, assuming commands succeed");
+  fprintf(stderr, "  %-*s %s\n", optionWidth, "--predict",
+          "report the commands the build would run, and why");
   fprintf(stderr, "  %-*s %s\n", optionWidth, "-C, --chdir <PATH>",
           "change directory to PATH before anything else");
   fprintf(stderr, "  %-*s %s\n", optionWidth, "--no-db",
           "do not persist build results");
   fprintf(stderr, "  %-*s %s\n", optionWidth, "--db <PATH>",
           "persist build results at PATH [default='build.db']");
+  fprintf(stderr, "  %-*s %s\n", optionWidth, "--db-durability <POLICY>",
+          "database durability: strict, normal or fast [default=strict]");
   fprintf(stderr, "  %-*s %s\n", optionWidth, "-f <PATH>",
           "load the manifest at PATH [default='build.ninja']");
   fprintf(stderr, "  %-*s %s\n", optionWidth, "-k <N>",
@@ -126,6 +134,16 @@ static void usage(int exitCode=1) {
           "number of jobs to build in parallel [default=cpu dependent]");
   fprintf(stderr, "  %-*s %s\n", optionWidth, "--scheduler <SCHEDULER>",
           "set scheduler algorithm");
+  fprintf(stderr, "  %-*s %s\n", optionWidth, "--numa-lanes",
+          "divide the jobs across the host NUMA nodes");
+  fprintf(stderr, "  %-*s %s\n", optionWidth, "--pin-engine-thread",
+          "pin the build engine to the first NUMA node");
+  fprintf(stderr, "  %-*s %s\n", optionWidth, "--jobserver",
+          "share the jobs with commands as a make jobserver");
+  fprintf(stderr, "  %-*s %s\n", optionWidth, "--deps-in-memory",
+          "give commands in-memory files for their depfiles");
+  fprintf(stderr, "  %-*s %s\n", optionWidth, "--replay-output",
+          "replay the stored output of up-to-date commands");
   fprintf(stderr, "  %-*s %s\n", optionWidth, "--no-regenerate",
           "disable manifest auto-regeneration");
   fprintf(stderr, "  %-*s %s\n", optionWidth, "--dump-graph <PATH>",
@@ -158,7 +176,7 @@ private:
   BuildValue &operator=(BuildValue&& rhs) LLBUILD_DELETED_FUNCTION;
 
 public:
-  static const int currentSchemaVersion = 3;
+  static const int currentSchemaVersion = 4;
 
 private:
   enum class BuildValueKind : uint32_t {
@@ -381,6 +399,10 @@ public:
   bool simulate = false;
   /// Whether to use strict mode.
   bool strict = false;
+  /// Whether commands are given in-memory files in place of their depfiles.
+  bool depsInMemory = false;
+  /// Whether to replay the stored output of commands which are up to date.
+  bool replayOutput = false;
   /// Whether output should use verbose mode.
   bool verbose = false;
   /// The number of failed commands to tolerate, or 0 if unlimited
@@ -388,10 +410,15 @@ public:
 
   int numJobsInParallel{0};
   basic::SchedulerAlgorithm schedulerAlgorithm{basic::SchedulerAlgorithm::NamePriority};
+  basic::LaneAffinityOptions laneAffinity;
+  bool useJobServer = false;
 
   /// The build profile output file.
   FILE *profileFP = nullptr;
 
+  /// The attached database, if any, which stores the output of commands.
+  core::BuildDB* db = nullptr;
+
   /// Whether the build has been cancelled or not.
   std::atomic<bool> isCancelled{false};
 
@@ -434,6 +461,12 @@ public:
 
   std::unique_ptr<std::thread> signalHandlerThread;
 
+  /// The thread used to write coalesced status lines, and its state.
+  std::unique_ptr<std::thread> statusRedrawThread;
+  std::mutex statusRedrawMutex;
+  std::condition_variable statusRedrawCondition;
+  bool isStatusRedrawDone = false;
+
   /// The previous SIGINT handler.
 #if defined(_WIN32)
   void (*previousSigintHandler)(int);
@@ -505,6 +538,20 @@ public:
     signalWatchingPipe[0] = -1;
   }
 
+  /// Thread function to periodically write the pending status line.
+  ///
+  /// Status updates are coalesced by the status output, this ensures the
+  /// latest one is shown even if no further updates arrive.
+  void statusRedrawLoop() {
+    std::unique_lock<std::mutex> lock(statusRedrawMutex);
+    while (!isStatusRedrawDone) {
+      statusRedrawCondition.wait_for(lock, statusOutput.getRedrawInterval());
+      if (statusOutput.hasPendingLine()) {
+        consoleQueue.async([this] { statusOutput.flushPendingLine(); });
+      }
+    }
+  }
+
 public:
   BuildContext(StringRef workingDirectory)
     : workingDirectory(workingDirectory),
@@ -543,9 +590,25 @@ public:
       perror("pipe");
     }
     signalHandlerThread.reset(new std::thread(&BuildContext::signalWaitThread, this));
+
+    // Start the status redraw thread, if status lines are coalesced.
+    if (statusOutput.canUpdateCurrentLine()) {
+      statusRedrawThread.reset(
+          new std::thread(&BuildContext::statusRedrawLoop, this));
+    }
   }
 
   ~BuildContext() {
+    // Stop the status redraw thread.
+    if (statusRedrawThread) {
+      {
+        std::lock_guard<std::mutex> guard(statusRedrawMutex);
+        isStatusRedrawDone = true;
+      }
+      statusRedrawCondition.notify_one();
+      statusRedrawThread->join();
+    }
+
     // Ensure the console queue tasks have been run to completion.
     consoleQueue.sync([] {});
 
@@ -574,6 +637,9 @@ public:
 
   /// Emit a status line, which can be updated.
   ///
+  /// Unless the build is verbose, rapid updates are coalesced and the line is
+  /// rewritten at a fixed rate, showing the latest progress.
+  ///
   /// This method should only be called from the console queue.
   void emitStatus(const char* fmt, ...) {
     va_list ap;
@@ -584,7 +650,7 @@ public:
     if (verbose) {
       statusOutput.writeText(message + "\n");
     } else {
-      statusOutput.setOrWriteLine(message);
+      statusOutput.setOrWriteLineCoalesced(message);
     }
   }
 
@@ -597,6 +663,52 @@ public:
       });
   }
 
+  /// Get the signature used to detect changes to the command string of the
+  /// given command, without materializing the string.
+  CommandSignature getCommandSignature(const ninja::Command* command) const {
+    return CommandSignature(manifest->getCommandSignature(command));
+  }
+
+  /// Get the key of the rule which runs the given command.
+  static std::string getCommandRuleKey(const ninja::Command* command) {
+    // Commands with multiple outputs are run by a composite rule.
+    //
+    // FIXME: Make efficient.
+    std::string key;
+    for (auto& output: command->getOutputs()) {
+      if (!key.empty())
+        key += "&&";
+      key += output->getCanonicalPath();
+    }
+    return key;
+  }
+
+  /// Persist the output of a command, so it can be replayed while the command
+  /// is up to date.
+  void storeCommandOutput(const ninja::Command* command, StringRef output) {
+    if (!db)
+      return;
+
+    // A failure to store the output only loses the replay, not the build.
+    std::string error;
+    (void)db->setCommandOutput(getCommandRuleKey(command), output, &error);
+  }
+
+  /// Replay the stored output of a command which is up to date.
+  void replayCommandOutput(const ninja::Command* command) {
+    if (!db)
+      return;
+
+    std::string output, error;
+    if (db->lookupCommandOutput(getCommandRuleKey(command), &output, &error)) {
+      if (!output.empty())
+        emitText(std::move(output));
+    } else if (!error.empty()) {
+      emitDiagnostic("warning", "unable to replay command output (" + error +
+                     ")");
+    }
+  }
+
   /// Emit a diagnostic followed by a block of text, ensuring the text
   /// immediately follows the diagnostic.
   void emitDiagnosticAndText(std::string kind, std::string&& message,
@@ -685,6 +797,8 @@ public:
     std::unique_lock<std::mutex> lock(outputBufferMutex);
     auto& outputData = outputBuffers[handle.id];
     lock.unlock();
+    if (result.status != ProcessStatus::Cancelled)
+      storeCommandOutput(job, StringRef(outputData.data(), outputData.size()));
     if (result.status == ProcessStatus::Succeeded) {
       if (!outputData.empty()) {
         emitText(std::string(outputData.data(), outputData.size()));
@@ -902,7 +1016,7 @@ std::atomic<bool> BuildContext::wasInterrupted{false};
 int BuildContext::signalWatchingPipe[2]{-1, -1};
 
 class BuildManifestActions : public ninja::ManifestLoaderActions {
-  BuildContext& context;
+  BuildContext* context;
   ninja::ManifestLoader* loader = 0;
   unsigned numErrors = 0;
   unsigned maxErrors = 20;
@@ -936,14 +1050,18 @@ private:
       util::emitError(fromFilename, error, *forToken,
                       loader->getCurrentParser());
     } else {
-      context.emitError(std::move(error));
+      context->emitError(std::move(error));
     }
 
     return false;
   };
 
 public:
-  BuildManifestActions(BuildContext& context) : context(context) {}
+  BuildManifestActions(BuildContext& context) : context(&context) {}
+
+  /// Set the context to report errors to, when the manifest is reloaded in a
+  /// later build iteration.
+  void setContext(BuildContext& context) { this->context = &context; }
 
   unsigned getNumErrors() const { return numErrors; }
 };
@@ -1143,7 +1261,7 @@ buildCommand(BuildContext& context, ninja::Command* command) {
       //
       // FIXME: Is it right to bring this up-to-date when one of the inputs
       // indicated a failure? It probably doesn't matter.
-      auto commandHash = CommandSignature(command->getCommandString());
+      auto commandHash = context.getCommandSignature(command);
       if (command->getRule() == context.manifest->getPhonyRule()) {
         // Get the result.
         BuildValue result = computeCommandResult(commandHash);
@@ -1335,6 +1453,27 @@ buildCommand(BuildContext& context, ninja::Command* command) {
         os.close();
       }
 
+      // If requested, give the command an in-memory file for its depfile, when
+      // the path appears as a whole word in the command string.
+      std::shared_ptr<InMemoryOutputFile> depsFile;
+      std::string commandString;
+      int depsDescriptor = -1;
+      ProcessAttributes attributes{true, isConsolePool};
+      if (context.depsInMemory &&
+          command->getDepsStyle() == ninja::Command::DepsStyleKind::GCC) {
+        std::string error;
+        depsFile = InMemoryOutputFile::create(command->getDepsFile(), &error);
+        if (depsFile && replacePathInCommandLine(command->getCommandString(),
+                                                 command->getDepsFile(),
+                                                 depsFile->getPath(),
+                                                 commandString)) {
+          depsDescriptor = depsFile->getDescriptor();
+          attributes.inheritedDescriptors = depsDescriptor;
+        } else {
+          depsFile.reset();
+        }
+      }
+
       StringRef args[] = {
 #if defined(_WIN32)
         "C:\\windows\\system32\\cmd.exe",
@@ -1343,11 +1482,11 @@ buildCommand(BuildContext& context, ninja::Command* command) {
         DefaultShellPath,
         "-c",
 #endif
-        command->getCommandString().c_str()
+        depsFile ? commandString : command->getCommandString()
       };
 
-      ti.spawn(qctx, args, {}, {true, isConsolePool}, {
-        [this, ti](ProcessResult result) mutable {
+      ti.spawn(qctx, args, {}, attributes, {
+        [this, ti, depsFile](ProcessResult result) mutable {
           // Actually run the command.
           if (result.status != ProcessStatus::Succeeded) {
             // If the command failed, complete the task with the failed result and
@@ -1357,7 +1496,7 @@ buildCommand(BuildContext& context, ninja::Command* command) {
           }
 
           // Otherwise, the command succeeded so process the dependencies.
-          if (!processDiscoveredDependencies(ti)) {
+          if (!processDiscoveredDependencies(ti, depsFile.get())) {
             context.incrementFailedCommands();
             return ti.complete(BuildValue::makeFailedCommand().toValue(),
                                /*ForceChange=*/true);
@@ -1367,7 +1506,7 @@ buildCommand(BuildContext& context, ninja::Command* command) {
           //
           // We always restat the output, but we honor Ninja's restat flag by
           // forcing downstream propagation if it isn't set.
-          auto commandHash = CommandSignature(command->getCommandString());
+          auto commandHash = context.getCommandSignature(command);
           BuildValue resultValue = computeCommandResult(commandHash);
 
           // Remove response file.
@@ -1382,7 +1521,8 @@ buildCommand(BuildContext& context, ninja::Command* command) {
     }
 
 
-    bool processDiscoveredDependencies(core::TaskInterface ti) {
+    bool processDiscoveredDependencies(core::TaskInterface ti,
+                                       InMemoryOutputFile* depsFile) {
       // Process the discovered dependencies, if used.
       switch (command->getDepsStyle()) {
       case ninja::Command::DepsStyleKind::None:
@@ -1396,8 +1536,16 @@ buildCommand(BuildContext& context, ninja::Command* command) {
         std::string error;
         std::unique_ptr<char[]> data;
         uint64_t length;
-        if (!util::readFileContents(command->getDepsFile(), &data, &length,
-                                    &error)) {
+        std::unique_ptr<llvm::MemoryBuffer> depsBuffer;
+        if (depsFile) {
+          depsBuffer = depsFile->getContents(command->getDepsFile(), &error);
+          if (!depsBuffer) {
+            context.emitError("unable to read dependency file: %s (%s)",
+                              command->getDepsFile().c_str(), error.c_str());
+            return false;
+          }
+        } else if (!util::readFileContents(command->getDepsFile(), &data,
+                                           &length, &error)) {
           // If the file is missing, just ignore it for consistency with Ninja
           // (when using stored deps) in non-strict mode.
           if (!context.strict)
@@ -1451,7 +1599,12 @@ buildCommand(BuildContext& context, ninja::Command* command) {
         };
 
         DepsActions actions(context, ti, context.workingDirectory, command->getDepsFile());
-        core::MakefileDepsParser(data.get(), length, actions).parse();
+        if (depsBuffer) {
+          core::MakefileDepsParser(depsBuffer->getBufferStart(),
+                                   depsBuffer->getBufferSize(), actions).parse();
+        } else {
+          core::MakefileDepsParser(data.get(), length, actions).parse();
+        }
         return actions.numErrors == 0;
       }
       }
@@ -1621,7 +1774,8 @@ static bool buildInputIsResultValid(ninja::Node* node,
   return value.getOutputInfo() == info;
 }
 
-static bool buildCommandIsResultValid(ninja::Command* command,
+static bool buildCommandIsResultValid(BuildContext& context,
+                                      ninja::Command* command,
                                       const core::ValueType& valueData) {
   BuildValue value = BuildValue::fromValue(valueData);
 
@@ -1631,8 +1785,7 @@ static bool buildCommandIsResultValid(ninja::Command* command,
 
   // For non-generator commands, if the command hash has changed, recompute.
   if (!command->hasGeneratorFlag()) {
-    if (value.getCommandHash() != CommandSignature(
-          command->getCommandString()))
+    if (value.getCommandHash() != context.getCommandSignature(command))
       return false;
   }
 
@@ -1654,7 +1807,8 @@ static bool buildCommandIsResultValid(ninja::Command* command,
   return true;
 }
 
-static bool selectCompositeIsResultValid(ninja::Command* command,
+static bool selectCompositeIsResultValid(BuildContext& context,
+                                         ninja::Command* command,
                                          const core::ValueType& valueData) {
   BuildValue value = BuildValue::fromValue(valueData);
 
@@ -1665,7 +1819,7 @@ static bool selectCompositeIsResultValid(ninja::Command* command,
   // If the command's signature has changed since it was built, rebuild. This is
   // important for ensuring that we properly reevaluate the select rule when
   // it's incoming composite rule no longer exists.
-  if (value.getCommandHash() != CommandSignature(command->getCommandString()))
+  if (value.getCommandHash() != context.getCommandSignature(command))
     return false;
 
   // Otherwise, this result is always valid.
@@ -1687,6 +1841,8 @@ static void updateCommandStatus(BuildContext& context,
     --context.numCommandsScanning;
     ++context.numCommandsUpToDate;
     ++context.numCommandsCompleted;
+    if (context.replayOutput)
+      context.replayCommandOutput(command);
   } else {
     assert(status == core::Rule::StatusKind::IsComplete);
     --context.numCommandsScanning;
@@ -1770,10 +1926,17 @@ int commands::executeNinjaBuildCommand(std::vector<std::string> args) {
   bool autoRegenerateManifest = true;
   bool quiet = false;
   bool simulate = false;
+  bool predict = false;
   bool strict = false;
   bool verbose = false;
   unsigned numJobsInParallel = 0;
   SchedulerAlgorithm schedulerAlgorithm = SchedulerAlgorithm::NamePriority;
+  LaneAffinityOptions laneAffinity;
+  bool useJobServer = false;
+  bool depsInMemory = false;
+  bool replayOutput = false;
+  core::SQLiteBuildDBDurability dbDurability =
+      core::SQLiteBuildDBDurability::Strict;
   unsigned numFailedCommandsToTolerate = 1;
   double maximumLoadAverage = 0.0;
   std::vector<std::string> debugTools;
@@ -1800,6 +1963,8 @@ int commands::executeNinjaBuildCommand(std::vector<std::string> args) {
       usage(/*exitCode=*/0);
     } else if (option == "--simulate") {
       simulate = true;
+    } else if (option == "--predict") {
+      predict = true;
     } else if (option == "--quiet") {
       quiet = true;
     } else if (option == "-C" || option == "--chdir") {
@@ -1820,6 +1985,18 @@ int commands::executeNinjaBuildCommand(std::vector<std::string> args) {
       }
       dbFilename = args[0];
       args.erase(args.begin());
+    } else if (option == "--db-durability") {
+      if (args.empty()) {
+        fprintf(stderr, "%s: error: missing argument to '%s'\n\n",
+                getProgramName(), option.c_str());
+        usage();
+      }
+      if (!core::parseSQLiteBuildDBDurability(args[0], &dbDurability)) {
+        fprintf(stderr, "%s: error: unknown database durability '%s'\n\n",
+                getProgramName(), args[0].c_str());
+        usage();
+      }
+      args.erase(args.begin());
     } else if (option == "--dump-graph") {
       if (args.empty()) {
         fprintf(stderr, "%s: error: missing argument to '%s'\n\n",
@@ -1903,6 +2080,16 @@ int commands::executeNinjaBuildCommand(std::vector<std::string> args) {
                   getProgramName(), &option[2]);
           usage();
       }
+    } else if (option == "--numa-lanes") {
+      laneAffinity.partitionLanesByNUMANode = true;
+    } else if (option == "--pin-engine-thread") {
+      laneAffinity.pinEngineThread = true;
+    } else if (option == "--jobserver") {
+      useJobServer = true;
+    } else if (option == "--deps-in-memory") {
+      depsInMemory = true;
+    } else if (option == "--replay-output") {
+      replayOutput = true;
     } else if (option == "--no-regenerate") {
       autoRegenerateManifest = false;
     } else if (option == "--profile") {
@@ -2032,7 +2219,12 @@ int commands::executeNinjaBuildCommand(std::vector<std::string> args) {
   //
   // This is somewhat inefficient in the case where the manifest needs to be
   // reloaded (we reopen the database, for example), but we don't expect that to
-  // be a common case spot in practice.
+  // be a common case spot in practice. The manifest loader is kept across the
+  // iterations, so that only the manifest files which were regenerated are
+  // parsed again.
+  std::unique_ptr<BuildManifestActions> manifestActions;
+  std::unique_ptr<ninja::ManifestLoader> manifestLoader;
+  std::unique_ptr<ninja::Manifest> previousManifest;
   for (int iteration = 0; iteration != 2; ++iteration) {
     BuildContext context{workingDirectory};
 
@@ -2040,17 +2232,28 @@ int commands::executeNinjaBuildCommand(std::vector<std::string> args) {
     context.quiet = quiet;
     context.simulate = simulate;
     context.strict = strict;
+    context.depsInMemory = depsInMemory;
+    context.replayOutput = replayOutput;
     context.verbose = verbose;
     context.numJobsInParallel = numJobsInParallel;
     context.schedulerAlgorithm = schedulerAlgorithm;
-
-    // Load the manifest.
-    BuildManifestActions actions(context);
-    ninja::ManifestLoader loader(workingDirectory, manifestFilename, actions);
-    context.manifest = loader.load();
+    context.laneAffinity = laneAffinity;
+    context.useJobServer = useJobServer;
+
+    // Load the manifest, or reload it if it was rebuilt.
+    if (!manifestLoader) {
+      manifestActions.reset(new BuildManifestActions(context));
+      manifestLoader.reset(new ninja::ManifestLoader(
+                               workingDirectory, manifestFilename,
+                               *manifestActions));
+      context.manifest = manifestLoader->load();
+    } else {
+      manifestActions->setContext(context);
+      context.manifest = manifestLoader->reload(std::move(previousManifest));
+    }
 
     // If there were errors loading, we are done.
-    if (unsigned numErrors = actions.getNumErrors()) {
+    if (unsigned numErrors = manifestActions->getNumErrors()) {
       context.emitNote("%d errors generated.", numErrors);
       return 1;
     }
@@ -2099,7 +2302,8 @@ int commands::executeNinjaBuildCommand(std::vector<std::string> args) {
         core::createSQLiteBuildDB(dbFilename,
                                   BuildValue::currentSchemaVersion,
                                   /* recreateUnmatchedVersion = */ true,
-                                  &error));
+                                  &error, dbDurability));
+      context.db = db.get();
       if (!db || !context.engine.attachDB(std::move(db), &error)) {
         context.emitError("unable to open build database: %s", error.c_str());
         return 1;
@@ -2132,7 +2336,25 @@ int commands::executeNinjaBuildCommand(std::vector<std::string> args) {
         if (context.simulate)
           return true;
 
-        return buildCommandIsResultValid(command, value);
+        return buildCommandIsResultValid(context, command, value);
+      }
+
+      void getKnownInputs(
+          core::BuildEngine&,
+          std::vector<std::pair<core::KeyType, bool>>& inputs) override {
+        // These mirror the requests made when the command starts, including
+        // skipping the immediately cyclic inputs of phony commands.
+        bool isPhony = command->getRule() == context.manifest->getPhonyRule();
+        const auto& outputs = command->getOutputs();
+        for (auto it = command->explicitInputs_begin(),
+               ie = command->orderOnlyInputs_end(); it != ie; ++it) {
+          if (!context.strict && isPhony &&
+              std::find(outputs.begin(), outputs.end(), *it) != outputs.end())
+            continue;
+
+          bool orderOnly = it >= command->orderOnlyInputs_begin();
+          inputs.push_back({ (*it)->getCanonicalPath(), orderOnly });
+        }
       }
 
       void updateStatus(core::BuildEngine&, core::Rule::StatusKind status) override {
@@ -2161,7 +2383,13 @@ int commands::executeNinjaBuildCommand(std::vector<std::string> args) {
         if (context.simulate)
           return true;
 
-        return selectCompositeIsResultValid(command, value);
+        return selectCompositeIsResultValid(context, command, value);
+      }
+
+      void getKnownInputs(
+          core::BuildEngine&,
+          std::vector<std::pair<core::KeyType, bool>>& inputs) override {
+        inputs.push_back({ compositeRuleName, false });
       }
     };
 
@@ -2180,34 +2408,42 @@ int commands::executeNinjaBuildCommand(std::vector<std::string> args) {
       bool isResultValid(core::BuildEngine&, const core::ValueType& value) override {
         return false;
       }
+
+      void getKnownInputs(
+          core::BuildEngine&,
+          std::vector<std::pair<core::KeyType, bool>>& inputs) override {
+        for (const auto& target: targets)
+          inputs.push_back({ target, false });
+      }
     };
 
 
     // Create rules for all of the build commands up front.
     //
     // FIXME: We should probably also move this to be dynamic.
+    //
+    // When predicting, also remember which command each rule runs.
+    llvm::StringMap<ninja::Command*> commandsByRuleKey;
     for (const auto command: context.manifest->getCommands()) {
       // If this command has a single output, create the trivial rule.
       if (command->getOutputs().size() == 1) {
         context.engine.addRule(std::unique_ptr<core::Rule>(new NinjaBuildCommandRule(command->getOutputs()[0]->getCanonicalPath(), context, command)));
+        if (predict)
+          commandsByRuleKey[command->getOutputs()[0]->getCanonicalPath()] =
+            command;
         continue;
       }
 
       // Otherwise, create a composite rule group for the multiple outputs.
 
       // Create a signature for the composite rule.
-      //
-      // FIXME: Make efficient.
-      std::string compositeRuleName = "";
-      for (auto& output: command->getOutputs()) {
-        if (!compositeRuleName.empty())
-          compositeRuleName += "&&";
-        compositeRuleName += output->getCanonicalPath();
-      }
+      std::string compositeRuleName = BuildContext::getCommandRuleKey(command);
 
       // Add the composite rule, which will run the command and build all
       // outputs.
       context.engine.addRule(std::unique_ptr<core::Rule>(new NinjaBuildCommandRule(compositeRuleName, context, command)));
+      if (predict)
+        commandsByRuleKey[compositeRuleName] = command;
 
       // Create the per-output selection rules that select the individual output
       // result from the composite result.
@@ -2216,14 +2452,16 @@ int commands::executeNinjaBuildCommand(std::vector<std::string> args) {
       }
     }
 
-    // If this is the first iteration, build the manifest, unless disabled.
-    if (autoRegenerateManifest && iteration == 0) {
+    // If this is the first iteration, build the manifest, unless disabled. A
+    // prediction is made for the manifest as it is.
+    if (autoRegenerateManifest && iteration == 0 && !predict) {
       SmallString<256> absManifestPath = StringRef(manifestFilename);
       llbuild::ninja::Manifest::normalize_path(workingDirectory, absManifestPath);
       context.engine.build(StringRef(absManifestPath));
 
       // If the manifest was rebuilt, then reload it and build again.
       if (context.numBuiltCommands) {
+        previousManifest = std::move(context.manifest);
         continue;
       }
 
@@ -2235,7 +2473,7 @@ int commands::executeNinjaBuildCommand(std::vector<std::string> args) {
     }
 
     // If using a build profile, open it.
-    if (!profileFilename.empty()) {
+    if (!profileFilename.empty() && !predict) {
       context.profileFP = ::fopen(profileFilename.c_str(), "w");
       if (!context.profileFP) {
         context.emitError("unable to open build profile '%s' (%s)\n",
@@ -2302,10 +2540,44 @@ int commands::executeNinjaBuildCommand(std::vector<std::string> args) {
       // Create a dummy rule to build all targets.
       context.engine.addRule(std::unique_ptr<core::Rule>(new NinjaBuildTargetsRule("<<build>>", context,
                                                        targetsToBuild)));
-      context.engine.build("<<build>>");
-    } else {
-      context.engine.build(targetsToBuild[0]);
     }
+    core::KeyType rootKey = targetsToBuild.size() > 1 ? "<<build>>" :
+      targetsToBuild[0];
+
+    // If only predicting, report the commands which would run, and stop.
+    if (predict) {
+      for (const auto& rule: context.engine.predict(rootKey)) {
+        auto it = commandsByRuleKey.find(rule.key.str());
+        if (it == commandsByRuleKey.end())
+          continue;
+        ninja::Command* command = it->second;
+        if (command->getRule() == context.manifest->getPhonyRule())
+          continue;
+
+        const char* reason = "";
+        switch (rule.reason) {
+        case core::PredictedRule::Reason::NeverBuilt:
+          reason = "never built";
+          break;
+        case core::PredictedRule::Reason::SignatureChanged:
+          reason = "signature changed";
+          break;
+        case core::PredictedRule::Reason::InvalidValue:
+          reason = "result is out of date";
+          break;
+        case core::PredictedRule::Reason::InputRebuilt:
+          reason = "input rebuilt: ";
+          break;
+        }
+        printf("would run: %s (%s%s)\n",
+               (verbose ? command->getCommandString() :
+                command->getEffectiveDescription()).c_str(),
+               reason, rule.input.c_str());
+      }
+      return context.numErrors ? 1 : 0;
+    }
+
+    context.engine.build(rootKey);
 
     if (!dumpGraphPath.empty()) {
       context.engine.dumpGraphToFile(dumpGraphPath);
@@ -2370,6 +2642,6 @@ int commands::executeNinjaBuildCommand(std::vector<std::string> args) {
 
 std::unique_ptr<basic::ExecutionQueue> NinjaBuildEngineDelegate::createExecutionQueue() {
   return std::unique_ptr<basic::ExecutionQueue>(
-    createLaneBasedExecutionQueue(*context, context->numJobsInParallel, context->schedulerAlgorithm, nullptr)
+    createLaneBasedExecutionQueue(*context, context->numJobsInParallel, context->schedulerAlgorithm, nullptr, context->laneAffinity, context->useJobServer)
   );
 }
@@ -0,0 +1,228 @@
+//===-- QueryCommand.cpp --------------------------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Commands/Commands.h"
+
+#include "llbuild/Basic/LLVM.h"
+#include "llbuild/BuildSystem/BuildSystem.h"
+#include "llbuild/Core/BuildDB.h"
+#include "llbuild/Core/DependencyGraphIndex.h"
+
+#include "llvm/Support/FileSystem.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace llbuild;
+using namespace llbuild::commands;
+using namespace llbuild::core;
+
+typedef DependencyGraphIndex::NodeID NodeID;
+
+static void usage(int exitCode) {
+  int optionWidth = 25;
+  fprintf(stderr, "Usage: %s query [options] <action> [<key>...]\n",
+          getProgramName());
+  fprintf(stderr, "\nQuery the dependency graph recorded in a build database.\n");
+  fprintf(stderr, "Keys are given in their encoded form, as listed by "
+          "'buildsystem db list-keys'.\n");
+  fprintf(stderr, "\nOptions:\n");
+  fprintf(stderr, "  %-*s %s\n", optionWidth, "--help",
+          "show this help message and exit");
+  fprintf(stderr, "  %-*s %s\n", optionWidth, "--db <path>",
+          "database path [default: 'build.db']");
+  fprintf(stderr, "  %-*s %s\n", optionWidth, "--persist-index",
+          "reuse or save the graph index beside the database");
+  fprintf(stderr, "  %-*s %s\n", optionWidth, "--time",
+          "report the time taken to load the index and query it");
+  fprintf(stderr, "\nActions:\n");
+  fprintf(stderr, "  %-*s %s\n", optionWidth, "deps <key>...",
+          "list the direct dependencies of the keys");
+  fprintf(stderr, "  %-*s %s\n", optionWidth, "rdeps <key>...",
+          "list the keys which directly depend on the keys");
+  fprintf(stderr, "  %-*s %s\n", optionWidth, "closure <key>...",
+          "list everything the keys transitively depend on");
+  fprintf(stderr, "  %-*s %s\n", optionWidth, "rebuilds <key>...",
+          "list everything which is recomputed if the keys change");
+  fprintf(stderr, "  %-*s %s\n", optionWidth, "path <from> <to>",
+          "show a shortest dependency chain between two keys");
+  fprintf(stderr, "  %-*s %s\n", optionWidth, "stats",
+          "show the size of the graph");
+  ::exit(exitCode);
+}
+
+/// Check whether a persisted index is up to date with the database.
+static bool isIndexCurrent(const DependencyGraphIndex& index, BuildDB& db,
+                           StringRef dbPath, StringRef indexPath) {
+  std::string error;
+  bool success = false;
+  auto epoch = db.getCurrentEpoch(&success, &error);
+  if (!success || epoch != index.getEpoch())
+    return false;
+
+  // The iteration restarts if the database is recreated, so also require that
+  // the index was written after the database was last modified.
+  llvm::sys::fs::file_status dbStatus, indexStatus;
+  if (llvm::sys::fs::status(dbPath, dbStatus) ||
+      llvm::sys::fs::status(indexPath, indexStatus))
+    return false;
+  return indexStatus.getLastModificationTime() >=
+    dbStatus.getLastModificationTime();
+}
+
+int commands::executeQueryCommand(const std::vector<std::string> &arguments) {
+  std::vector<std::string> args(arguments);
+  std::string dbPath = "build.db";
+  bool persistIndex = false;
+  bool reportTime = false;
+
+  // Parse options
+  while (!args.empty() && args[0][0] == '-') {
+    const std::string option = args[0];
+    args.erase(args.begin());
+
+    if (option == "--")
+      break;
+
+    if (option == "--help") {
+      usage(0);
+    } else if (option == "--db") {
+      if (args.empty()) {
+        fprintf(stderr, "error: %s: missing db path\n\n", getProgramName());
+        usage(1);
+      }
+      dbPath = args[0];
+      args.erase(args.begin());
+    } else if (option == "--persist-index") {
+      persistIndex = true;
+    } else if (option == "--time") {
+      reportTime = true;
+    } else {
+      fprintf(stderr, "error: %s: invalid option: '%s'\n\n",
+              getProgramName(), option.c_str());
+      usage(1);
+    }
+  }
+
+  if (args.empty()) {
+    fprintf(stderr, "error: %s: invalid number of arguments\n",
+            getProgramName());
+    usage(1);
+  }
+  const std::string action = args[0];
+  args.erase(args.begin());
+  if (action == "stats" ? !args.empty() :
+      action == "path" ? args.size() != 2 : args.empty()) {
+    fprintf(stderr, "error: %s: invalid number of arguments\n",
+            getProgramName());
+    usage(1);
+  }
+
+  auto startTime = std::chrono::steady_clock::now();
+  auto elapsedMilliseconds = [](std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - since).count();
+  };
+
+  // Load the database; this is only ever read, so use a snapshot which can be
+  // taken while a build is running.
+  std::string error;
+  std::unique_ptr<BuildDB> buildDB = createReadOnlySQLiteBuildDB(
+      dbPath, buildsystem::BuildSystem::getSchemaVersion(), &error);
+  if (!buildDB) {
+    fprintf(stderr, "error: failed to load build db: %s\n\n", error.c_str());
+    return 1;
+  }
+
+  // Load or build the index.
+  std::string indexPath = dbPath + ".graph-index";
+  std::unique_ptr<DependencyGraphIndex> index;
+  bool reusedIndex = false;
+  if (persistIndex && llvm::sys::fs::exists(indexPath)) {
+    index = DependencyGraphIndex::load(indexPath, &error);
+    if (!index) {
+      fprintf(stderr, "warning: %s: ignoring index '%s': %s\n",
+              getProgramName(), indexPath.c_str(), error.c_str());
+    } else if (!isIndexCurrent(*index, *buildDB, dbPath, indexPath)) {
+      index.reset();
+    } else {
+      reusedIndex = true;
+    }
+  }
+  if (!index) {
+    index = DependencyGraphIndex::build(*buildDB, &error);
+    if (!index) {
+      fprintf(stderr, "error: failed to read build db: %s\n\n", error.c_str());
+      return 1;
+    }
+    if (persistIndex && !index->write(indexPath, &error)) {
+      fprintf(stderr, "warning: %s: unable to save index '%s': %s\n",
+              getProgramName(), indexPath.c_str(), error.c_str());
+    }
+  }
+  if (reportTime) {
+    fprintf(stderr, "note: index %s in %.3fms\n",
+            reusedIndex ? "loaded" : "built", elapsedMilliseconds(startTime));
+  }
+  auto queryTime = std::chrono::steady_clock::now();
+
+  std::vector<NodeID> nodes;
+  for (const auto& key: args) {
+    NodeID node;
+    if (!index->lookup(key, &node)) {
+      fprintf(stderr, "error: %s: unknown key: '%s'\n", getProgramName(),
+              key.c_str());
+      return 1;
+    }
+    nodes.push_back(node);
+  }
+
+  // Perform the query, collecting the nodes to print.
+  std::vector<NodeID> result;
+  if (action == "deps" || action == "rdeps") {
+    for (auto node: nodes) {
+      auto edges = action == "deps" ? index->getDependencies(node) :
+        index->getDependents(node);
+      result.insert(result.end(), edges.begin(), edges.end());
+    }
+  } else if (action == "closure") {
+    result = index->getTransitiveDependencies(nodes);
+  } else if (action == "rebuilds") {
+    result = index->getTransitiveDependents(nodes);
+  } else if (action == "path") {
+    result = index->findPath(nodes[0], nodes[1]);
+    if (result.empty()) {
+      fprintf(stderr, "error: %s: '%s' does not depend on '%s'\n",
+              getProgramName(), args[0].c_str(), args[1].c_str());
+      return 1;
+    }
+  } else if (action == "stats") {
+    printf("nodes: %u\nedges: %zu\niteration: %llu\n", index->getNumNodes(),
+           index->getNumEdges(), (unsigned long long)index->getEpoch());
+  } else {
+    fprintf(stderr, "error: %s: invalid action: '%s'\n\n",
+            getProgramName(), action.c_str());
+    usage(1);
+  }
+  double queryMilliseconds = elapsedMilliseconds(queryTime);
+
+  for (auto node: result) {
+    auto key = index->getKey(node);
+    printf("%.*s\n", int(key.size()), key.data());
+  }
+  if (reportTime) {
+    fprintf(stderr, "note: query answered in %.3fms\n", queryMilliseconds);
+  }
+
+  return 0;
+}
@@ -19,6 +19,7 @@
 #include "llbuild/Core/KeyID.h"
 
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringMap.h"
 
 #include "BuildEngineTrace.h"
@@ -43,6 +44,8 @@ Task::~Task() {}
 
 Rule::~Rule() {}
 void Rule::updateStatus(BuildEngine&, StatusKind) {}
+void Rule::getKnownInputs(BuildEngine&,
+                          std::vector<std::pair<KeyType, bool>>&) {}
 
 BuildEngineDelegate::~BuildEngineDelegate() {}
 
@@ -90,6 +93,10 @@ class BuildEngineImpl : public BuildDBDelegate {
   /// The current build iteration, used to sequentially timestamp build results.
   Epoch currentEpoch = 0;
 
+  /// The memory budget for the values and dependencies of rule results kept
+  /// in memory between builds, or zero if unlimited.
+  uint64_t resultMemoryBudget = 0;
+
   /// Whether the build should be cancelled.
   std::atomic<bool> buildCancelled{ false };
 
@@ -185,6 +192,10 @@ class BuildEngineImpl : public BuildDBDelegate {
     /// The current state of the rule.
     StateKind state = StateKind::Incomplete;
     bool wasForced = false;
+    /// Whether the value and dependencies of the result have been released,
+    /// and must be reloaded from the database before use. The remaining fields
+    /// of the result are always kept in memory.
+    bool isResultPagedOut = false;
 
   public:
     bool isScanning() const {
@@ -306,8 +317,17 @@ class BuildEngineImpl : public BuildDBDelegate {
     /// The number of outstanding inputs that this task is waiting on to be
     /// provided.
     unsigned waitCount = 0;
+    /// The number of tasks waiting on this one, including transitively, as
+    /// accumulated by \see addTaskWaiter().
+    uint32_t waiterCount = 0;
+    /// The scheduling priority for jobs spawned by the task, fixed from \see
+    /// waiterCount once its inputs are available.
+    uint32_t priority = 0;
     /// The list of discovered dependencies found during execution of the task.
     AttributedKeyIDs discoveredDependencies;
+    /// The next task in the finished task queue (see \see
+    /// finishedTaskInfosHead).
+    TaskInfo* nextFinishedTaskInfo = nullptr;
 
 #ifndef NDEBUG
     void dump() const {
@@ -338,15 +358,27 @@ class BuildEngineImpl : public BuildDBDelegate {
   /// The number of tasks which have been readied but not yet finished.
   unsigned numOutstandingUnfinishedTasks = 0;
 
-  /// The queue of tasks which are complete, accesses to this member variable
-  /// must be protected via \see finishedTaskInfosMutex.
-  std::vector<TaskInfo*> finishedTaskInfos;
+  /// The queue of tasks which are complete, as an intrusive list linked
+  /// through \see TaskInfo::nextFinishedTaskInfo.
+  ///
+  /// Tasks are pushed onto the list by the lane threads without locking, and
+  /// the engine thread takes the entire list at once (see \see
+  /// takeFinishedTaskInfos()).
+  std::atomic<TaskInfo*> finishedTaskInfosHead{ nullptr };
+
+  /// The finished tasks taken from the queue by the engine thread, but not yet
+  /// processed.
+  TaskInfo* finishedTaskInfosBatch = nullptr;
+
+  /// Whether the engine thread is waiting for tasks to finish, in which case
+  /// it must be notified when a task is enqueued.
+  std::atomic<bool> isWaitingForFinishedTasks{ false };
 
-  /// The mutex that protects finished task infos.
+  /// The mutex used with \see finishedTaskInfosCondition, for waiting.
   std::mutex finishedTaskInfosMutex;
 
   /// This variable is used to signal when additional work is added to the
-  /// FinishedTaskInfos queue, which the engine may need to wait on.
+  /// finished task queue, while the engine is waiting on it.
   std::condition_variable finishedTaskInfosCondition;
 
 
@@ -439,6 +471,13 @@ private:
 
     ruleInfo.wasForced = false;
 
+    // Reload the result, if it was paged out. If that fails the prior result is
+    // unusable, so the rule needs to run.
+    if (!pageInRuleResult(ruleInfo)) {
+      ruleInfo.state = RuleInfo::StateKind::NeedsToRun;
+      return true;
+    }
+
     // If the rule has never been run, it needs to run.
     if (ruleInfo.result.builtAt == 0) {
       if (trace)
@@ -780,8 +819,9 @@ private:
           if (trace)
             trace->addedRulePendingTask(request.inputRuleInfo->rule.get(),
                                         request.taskInfo->task.get());
-          request.inputRuleInfo->getPendingTaskInfo()->requestedBy.push_back(
-            request);
+          TaskInfo* inputTaskInfo = request.inputRuleInfo->getPendingTaskInfo();
+          inputTaskInfo->requestedBy.push_back(request);
+          addTaskWaiter(inputTaskInfo, request.taskInfo);
         }
       }
 
@@ -850,6 +890,9 @@ private:
         // Transition the rule state.
         ruleInfo->setComputing(this);
 
+        // Prioritize the jobs of the task by the work it is blocking.
+        taskInfo->priority = taskInfo->waiterCount;
+
         // Inform the task its inputs are ready and it should finish.
         //
         // FIXME: We need to track this state, and generate an error if this
@@ -868,17 +911,14 @@ private:
       while (true) {
         TracingEngineQueueItemEvent i(EngineQueueItemKind::FinishedTask, buildKey.c_str());
 
-        // Try to take a task from the finished queue.
-        TaskInfo* taskInfo = nullptr;
-        {
-          std::lock_guard<std::mutex> guard(finishedTaskInfosMutex);
-          if (!finishedTaskInfos.empty()) {
-            taskInfo = finishedTaskInfos.back();
-            finishedTaskInfos.pop_back();
-          }
-        }
+        // Try to take a task from the finished queue, taking all of the
+        // available tasks once the current batch is processed.
+        if (!finishedTaskInfosBatch)
+          finishedTaskInfosBatch = takeFinishedTaskInfos();
+        TaskInfo* taskInfo = finishedTaskInfosBatch;
         if (!taskInfo)
           break;
+        finishedTaskInfosBatch = taskInfo->nextFinishedTaskInfo;
 
         didWork = true;
 
@@ -975,15 +1015,7 @@ private:
       if (!didWork && numOutstandingUnfinishedTasks != 0) {
         TracingEngineQueueItemEvent i(EngineQueueItemKind::Waiting, buildKey.c_str());
 
-        // Wait for our condition variable.
-        std::unique_lock<std::mutex> lock(finishedTaskInfosMutex);
-
-        // Ensure we still don't have enqueued operations under the protection
-        // of the mutex, if one has been added then we may have already missed
-        // the condition notification and cannot safely wait.
-        if (finishedTaskInfos.empty()) {
-          finishedTaskInfosCondition.wait(lock);
-        }
+        waitForFinishedTaskInfos();
 
         didWork = true;
       }
@@ -1017,8 +1049,7 @@ private:
   /// be broken.
   bool resolveCycle(const KeyType& buildKey) {
     // Take all available locks, to ensure we dump a consistent state.
-    std::lock_guard<std::mutex> guard1(taskInfosMutex);
-    std::lock_guard<std::mutex> guard2(finishedTaskInfosMutex);
+    std::lock_guard<std::mutex> guard(taskInfosMutex);
 
     std::vector<Rule*> cycleList = findCycle(buildKey);
     assert(!cycleList.empty());
@@ -1253,6 +1284,31 @@ private:
     return requests.end();
   }
 
+  /// Take all of the tasks in the finished queue.
+  ///
+  /// \returns The list of tasks, linked through \see
+  /// TaskInfo::nextFinishedTaskInfo, or null if the queue is empty.
+  TaskInfo* takeFinishedTaskInfos() {
+    if (!finishedTaskInfosHead.load(std::memory_order_relaxed))
+      return nullptr;
+    return finishedTaskInfosHead.exchange(nullptr, std::memory_order_acquire);
+  }
+
+  /// Wait until the finished queue is non-empty.
+  void waitForFinishedTaskInfos() {
+    std::unique_lock<std::mutex> lock(finishedTaskInfosMutex);
+
+    // Publish that we are waiting before checking the queue, so that a task
+    // enqueued after the check will see the flag and notify us (these are
+    // sequentially consistent with the enqueue and the check in
+    // taskIsComplete()).
+    isWaitingForFinishedTasks.store(true);
+    finishedTaskInfosCondition.wait(lock, [&] {
+        return finishedTaskInfosHead.load() != nullptr;
+      });
+    isWaitingForFinishedTasks.store(false);
+  }
+
   // Cancel all of the remaining tasks.
   void cancelRemainingTasks() {
     // We need to wait for any currently running tasks to be reported as
@@ -1264,15 +1320,19 @@ private:
     // we expect clients to implement cancellation in conjection with causing
     // long-running tasks to also cancel and fail, so preserving those results
     // is not valuable.
-    while (numOutstandingUnfinishedTasks != 0) {
-        std::unique_lock<std::mutex> lock(finishedTaskInfosMutex);
-        if (finishedTaskInfos.empty()) {
-          finishedTaskInfosCondition.wait(lock);
-        } else {
-          assert(finishedTaskInfos.size() <= numOutstandingUnfinishedTasks);
-          numOutstandingUnfinishedTasks -= finishedTaskInfos.size();
-          finishedTaskInfos.clear();
-        }
+    while (true) {
+      for (; finishedTaskInfosBatch;
+           finishedTaskInfosBatch =
+             finishedTaskInfosBatch->nextFinishedTaskInfo) {
+        assert(numOutstandingUnfinishedTasks != 0);
+        --numOutstandingUnfinishedTasks;
+      }
+      if (numOutstandingUnfinishedTasks == 0)
+        break;
+
+      finishedTaskInfosBatch = takeFinishedTaskInfos();
+      if (!finishedTaskInfosBatch)
+        waitForFinishedTaskInfos();
     }
 
     std::lock_guard<std::mutex> guard(taskInfosMutex);
@@ -1313,7 +1373,7 @@ private:
     inputRequests.clear();
     finishedInputRequests.clear();
     readyTaskInfos.clear();
-    finishedTaskInfos.clear();
+    assert(!finishedTaskInfosHead && !finishedTaskInfosBatch);
     taskInfos.clear();
   }
 
@@ -1345,12 +1405,18 @@ public:
   // When changing the implementation of those, do also copy
   // the changes to CAPIBuildDB.
   virtual const KeyID getKeyID(const KeyType& key) override {
+    return getKeyID(KeyRef(key));
+  }
+
+  /// Resolve a key view to its identifier, using its precomputed hash.
+  const KeyID getKeyID(KeyRef key) {
     std::lock_guard<std::mutex> guard(keyTableMutex);
 
     // The RHS of the mapping is actually ignored, we use the StringMap's ptr
     // identity because it allows us to efficiently map back to the key string
     // in `getRuleInfoForKey`.
-    auto it = keyTable.insert(std::make_pair(key.str(), KeyID::novalue())).first;
+    auto it = keyTable.try_emplace_with_hash(key.str(), key.getHash(),
+                                             KeyID::novalue()).first;
     return KeyID(it->getKey().data());
   }
 
@@ -1362,6 +1428,10 @@ public:
   }
 
   RuleInfo& getRuleInfoForKey(const KeyType& key) {
+    return getRuleInfoForKey(KeyRef(key));
+  }
+
+  RuleInfo& getRuleInfoForKey(KeyRef key) {
     auto keyID = getKeyID(key);
 
     // Check if we have already found the rule.
@@ -1370,7 +1440,7 @@ public:
       return it->second;
 
     // Otherwise, request it from the delegate and add it.
-    return addRule(keyID, delegate.lookupRule(key));
+    return addRule(keyID, delegate.lookupRule(KeyType(key.str())));
   }
 
   RuleInfo& getRuleInfoForKey(KeyID keyID) {
@@ -1390,6 +1460,111 @@ public:
     return it == taskInfos.end() ? nullptr : &it->second;
   }
 
+  /// Record that \p waiter is waiting on \p taskInfo, for the scheduling
+  /// priority of the latter.
+  ///
+  /// Tasks are prioritized by the number of tasks transitively waiting on them,
+  /// so work which unblocks much of the build (e.g., generating a header used
+  /// by many compiles) is not queued behind leaf work, even without any timing
+  /// history. The count is derived from the waiter's own count, so it is O(1)
+  /// per request: a task reached along several paths is counted once per path,
+  /// and waiters recorded after a task made its request are not propagated.
+  /// The count saturates, to bound it for very large graphs.
+  void addTaskWaiter(TaskInfo* taskInfo, const TaskInfo* waiter) {
+    static const uint32_t maxWaiterCount = 4096;
+    taskInfo->waiterCount = std::min(
+        maxWaiterCount, taskInfo->waiterCount + 1 + waiter->waiterCount);
+  }
+
+  /// Get the scheduling priority of the given task.
+  uint32_t getTaskPriority(Task* task) {
+    std::lock_guard<std::mutex> guard(taskInfosMutex);
+    auto it = taskInfos.find(task);
+    return it == taskInfos.end() ? 0 : it->second.priority;
+  }
+
+  /// @name Result Paging
+  /// @{
+
+  /// Get the approximate memory used by the pageable parts of a result.
+  static uint64_t getPageableResultSize(const Result& result) {
+    return result.value.capacity() +
+      result.dependencies.size() * sizeof(KeyID);
+  }
+
+  /// Reload the value and dependencies of a paged out rule result from the
+  /// database.
+  ///
+  /// \returns False if the result could not be reloaded.
+  bool pageInRuleResult(RuleInfo& ruleInfo) {
+    if (!ruleInfo.isResultPagedOut)
+      return true;
+    ruleInfo.isResultPagedOut = false;
+
+    // The database holds the most recently computed result, only the build
+    // timestamp is maintained solely in memory (\see RuleInfo::setComplete()).
+    Result stored;
+    std::string error;
+    if (!db->lookupRuleResult(ruleInfo.keyID, *ruleInfo.rule, &stored,
+                              &error)) {
+      if (!error.empty()) {
+        delegate.error(error);
+        buildCancelled = true;
+      }
+      return false;
+    }
+    ruleInfo.result.value = std::move(stored.value);
+    ruleInfo.result.dependencies = std::move(stored.dependencies);
+    return true;
+  }
+
+  /// Page out the results of the least recently built rules, until the
+  /// results remaining in memory fit in the memory budget.
+  ///
+  /// This must only be called before starting a build, when no tasks (or
+  /// clients, via the value returned by \see build()) reference any result.
+  void pageOutRuleResults() {
+    if (!db || resultMemoryBudget == 0)
+      return;
+
+    uint64_t residentSize = 0;
+    std::vector<RuleInfo*> candidates;
+    for (auto& entry: ruleInfos) {
+      RuleInfo& ruleInfo = entry.second;
+      if (ruleInfo.isResultPagedOut)
+        continue;
+      residentSize += getPageableResultSize(ruleInfo.result);
+
+      // Only results which were persisted can be paged out.
+      if (ruleInfo.result.builtAt != 0 &&
+          (ruleInfo.state == RuleInfo::StateKind::Complete ||
+           ruleInfo.state == RuleInfo::StateKind::Incomplete))
+        candidates.push_back(&ruleInfo);
+    }
+    if (residentSize <= resultMemoryBudget)
+      return;
+
+    // The build timestamp orders the results by their last use.
+    std::sort(candidates.begin(), candidates.end(),
+              [](const RuleInfo* a, const RuleInfo* b) {
+                return a->result.builtAt < b->result.builtAt;
+              });
+    for (auto* ruleInfo: candidates) {
+      if (residentSize <= resultMemoryBudget)
+        break;
+      residentSize -= getPageableResultSize(ruleInfo->result);
+      ruleInfo->result.value = ValueType();
+      ruleInfo->result.dependencies = AttributedKeyIDs();
+      ruleInfo->isResultPagedOut = true;
+    }
+  }
+
+  void setResultMemoryBudget(uint64_t bytes) {
+    resultMemoryBudget = bytes;
+  }
+
+  /// @}
+
   /// @name Rule Definition
   /// @{
 
@@ -1429,17 +1604,26 @@ public:
     return ruleInfo;
   }
 
+  void replaceRules(llvm::function_ref<bool(const KeyType&)> shouldReplace) {
+    assert(!buildRunning && "invalid replaceRules() call");
+    for (auto& entry: ruleInfos) {
+      RuleInfo& ruleInfo = entry.second;
+      if (!shouldReplace(ruleInfo.rule->key))
+        continue;
+      ruleInfo.rule = delegate.lookupRule(ruleInfo.rule->key);
+    }
+  }
+
   /// @}
 
   /// @name Client API
   /// @{
 
-  const ValueType& build(const KeyType& key) {
+  ValueType build(const KeyType& key) {
     // Protect the engine against invalid concurrent use.
     if (buildRunning.exchange(true)) {
       delegate.error("build engine busy");
-      static ValueType emptyValue{};
-      return emptyValue;
+      return {};
     }
     llbuild_defer {
       buildRunning = false;
@@ -1450,8 +1634,7 @@ public:
       bool result = db->buildStarted(&error);
       if (!result) {
         delegate.error(error);
-        static ValueType emptyValue{};
-        return emptyValue;
+        return {};
       }
     }
     llbuild_defer {
@@ -1463,8 +1646,7 @@ public:
     {
       std::lock_guard<std::mutex> guard(executionQueueMutex);
       if (buildCancelled) {
-        static ValueType emptyValue{};
-        return emptyValue;
+        return {};
       }
       executionQueue = delegate.createExecutionQueue();
     }
@@ -1482,6 +1664,9 @@ public:
       executionQueue.reset();
     };
 
+    // Release the least recently used results, if they exceed the budget.
+    pageOutRuleResults();
+
     // Increment our running iteration count.
     //
     // At this point, we should conceptually mark each complete rule as
@@ -1518,8 +1703,7 @@ public:
       bool result = db->setCurrentIteration(currentEpoch, &error);
       if (!result) {
         delegate.error(error);
-        static ValueType emptyValue{};
-        return emptyValue;
+        return {};
       }
     }
 
@@ -1528,8 +1712,7 @@ public:
 
     // If the build failed, return the empty result.
     if (!success) {
-      static ValueType emptyValue{};
-      return emptyValue;
+      return {};
     }
 
     // The task queue should be empty and the rule complete.
@@ -1538,6 +1721,107 @@ public:
     return ruleInfo.result.value;
   }
 
+  std::vector<PredictedRule> predict(const KeyType& key) {
+    std::vector<PredictedRule> predicted;
+
+    // Protect the engine against invalid concurrent use.
+    if (buildRunning.exchange(true)) {
+      delegate.error("build engine busy");
+      return predicted;
+    }
+    llbuild_defer {
+      buildRunning = false;
+    };
+
+    // This mirrors scanRule() and processRuleScanRequest(), but walks the
+    // inputs directly instead of demanding them, and never changes the rule
+    // state. The rule state cannot be consulted either: a rule completed by the
+    // last build looks up to date until the next build increments the epoch.
+    struct PredictionItem {
+      RuleInfo* ruleInfo;
+      /// The inputs reported by Rule::getKnownInputs(), which are visited
+      /// before the recorded dependencies.
+      std::vector<std::pair<KeyType, bool>> knownInputs;
+      size_t inputIndex;
+      bool needsToRun;
+      PredictedRule::Reason reason;
+      RuleInfo* input;
+    };
+    std::vector<PredictionItem> stack;
+
+    // The rules visited so far, mapped to whether they would run. Rules still
+    // on the stack map to false, so cycles do not cause a rule to run.
+    std::unordered_map<RuleInfo*, bool> willRun;
+
+    auto visit = [&](RuleInfo& ruleInfo) {
+      willRun.emplace(&ruleInfo, false);
+      PredictionItem item{ &ruleInfo, {}, 0, true,
+                           PredictedRule::Reason::NeverBuilt, nullptr };
+      ruleInfo.rule->getKnownInputs(buildEngine, item.knownInputs);
+      if (!pageInRuleResult(ruleInfo) || ruleInfo.result.builtAt == 0) {
+        item.reason = PredictedRule::Reason::NeverBuilt;
+      } else if (ruleInfo.rule->signature != ruleInfo.result.signature) {
+        item.reason = PredictedRule::Reason::SignatureChanged;
+      } else if (!ruleInfo.rule->isResultValid(buildEngine,
+                                               ruleInfo.result.value)) {
+        item.reason = PredictedRule::Reason::InvalidValue;
+      } else {
+        item.needsToRun = false;
+      }
+      stack.push_back(std::move(item));
+    };
+
+    visit(getRuleInfoForKey(key));
+    while (!stack.empty()) {
+      auto& item = stack.back();
+      auto& ruleInfo = *item.ruleInfo;
+
+      // Visit the inputs, even once the rule is known to run, since running it
+      // will request them.
+      size_t numKnownInputs = item.knownInputs.size();
+      if (item.inputIndex !=
+          numKnownInputs + ruleInfo.result.dependencies.size()) {
+        RuleInfo* inputRuleInfo;
+        bool orderOnly = false;
+        if (item.inputIndex < numKnownInputs) {
+          const auto& keyAndFlag = item.knownInputs[item.inputIndex];
+          inputRuleInfo = &getRuleInfoForKey(keyAndFlag.first);
+          orderOnly = keyAndFlag.second;
+        } else {
+          const auto& keyAndFlag =
+            ruleInfo.result.dependencies[item.inputIndex - numKnownInputs];
+          inputRuleInfo = &getRuleInfoForKey(keyAndFlag.keyID);
+          orderOnly = keyAndFlag.flag;
+        }
+        auto it = willRun.find(inputRuleInfo);
+        if (it == willRun.end()) {
+          visit(*inputRuleInfo);
+          continue;
+        }
+
+        // Order-only inputs never cause a rule to run.
+        if (!item.needsToRun && !orderOnly &&
+            (it->second ||
+             ruleInfo.result.builtAt < inputRuleInfo->result.computedAt)) {
+          item.needsToRun = true;
+          item.reason = PredictedRule::Reason::InputRebuilt;
+          item.input = inputRuleInfo;
+        }
+        ++item.inputIndex;
+        continue;
+      }
+
+      willRun[&ruleInfo] = item.needsToRun;
+      if (item.needsToRun) {
+        predicted.push_back({ ruleInfo.rule->key, item.reason,
+                              item.input ? item.input->rule->key : KeyType() });
+      }
+      stack.pop_back();
+    }
+
+    return predicted;
+  }
+
   void resetForBuild() {
     std::lock_guard<std::mutex> guard(executionQueueMutex);
     buildCancelled = false;
@@ -1603,8 +1887,8 @@ public:
     fprintf(fp, "\n");
 
     // Create a canonical node ordering.
-    std::vector<const RuleInfo*> orderedRuleInfos;
-    for (const auto& entry: ruleInfos)
+    std::vector<RuleInfo*> orderedRuleInfos;
+    for (auto& entry: ruleInfos)
       orderedRuleInfos.push_back(&entry.second);
     std::sort(orderedRuleInfos.begin(), orderedRuleInfos.end(),
               [] (const RuleInfo* a, const RuleInfo* b) {
@@ -1614,6 +1898,7 @@ public:
     // Write out all of the rules.
     for (const auto& ruleInfo: orderedRuleInfos) {
       fprintf(fp, "\"%s\"\n", ruleInfo->rule->key.c_str());
+      (void)pageInRuleResult(*ruleInfo);
       for (auto keyIDAndFlag: ruleInfo->result.dependencies) {
         const auto& dependency = getRuleInfoForKey(keyIDAndFlag.keyID);
         fprintf(fp, "\"%s\" -> \"%s\"\n", ruleInfo->rule->key.c_str(),
@@ -1627,7 +1912,7 @@ public:
     fclose(fp);
   }
 
-  void addTaskInputRequest(Task* task, const KeyType& key, uintptr_t inputID, bool orderOnly) {
+  void addTaskInputRequest(Task* task, KeyRef key, uintptr_t inputID, bool orderOnly) {
     auto taskInfo = getTaskInfo(task);
 
     // Validate that the task is in a valid state to request inputs.
@@ -1648,7 +1933,7 @@ public:
   /// @name Task Management Client APIs
   /// @{
 
-  void taskNeedsInput(Task* task, const KeyType& key, uintptr_t inputID) {
+  void taskNeedsInput(Task* task, KeyRef key, uintptr_t inputID) {
     // Validate the InputID.
     if (inputID > BuildEngine::kMaximumInputID) {
       delegate.error("attempt to use reserved input ID");
@@ -1659,13 +1944,13 @@ public:
     addTaskInputRequest(task, key, inputID, false);
   }
 
-  void taskMustFollow(Task* task, const KeyType& key) {
+  void taskMustFollow(Task* task, KeyRef key) {
     // The inputID is not used when taskMustFollow is used.
     // (The user-supplied provideValue() is not called).
     addTaskInputRequest(task, key, kMustFollowInputID, true);
   }
 
-  void taskDiscoveredDependency(Task* task, const KeyType& key) {
+  void taskDiscoveredDependency(Task* task, KeyRef key) {
     // Find the task info.
     auto taskInfo = getTaskInfo(task);
     assert(taskInfo && "cannot request inputs for an unknown task");
@@ -1710,13 +1995,18 @@ public:
     }
 
     // Enqueue the finished task.
-    {
+    TaskInfo* head = finishedTaskInfosHead.load(std::memory_order_relaxed);
+    do {
+      taskInfo->nextFinishedTaskInfo = head;
+    } while (!finishedTaskInfosHead.compare_exchange_weak(head, taskInfo));
+
+    // Notify the engine to wake up, if it is waiting. The engine is only
+    // signalled under the mutex, so the notification can't be lost between
+    // its check of the queue and its wait.
+    if (isWaitingForFinishedTasks.load()) {
       std::lock_guard<std::mutex> guard(finishedTaskInfosMutex);
-      finishedTaskInfos.push_back(taskInfo);
+      finishedTaskInfosCondition.notify_one();
     }
-
-    // Notify the engine to wake up, if necessary.
-    finishedTaskInfosCondition.notify_one();
   }
 
   /// @}
@@ -1746,16 +2036,28 @@ BuildEngineDelegate* TaskInterface::delegate() {
 }
 
 void TaskInterface::request(const KeyType& key, uintptr_t inputID) {
+  request(KeyRef(key), inputID);
+}
+
+void TaskInterface::request(KeyRef key, uintptr_t inputID) {
   Task* task = static_cast<Task*>(ctx);
   static_cast<BuildEngineImpl*>(impl)->taskNeedsInput(task, key, inputID);
 }
 
 void TaskInterface::mustFollow(const KeyType& key) {
+  mustFollow(KeyRef(key));
+}
+
+void TaskInterface::mustFollow(KeyRef key) {
   Task* task = static_cast<Task*>(ctx);
   static_cast<BuildEngineImpl*>(impl)->taskMustFollow(task, key);
 }
 
 void TaskInterface::discoveredDependency(const KeyType& key) {
+  discoveredDependency(KeyRef(key));
+}
+
+void TaskInterface::discoveredDependency(KeyRef key) {
   Task* task = static_cast<Task*>(ctx);
   static_cast<BuildEngineImpl*>(impl)->taskDiscoveredDependency(task, key);
 }
@@ -1768,7 +2070,9 @@ void TaskInterface::complete(ValueType &&value, bool forceChange) {
 
 void TaskInterface::spawn(basic::QueueJob&& job) {
   // FIXME: handle environment
-  static_cast<BuildEngineImpl*>(impl)->getExecutionQueue().addJob(std::move(job));
+  auto engine = static_cast<BuildEngineImpl*>(impl);
+  job.setPriority(engine->getTaskPriority(static_cast<Task*>(ctx)));
+  engine->getExecutionQueue().addJob(std::move(job));
 }
 
 void TaskInterface::spawn(basic::QueueJobContext *context,
@@ -1811,10 +2115,19 @@ void BuildEngine::addRule(std::unique_ptr<Rule>&& rule) {
   static_cast<BuildEngineImpl*>(impl)->addRule(std::move(rule));
 }
 
-const ValueType& BuildEngine::build(const KeyType& key) {
+void BuildEngine::replaceRules(
+    llvm::function_ref<bool(const KeyType&)> shouldReplace) {
+  static_cast<BuildEngineImpl*>(impl)->replaceRules(shouldReplace);
+}
+
+ValueType BuildEngine::build(const KeyType& key) {
   return static_cast<BuildEngineImpl*>(impl)->build(key);
 }
 
+std::vector<PredictedRule> BuildEngine::predict(const KeyType& key) {
+  return static_cast<BuildEngineImpl*>(impl)->predict(key);
+}
+
 void BuildEngine::resetForBuild() {
   static_cast<BuildEngineImpl*>(impl)->resetForBuild();
 }
@@ -1827,6 +2140,10 @@ bool BuildEngine::isCancelled() {
   return static_cast<BuildEngineImpl*>(impl)->isCancelled();
 }
 
+void BuildEngine::setResultMemoryBudget(uint64_t bytes) {
+  static_cast<BuildEngineImpl*>(impl)->setResultMemoryBudget(bytes);
+}
+
 void BuildEngine::dumpGraphToFile(const std::string& path) {
   static_cast<BuildEngineImpl*>(impl)->dumpGraphToFile(path);
 }
@@ -0,0 +1,390 @@
+//===-- DependencyGraphIndex.cpp ------------------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Core/DependencyGraphIndex.h"
+
+#include "llbuild/Core/BuildDB.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <mutex>
+
+using namespace llbuild;
+using namespace llbuild::core;
+
+namespace {
+
+/// Assigns each key a dense number, in the order the keys are first seen.
+class DenseKeyDelegate : public BuildDBDelegate {
+  std::mutex keysMutex;
+  llvm::StringMap<uint32_t> keyNumbers;
+
+public:
+  /// The keys, by number.
+  std::vector<StringRef> keys;
+
+  virtual const KeyID getKeyID(const KeyType& key) override {
+    std::lock_guard<std::mutex> guard(keysMutex);
+    auto it = keyNumbers.try_emplace(key.str(), uint32_t(keys.size()));
+    if (it.second)
+      keys.push_back(it.first->getKey());
+    return KeyID(it.first->getKey().data());
+  }
+
+  virtual KeyType getKeyForID(const KeyID key) override {
+    return getEntry(key).getKey();
+  }
+
+  /// Get the number of the key with the given ID.
+  uint32_t getKeyNumber(KeyID key) const { return getEntry(key).getValue(); }
+
+private:
+  static const llvm::StringMapEntry<uint32_t>& getEntry(KeyID key) {
+    // The entries never move once created.
+    return llvm::StringMapEntry<uint32_t>::GetStringMapEntryFromKeyData(
+        (const char*)(uintptr_t)key.value());
+  }
+};
+
+/// The header of a persisted index, which is followed by the key offsets,
+/// dependency offsets, dependencies, dependent offsets, dependents and key
+/// data, in that order.
+struct IndexFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrderMark;
+  uint64_t epoch;
+  uint64_t numNodes;
+  uint64_t numEdges;
+  uint64_t keyDataSize;
+};
+
+const char indexFileMagic[8] = { 'L', 'L', 'B', 'D', 'G', 'I', 'D', 'X' };
+
+/// The version of the persisted index format.
+///
+/// Version History:
+///
+/// * 1: Initial version.
+const uint32_t indexFileVersion = 1;
+
+const uint32_t indexFileByteOrderMark = 0x01020304;
+
+/// Convert a vector of per-node counts into offsets, in place, appending the
+/// total.
+void countsToOffsets(std::vector<uint32_t>& counts) {
+  uint32_t offset = 0;
+  for (auto& count: counts) {
+    auto next = offset + count;
+    count = offset;
+    offset = next;
+  }
+  counts.push_back(offset);
+}
+
+/// Check that \p offsets are a valid CSR offset array over \p size elements.
+bool validOffsets(const std::vector<uint32_t>& offsets, uint64_t size) {
+  if (offsets.front() != 0 || offsets.back() != size)
+    return false;
+  return std::is_sorted(offsets.begin(), offsets.end());
+}
+
+}
+
+std::unique_ptr<DependencyGraphIndex>
+DependencyGraphIndex::build(BuildDB& db, std::string* error_out) {
+  std::unique_ptr<DependencyGraphIndex> index(new DependencyGraphIndex());
+
+  bool success = false;
+  index->epoch = db.getCurrentEpoch(&success, error_out);
+  if (!success)
+    return nullptr;
+
+  DenseKeyDelegate delegate;
+  db.attachDelegate(&delegate);
+  std::vector<KeyType> keys;
+  std::vector<Result> results;
+  success = db.getKeysWithResult(keys, results, error_out);
+  db.attachDelegate(nullptr);
+  if (!success)
+    return nullptr;
+
+  // Number the nodes in key order, so they can be found by binary search.
+  auto numNodes = delegate.keys.size();
+  if (numNodes >= std::numeric_limits<NodeID>::max()) {
+    *error_out = "too many keys in database";
+    return nullptr;
+  }
+  std::vector<uint32_t> order(numNodes);
+  for (uint32_t i = 0; i != numNodes; ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&](uint32_t lhs, uint32_t rhs) {
+    return delegate.keys[lhs] < delegate.keys[rhs];
+  });
+  std::vector<NodeID> nodeForKeyNumber(numNodes);
+  index->keyOffsets.reserve(numNodes + 1);
+  for (uint32_t i = 0; i != numNodes; ++i) {
+    auto key = delegate.keys[order[i]];
+    if (index->keyData.size() + key.size() >
+        std::numeric_limits<uint32_t>::max()) {
+      *error_out = "database keys are too large to index";
+      return nullptr;
+    }
+    nodeForKeyNumber[order[i]] = i;
+    index->keyOffsets.push_back(index->keyData.size());
+    index->keyData += key;
+  }
+  index->keyOffsets.push_back(index->keyData.size());
+
+  // Lay out each node's dependencies, dropping duplicates (which have no
+  // meaning to the engine).
+  const uint32_t noResult = std::numeric_limits<uint32_t>::max();
+  std::vector<uint32_t> resultForNode(numNodes, noResult);
+  for (uint32_t i = 0, e = results.size(); i != e; ++i) {
+    auto node = nodeForKeyNumber[delegate.getKeyNumber(
+        delegate.getKeyID(keys[i]))];
+    resultForNode[node] = i;
+  }
+  std::vector<NodeID> lastDependent(numNodes, noResult);
+  std::vector<uint32_t> dependentCounts(numNodes);
+  index->dependencyOffsets.reserve(numNodes + 1);
+  for (NodeID node = 0; node != numNodes; ++node) {
+    index->dependencyOffsets.push_back(index->dependencies.size());
+    if (resultForNode[node] == noResult)
+      continue;
+    for (auto keyIDAndFlag: results[resultForNode[node]].dependencies) {
+      auto dependency =
+          nodeForKeyNumber[delegate.getKeyNumber(keyIDAndFlag.keyID)];
+      if (lastDependent[dependency] == node)
+        continue;
+      lastDependent[dependency] = node;
+      index->dependencies.push_back(dependency);
+      ++dependentCounts[dependency];
+    }
+    if (index->dependencies.size() >= std::numeric_limits<uint32_t>::max()) {
+      *error_out = "too many dependencies in database";
+      return nullptr;
+    }
+  }
+  index->dependencyOffsets.push_back(index->dependencies.size());
+
+  // Lay out the reverse edges, which are then in node order.
+  countsToOffsets(dependentCounts);
+  index->dependentOffsets = dependentCounts;
+  index->dependents.resize(index->dependencies.size());
+  for (NodeID node = 0; node != numNodes; ++node) {
+    for (auto dependency: index->getDependencies(node))
+      index->dependents[dependentCounts[dependency]++] = node;
+  }
+
+  return index;
+}
+
+std::unique_ptr<DependencyGraphIndex>
+DependencyGraphIndex::load(StringRef path, std::string* error_out) {
+  auto bufferOrError = llvm::MemoryBuffer::getFile(
+      path, /*FileSize=*/-1, /*RequiresNullTerminator=*/false);
+  if (!bufferOrError) {
+    *error_out = "unable to read index: " + bufferOrError.getError().message();
+    return nullptr;
+  }
+  StringRef data = (*bufferOrError)->getBuffer();
+
+  auto invalid = [&]() -> std::unique_ptr<DependencyGraphIndex> {
+    *error_out = "invalid index file";
+    return nullptr;
+  };
+
+  IndexFileHeader header;
+  if (data.size() < sizeof(header))
+    return invalid();
+  memcpy(&header, data.data(), sizeof(header));
+  if (memcmp(header.magic, indexFileMagic, sizeof(indexFileMagic)) != 0 ||
+      header.byteOrderMark != indexFileByteOrderMark)
+    return invalid();
+  if (header.version != indexFileVersion) {
+    *error_out = "unsupported index file version";
+    return nullptr;
+  }
+  if (header.numNodes >= std::numeric_limits<NodeID>::max() ||
+      header.numEdges > std::numeric_limits<uint32_t>::max() ||
+      header.keyDataSize > std::numeric_limits<uint32_t>::max())
+    return invalid();
+  uint64_t expectedSize = sizeof(header) +
+    3 * (header.numNodes + 1) * sizeof(uint32_t) +
+    2 * header.numEdges * sizeof(NodeID) + header.keyDataSize;
+  if (data.size() != expectedSize)
+    return invalid();
+
+  std::unique_ptr<DependencyGraphIndex> index(new DependencyGraphIndex());
+  index->epoch = header.epoch;
+  const char* pos = data.data() + sizeof(header);
+  auto readArray = [&](std::vector<uint32_t>& array, uint64_t count) {
+    array.resize(count);
+    if (count != 0)
+      memcpy(array.data(), pos, count * sizeof(uint32_t));
+    pos += count * sizeof(uint32_t);
+  };
+  readArray(index->keyOffsets, header.numNodes + 1);
+  readArray(index->dependencyOffsets, header.numNodes + 1);
+  readArray(index->dependencies, header.numEdges);
+  readArray(index->dependentOffsets, header.numNodes + 1);
+  readArray(index->dependents, header.numEdges);
+  index->keyData.assign(pos, header.keyDataSize);
+
+  // Validate the structure, so that queries never read out of bounds.
+  if (!validOffsets(index->keyOffsets, header.keyDataSize) ||
+      !validOffsets(index->dependencyOffsets, header.numEdges) ||
+      !validOffsets(index->dependentOffsets, header.numEdges))
+    return invalid();
+  for (auto* edges: { &index->dependencies, &index->dependents }) {
+    for (auto node: *edges) {
+      if (node >= header.numNodes)
+        return invalid();
+    }
+  }
+
+  return index;
+}
+
+bool DependencyGraphIndex::write(StringRef path, std::string* error_out) const {
+  IndexFileHeader header;
+  memcpy(header.magic, indexFileMagic, sizeof(indexFileMagic));
+  header.version = indexFileVersion;
+  header.byteOrderMark = indexFileByteOrderMark;
+  header.epoch = epoch;
+  header.numNodes = getNumNodes();
+  header.numEdges = getNumEdges();
+  header.keyDataSize = keyData.size();
+
+  // Write to a temporary file beside the index and move it into place, so
+  // readers never observe a partially written index.
+  int fd;
+  SmallString<256> tmpPath;
+  if (auto ec = llvm::sys::fs::createUniqueFile(path + "-%%%%%%%%.tmp", fd,
+                                                tmpPath)) {
+    *error_out = "unable to create index: " + ec.message();
+    return false;
+  }
+  {
+    llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+    auto writeArray = [&](const std::vector<uint32_t>& array) {
+      os.write((const char*)array.data(), array.size() * sizeof(uint32_t));
+    };
+    os.write((const char*)&header, sizeof(header));
+    writeArray(keyOffsets);
+    writeArray(dependencyOffsets);
+    writeArray(dependencies);
+    writeArray(dependentOffsets);
+    writeArray(dependents);
+    os << keyData;
+    os.close();
+    if (os.has_error()) {
+      os.clear_error();
+      (void)llvm::sys::fs::remove(tmpPath);
+      *error_out = "unable to write index";
+      return false;
+    }
+  }
+  if (auto ec = llvm::sys::fs::rename(tmpPath, path)) {
+    (void)llvm::sys::fs::remove(tmpPath);
+    *error_out = "unable to write index: " + ec.message();
+    return false;
+  }
+  return true;
+}
+
+bool DependencyGraphIndex::lookup(StringRef key, NodeID* id_out) const {
+  NodeID lo = 0, hi = getNumNodes();
+  while (lo != hi) {
+    NodeID mid = lo + (hi - lo) / 2;
+    if (getKey(mid) < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == getNumNodes() || getKey(lo) != key)
+    return false;
+  *id_out = lo;
+  return true;
+}
+
+/// Find every node reachable from \p roots along the edges given by \p edges.
+template<typename EdgesFn>
+static std::vector<DependencyGraphIndex::NodeID>
+reachableNodes(unsigned numNodes, ArrayRef<DependencyGraphIndex::NodeID> roots,
+               const EdgesFn& edges) {
+  std::vector<bool> visited(numNodes);
+  std::vector<DependencyGraphIndex::NodeID> stack(roots.begin(), roots.end());
+  for (auto root: roots)
+    visited[root] = true;
+  std::vector<DependencyGraphIndex::NodeID> result;
+  while (!stack.empty()) {
+    auto node = stack.back();
+    stack.pop_back();
+    for (auto next: edges(node)) {
+      if (visited[next])
+        continue;
+      visited[next] = true;
+      result.push_back(next);
+      stack.push_back(next);
+    }
+  }
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+std::vector<DependencyGraphIndex::NodeID>
+DependencyGraphIndex::getTransitiveDependencies(ArrayRef<NodeID> roots) const {
+  return reachableNodes(getNumNodes(), roots,
+                        [&](NodeID node) { return getDependencies(node); });
+}
+
+std::vector<DependencyGraphIndex::NodeID>
+DependencyGraphIndex::getTransitiveDependents(ArrayRef<NodeID> roots) const {
+  return reachableNodes(getNumNodes(), roots,
+                        [&](NodeID node) { return getDependents(node); });
+}
+
+std::vector<DependencyGraphIndex::NodeID>
+DependencyGraphIndex::findPath(NodeID from, NodeID to) const {
+  // Breadth first search from the source, recording how each node was
+  // reached.
+  const NodeID unvisited = std::numeric_limits<NodeID>::max();
+  std::vector<NodeID> reachedFrom(getNumNodes(), unvisited);
+  std::vector<NodeID> queue{ from };
+  reachedFrom[from] = from;
+  for (size_t i = 0; i != queue.size() && reachedFrom[to] == unvisited; ++i) {
+    for (auto next: getDependencies(queue[i])) {
+      if (reachedFrom[next] != unvisited)
+        continue;
+      reachedFrom[next] = queue[i];
+      queue.push_back(next);
+    }
+  }
+  if (reachedFrom[to] == unvisited)
+    return {};
+
+  std::vector<NodeID> path{ to };
+  while (path.back() != from)
+    path.push_back(reachedFrom[path.back()]);
+  std::reverse(path.begin(), path.end());
+  return path;
+}
@@ -13,6 +13,8 @@
 #include "llbuild/Core/BuildDB.h"
 
 #include "llbuild/Basic/BinaryCoding.h"
+#include "llbuild/Basic/Compression.h"
+#include "llbuild/Basic/Hashing.h"
 #include "llbuild/Basic/PlatformUtility.h"
 #include "llbuild/Core/BuildEngine.h"
 
@@ -66,6 +68,8 @@ namespace {
 
 class SQLiteBuildDB : public BuildDB {
   /// Version History:
+  /// * 14: Add command outputs.
+  /// * 13: Add auxiliary values.
   /// * 12: Tagging dependencies with order-only flag.
   /// * 11: Add result timestamps
   /// * 10: Add result signature
@@ -75,13 +79,17 @@ class SQLiteBuildDB : public BuildDB {
   /// * 6: Added `ordinal` field for dependencies.
   /// * 5: Switched to using `WITHOUT ROWID` for dependencies.
   /// * 4: Pre-history
-  static const int currentSchemaVersion = 12;
+  static const int currentSchemaVersion = 14;
 
   std::string path;
   uint32_t clientSchemaVersion;
   /// If this is `true`, the database will be re-created if the client/schema version mismatches.
   /// If `false`, it will not be re-created but returns an error instead.
   bool recreateOnUnmatchedVersion;
+  SQLiteBuildDBDurability durability;
+  /// If this is `true`, the database is only read, from a snapshot which is
+  /// held from the first access until \see buildComplete().
+  bool readOnly;
 
   sqlite3 *db = nullptr;
 
@@ -101,13 +109,45 @@ class SQLiteBuildDB : public BuildDB {
     outStream << "error: accessing build database \"" << filename << "\": " << err_message;
 
     if (err_code == SQLITE_BUSY || err_code == SQLITE_LOCKED) {
-      outStream << " Possibly there are two concurrent builds running in the same filesystem location.";
+      if (readOnly) {
+        outStream << " A build may be running; snapshots can only be read during a build if the database uses a write-ahead log (the 'normal' or 'fast' durability).";
+      } else {
+        outStream << " Possibly there are two concurrent builds running in the same filesystem location.";
+      }
     }
 
     outStream.flush();
     return out;
   }
 
+  /// Configure the journaling and sync policy of the open connection.
+  bool configureDurability(std::string *error_out) {
+    // Switching the journal mode needs exclusive access to the file, so it is
+    // best effort; a write-ahead log synced on every transaction is as durable
+    // as the rollback journal.
+    const char* journalMode =
+      durability == SQLiteBuildDBDurability::Strict ? "DELETE" : "WAL";
+    char* query = sqlite3_mprintf("PRAGMA journal_mode = %s;", journalMode);
+    (void)sqlite3_exec(db, query, nullptr, nullptr, nullptr);
+    sqlite3_free(query);
+
+    const char* pragmas = nullptr;
+    switch (durability) {
+    case SQLiteBuildDBDurability::Strict:
+    case SQLiteBuildDBDurability::Normal:
+      pragmas = "PRAGMA synchronous = FULL;";
+      break;
+    case SQLiteBuildDBDurability::Fast:
+      pragmas = ("PRAGMA synchronous = NORMAL; "
+                 "PRAGMA mmap_size = 268435456; "
+                 "PRAGMA cache_size = -65536;");
+      break;
+    }
+    int result = sqlite3_exec(db, pragmas, nullptr, nullptr, nullptr);
+    checkSQLiteResultOKReturnFalse(result);
+    return true;
+  }
+
   bool open(std::string *error_out) {
     // The db is opened lazily whenever an operation on it occurs. Thus if it is
     // already open, we don't need to do any further work.
@@ -128,14 +168,28 @@ class SQLiteBuildDB : public BuildDB {
         }
     }
 
-    int result = sqlite3_open(path.c_str(), &db);
+    int result = sqlite3_open_v2(
+        path.c_str(), &db,
+        readOnly ? SQLITE_OPEN_READONLY
+                 : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE),
+        nullptr);
     if (result != SQLITE_OK) {
       *error_out = "unable to open database: " + std::string(
           sqlite3_errstr(result));
+      sqlite3_close(db);
+      db = nullptr;
       return false;
     }
 
     sqlite3_busy_timeout(db, 5000);
+
+    // Readers perform all of their queries in a single transaction, so that
+    // they see a consistent snapshot. With a write-ahead log, this does not
+    // block (and is not blocked by) a concurrent build.
+    if (readOnly) {
+      result = sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
+      checkSQLiteResultOKReturnFalse(result);
+    }
     // Create the database schema, if necessary.
     char *cError;
     int version;
@@ -178,7 +232,10 @@ class SQLiteBuildDB : public BuildDB {
         return false;
       }
 
-      // Always recreate the database from scratch when the schema changes.
+      // Always recreate the database from scratch when the schema changes,
+      // including any write-ahead log left by a previous connection.
+      (void)basic::sys::unlink((path + "-wal").c_str());
+      (void)basic::sys::unlink((path + "-shm").c_str());
       result = basic::sys::unlink(path.c_str());
       if (result == -1) {
         if (errno != ENOENT) {
@@ -238,6 +295,33 @@ class SQLiteBuildDB : public BuildDB {
                "FOREIGN KEY(key_id) REFERENCES key_names(id));"),
           nullptr, nullptr, &cError);
       }
+      if (result == SQLITE_OK) {
+        result = sqlite3_exec(
+          db, ("CREATE TABLE auxiliary_values ("
+               "key STRING PRIMARY KEY, "
+               "value BLOB);"),
+          nullptr, nullptr, &cError);
+      }
+
+      // Command outputs are compressed, and identical outputs (e.g., the same
+      // warning from a header included by many sources) are stored once.
+      if (result == SQLITE_OK) {
+        result = sqlite3_exec(
+          db, ("CREATE TABLE output_blobs ("
+               "id INTEGER PRIMARY KEY, "
+               "hash INTEGER, "
+               "data BLOB);"),
+          nullptr, nullptr, &cError);
+      }
+      if (result == SQLITE_OK) {
+        result = sqlite3_exec(
+          db, ("CREATE TABLE command_outputs ("
+               "key_id INTEGER PRIMARY KEY, "
+               "blob_id INTEGER, "
+               "FOREIGN KEY(key_id) REFERENCES key_names(id), "
+               "FOREIGN KEY(blob_id) REFERENCES output_blobs(id));"),
+          nullptr, nullptr, &cError);
+      }
 
       // Create the indices on the rule tables.
       if (result == SQLITE_OK) {
@@ -247,6 +331,11 @@ class SQLiteBuildDB : public BuildDB {
             db, "CREATE UNIQUE INDEX rule_results_idx ON rule_results (key_id);",
             nullptr, nullptr, &cError);
       }
+      if (result == SQLITE_OK) {
+        result = sqlite3_exec(
+            db, "CREATE INDEX output_blobs_idx ON output_blobs (hash);",
+            nullptr, nullptr, &cError);
+      }
 
       // Sync changes to disk.
       if (result == SQLITE_OK) {
@@ -263,47 +352,26 @@ class SQLiteBuildDB : public BuildDB {
       }
     }
 
-    // Initialize prepared statements.
-    result = sqlite3_prepare_v2(
-      db, findKeyIDForKeyStmtSQL,
-      -1, &findKeyIDForKeyStmt, nullptr);
-    checkSQLiteResultOKReturnFalse(result);
-
-    result = sqlite3_prepare_v2(
-      db, findKeyNameForKeyIDStmtSQL,
-      -1, &findKeyNameForKeyIDStmt, nullptr);
-    checkSQLiteResultOKReturnFalse(result);
-
-    result = sqlite3_prepare_v2(
-      db, insertIntoKeysStmtSQL,
-      -1, &insertIntoKeysStmt, nullptr);
-    checkSQLiteResultOKReturnFalse(result);
-
-    result = sqlite3_prepare_v2(
-      db, insertIntoRuleResultsStmtSQL,
-      -1, &insertIntoRuleResultsStmt, nullptr);
-    checkSQLiteResultOKReturnFalse(result);
+    if (!readOnly && !configureDurability(error_out)) {
+      sqlite3_close(db);
+      db = nullptr;
+      return false;
+    }
 
-    result = sqlite3_prepare_v2(
-      db, deleteFromKeysStmtSQL,
-      -1, &deleteFromKeysStmt, nullptr);
-    checkSQLiteResultOKReturnFalse(result);
+    // Prepared statements are created on first use, see prepareStatement().
 
-    result = sqlite3_prepare_v2(
-      db, findRuleResultStmtSQL,
-      -1, &findRuleResultStmt, nullptr);
-    checkSQLiteResultOKReturnFalse(result);
+    return true;
+  }
 
-    result = sqlite3_prepare_v2(
-      db, fastFindRuleResultStmtSQL,
-      -1, &fastFindRuleResultStmt, nullptr);
-    checkSQLiteResultOKReturnFalse(result);
-    
-    result = sqlite3_prepare_v2(
-      db, getKeysWithResultStmtSQL,
-      -1, &getKeysWithResultStmt, nullptr);
+  /// Prepare \p stmt from \p sql, unless it has already been prepared.
+  ///
+  /// Statements are prepared on first use rather than when the database is
+  /// opened, so a build only compiles the queries it actually performs.
+  bool prepareStatement(sqlite3_stmt** stmt, const char* sql,
+                        std::string* error_out) {
+    if (*stmt) return true;
+    int result = sqlite3_prepare_v2(db, sql, -1, stmt, nullptr);
     checkSQLiteResultOKReturnFalse(result);
-
     return true;
   }
 
@@ -327,6 +395,22 @@ class SQLiteBuildDB : public BuildDB {
     insertIntoRuleResultsStmt = nullptr;
     sqlite3_finalize(getKeysWithResultStmt);
     getKeysWithResultStmt = nullptr;
+    sqlite3_finalize(findAuxiliaryValueStmt);
+    findAuxiliaryValueStmt = nullptr;
+    sqlite3_finalize(insertIntoAuxiliaryValuesStmt);
+    insertIntoAuxiliaryValuesStmt = nullptr;
+    sqlite3_finalize(findCommandOutputStmt);
+    findCommandOutputStmt = nullptr;
+    sqlite3_finalize(findCommandOutputBlobStmt);
+    findCommandOutputBlobStmt = nullptr;
+    sqlite3_finalize(findOutputBlobsStmt);
+    findOutputBlobsStmt = nullptr;
+    sqlite3_finalize(insertIntoOutputBlobsStmt);
+    insertIntoOutputBlobsStmt = nullptr;
+    sqlite3_finalize(insertIntoCommandOutputsStmt);
+    insertIntoCommandOutputsStmt = nullptr;
+    sqlite3_finalize(deleteFromCommandOutputsStmt);
+    deleteFromCommandOutputsStmt = nullptr;
 
     int result = sqlite3_close(db);
     (void)result; // use the variable if we're building without asserts
@@ -335,8 +419,13 @@ class SQLiteBuildDB : public BuildDB {
   }
 
 public:
-  SQLiteBuildDB(StringRef path, uint32_t clientSchemaVersion, bool recreateOnUnmatchedVersion)
-    : path(path), clientSchemaVersion(clientSchemaVersion), recreateOnUnmatchedVersion(recreateOnUnmatchedVersion) { }
+  SQLiteBuildDB(StringRef path, uint32_t clientSchemaVersion, bool recreateOnUnmatchedVersion,
+                SQLiteBuildDBDurability durability, bool readOnly = false)
+    : path(path), clientSchemaVersion(clientSchemaVersion), recreateOnUnmatchedVersion(recreateOnUnmatchedVersion),
+      durability(durability), readOnly(readOnly) {
+    assert((!readOnly || !recreateOnUnmatchedVersion) &&
+           "cannot recreate a read-only database");
+  }
 
   virtual ~SQLiteBuildDB() {
     std::lock_guard<std::mutex> guard(dbMutex);
@@ -391,6 +480,11 @@ public:
   virtual bool setCurrentIteration(uint64_t value, std::string *error_out) override {
     std::lock_guard<std::mutex> guard(dbMutex);
 
+    if (readOnly) {
+      *error_out = "unable to modify database: opened read-only";
+      return false;
+    }
+
     if (!open(error_out)) {
       return false;
     }
@@ -462,6 +556,8 @@ public:
     if (it != dbKeyIDs.end()) {
       // DBKeyID is known, perform the fast path that avoids table joining
 
+      if (!prepareStatement(&fastFindRuleResultStmt, fastFindRuleResultStmtSQL, error_out))
+        return false;
       result = sqlite3_reset(fastFindRuleResultStmt);
       checkSQLiteResultOKReturnFalse(result);
       result = sqlite3_clear_bindings(fastFindRuleResultStmt);
@@ -502,6 +598,8 @@ public:
     } else {
       // KeyID is not known, perform the 'normal' search using the key value
 
+      if (!prepareStatement(&findRuleResultStmt, findRuleResultStmtSQL, error_out))
+        return false;
       result = sqlite3_reset(findRuleResultStmt);
       checkSQLiteResultOKReturnFalse(result);
       result = sqlite3_clear_bindings(findRuleResultStmt);
@@ -600,6 +698,11 @@ public:
     std::lock_guard<std::mutex> guard(dbMutex);
     int result;
 
+    if (readOnly) {
+      *error_out = "unable to modify database: opened read-only";
+      return false;
+    }
+
     if (!open(error_out)) {
       return false;
     }
@@ -628,6 +731,8 @@ public:
     }
 
     // Insert the actual rule result.
+    if (!prepareStatement(&insertIntoRuleResultsStmt, insertIntoRuleResultsStmtSQL, error_out))
+      return false;
     result = sqlite3_reset(insertIntoRuleResultsStmt);
     checkSQLiteResultOKReturnFalse(result);
     result = sqlite3_clear_bindings(insertIntoRuleResultsStmt);
@@ -675,6 +780,10 @@ public:
     if (!open(error_out))
       return false;
 
+    // Readers are already inside their snapshot transaction.
+    if (readOnly)
+      return true;
+
     // Execute the entire build inside a single transaction.
     //
     // FIXME: We should revist this, as we probably wouldn't want a crash in the
@@ -692,6 +801,21 @@ public:
   virtual void buildComplete() override {
     std::lock_guard<std::mutex> guard(dbMutex);
 
+    // A reader may never have accessed the database.
+    if (!db)
+      return;
+
+    // Drop any outputs which are no longer referenced.
+    if (commandOutputsChanged) {
+      int result = sqlite3_exec(
+          db, ("DELETE FROM output_blobs WHERE id NOT IN "
+               "(SELECT blob_id FROM command_outputs);"),
+          nullptr, nullptr, nullptr);
+      assert(result == SQLITE_OK);
+      (void)result;
+      commandOutputsChanged = false;
+    }
+
     // Sync changes to disk.
     int result = sqlite3_exec(db, "END;", nullptr, nullptr, nullptr);
     assert(result == SQLITE_OK);
@@ -737,6 +861,8 @@ public:
     if (!open(error_out))
       return false;
     
+    if (!prepareStatement(&getKeysWithResultStmt, getKeysWithResultStmtSQL, error_out))
+      return false;
     auto stmt = getKeysWithResultStmt;
     
     int result = sqlite3_reset(stmt);
@@ -800,6 +926,292 @@ public:
     return true;
   }
 
+  static constexpr const char *findAuxiliaryValueStmtSQL = (
+      "SELECT value FROM auxiliary_values WHERE key == ? LIMIT 1;");
+  sqlite3_stmt* findAuxiliaryValueStmt = nullptr;
+
+  static constexpr const char *insertIntoAuxiliaryValuesStmtSQL =
+    "INSERT OR REPLACE INTO auxiliary_values VALUES (?, ?);";
+  sqlite3_stmt* insertIntoAuxiliaryValuesStmt = nullptr;
+
+  virtual bool lookupAuxiliaryValue(StringRef key, std::string* value_out,
+                                    std::string* error_out) override {
+    std::lock_guard<std::mutex> guard(dbMutex);
+
+    if (!open(error_out))
+      return false;
+
+    if (!prepareStatement(&findAuxiliaryValueStmt, findAuxiliaryValueStmtSQL, error_out))
+      return false;
+    int result = sqlite3_reset(findAuxiliaryValueStmt);
+    checkSQLiteResultOKReturnFalse(result);
+    result = sqlite3_clear_bindings(findAuxiliaryValueStmt);
+    checkSQLiteResultOKReturnFalse(result);
+    result = sqlite3_bind_text(findAuxiliaryValueStmt, /*index=*/1,
+                               key.data(), key.size(),
+                               SQLITE_STATIC);
+    checkSQLiteResultOKReturnFalse(result);
+
+    result = sqlite3_step(findAuxiliaryValueStmt);
+    if (result == SQLITE_DONE)
+      return false;
+    if (result != SQLITE_ROW) {
+      *error_out = getCurrentErrorMessage();
+      return false;
+    }
+
+    assert(sqlite3_column_count(findAuxiliaryValueStmt) == 1);
+    auto size = sqlite3_column_bytes(findAuxiliaryValueStmt, 0);
+    auto bytes = (const char*) sqlite3_column_blob(findAuxiliaryValueStmt, 0);
+    value_out->assign(bytes ? bytes : "", size);
+    return true;
+  }
+
+  virtual bool setAuxiliaryValue(StringRef key, StringRef value,
+                                 std::string* error_out) override {
+    std::lock_guard<std::mutex> guard(dbMutex);
+
+    if (readOnly) {
+      *error_out = "unable to modify database: opened read-only";
+      return false;
+    }
+
+    if (!open(error_out))
+      return false;
+
+    if (!prepareStatement(&insertIntoAuxiliaryValuesStmt, insertIntoAuxiliaryValuesStmtSQL, error_out))
+      return false;
+    int result = sqlite3_reset(insertIntoAuxiliaryValuesStmt);
+    checkSQLiteResultOKReturnFalse(result);
+    result = sqlite3_clear_bindings(insertIntoAuxiliaryValuesStmt);
+    checkSQLiteResultOKReturnFalse(result);
+    result = sqlite3_bind_text(insertIntoAuxiliaryValuesStmt, /*index=*/1,
+                               key.data(), key.size(),
+                               SQLITE_STATIC);
+    checkSQLiteResultOKReturnFalse(result);
+    result = sqlite3_bind_blob(insertIntoAuxiliaryValuesStmt, /*index=*/2,
+                               value.data(), value.size(),
+                               SQLITE_STATIC);
+    checkSQLiteResultOKReturnFalse(result);
+    result = sqlite3_step(insertIntoAuxiliaryValuesStmt);
+    if (result != SQLITE_DONE) {
+      *error_out = getCurrentErrorMessage();
+      return false;
+    }
+
+    return true;
+  }
+
+  static constexpr const char *findCommandOutputStmtSQL = (
+      "SELECT output_blobs.data FROM command_outputs "
+      "INNER JOIN key_names ON key_names.id = command_outputs.key_id "
+      "INNER JOIN output_blobs ON output_blobs.id = command_outputs.blob_id "
+      "WHERE key_names.key == ?;");
+  sqlite3_stmt* findCommandOutputStmt = nullptr;
+
+  static constexpr const char *findCommandOutputBlobStmtSQL = (
+      "SELECT blob_id FROM command_outputs WHERE key_id == ?;");
+  sqlite3_stmt* findCommandOutputBlobStmt = nullptr;
+
+  static constexpr const char *findOutputBlobsStmtSQL = (
+      "SELECT id, data FROM output_blobs WHERE hash == ?;");
+  sqlite3_stmt* findOutputBlobsStmt = nullptr;
+
+  static constexpr const char *insertIntoOutputBlobsStmtSQL =
+    "INSERT INTO output_blobs(hash, data) VALUES (?, ?);";
+  sqlite3_stmt* insertIntoOutputBlobsStmt = nullptr;
+
+  static constexpr const char *insertIntoCommandOutputsStmtSQL =
+    "INSERT OR REPLACE INTO command_outputs VALUES (?, ?);";
+  sqlite3_stmt* insertIntoCommandOutputsStmt = nullptr;
+
+  static constexpr const char *deleteFromCommandOutputsStmtSQL =
+    "DELETE FROM command_outputs WHERE key_id == ?;";
+  sqlite3_stmt* deleteFromCommandOutputsStmt = nullptr;
+
+  /// Whether any command output was replaced or removed during this build, in
+  /// which case unreferenced blobs are removed when it completes.
+  bool commandOutputsChanged = false;
+
+  virtual bool lookupCommandOutput(const KeyType& key, std::string* output_out,
+                                   std::string* error_out) override {
+    std::lock_guard<std::mutex> guard(dbMutex);
+
+    if (!open(error_out))
+      return false;
+
+    if (!prepareStatement(&findCommandOutputStmt, findCommandOutputStmtSQL,
+                          error_out))
+      return false;
+    int result = sqlite3_reset(findCommandOutputStmt);
+    checkSQLiteResultOKReturnFalse(result);
+    result = sqlite3_clear_bindings(findCommandOutputStmt);
+    checkSQLiteResultOKReturnFalse(result);
+    result = sqlite3_bind_text(findCommandOutputStmt, /*index=*/1,
+                               key.data(), key.size(),
+                               SQLITE_STATIC);
+    checkSQLiteResultOKReturnFalse(result);
+
+    result = sqlite3_step(findCommandOutputStmt);
+    if (result == SQLITE_DONE)
+      return false;
+    if (result != SQLITE_ROW) {
+      *error_out = getCurrentErrorMessage();
+      return false;
+    }
+
+    assert(sqlite3_column_count(findCommandOutputStmt) == 1);
+    auto size = sqlite3_column_bytes(findCommandOutputStmt, 0);
+    auto bytes = (const char*) sqlite3_column_blob(findCommandOutputStmt, 0);
+    if (!basic::decompressData(StringRef(bytes ? bytes : "", size),
+                               output_out)) {
+      *error_out = "unexpected contents for command output: " + key.str();
+      return false;
+    }
+    return true;
+  }
+
+  virtual bool setCommandOutput(const KeyType& key, StringRef output,
+                                std::string* error_out) override {
+    assert(delegate != nullptr);
+    std::lock_guard<std::mutex> guard(dbMutex);
+    int result;
+
+    if (readOnly) {
+      *error_out = "unable to modify database: opened read-only";
+      return false;
+    }
+
+    if (!open(error_out))
+      return false;
+
+    auto dbKeyID = getKeyID(delegate->getKeyID(key), error_out);
+    if (!error_out->empty())
+      return false;
+
+    // Find the currently stored output, if any.
+    if (!prepareStatement(&findCommandOutputBlobStmt,
+                          findCommandOutputBlobStmtSQL, error_out))
+      return false;
+    result = sqlite3_reset(findCommandOutputBlobStmt);
+    checkSQLiteResultOKReturnFalse(result);
+    result = sqlite3_clear_bindings(findCommandOutputBlobStmt);
+    checkSQLiteResultOKReturnFalse(result);
+    result = sqlite3_bind_int64(findCommandOutputBlobStmt, /*index=*/1,
+                                dbKeyID.value);
+    checkSQLiteResultOKReturnFalse(result);
+    int64_t storedBlobID = 0;
+    result = sqlite3_step(findCommandOutputBlobStmt);
+    if (result == SQLITE_ROW) {
+      storedBlobID = sqlite3_column_int64(findCommandOutputBlobStmt, 0);
+    } else if (result != SQLITE_DONE) {
+      *error_out = getCurrentErrorMessage();
+      return false;
+    }
+
+    // An empty output just removes any stored one.
+    if (output.empty()) {
+      // Most commands produce no output, avoid writing to the database at all
+      // when there is nothing to remove.
+      if (storedBlobID == 0)
+        return true;
+
+      if (!prepareStatement(&deleteFromCommandOutputsStmt,
+                            deleteFromCommandOutputsStmtSQL, error_out))
+        return false;
+      result = sqlite3_reset(deleteFromCommandOutputsStmt);
+      checkSQLiteResultOKReturnFalse(result);
+      result = sqlite3_clear_bindings(deleteFromCommandOutputsStmt);
+      checkSQLiteResultOKReturnFalse(result);
+      result = sqlite3_bind_int64(deleteFromCommandOutputsStmt, /*index=*/1,
+                                  dbKeyID.value);
+      checkSQLiteResultOKReturnFalse(result);
+      result = sqlite3_step(deleteFromCommandOutputsStmt);
+      if (result != SQLITE_DONE) {
+        *error_out = getCurrentErrorMessage();
+        return false;
+      }
+      commandOutputsChanged = true;
+      return true;
+    }
+
+    // Find an existing blob with the same contents, or add a new one.
+    std::string data = basic::compressData(output);
+    int64_t hash = int64_t(basic::hashString(data));
+    if (!prepareStatement(&findOutputBlobsStmt, findOutputBlobsStmtSQL,
+                          error_out))
+      return false;
+    result = sqlite3_reset(findOutputBlobsStmt);
+    checkSQLiteResultOKReturnFalse(result);
+    result = sqlite3_clear_bindings(findOutputBlobsStmt);
+    checkSQLiteResultOKReturnFalse(result);
+    result = sqlite3_bind_int64(findOutputBlobsStmt, /*index=*/1, hash);
+    checkSQLiteResultOKReturnFalse(result);
+    int64_t blobID = 0;
+    while ((result = sqlite3_step(findOutputBlobsStmt)) == SQLITE_ROW) {
+      auto size = sqlite3_column_bytes(findOutputBlobsStmt, 1);
+      auto bytes = (const char*) sqlite3_column_blob(findOutputBlobsStmt, 1);
+      if (StringRef(bytes ? bytes : "", size) == data) {
+        blobID = sqlite3_column_int64(findOutputBlobsStmt, 0);
+        break;
+      }
+    }
+    if (result != SQLITE_ROW && result != SQLITE_DONE) {
+      *error_out = getCurrentErrorMessage();
+      return false;
+    }
+
+    if (blobID == 0) {
+      if (!prepareStatement(&insertIntoOutputBlobsStmt,
+                            insertIntoOutputBlobsStmtSQL, error_out))
+        return false;
+      result = sqlite3_reset(insertIntoOutputBlobsStmt);
+      checkSQLiteResultOKReturnFalse(result);
+      result = sqlite3_clear_bindings(insertIntoOutputBlobsStmt);
+      checkSQLiteResultOKReturnFalse(result);
+      result = sqlite3_bind_int64(insertIntoOutputBlobsStmt, /*index=*/1, hash);
+      checkSQLiteResultOKReturnFalse(result);
+      result = sqlite3_bind_blob(insertIntoOutputBlobsStmt, /*index=*/2,
+                                 data.data(), data.size(),
+                                 SQLITE_STATIC);
+      checkSQLiteResultOKReturnFalse(result);
+      result = sqlite3_step(insertIntoOutputBlobsStmt);
+      if (result != SQLITE_DONE) {
+        *error_out = getCurrentErrorMessage();
+        return false;
+      }
+      blobID = sqlite3_last_insert_rowid(db);
+    }
+
+    // Nothing to do if the same output is already stored.
+    if (blobID == storedBlobID)
+      return true;
+
+    if (!prepareStatement(&insertIntoCommandOutputsStmt,
+                          insertIntoCommandOutputsStmtSQL, error_out))
+      return false;
+    result = sqlite3_reset(insertIntoCommandOutputsStmt);
+    checkSQLiteResultOKReturnFalse(result);
+    result = sqlite3_clear_bindings(insertIntoCommandOutputsStmt);
+    checkSQLiteResultOKReturnFalse(result);
+    result = sqlite3_bind_int64(insertIntoCommandOutputsStmt, /*index=*/1,
+                                dbKeyID.value);
+    checkSQLiteResultOKReturnFalse(result);
+    result = sqlite3_bind_int64(insertIntoCommandOutputsStmt, /*index=*/2,
+                                blobID);
+    checkSQLiteResultOKReturnFalse(result);
+    result = sqlite3_step(insertIntoCommandOutputsStmt);
+    if (result != SQLITE_DONE) {
+      *error_out = getCurrentErrorMessage();
+      return false;
+    }
+
+    // Replacing an output may leave its blob unreferenced.
+    if (storedBlobID != 0)
+      commandOutputsChanged = true;
+    return true;
+  }
+
   virtual void dump(raw_ostream& os) override {
     std::lock_guard<std::mutex> guard(dbMutex);
 
@@ -899,6 +1311,8 @@ if (result != SQLITE_OK) { \
 
     // Search for the key in the key_names table
     auto key = delegate->getKeyForID(keyID);
+    if (!prepareStatement(&findKeyIDForKeyStmt, findKeyIDForKeyStmtSQL, error_out))
+      return DBKeyID();
     result = sqlite3_reset(findKeyIDForKeyStmt);
     checkSQLiteResultOKReturnDBKeyID(result);
     result = sqlite3_clear_bindings(findKeyIDForKeyStmt);
@@ -917,6 +1331,8 @@ if (result != SQLITE_OK) { \
     }
 
     // Did not find the key, need to insert.
+    if (!prepareStatement(&insertIntoKeysStmt, insertIntoKeysStmtSQL, error_out))
+      return DBKeyID();
     result = sqlite3_reset(insertIntoKeysStmt);
     checkSQLiteResultOKReturnDBKeyID(result);
     result = sqlite3_clear_bindings(insertIntoKeysStmt);
@@ -953,6 +1369,8 @@ if (result != SQLITE_OK) { \
 
     // Search for the key in the database
     int result;
+    if (!prepareStatement(&findKeyNameForKeyIDStmt, findKeyNameForKeyIDStmtSQL, error_out))
+      return KeyID();
     result = sqlite3_reset(findKeyNameForKeyIDStmt);
     checkSQLiteResultOKReturnKeyID(result);
     result = sqlite3_clear_bindings(findKeyNameForKeyIDStmt);
@@ -988,8 +1406,33 @@ if (result != SQLITE_OK) { \
 std::unique_ptr<BuildDB> core::createSQLiteBuildDB(StringRef path,
                                                    uint32_t clientSchemaVersion,
                                                    bool recreateUnmatchedVersion,
-                                                   std::string *error_out) {
-  return llvm::make_unique<SQLiteBuildDB>(path, clientSchemaVersion, recreateUnmatchedVersion);
+                                                   std::string *error_out,
+                                                   SQLiteBuildDBDurability durability) {
+  return llvm::make_unique<SQLiteBuildDB>(path, clientSchemaVersion, recreateUnmatchedVersion,
+                                          durability);
+}
+
+std::unique_ptr<BuildDB> core::createReadOnlySQLiteBuildDB(StringRef path,
+                                                           uint32_t clientSchemaVersion,
+                                                           std::string *error_out) {
+  return llvm::make_unique<SQLiteBuildDB>(path, clientSchemaVersion,
+                                          /* recreateOnUnmatchedVersion = */ false,
+                                          SQLiteBuildDBDurability::Strict,
+                                          /* readOnly = */ true);
+}
+
+bool core::parseSQLiteBuildDBDurability(StringRef name,
+                                        SQLiteBuildDBDurability* durability_out) {
+  if (name == "strict") {
+    *durability_out = SQLiteBuildDBDurability::Strict;
+  } else if (name == "normal") {
+    *durability_out = SQLiteBuildDBDurability::Normal;
+  } else if (name == "fast") {
+    *durability_out = SQLiteBuildDBDurability::Fast;
+  } else {
+    return false;
+  }
+  return true;
 }
 
 #undef checkSQLiteResultOKReturnFalse
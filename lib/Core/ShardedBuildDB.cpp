@@ -0,0 +1,218 @@
+//===-- ShardedBuildDB.cpp ------------------------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2014 - 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Core/BuildDB.h"
+
+#include "llbuild/Core/BuildEngine.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+using namespace llbuild;
+using namespace llbuild::core;
+
+// Sharded BuildDB Implementation
+
+namespace {
+
+/// A BuildDB which partitions the rule results across several independent
+/// SQLite databases.
+///
+/// Each shard is a complete SQLite build database with its own connection and
+/// lock, so operations on keys in different shards do not contend with each
+/// other. Rules are assigned to shards by a hash of their key (engine KeyIDs
+/// are not stable across runs). A shard records the names of every key its
+/// results depend on, so each shard can be read on its own.
+///
+/// The build iteration and auxiliary values are owned by the first shard, while
+/// command outputs are kept with the result of their rule. Every shard also
+/// records the iteration it was last written at, and the current epoch is the
+/// newest of them, so an epoch is never reused even if only some of the shards
+/// committed their last build.
+class ShardedBuildDB : public BuildDB {
+  std::vector<std::unique_ptr<BuildDB>> shards;
+
+  BuildDB& getShardForKey(const KeyType& key) {
+    return *shards[KeyRef(key).getHash() % shards.size()];
+  }
+
+public:
+  ShardedBuildDB(std::vector<std::unique_ptr<BuildDB>>&& shards)
+      : shards(std::move(shards)) {
+    assert(!this->shards.empty());
+  }
+
+  /// @name BuildDB API
+  /// @{
+
+  virtual void attachDelegate(BuildDBDelegate* delegate) override {
+    for (auto& shard: shards)
+      shard->attachDelegate(delegate);
+  }
+
+  virtual Epoch getCurrentEpoch(bool* success_out,
+                                std::string* error_out) override {
+    // If a build was interrupted after some shards were committed, those
+    // shards may hold results newer than the iteration saved in the first
+    // one. Resume after the newest of them, so that \see Result::builtAt and
+    // \see Result::computedAt keep increasing.
+    Epoch epoch = 0;
+    for (auto& shard: shards) {
+      epoch = std::max(epoch, shard->getCurrentEpoch(success_out, error_out));
+      if (!*success_out)
+        return 0;
+    }
+    return epoch;
+  }
+
+  virtual bool setCurrentIteration(uint64_t value,
+                                   std::string* error_out) override {
+    // Keep every shard's iteration in sync, so that any one of them can be
+    // inspected on its own.
+    for (auto& shard: shards) {
+      if (!shard->setCurrentIteration(value, error_out))
+        return false;
+    }
+    return true;
+  }
+
+  virtual bool lookupRuleResult(KeyID keyID, const KeyType& key,
+                                Result* result_out,
+                                std::string* error_out) override {
+    return getShardForKey(key).lookupRuleResult(keyID, key, result_out,
+                                                error_out);
+  }
+
+  virtual bool setRuleResult(KeyID keyID, const Rule& rule,
+                             const Result& result,
+                             std::string* error_out) override {
+    return getShardForKey(rule.key).setRuleResult(keyID, rule, result,
+                                                  error_out);
+  }
+
+  virtual bool buildStarted(std::string* error_out) override {
+    for (unsigned i = 0, e = shards.size(); i != e; ++i) {
+      if (!shards[i]->buildStarted(error_out)) {
+        // Release the shards we have already started.
+        for (unsigned j = 0; j != i; ++j)
+          shards[j]->buildComplete();
+        return false;
+      }
+    }
+    return true;
+  }
+
+  virtual void buildComplete() override {
+    // Commit the first shard, which owns the iteration, before any of the
+    // others. A result left behind by a shard which fails to commit is then
+    // older than the saved iteration, and is rebuilt if any of its
+    // dependencies changed.
+    for (auto& shard: shards)
+      shard->buildComplete();
+  }
+
+  virtual bool getKeys(std::vector<KeyType>& keys_out,
+                       std::string* error_out) override {
+    // Dependency keys are recorded in each shard which references them, so
+    // unique the combined list.
+    llvm::StringMap<bool> seen;
+    for (auto& shard: shards) {
+      std::vector<KeyType> keys;
+      if (!shard->getKeys(keys, error_out))
+        return false;
+      for (auto& key: keys) {
+        if (seen.try_emplace(key.str(), true).second)
+          keys_out.push_back(std::move(key));
+      }
+    }
+    return true;
+  }
+
+  virtual bool getKeysWithResult(std::vector<KeyType>& keys_out,
+                                 std::vector<Result>& results_out,
+                                 std::string* error_out) override {
+    for (auto& shard: shards) {
+      if (!shard->getKeysWithResult(keys_out, results_out, error_out))
+        return false;
+    }
+    return true;
+  }
+
+  virtual bool lookupAuxiliaryValue(StringRef key, std::string* value_out,
+                                    std::string* error_out) override {
+    return shards[0]->lookupAuxiliaryValue(key, value_out, error_out);
+  }
+
+  virtual bool setAuxiliaryValue(StringRef key, StringRef value,
+                                 std::string* error_out) override {
+    return shards[0]->setAuxiliaryValue(key, value, error_out);
+  }
+
+  virtual bool lookupCommandOutput(const KeyType& key, std::string* output_out,
+                                   std::string* error_out) override {
+    return getShardForKey(key).lookupCommandOutput(key, output_out, error_out);
+  }
+
+  virtual bool setCommandOutput(const KeyType& key, StringRef output,
+                                std::string* error_out) override {
+    return getShardForKey(key).setCommandOutput(key, output, error_out);
+  }
+
+  virtual void dump(raw_ostream& os) override {
+    for (unsigned i = 0, e = shards.size(); i != e; ++i) {
+      os << "shard " << i << ":\n";
+      shards[i]->dump(os);
+      os << "\n";
+    }
+  }
+
+  /// @}
+};
+
+}
+
+std::unique_ptr<BuildDB> core::createShardedBuildDB(
+    std::vector<std::unique_ptr<BuildDB>>&& shards) {
+  return llvm::make_unique<ShardedBuildDB>(std::move(shards));
+}
+
+std::unique_ptr<BuildDB> core::createShardedSQLiteBuildDB(
+    StringRef path, unsigned numShards, uint32_t clientSchemaVersion,
+    bool recreateUnmatchedVersion, std::string* error_out,
+    SQLiteBuildDBDurability durability) {
+  if (numShards <= 1) {
+    return createSQLiteBuildDB(path, clientSchemaVersion,
+                               recreateUnmatchedVersion, error_out,
+                               durability);
+  }
+
+  // The shard count is part of the file names, so that changing it never
+  // reads results which were assigned to a shard under a different count.
+  std::vector<std::unique_ptr<BuildDB>> shards;
+  for (unsigned i = 0; i != numShards; ++i) {
+    std::string shardPath = (llvm::Twine(path) + ".shard-" + llvm::Twine(i) +
+                             "-of-" + llvm::Twine(numShards)).str();
+    auto shard = createSQLiteBuildDB(shardPath, clientSchemaVersion,
+                                     recreateUnmatchedVersion, error_out,
+                                     durability);
+    if (!shard)
+      return nullptr;
+    shards.push_back(std::move(shard));
+  }
+  return createShardedBuildDB(std::move(shards));
+}
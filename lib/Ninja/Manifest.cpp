@@ -13,13 +13,360 @@
 #include "llbuild/Ninja/Manifest.h"
 
 #include "llbuild/Basic/LLVM.h"
+#include "llbuild/Basic/ShellUtility.h"
+#include "llbuild/Ninja/Lexer.h"
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
 
 using namespace llbuild;
 using namespace llbuild::ninja;
 
+void ninja::evalString(StringRef string, raw_ostream& result,
+                       llvm::function_ref<void(StringRef, raw_ostream&)> lookup,
+                       llvm::function_ref<void(const std::string&)> error) {
+  // Scan the string for escape sequences or variable references, accumulating
+  // output pieces as we go.
+  const char* pos = string.begin();
+  const char* end = string.end();
+  while (pos != end) {
+    // Find the next '$'.
+    const char* pieceStart = pos;
+    for (; pos != end; ++pos) {
+      if (*pos == '$')
+        break;
+    }
+
+    // Add the current piece, if non-empty.
+    if (pos != pieceStart)
+      result << StringRef(pieceStart, pos - pieceStart);
+
+    // If we are at the end, we are done.
+    if (pos == end)
+      break;
+
+    // Otherwise, we have a '$' character to handle.
+    ++pos;
+    if (pos == end) {
+      error("invalid '$'-escape at end of string");
+      break;
+    }
+
+    // If this is a newline continuation, skip it and all leading space.
+    int c = *pos;
+    if (c == '\n') {
+      ++pos;
+      while (pos != end && isspace(*pos))
+        ++pos;
+      continue;
+    }
+
+    // If this is single character escape, honor it.
+    if (c == ' ' || c == ':' || c == '$') {
+      result << char(c);
+      ++pos;
+      continue;
+    }
+
+    // If this is a braced variable reference, expand it.
+    if (c == '{') {
+      // Scan until the end of the reference, checking validity of the
+      // identifier name as we go.
+      ++pos;
+      const char* varStart = pos;
+      bool isValid = true;
+      while (true) {
+        // If we reached the end of the string, this is an error.
+        if (pos == end) {
+          error("invalid variable reference in string (missing trailing '}')");
+          break;
+        }
+
+        // If we found the end of the reference, resolve it.
+        int c = *pos;
+        if (c == '}') {
+          // If this identifier isn't valid, emit an error.
+          if (!isValid) {
+            error("invalid variable name in reference");
+          } else {
+            lookup(StringRef(varStart, pos - varStart), result);
+          }
+          ++pos;
+          break;
+        }
+
+        // Track whether this is a valid identifier.
+        if (!Lexer::isIdentifierChar(c))
+          isValid = false;
+
+        ++pos;
+      }
+      continue;
+    }
+
+    // If this is a simple variable reference, expand it.
+    if (Lexer::isSimpleIdentifierChar(c)) {
+      const char* varStart = pos;
+      // Scan until the end of the simple identifier.
+      ++pos;
+      while (pos != end && Lexer::isSimpleIdentifierChar(*pos))
+        ++pos;
+      lookup(StringRef(varStart, pos-varStart), result);
+      continue;
+    }
+
+    // Otherwise, we have an invalid '$' escape.
+    error("invalid '$'-escape (literal '$' should be written as '$$')");
+    break;
+  }
+}
+
+void Command::evalParameter(
+    StringRef name, bool shellEscapeInAndOut, raw_ostream& result,
+    llvm::function_ref<void(const std::string&)> error) const {
+  // FIXME: Mange recursive lookup? Ninja crashes on it.
+
+  // Support "in", "in_newline" and "out".
+  if (name == "in" || name == "in_newline") {
+    const auto separator = name == "in" ? ' ' : '\n';
+    for (unsigned i = 0, ie = getNumExplicitInputs(); i != ie; ++i) {
+      if (i != 0)
+        result << separator;
+      auto& path = getInputs()[i]->getScreenPath();
+      result << (shellEscapeInAndOut ? basic::shellEscaped(path) : path);
+    }
+    return;
+  } else if (name == "out") {
+    for (unsigned i = 0, ie = getOutputs().size(); i != ie; ++i) {
+      if (i != 0)
+        result << " ";
+      auto& path = getOutputs()[i]->getScreenPath();
+      result << (shellEscapeInAndOut ? basic::shellEscaped(path) : path);
+    }
+    return;
+  }
+
+  auto it = getParameters().find(name);
+  if (it != getParameters().end()) {
+    result << it->second;
+    return;
+  }
+  auto it2 = getRule()->getParameters().find(name);
+  if (it2 != getRule()->getParameters().end()) {
+    evalString(it2->second, result,
+               /*Lookup=*/ [&](StringRef name, raw_ostream& result) {
+                 evalParameter(name, shellEscapeInAndOut, result, error);
+               },
+               /*Error=*/ [&](const std::string& msg) {
+                 error(msg + " during evaluation of '" + name.str() + "'");
+               });
+    return;
+  }
+
+  if (scope)
+    result << scope->lookupBinding(name);
+}
+
+void Command::materializeAttribute(StringRef name,
+                                   std::string& storage) const {
+  if (!scope)
+    return;
+
+  // Any malformed rule templates were diagnosed when the command was loaded.
+  SmallString<256> value;
+  llvm::raw_svector_ostream os(value);
+  evalParameter(name, /*shellEscapeInAndOut=*/name == "command", os,
+                [](const std::string&) {});
+  storage = os.str();
+}
+
+#pragma mark - Command Signatures
+
+namespace llbuild {
+namespace ninja {
+
+/// The memoized templates used to compute command signatures.
+///
+/// A template describes how a variable is resolved for the commands of a rule
+/// in a particular scope, in the absence of command parameters (which are
+/// checked when the signature is computed, as they override the rule and scope
+/// bindings).
+class CommandSignatureCache {
+  struct Template;
+
+  /// A piece of a template, either literal text or a variable reference.
+  struct Piece {
+    /// The hash of the literal text.
+    uint64_t literalHash = 0;
+
+    /// The referenced variable, or null for literal text.
+    const Template* variable = nullptr;
+  };
+
+  struct Template {
+    enum class Kind {
+      /// The "in", "in_newline" or "out" paths.
+      Inputs, InputsNewline, Outputs,
+
+      /// A rule parameter, evaluated using the pieces.
+      RuleParameter,
+
+      /// A scope binding (or the empty string), with the given hash.
+      Binding
+    };
+
+    /// The name of the variable.
+    std::string name;
+
+    Kind kind;
+
+    uint64_t bindingHash = 0;
+
+    std::vector<Piece> pieces;
+  };
+
+  /// The templates for a rule and scope.
+  typedef llvm::StringMap<std::unique_ptr<Template>> TemplateMap;
+
+  std::mutex mutex;
+
+  llvm::DenseMap<std::pair<const Rule*, const Scope*>,
+                 std::unique_ptr<TemplateMap>> templates;
+
+  /// Get the template resolving \arg name, creating it if necessary.
+  const Template* getTemplate(const Rule* rule, const Scope* scope,
+                              TemplateMap& map, StringRef name) {
+    auto& result = map[name];
+    if (result)
+      return result.get();
+    result.reset(new Template);
+    Template* t = result.get();
+    t->name = name;
+
+    if (name == "in") {
+      t->kind = Template::Kind::Inputs;
+    } else if (name == "in_newline") {
+      t->kind = Template::Kind::InputsNewline;
+    } else if (name == "out") {
+      t->kind = Template::Kind::Outputs;
+    } else {
+      auto it = rule->getParameters().find(name);
+      if (it == rule->getParameters().end()) {
+        t->kind = Template::Kind::Binding;
+        t->bindingHash = llvm::hash_value(
+            scope ? scope->lookupBinding(name) : StringRef());
+      } else {
+        // Parse the rule template. Literal text is accumulated so that each
+        // run of text between references is a single piece.
+        //
+        // FIXME: Mange recursive lookup? Ninja crashes on it.
+        t->kind = Template::Kind::RuleParameter;
+        SmallString<256> literal;
+        llvm::raw_svector_ostream os(literal);
+        evalString(it->second, os,
+                   /*Lookup=*/ [&](StringRef name, raw_ostream&) {
+                     if (!literal.empty()) {
+                       Piece piece;
+                       piece.literalHash = llvm::hash_value(literal.str());
+                       t->pieces.push_back(piece);
+                       literal.clear();
+                     }
+                     Piece piece;
+                     piece.variable = getTemplate(rule, scope, map, name);
+                     t->pieces.push_back(piece);
+                   },
+                   /*Error=*/ [](const std::string&) {});
+        if (!literal.empty()) {
+          Piece piece;
+          piece.literalHash = llvm::hash_value(literal.str());
+          t->pieces.push_back(piece);
+        }
+      }
+    }
+
+    return t;
+  }
+
+  static void combine(const Command* command, const Template& t,
+                      uint64_t& hash) {
+    switch (t.kind) {
+    case Template::Kind::Inputs:
+    case Template::Kind::InputsNewline:
+      hash = llvm::hash_combine(hash, unsigned(t.kind));
+      for (unsigned i = 0, e = command->getNumExplicitInputs(); i != e; ++i)
+        hash = llvm::hash_combine(
+            hash, StringRef(command->getInputs()[i]->getScreenPath()));
+      return;
+    case Template::Kind::Outputs:
+      hash = llvm::hash_combine(hash, unsigned(t.kind));
+      for (const auto* node: command->getOutputs())
+        hash = llvm::hash_combine(hash, StringRef(node->getScreenPath()));
+      return;
+    case Template::Kind::RuleParameter:
+    case Template::Kind::Binding:
+      break;
+    }
+
+    // Command parameters override the rule and scope bindings.
+    if (!command->getParameters().empty()) {
+      auto it = command->getParameters().find(t.name);
+      if (it != command->getParameters().end()) {
+        hash = llvm::hash_combine(hash, StringRef(it->second));
+        return;
+      }
+    }
+
+    if (t.kind == Template::Kind::Binding) {
+      hash = llvm::hash_combine(hash, t.bindingHash);
+      return;
+    }
+
+    hash = llvm::hash_combine(hash, t.pieces.size());
+    for (const auto& piece: t.pieces) {
+      if (piece.variable) {
+        combine(command, *piece.variable, hash);
+      } else {
+        hash = llvm::hash_combine(hash, piece.literalHash);
+      }
+    }
+  }
+
+public:
+  uint64_t getSignature(const Command* command) {
+    // The templates resolve bindings against the final state of the scope, so
+    // commands evaluated before their scope was rebound are hashed by their
+    // command string.
+    if (command->hasFixedCommandString())
+      return llvm::hash_combine(
+          unsigned(-1), StringRef(command->getCommandString()));
+
+    const Template* t;
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      auto& map = templates[{command->getRule(), command->getScope()}];
+      if (!map)
+        map.reset(new TemplateMap);
+      t = getTemplate(command->getRule(), command->getScope(), *map,
+                      "command");
+    }
+
+    // The templates are immutable once created, so the signature can be
+    // computed without holding the lock.
+    uint64_t hash = 0;
+    combine(command, *t, hash);
+    return hash;
+  }
+};
+
+}
+}
+
+#pragma mark - Manifest
+
 bool Rule::isValidParameterName(StringRef name) {
   return name == "command" ||
     name == "description" ||
@@ -32,7 +379,7 @@ bool Rule::isValidParameterName(StringRef name) {
     name == "rspfile_content";
 }
 
-Manifest::Manifest() {
+Manifest::Manifest() : signatureCache(new CommandSignatureCache) {
   // Create the built-in console pool, and add it to the pool map.
   consolePool = new (getAllocator()) Pool("console");
   assert(consolePool != nullptr);
@@ -45,6 +392,12 @@ Manifest::Manifest() {
   getRootScope().getRules()["phony"] = phonyRule;
 }
 
+Manifest::~Manifest() {}
+
+uint64_t Manifest::getCommandSignature(const Command* command) const {
+  return signatureCache->getSignature(command);
+}
+
 bool Manifest::normalize_path(StringRef workingDirectory, SmallVectorImpl<char>& tmp){
   auto separatorRef = llvm::sys::path::get_separator();
   assert(separatorRef.size() == 1);
@@ -13,11 +13,13 @@
 #include "llbuild/Ninja/ManifestLoader.h"
 
 #include "llbuild/Basic/LLVM.h"
-#include "llbuild/Basic/ShellUtility.h"
 #include "llbuild/Ninja/Lexer.h"
 #include "llbuild/Ninja/Parser.h"
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/Support/raw_ostream.h"
 
@@ -49,13 +51,50 @@ class ManifestLoaderImpl: public ParseActions {
     std::unique_ptr<Parser> parser;
     /// The active scope..
     Scope& scope;
+    /// The index of the file in the loaded files.
+    unsigned fileIndex;
 
     IncludeEntry(StringRef filename,
                  std::unique_ptr<char[]> data,
                  std::unique_ptr<class Parser> parser,
-                 Scope& scope)
+                 Scope& scope, unsigned fileIndex)
       : filename(filename), data(std::move(data)), parser(std::move(parser)),
-        scope(scope) {}
+        scope(scope), fileIndex(fileIndex) {}
+  };
+
+  /// A file loaded into the manifest, recorded so that the manifest can be
+  /// reloaded incrementally.
+  ///
+  /// The files are stored in the order they were entered, so the files loaded
+  /// (transitively) by a file immediately follow it.
+  struct LoadedFile {
+    /// The file which loaded this one (or the file itself, for the main file).
+    std::string fromFilename;
+    /// The name of the file.
+    std::string filename;
+    /// The hash of the file contents.
+    uint64_t contentHash;
+    /// The scope the file was parsed in.
+    Scope* scope;
+    /// Whether the file has its own scope, i.e. it is the main file or was
+    /// loaded by a "subninja" decl.
+    bool hasOwnScope;
+    /// The index of the file which loaded this one, or ~0 for the main file.
+    unsigned parent;
+    /// The index after the last file loaded (transitively) by this one.
+    unsigned subtreeEnd = 0;
+    /// The range of manifest commands declared by this file and the files it
+    /// loaded.
+    size_t commandsBegin, commandsEnd = 0;
+    /// Whether this file, or one it loaded, declared pools or default targets,
+    /// which are global to the manifest.
+    bool declaresGlobals = false;
+    /// For files with their own scope, the number of declarations in each
+    /// enclosing scope when the file was entered.
+    std::vector<std::pair<const Scope*, unsigned>> enclosingDeclCounts;
+    /// For files with their own scope, the number of pools when the file was
+    /// entered.
+    unsigned numPools = 0;
   };
 
   std::string workingDirectory;
@@ -64,11 +103,32 @@ class ManifestLoaderImpl: public ParseActions {
   std::unique_ptr<Manifest> theManifest;
   std::vector<IncludeEntry> includeStack;
 
-  // Cached buffers for temporary expansion of possibly large strings. These are
-  // lifted out of the function body to ensure we don't blow up the stack
-  // unnecesssarily.
-  SmallString<10 * 1024> buildCommand;
-  SmallString<10 * 1024> buildDescription;
+  /// The files loaded by the last load, in the order they were entered.
+  std::vector<LoadedFile> loadedFiles;
+
+  /// Whether the last load completed, so its files can be reloaded.
+  bool isReloadable = false;
+
+  /// The number of binding and rule decls made in each scope.
+  llvm::DenseMap<const Scope*, unsigned> declCounts;
+
+  /// Whether files are being re-parsed into an existing manifest.
+  bool isReparsing = false;
+
+  /// Whether a re-parse declared pools or default targets, which requires a
+  /// full reload.
+  bool reparseDeclaredGlobals = false;
+
+  /// The commands whose command string and description have not been
+  /// materialized yet.
+  std::vector<Command*> lazyCommands;
+
+  /// The scopes (and their ancestors) which contain lazy commands.
+  llvm::SmallPtrSet<const Scope*, 8> scopesWithLazyCommands;
+
+  /// The rules with malformed parameter templates, whose commands are
+  /// evaluated eagerly so that the errors are diagnosed during loading.
+  llvm::SmallPtrSet<const Rule*, 8> rulesWithInvalidTemplates;
 
 public:
   ManifestLoaderImpl(StringRef workingDirectory, StringRef mainFilename, ManifestLoaderActions& actions)
@@ -78,6 +138,9 @@ public:
   std::unique_ptr<Manifest> load() {
     // Create the manifest.
     theManifest.reset(new Manifest);
+    loadedFiles.clear();
+    declCounts.clear();
+    isReloadable = false;
 
     // Enter the main file.
     if (!enterFile(mainFilename, theManifest->getRootScope()))
@@ -88,33 +151,224 @@ public:
     getCurrentParser()->parse();
     assert(includeStack.size() == 0);
 
+    // The scopes are complete, any remaining lazy commands can now be
+    // evaluated on demand.
+    lazyCommands.clear();
+    scopesWithLazyCommands.clear();
+
+    isReloadable = true;
+    return std::move(theManifest);
+  }
+
+  /// Reload a manifest produced by the last load, re-parsing only the files
+  /// which changed.
+  ///
+  /// A changed file is re-parsed along with the other files of its "subninja"
+  /// unit (the nearest enclosing file with its own scope), in a new scope, and
+  /// the commands of the unit are replaced in place. This is only possible
+  /// when no other file can observe the unit: the main file always requires a
+  /// full load, as do units which declare pools or default targets, or whose
+  /// enclosing scopes have declarations after the unit was loaded (which the
+  /// unit must not see).
+  std::unique_ptr<Manifest> reload(std::unique_ptr<Manifest> manifest) {
+    if (!manifest || !isReloadable)
+      return load();
+
+    // Find the files whose contents changed.
+    std::vector<unsigned> changedUnits;
+    for (unsigned i = 0, e = loadedFiles.size(); i != e; ++i) {
+      const LoadedFile& file = loadedFiles[i];
+      std::unique_ptr<char[]> data;
+      uint64_t length;
+      if (!actions.readFileContents(file.fromFilename, file.filename,
+                                    nullptr, &data, &length)) {
+        // The error has been reported, and a full load would report it again.
+        isReloadable = false;
+        return nullptr;
+      }
+      if (hashContents(data.get(), length) == file.contentHash)
+        continue;
+
+      // Find the unit of the file.
+      unsigned unit = i;
+      while (!loadedFiles[unit].hasOwnScope)
+        unit = loadedFiles[unit].parent;
+      if (unit == 0)
+        return load();
+
+      // Only the outermost changed units need to be re-parsed (the files are
+      // in preorder, so earlier units after this one are contained in it).
+      while (!changedUnits.empty() && changedUnits.back() > unit)
+        changedUnits.pop_back();
+      if (!changedUnits.empty() &&
+          unit < loadedFiles[changedUnits.back()].subtreeEnd)
+        continue;
+      if (!canReparseUnit(*manifest, loadedFiles[unit]))
+        return load();
+      changedUnits.push_back(unit);
+    }
+
+    // Re-parse the units, last first so the indices of the earlier ones are
+    // unaffected.
+    theManifest = std::move(manifest);
+    for (auto it = changedUnits.rbegin(); it != changedUnits.rend(); ++it) {
+      if (!reparseUnit(*it))
+        return load();
+    }
+
     return std::move(theManifest);
   }
 
+  static uint64_t hashContents(const char* data, uint64_t length) {
+    return llvm::hash_value(StringRef(data, length));
+  }
+
+  /// Check whether the given unit can be re-parsed independently of the rest
+  /// of the manifest.
+  bool canReparseUnit(const Manifest& manifest, const LoadedFile& unit) {
+    if (unit.declaresGlobals ||
+        unit.numPools != manifest.getPools().size())
+      return false;
+    for (const auto& entry: unit.enclosingDeclCounts) {
+      if (declCounts.lookup(entry.first) != entry.second)
+        return false;
+    }
+    return true;
+  }
+
+  /// Re-parse the unit at the given index, replacing its files and commands.
+  ///
+  /// \returns False if the unit could not be re-parsed independently, in which
+  /// case a full load is required.
+  bool reparseUnit(unsigned index) {
+    LoadedFile unit = loadedFiles[index];
+
+    // Parse the unit into empty file and command lists, in a new scope (the
+    // commands of the manifest are memoized against their scope).
+    std::vector<LoadedFile> previousFiles;
+    std::swap(previousFiles, loadedFiles);
+    std::vector<Command*> previousCommands;
+    std::swap(previousCommands, theManifest->getCommands());
+    Scope* scope = new (theManifest->getAllocator()) Scope(unit.scope->getParent());
+    isReparsing = true;
+    reparseDeclaredGlobals = false;
+    if (enterFile(unit.filename, *scope, nullptr, unit.fromFilename)) {
+      getCurrentParser()->parse();
+      assert(includeStack.size() == 0);
+    }
+    isReparsing = false;
+    bool declaredGlobals = reparseDeclaredGlobals;
+    reparseDeclaredGlobals = false;
+    lazyCommands.clear();
+    scopesWithLazyCommands.clear();
+
+    std::vector<LoadedFile> files;
+    std::swap(files, loadedFiles);
+    loadedFiles = std::move(previousFiles);
+    std::vector<Command*> commands;
+    std::swap(commands, theManifest->getCommands());
+    theManifest->getCommands() = std::move(previousCommands);
+    if (files.empty() || declaredGlobals)
+      return false;
+
+    // Rebase the re-parsed files onto the unit.
+    for (auto& file: files) {
+      file.parent = (&file == &files[0]) ? unit.parent : file.parent + index;
+      file.subtreeEnd += index;
+      file.commandsBegin += unit.commandsBegin;
+      file.commandsEnd += unit.commandsBegin;
+    }
+    files[0].enclosingDeclCounts = unit.enclosingDeclCounts;
+    files[0].numPools = unit.numPools;
+
+    // Adjust the files enclosing or following the unit.
+    int filesDelta = int(files.size()) - int(unit.subtreeEnd - index);
+    ptrdiff_t commandsDelta =
+      ptrdiff_t(commands.size()) -
+      ptrdiff_t(unit.commandsEnd - unit.commandsBegin);
+    for (unsigned i = 0; i != index; ++i) {
+      if (loadedFiles[i].subtreeEnd > index) {
+        loadedFiles[i].subtreeEnd += filesDelta;
+        loadedFiles[i].commandsEnd += commandsDelta;
+      }
+    }
+    for (unsigned i = unit.subtreeEnd, e = loadedFiles.size(); i != e; ++i) {
+      auto& file = loadedFiles[i];
+      if (file.parent >= unit.subtreeEnd)
+        file.parent += filesDelta;
+      file.subtreeEnd += filesDelta;
+      file.commandsBegin += commandsDelta;
+      file.commandsEnd += commandsDelta;
+    }
+
+    // Splice in the files and commands.
+    loadedFiles.erase(loadedFiles.begin() + index,
+                      loadedFiles.begin() + unit.subtreeEnd);
+    loadedFiles.insert(loadedFiles.begin() + index, files.begin(), files.end());
+    auto& manifestCommands = theManifest->getCommands();
+    manifestCommands.erase(manifestCommands.begin() + unit.commandsBegin,
+                           manifestCommands.begin() + unit.commandsEnd);
+    manifestCommands.insert(manifestCommands.begin() + unit.commandsBegin,
+                            commands.begin(), commands.end());
+
+    return true;
+  }
+
   bool enterFile(const std::string& filename, Scope& scope,
-                 const Token* forToken = nullptr) {
+                 const Token* forToken = nullptr,
+                 StringRef fromFilenameOverride = {}) {
     // Load the file data.
     std::unique_ptr<char[]> data;
     uint64_t length;
-    std::string fromFilename = includeStack.empty() ? filename :
+    std::string fromFilename = !fromFilenameOverride.empty() ?
+      fromFilenameOverride.str() : includeStack.empty() ? filename :
       getCurrentFilename();
     if (!actions.readFileContents(fromFilename, filename, forToken, &data,
                                   &length))
       return false;
 
+    // Record the file.
+    LoadedFile file;
+    file.fromFilename = fromFilename;
+    file.filename = filename;
+    file.contentHash = hashContents(data.get(), length);
+    file.scope = &scope;
+    file.hasOwnScope = includeStack.empty() || &scope != &getCurrentScope();
+    file.parent = includeStack.empty() ? ~0U : includeStack.back().fileIndex;
+    file.commandsBegin = theManifest->getCommands().size();
+    if (file.hasOwnScope) {
+      for (auto parent = scope.getParent(); parent;
+           parent = parent->getParent()) {
+        file.enclosingDeclCounts.push_back({parent, declCounts.lookup(parent)});
+      }
+      file.numPools = theManifest->getPools().size();
+    }
+    loadedFiles.push_back(std::move(file));
+
     // Push a new entry onto the include stack.
     auto fileParser = llvm::make_unique<Parser>(data.get(), length, *this);
     includeStack.push_back(IncludeEntry(filename, std::move(data),
                                         std::move(fileParser),
-                                        scope));
+                                        scope, loadedFiles.size() - 1));
 
     return true;
   }
 
   void exitCurrentFile() {
+    auto& file = loadedFiles[includeStack.back().fileIndex];
+    file.subtreeEnd = loadedFiles.size();
+    file.commandsEnd = theManifest->getCommands().size();
     includeStack.pop_back();
   }
 
+  /// Record that the current files declare pools or default targets.
+  void noteGlobalDecl() {
+    for (const auto& entry: includeStack)
+      loadedFiles[entry.fileIndex].declaresGlobals = true;
+    if (isReparsing)
+      reparseDeclaredGlobals = true;
+  }
+
   ManifestLoaderActions& getActions() { return actions; }
   Parser* getCurrentParser() const {
     assert(!includeStack.empty());
@@ -129,105 +383,28 @@ public:
     return includeStack.back().scope;
   }
 
-  void evalString(void* userContext, StringRef string, raw_ostream& result,
-                  std::function<void(void*, StringRef, raw_ostream&)> lookup,
-                  std::function<void(const std::string&)> error) {
-    // Scan the string for escape sequences or variable references, accumulating
-    // output pieces as we go.
-    const char* pos = string.begin();
-    const char* end = string.end();
-    while (pos != end) {
-      // Find the next '$'.
-      const char* pieceStart = pos;
-      for (; pos != end; ++pos) {
-        if (*pos == '$')
-          break;
-      }
-
-      // Add the current piece, if non-empty.
-      if (pos != pieceStart)
-        result << StringRef(pieceStart, pos - pieceStart);
-
-      // If we are at the end, we are done.
-      if (pos == end)
-        break;
-
-      // Otherwise, we have a '$' character to handle.
-      ++pos;
-      if (pos == end) {
-        error("invalid '$'-escape at end of string");
+  /// Defer the evaluation of the command string and description of the given
+  /// command until they are used.
+  void addLazyCommand(Command* decl) {
+    lazyCommands.push_back(decl);
+    for (auto scope = decl->getScope(); scope; scope = scope->getParent()) {
+      if (!scopesWithLazyCommands.insert(scope).second)
         break;
-      }
-
-      // If this is a newline continuation, skip it and all leading space.
-      int c = *pos;
-      if (c == '\n') {
-        ++pos;
-        while (pos != end && isspace(*pos))
-          ++pos;
-        continue;
-      }
-
-      // If this is single character escape, honor it.
-      if (c == ' ' || c == ':' || c == '$') {
-        result << char(c);
-        ++pos;
-        continue;
-      }
-
-      // If this is a braced variable reference, expand it.
-      if (c == '{') {
-        // Scan until the end of the reference, checking validity of the
-        // identifier name as we go.
-        ++pos;
-        const char* varStart = pos;
-        bool isValid = true;
-        while (true) {
-          // If we reached the end of the string, this is an error.
-          if (pos == end) {
-            error(
-                "invalid variable reference in string (missing trailing '}')");
-            break;
-          }
-
-          // If we found the end of the reference, resolve it.
-          int c = *pos;
-          if (c == '}') {
-            // If this identifier isn't valid, emit an error.
-            if (!isValid) {
-              error("invalid variable name in reference");
-            } else {
-              lookup(userContext, StringRef(varStart, pos - varStart),
-                     result);
-            }
-            ++pos;
-            break;
-          }
-
-          // Track whether this is a valid identifier.
-          if (!Lexer::isIdentifierChar(c))
-            isValid = false;
-
-          ++pos;
-        }
-        continue;
-      }
-
-      // If this is a simple variable reference, expand it.
-      if (Lexer::isSimpleIdentifierChar(c)) {
-        const char* varStart = pos;
-        // Scan until the end of the simple identifier.
-        ++pos;
-        while (pos != end && Lexer::isSimpleIdentifierChar(*pos))
-          ++pos;
-        lookup(userContext, StringRef(varStart, pos-varStart), result);
-        continue;
-      }
+    }
+  }
 
-      // Otherwise, we have an invalid '$' escape.
-      error("invalid '$'-escape (literal '$' should be written as '$$')");
-      break;
+  /// Materialize all of the lazy commands.
+  ///
+  /// This must be done before changing the bindings of a scope which lazy
+  /// commands can observe, as Ninja evaluates commands against the bindings in
+  /// effect at the point of the build decl.
+  void materializeLazyCommands() {
+    for (auto decl: lazyCommands) {
+      decl->fixCommandString();
+      decl->getDescription();
     }
+    lazyCommands.clear();
+    scopesWithLazyCommands.clear();
   }
 
   /// Given a string template token, evaluate it against the given \arg Bindings
@@ -237,8 +414,8 @@ public:
     assert(value.tokenKind == Token::Kind::String && "invalid token kind");
     
     llvm::raw_svector_ostream result(storage);
-    evalString(nullptr, StringRef(value.start, value.length), result,
-               /*Lookup=*/ [&](void*, StringRef name, raw_ostream& result) {
+    ninja::evalString(StringRef(value.start, value.length), result,
+               /*Lookup=*/ [&](StringRef name, raw_ostream& result) {
                  result << scope.lookupBinding(name);
                },
                /*Error=*/ [this, &value](const std::string& msg) {
@@ -252,6 +429,10 @@ public:
   virtual void initialize(ninja::Parser* parser) override { }
 
   virtual void error(std::string message, const Token& at) override {
+    // An abandoned re-parse is followed by a full load, which reports the
+    // errors.
+    if (reparseDeclaredGlobals)
+      return;
     actions.error(getCurrentFilename(), message, at);
   }
 
@@ -270,10 +451,17 @@ public:
     SmallString<256> value;
     evalString(valueTok, getCurrentScope(), value);
 
+    if (scopesWithLazyCommands.count(&getCurrentScope()))
+      materializeLazyCommands();
     getCurrentScope().insertBinding(name, value.str());
+    ++declCounts[&getCurrentScope()];
   }
 
   virtual void actOnDefaultDecl(ArrayRef<Token> nameToks) override {
+    noteGlobalDecl();
+    if (reparseDeclaredGlobals)
+      return;
+
     // Resolve all of the inputs and outputs.
     for (const auto& nameTok: nameToks) {
       StringRef name(nameTok.start, nameTok.length);
@@ -302,9 +490,11 @@ public:
       }
     } else {
       // Establish a local binding set and use that to contain the bindings for
-      // the subninja.
-      Scope subninjaScope(&getCurrentScope());
-      if (enterFile(path.str(), subninjaScope, &pathTok)) {
+      // the subninja. The scope is owned by the manifest, as commands are
+      // evaluated against it lazily.
+      Scope* subninjaScope =
+        new (theManifest->getAllocator()) Scope(&getCurrentScope());
+      if (enterFile(path.str(), *subninjaScope, &pathTok)) {
         // Run the parser for the included file.
         getCurrentParser()->parse();
       }
@@ -355,6 +545,7 @@ public:
 
     Command* decl = new (theManifest->getAllocator())
       Command(rule, outputs, inputs, numExplicitInputs, numImplicitInputs);
+    decl->setScope(&getCurrentScope());
     theManifest->getCommands().push_back(decl);
 
     return decl;
@@ -378,69 +569,14 @@ public:
     decl->getParameters()[name] = value.str();
   }
 
-  struct LookupContext {
-    ManifestLoaderImpl& loader;
-    Command* decl;
-    const Token& startTok;
-    bool shellEscapeInAndOut;
-  };
-  static void lookupBuildParameter(void* userContext, StringRef name,
-                                   raw_ostream& result) {
-    LookupContext* context = static_cast<LookupContext*>(userContext);
-    context->loader.lookupBuildParameterImpl(context, name, result);
-  }
-  void lookupBuildParameterImpl(LookupContext* context, StringRef name,
-                                raw_ostream& result) {
-    auto decl = context->decl;
-      
-    // FIXME: Mange recursive lookup? Ninja crashes on it.
-      
-    // Support "in", "in_newline" and "out".
-    if (name == "in" || name == "in_newline") {
-      const auto separator = name == "in" ? ' ' : '\n';
-      for (unsigned i = 0, ie = decl->getNumExplicitInputs(); i != ie; ++i) {
-        if (i != 0)
-          result << separator;
-        auto& path = decl->getInputs()[i]->getScreenPath();
-        result << (context->shellEscapeInAndOut ? basic::shellEscaped(path)
-                                                : path);
-      }
-      return;
-    } else if (name == "out") {
-      for (unsigned i = 0, ie = decl->getOutputs().size(); i != ie; ++i) {
-        if (i != 0)
-          result << " ";
-        auto& path = decl->getOutputs()[i]->getScreenPath();
-        result << (context->shellEscapeInAndOut ? basic::shellEscaped(path)
-                                                : path);
-      }
-      return;
-    }
-
-    auto it = decl->getParameters().find(name);
-    if (it != decl->getParameters().end()) {
-      result << it->second;
-      return;
-    }
-    auto it2 = decl->getRule()->getParameters().find(name);
-    if (it2 != decl->getRule()->getParameters().end()) {
-      evalString(context, it2->second, result, lookupBuildParameter,
-                 /*Error=*/ [&](const std::string& msg) {
-                   error(msg + " during evaluation of '" + name.str() + "'",
-                         context->startTok);
-                 });
-      return;
-    }
-      
-    result << context->loader.getCurrentScope().lookupBinding(name);
-  }
   StringRef lookupNamedBuildParameter(Command* decl, const Token& startTok,
                                       StringRef name,
                                       SmallVectorImpl<char>& storage) {
-    LookupContext context{*this, decl, startTok,
-                          /*shellEscapeInAndOut*/ name == "command"};
     llvm::raw_svector_ostream os(storage);
-    lookupBuildParameter(&context, name, os);
+    decl->evalParameter(name, /*shellEscapeInAndOut*/ name == "command", os,
+                        /*Error=*/ [&](const std::string& msg) {
+                          error(msg, startTok);
+                        });
     return os.str();
   }
   
@@ -451,26 +587,24 @@ public:
     // Resolve the build decl parameters by evaluating in the context of the
     // rule and parameter overrides.
     //
-    // FIXME: Eventually, we should evaluate whether it would be more efficient
-    // to lazily bind all of these by only storing the parameters for the
-    // commands. This would let us delay the computation of all of the "command"
-    // strings until right before the command is run, which would then be
-    // parallelized and could also be more memory efficient. However, that would
-    // also requires us to expose more of the string evaluation machinery, as
-    // well as ensure that the recursive binding sets used by "subninja" decls
-    // are properly stored.
-
-    // FIXME: There is no need to store the parameters in the build decl anymore
-    // once this is all complete.
-    
-    // Evaluate the build parameters.
-    buildCommand.clear();
-    decl->setCommandString(lookupNamedBuildParameter(
-                               decl, startTok, "command", buildCommand));
-    buildDescription.clear();
-    decl->setDescription(lookupNamedBuildParameter(
-                             decl, startTok, "description", buildDescription));
+    // The command string and description are only evaluated when they are
+    // first used, as they dominate the size of large manifests in which most
+    // commands do not run. If the rule has malformed templates they are
+    // evaluated now, to diagnose the errors.
+    if (rulesWithInvalidTemplates.count(decl->getRule())) {
+      SmallString<256> command;
+      decl->setCommandString(lookupNamedBuildParameter(
+                                 decl, startTok, "command", command));
+      SmallString<256> description;
+      decl->setDescription(lookupNamedBuildParameter(
+                               decl, startTok, "description", description));
+    } else {
+      addLazyCommand(decl);
+    }
 
+    // FIXME: There is no need to store the parameters in the build decl for
+    // the remaining attributes, they could be resolved up-front.
+    
     // Set the dependency style.
     SmallString<256> deps;
     lookupNamedBuildParameter(decl, startTok, "deps", deps);
@@ -538,6 +672,13 @@ public:
 
   virtual PoolResult actOnBeginPoolDecl(const Token& nameTok) override {
     StringRef name(nameTok.start, nameTok.length);
+    noteGlobalDecl();
+
+    // A re-parse is abandoned, so the pool is not inserted.
+    if (reparseDeclaredGlobals) {
+      return static_cast<PoolResult>(
+          new (theManifest->getAllocator()) Pool(name));
+    }
 
     // Find the hash slot.
     auto& result = theManifest->getPools()[name];
@@ -592,6 +733,7 @@ public:
 
     // Find the hash slot.
     auto& result = getCurrentScope().getRules()[name];
+    ++declCounts[&getCurrentScope()];
 
     // Diagnose if the rule already exists (we still create a new one).
     if (result) {
@@ -627,6 +769,19 @@ public:
     if (!decl->getParameters().count("command")) {
       error("missing 'command' variable assignment", startTok);
     }
+
+    // Check whether the templates are well-formed, and can be evaluated lazily.
+    for (const auto& entry: decl->getParameters()) {
+      bool isValid = true;
+      llvm::raw_null_ostream os;
+      ninja::evalString(entry.getValue(), os,
+                        /*Lookup=*/ [](StringRef, raw_ostream&) {},
+                        /*Error=*/ [&](const std::string&) { isValid = false; });
+      if (!isValid) {
+        rulesWithInvalidTemplates.insert(decl);
+        break;
+      }
+    }
   }
 
   /// @}
@@ -654,6 +809,13 @@ std::unique_ptr<Manifest> ManifestLoader::load() {
   return static_cast<ManifestLoaderImpl*>(impl)->load();
 }
 
+std::unique_ptr<Manifest>
+ManifestLoader::reload(std::unique_ptr<Manifest> manifest) {
+  static_cast<ManifestLoaderImpl*>(impl)->getActions().initialize(this);
+
+  return static_cast<ManifestLoaderImpl*>(impl)->reload(std::move(manifest));
+}
+
 const Parser* ManifestLoader::getCurrentParser() const {
   return static_cast<const ManifestLoaderImpl*>(impl)->getCurrentParser();
 }
@@ -0,0 +1,123 @@
+//===- SerialQueuePerfTest.cpp --------------------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2020 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+//
+// A portable version of the SerialQueuePerfTests XCTest cases, comparing
+// SerialQueue against the previous thread per queue implementation.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Basic/SerialQueue.h"
+
+#include "ThreadSerialQueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace llbuild::basic;
+using llbuild::perftests::ThreadSerialQueue;
+
+namespace {
+
+static const int NumProducers = 4;
+static const int NumOperationsPerProducer = 250000;
+static const int NumSyncOperations = 100000;
+static const int NumQueues = 256;
+static const int NumRuns = 5;
+
+/// Add operations to a queue from several producer threads.
+template <typename Queue>
+static void addOperationsConcurrently(Queue& queue, uint64_t& sum) {
+  std::vector<std::thread> producers;
+  for (int p = 0; p != NumProducers; ++p) {
+    producers.emplace_back([&queue, &sum]() {
+        for (int i = 0; i != NumOperationsPerProducer; ++i) {
+          queue.async([&sum, i]() { sum += i; });
+        }
+      });
+  }
+  for (auto& producer: producers) {
+    producer.join();
+  }
+  queue.sync([]() {});
+}
+
+template <typename Queue>
+static void testAsync() {
+  uint64_t sum = 0;
+  Queue queue;
+  addOperationsConcurrently(queue, sum);
+  if (sum == 0)
+    abort();
+}
+
+template <typename Queue>
+static void testSync() {
+  int count = 0;
+  Queue queue;
+  for (int i = 0; i != NumSyncOperations; ++i) {
+    queue.sync([&count]() { ++count; });
+  }
+  if (count != NumSyncOperations)
+    abort();
+}
+
+template <typename Queue>
+static void testCreate() {
+  std::atomic<int> count{ 0 };
+  std::vector<std::unique_ptr<Queue>> queues;
+  for (int i = 0; i != NumQueues; ++i) {
+    queues.emplace_back(new Queue());
+    queues.back()->async([&count]() { ++count; });
+  }
+  queues.clear();
+  if (count.load() != NumQueues)
+    abort();
+}
+
+/// Get the median time of several runs of \p fn, in milliseconds.
+static double measure(void (*fn)()) {
+  std::vector<double> times;
+  for (int i = 0; i != NumRuns; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    times.push_back(std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start).count());
+  }
+  std::sort(times.begin(), times.end());
+  return times[NumRuns / 2];
+}
+
+static void report(const char* name, void (*threadFn)(), void (*strandFn)()) {
+  double threadTime = measure(threadFn);
+  double strandTime = measure(strandFn);
+  printf("%-24s thread: %9.2fms  strand: %9.2fms\n", name, threadTime,
+         strandTime);
+}
+
+}
+
+int main() {
+  printf("median of %d runs, %u hardware threads\n", NumRuns,
+         std::thread::hardware_concurrency());
+  report("async 1M (4 producers)", testAsync<ThreadSerialQueue>,
+         testAsync<SerialQueue>);
+  report("sync 100K", testSync<ThreadSerialQueue>, testSync<SerialQueue>);
+  report("create 256 queues", testCreate<ThreadSerialQueue>,
+         testCreate<SerialQueue>);
+  return 0;
+}
@@ -0,0 +1,96 @@
+//===- ThreadSerialQueue.h --------------------------------------*- C++ -*-===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2020 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+//
+// The previous serial queue implementation, used as a baseline by the serial
+// queue performance tests.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLBUILD_PERFTESTS_THREADSERIALQUEUE_H
+#define LLBUILD_PERFTESTS_THREADSERIALQUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace llbuild {
+namespace perftests {
+
+/// A serial queue with a dedicated thread and a mutex protected queue of
+/// copyable functions.
+class ThreadSerialQueue {
+  std::unique_ptr<std::thread> operationsThread;
+  std::deque<std::function<void(void)>> operations;
+  std::mutex operationsMutex;
+  std::condition_variable readyOperationsCondition;
+
+  void run() {
+    while (true) {
+      std::function<void(void)> fn;
+      {
+        std::unique_lock<std::mutex> lock(operationsMutex);
+        while (operations.empty()) {
+          readyOperationsCondition.wait(lock);
+        }
+        fn = operations.front();
+        operations.pop_front();
+      }
+      if (!fn)
+        break;
+      fn();
+    }
+  }
+
+  void addOperation(std::function<void(void)>&& fn) {
+    std::lock_guard<std::mutex> guard(operationsMutex);
+    operations.push_back(fn);
+    readyOperationsCondition.notify_one();
+  }
+
+public:
+  ThreadSerialQueue() {
+    operationsThread.reset(new std::thread(&ThreadSerialQueue::run, this));
+  }
+
+  ~ThreadSerialQueue() {
+    addOperation({});
+    operationsThread->join();
+  }
+
+  void sync(std::function<void(void)> fn) {
+    std::condition_variable cv{};
+    std::mutex isCompleteMutex{};
+    bool isComplete = false;
+    addOperation([&]() {
+        fn();
+        std::unique_lock<std::mutex> lock(isCompleteMutex);
+        isComplete = true;
+        cv.notify_one();
+      });
+    std::unique_lock<std::mutex> lock(isCompleteMutex);
+    while (!isComplete) {
+      cv.wait(lock);
+    }
+  }
+
+  void async(std::function<void(void)> fn) {
+    addOperation(std::move(fn));
+  }
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,133 @@
+//===- SerialQueuePerfTests.mm --------------------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2020 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#import "llbuild/Basic/SerialQueue.h"
+
+#import "../../SerialQueue/ThreadSerialQueue.h"
+
+#import <XCTest/XCTest.h>
+
+#import <atomic>
+#import <memory>
+#import <thread>
+#import <vector>
+
+using namespace llbuild::basic;
+using llbuild::perftests::ThreadSerialQueue;
+
+@interface SerialQueuePerfTests : XCTestCase
+
+@end
+
+#pragma mark - Support Classes
+
+namespace {
+
+static const int NumProducers = 4;
+static const int NumOperationsPerProducer = 250000;
+static const int NumSyncOperations = 100000;
+static const int NumQueues = 256;
+
+/// Add operations to a queue from several producer threads.
+template <typename Queue>
+static void addOperationsConcurrently(Queue& queue, uint64_t& sum) {
+  std::vector<std::thread> producers;
+  for (int p = 0; p != NumProducers; ++p) {
+    producers.emplace_back([&queue, &sum]() {
+        for (int i = 0; i != NumOperationsPerProducer; ++i) {
+          queue.async([&sum, i]() { sum += i; });
+        }
+      });
+  }
+  for (auto& producer: producers) {
+    producer.join();
+  }
+  queue.sync([]() {});
+}
+
+}
+
+@implementation SerialQueuePerfTests
+
+#pragma mark - Async Throughput
+
+- (void)testAsync_1M_Thread {
+  [self measureBlock:^{
+      uint64_t sum = 0;
+      ThreadSerialQueue queue;
+      addOperationsConcurrently(queue, sum);
+      XCTAssertNotEqual(sum, 0ULL);
+    }];
+}
+
+- (void)testAsync_1M_Strand {
+  [self measureBlock:^{
+      uint64_t sum = 0;
+      SerialQueue queue;
+      addOperationsConcurrently(queue, sum);
+      XCTAssertNotEqual(sum, 0ULL);
+    }];
+}
+
+#pragma mark - Sync Latency
+
+- (void)testSync_100K_Thread {
+  [self measureBlock:^{
+      int count = 0;
+      ThreadSerialQueue queue;
+      for (int i = 0; i != NumSyncOperations; ++i) {
+        queue.sync([&count]() { ++count; });
+      }
+      XCTAssertEqual(count, NumSyncOperations);
+    }];
+}
+
+- (void)testSync_100K_Strand {
+  [self measureBlock:^{
+      int count = 0;
+      SerialQueue queue;
+      for (int i = 0; i != NumSyncOperations; ++i) {
+        queue.sync([&count]() { ++count; });
+      }
+      XCTAssertEqual(count, NumSyncOperations);
+    }];
+}
+
+#pragma mark - Queue Creation
+
+- (void)testCreate_256Queues_Thread {
+  [self measureBlock:^{
+      std::atomic<int> count{ 0 };
+      std::vector<std::unique_ptr<ThreadSerialQueue>> queues;
+      for (int i = 0; i != NumQueues; ++i) {
+        queues.emplace_back(new ThreadSerialQueue());
+        queues.back()->async([&count]() { ++count; });
+      }
+      queues.clear();
+      XCTAssertEqual(count.load(), NumQueues);
+    }];
+}
+
+- (void)testCreate_256Queues_Strand {
+  [self measureBlock:^{
+      std::atomic<int> count{ 0 };
+      std::vector<std::unique_ptr<SerialQueue>> queues;
+      for (int i = 0; i != NumQueues; ++i) {
+        queues.emplace_back(new SerialQueue());
+        queues.back()->async([&count]() { ++count; });
+      }
+      queues.clear();
+      XCTAssertEqual(count.load(), NumQueues);
+    }];
+}
+
+@end
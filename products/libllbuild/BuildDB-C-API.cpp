@@ -42,9 +42,7 @@ private:
   
   bool keyCacheInitialized = false;
   
-  CAPIBuildDB(StringRef path, uint32_t clientSchemaVersion, std::string *error_out) {
-    _db = createSQLiteBuildDB(path, clientSchemaVersion, /* recreateUnmatchedVersion = */ false, error_out);
-  }
+  CAPIBuildDB(std::unique_ptr<BuildDB> db) : _db(std::move(db)) { }
   
   bool fetchKeysIfNecessary(std::string *error) {
     if (keyCacheInitialized) {
@@ -89,8 +87,8 @@ private:
   }
   
 public:
-  static CAPIBuildDB *create(StringRef path, uint32_t clientSchemaVersion, std::string *error_out) {
-    auto databaseObject = new CAPIBuildDB(path, clientSchemaVersion, error_out);
+  static CAPIBuildDB *create(std::unique_ptr<BuildDB> db, std::string *error_out) {
+    auto databaseObject = new CAPIBuildDB(std::move(db));
     if (databaseObject->_db == nullptr || !error_out->empty() || !databaseObject->buildStarted(error_out)) {
       delete databaseObject;
       return nullptr;
@@ -250,9 +248,33 @@ const llb_database_t* llb_database_open(
                                         char *path,
                                         uint32_t clientSchemaVersion,
                                         llb_data_t *error_out) {
+  return llb_database_open_with_durability(path, clientSchemaVersion, llb_database_durability_strict, error_out);
+}
+
+const llb_database_t* llb_database_open_with_durability(
+                                        char *path,
+                                        uint32_t clientSchemaVersion,
+                                        llb_database_durability_t durability,
+                                        llb_data_t *error_out) {
   std::string error;
-  
-  auto database = CAPIBuildDB::create(StringRef(path), clientSchemaVersion, &error);
+
+  SQLiteBuildDBDurability internalDurability;
+  switch (durability) {
+  case llb_database_durability_strict:
+    internalDurability = SQLiteBuildDBDurability::Strict;
+    break;
+  case llb_database_durability_normal:
+    internalDurability = SQLiteBuildDBDurability::Normal;
+    break;
+  case llb_database_durability_fast:
+    internalDurability = SQLiteBuildDBDurability::Fast;
+    break;
+  default:
+    internalDurability = SQLiteBuildDBDurability::Strict;
+    break;
+  }
+
+  auto database = CAPIBuildDB::create(createSQLiteBuildDB(StringRef(path), clientSchemaVersion, /* recreateUnmatchedVersion = */ false, &error, internalDurability), &error);
   
   if (!error.empty()) {
     error_out->length = error.size();
@@ -264,6 +286,24 @@ const llb_database_t* llb_database_open(
   return (llb_database_t *)database;
 }
 
+const llb_database_t* llb_database_open_snapshot(
+                                        char *path,
+                                        uint32_t clientSchemaVersion,
+                                        llb_data_t *error_out) {
+  std::string error;
+
+  auto database = CAPIBuildDB::create(createReadOnlySQLiteBuildDB(StringRef(path), clientSchemaVersion, &error), &error);
+
+  if (!error.empty()) {
+    error_out->length = error.size();
+    error_out->data = (const uint8_t*)strdup(error.c_str());
+    delete database;
+    return nullptr;
+  }
+
+  return (llb_database_t *)database;
+}
+
 void llb_database_destroy(llb_database_t *database) {
   auto db = (CAPIBuildDB *)database;
   db->buildComplete();
@@ -60,7 +60,8 @@ bool CAPIBuildKey::operator ==(const CAPIBuildKey &other) {
   if (hasIdentifier && other.hasIdentifier) {
     return identifier == other.identifier;
   }
-  return internalBuildKey.getKeyData() == other.internalBuildKey.getKeyData();
+  return internalBuildKey.toKeyRef().str() ==
+      other.internalBuildKey.toKeyRef().str();
 }
 
 static BuildKey::Kind publicToInternalBuildKeyKind(llb_build_key_kind_t kind) {
@@ -110,7 +111,7 @@ llb_build_key_kind_t llb_build_key_get_kind(llb_build_key_t *_Nonnull key) {
 }
 
 void llb_build_key_get_key_data(llb_build_key_t *key, void *_Nonnull context, void (*_Nonnull iteration)(void *context, uint8_t *data, size_t count)) {
-  auto &keyData = ((CAPIBuildKey *)key)->getInternalBuildKey().getKeyData();
+  auto keyData = ((CAPIBuildKey *)key)->getInternalBuildKey().toKeyRef();
   iteration(context, (uint8_t *)keyData.data(), keyData.size());
 }
 
@@ -151,6 +151,16 @@ public:
 
     return cAPIDelegate.fs_create_symlink(cAPIDelegate.context, src.c_str(), target.c_str());
   }
+
+  virtual bool copyFile(const std::string& src, const std::string& target) override {
+    // Only use the local file system if the client does not virtualize either
+    // side of the copy.
+    if (!cAPIDelegate.fs_get_file_contents && !cAPIDelegate.fs_get_file_info) {
+      return localFileSystem->copyFile(src, target);
+    }
+
+    return basic::FileSystem::copyFile(src, target);
+  }
 };
   
 class CAPIBuildSystemFrontendDelegate : public BuildSystemFrontendDelegate {
@@ -543,6 +553,11 @@ public:
     invocation.useSerialBuild = cAPIInvocation.useSerialBuild;
     invocation.showVerboseStatus = cAPIInvocation.showVerboseStatus;
     invocation.schedulerLanes = cAPIInvocation.schedulerLanes;
+    invocation.partitionLanesByNUMANode =
+      cAPIInvocation.partitionLanesByNUMANode;
+    invocation.pinEngineThread = cAPIInvocation.pinEngineThread;
+    invocation.resultMemoryBudget = cAPIInvocation.resultMemoryBudget;
+    invocation.useJobServer = cAPIInvocation.useJobServer;
 
     // Register a custom diagnostic handler with the source manager.
     sourceMgr.setDiagHandler([](const llvm::SMDiagnostic& diagnostic,
@@ -672,7 +687,7 @@ class CAPIExternalCommand : public ExternalCommand {
       virtual void actOnMissing(StringRef) override { }
       virtual void actOnOutput(StringRef) override { }
       virtual void actOnInput(StringRef name) override {
-        ti.discoveredDependency(BuildKey::makeNode(name).toData());
+        ti.discoveredDependency(BuildKey::makeNode(name).toKeyRef());
       }
     };
     
@@ -950,12 +965,12 @@ char* llb_buildsystem_command_get_verbose_description(
 
 void llb_buildsystem_command_interface_task_discovered_dependency(llb_task_interface_t ti, llb_build_key_t* key) {
   auto coreti = reinterpret_cast<core::TaskInterface*>(&ti);
-  coreti->discoveredDependency(((CAPIBuildKey *)key)->getInternalBuildKey().toData());
+  coreti->discoveredDependency(((CAPIBuildKey *)key)->getInternalBuildKey().toKeyRef());
 }
 
 void llb_buildsystem_command_interface_task_needs_input(llb_task_interface_t ti, llb_build_key_t* key, uintptr_t inputID) {
   auto coreti = reinterpret_cast<core::TaskInterface*>(&ti);
-  coreti->request(((CAPIBuildKey *)key)->getInternalBuildKey().toData(), inputID);
+  coreti->request(((CAPIBuildKey *)key)->getInternalBuildKey().toKeyRef(), inputID);
 }
 
 llb_build_value_file_info_t llb_buildsystem_command_interface_get_file_info(llb_buildsystem_interface_t* bi_p, const char* path) {
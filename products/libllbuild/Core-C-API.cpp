@@ -112,6 +112,10 @@ public:
 struct CAPIBuildEngine {
   std::unique_ptr<BuildEngineDelegate> delegate;
   std::unique_ptr<BuildEngine> engine;
+
+  /// The result of the last build, which the data returned by
+  /// llb_buildengine_build() refers to.
+  ValueType lastResult;
 };
 
 class CAPITask : public Task {
@@ -203,11 +207,19 @@ bool llb_buildengine_attach_db(llb_buildengine_t* engine_p,
   return result;
 }
 
+void llb_buildengine_set_result_memory_budget(llb_buildengine_t* engine_p,
+                                              uint64_t bytes) {
+  auto& engine = ((CAPIBuildEngine*) engine_p)->engine;
+  engine->setResultMemoryBudget(bytes);
+}
+
 void llb_buildengine_build(llb_buildengine_t* engine_p, const llb_data_t* key,
                            llb_data_t* result_out) {
-  auto& engine = ((CAPIBuildEngine*) engine_p)->engine;
+  auto* capiEngine = (CAPIBuildEngine*) engine_p;
 
-  auto& result = engine->build(KeyType((const char*)key->data, key->length));
+  auto& result = capiEngine->lastResult;
+  result = capiEngine->engine->build(
+      KeyType((const char*)key->data, key->length));
 
   *result_out = llb_data_t{ result.size(), result.data() };
 }
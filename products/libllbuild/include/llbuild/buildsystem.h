@@ -206,6 +206,24 @@ struct llb_buildsystem_invocation_t_ {
   llb_scheduler_algorithm_t schedulerAlgorithm;
 
   uint32_t schedulerLanes;
+
+  /// Whether to divide the scheduler lanes evenly across the NUMA nodes of the
+  /// host, restricting each lane (and the processes it spawns) to the CPUs of
+  /// its node.
+  bool partitionLanesByNUMANode;
+
+  /// Whether to restrict the thread running the build engine to the CPUs of
+  /// the first NUMA node for the duration of a build.
+  bool pinEngineThread;
+
+  /// The memory budget (in bytes) for rule results kept in memory between
+  /// builds, or zero for no limit, \see
+  /// llb_buildengine_set_result_memory_budget().
+  uint64_t resultMemoryBudget;
+
+  /// Whether to share the scheduler lanes with the processes run by the build
+  /// through a GNU make compatible jobserver (advertised through MAKEFLAGS).
+  bool useJobServer;
 };
   
 /// Delegate structure for callbacks required by the build system.
@@ -151,11 +151,25 @@ llb_buildengine_attach_db(llb_buildengine_t* engine,
                           uint32_t schema_version,
                           char **error_out);
 
+/// Limit the memory used by rule results kept between builds.
+///
+/// When a database is attached, the values and dependencies of the least
+/// recently built rules are paged out at the start of each build, until the
+/// remaining results fit in the budget, and are reloaded from the database on
+/// demand.
+///
+/// \param bytes The memory budget, or zero for no limit (the default).
+LLBUILD_EXPORT void
+llb_buildengine_set_result_memory_budget(llb_buildengine_t* engine,
+                                         uint64_t bytes);
+
 /// Build the result for a particular key.
 ///
 /// \param engine The engine to operate on.
 /// \param key The key to build.
 /// \param result_out [out] On return, the result of computing the given key.
+/// The data is owned by the engine, and remains valid until the next build or
+/// until the engine is destroyed.
 LLBUILD_EXPORT void
 llb_buildengine_build(llb_buildengine_t* engine, const llb_data_t* key,
                       llb_data_t* result_out);
@@ -59,9 +59,32 @@ typedef struct llb_database_result_t_ {
 /// Opaque handler to a database
 typedef struct llb_database_t_ llb_database_t;
 
+/// The journaling and sync policy of a database.
+typedef enum LLBUILD_ENUM_ATTRIBUTES {
+  /// Use a rollback journal, and sync every transaction to disk.
+  llb_database_durability_strict LLBUILD_SWIFT_NAME(strict) = 0,
+
+  /// Use a write-ahead log, and sync every transaction to disk.
+  llb_database_durability_normal LLBUILD_SWIFT_NAME(normal) = 1,
+
+  /// Use a write-ahead log which is only synced at checkpoints, and read
+  /// through a memory map.
+  llb_database_durability_fast LLBUILD_SWIFT_NAME(fast) = 2,
+} llb_database_durability_t LLBUILD_SWIFT_NAME(BuildDBDurability);
+
 /// Open the database that's saved at the given path by creating a llb_database_t instance. If the creation fails due to an error, nullptr will be returned.
 LLBUILD_EXPORT const llb_database_t *_Nullable llb_database_open(char *path, uint32_t clientSchemaVersion, llb_data_t *error_out);
 
+/// Open the database at the given path, as \see llb_database_open(), with the given durability policy.
+LLBUILD_EXPORT const llb_database_t *_Nullable llb_database_open_with_durability(char *path, uint32_t clientSchemaVersion, llb_database_durability_t durability, llb_data_t *error_out);
+
+/// Open the database at the given path read-only, for use by tools while a build may be running.
+///
+/// All lookups on the returned instance see a consistent snapshot of the database, taken when it is opened. The database is never modified, and a version mismatch is an error.
+///
+/// Lookups only run concurrently with a build if the build writes the database with a write-ahead log, i.e. with \see llb_database_durability_normal or \see llb_database_durability_fast; the snapshot then does not block the build, and vice versa. The default, \see llb_database_durability_strict, uses a rollback journal, and lookups fail while a build is in progress.
+LLBUILD_EXPORT const llb_database_t *_Nullable llb_database_open_snapshot(char *path, uint32_t clientSchemaVersion, llb_data_t *error_out);
+
 /// Destroy a build database instance
 LLBUILD_EXPORT void
 llb_database_destroy(llb_database_t *database);
@@ -81,6 +81,22 @@
 ///
 /// Version History:
 ///
+/// 17: Removed dbShards from llb_buildsystem_invocation_t
+///
+/// 16: Added llb_database_open_snapshot (only concurrent with a build for
+///     databases using a write-ahead log, which is not the default durability)
+///
+/// 15: Added llb_database_open_with_durability
+///
+/// 14: Added dbShards to llb_buildsystem_invocation_t
+///
+/// 13: Added useJobServer to llb_buildsystem_invocation_t
+///
+/// 12: Added llb_buildengine_set_result_memory_budget and resultMemoryBudget to
+/// llb_buildsystem_invocation_t
+///
+/// 11: Added CPU affinity options to llb_buildsystem_invocation_t
+///
 /// 10: Changed to a llb_task_interface_t copies instead of pointers
 ///
 /// 9: Changed the API for build keys to use bridged opaque pointers with access functions
@@ -102,7 +118,7 @@
 /// 1: Added `environment` parameter to llb_buildsystem_invocation_t.
 ///
 /// 0: Pre-history
-#define LLBUILD_C_API_VERSION 10
+#define LLBUILD_C_API_VERSION 17
 
 /// Get the full version of the llbuild library.
 LLBUILD_EXPORT const char* llb_get_full_version_string(void);
@@ -49,7 +49,7 @@ struct CriticalPathTool: ParsableCommand {
     var quiet: Bool
 
     func run() throws {
-        let db = try BuildDB(path: database.pathString, clientSchemaVersion: UInt32(clientSchemaVersion))
+        let db = try BuildDB(path: database.pathString, clientSchemaVersion: UInt32(clientSchemaVersion), readOnly: true)
         let allKeysWithResult = try db.getKeysWithResult()
         let solver = CriticalBuildPath.Solver(keys: allKeysWithResult)
         let path = solver.run()
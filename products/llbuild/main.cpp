@@ -36,6 +36,7 @@ static void usage() {
   fprintf(stderr, "  ninja       -- Run the Ninja subtool\n");
   fprintf(stderr, "  buildengine -- Run the build engine subtool\n");
   fprintf(stderr, "  buildsystem -- Run the build system subtool\n");
+  fprintf(stderr, "  query       -- Query the dependency graph of a build.db\n");
   fprintf(stderr, "  analyze     -- Run the analyze subtool\n");
   fprintf(stderr, "\n");
   exit(0);
@@ -123,6 +124,8 @@ int main(int argc, const char **argv) {
     return executeBuildEngineCommand(args);
   } else if (command == "buildsystem") {
     return executeBuildSystemCommand(args);
+  } else if (command == "query") {
+    return executeQueryCommand(args);
   } else if (command == "analyze") {
     // Next to the llbuild binary we build a llbuild-analyze binary with SwiftPM
     // which we treat as a subtool to llbuild. If that doesn't exist, the exec
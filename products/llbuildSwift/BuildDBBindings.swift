@@ -224,7 +224,8 @@ public final class BuildDB {
     /// Initializes the build database at a given path
     /// If the database at this path doesn't exist, it will created
     /// If the clientSchemaVersion is different to the one in the database at this path, its content will be automatically erased!
-    public init(path: String, clientSchemaVersion: UInt32) throws {
+    /// If readOnly is true, the database is opened as a consistent snapshot which can be read while a build is running (see llb_database_open_snapshot), and durability is ignored.
+    public init(path: String, clientSchemaVersion: UInt32, durability: BuildDBDurability = .strict, readOnly: Bool = false) throws {
         // Safety check that we have linked against a compatibile llbuild framework version
         if llb_get_api_version() != LLBUILD_C_API_VERSION {
             throw Error.couldNotOpenDB(error: "llbuild C API version mismatch, found \(llb_get_api_version()), expect \(LLBUILD_C_API_VERSION)")
@@ -240,7 +241,10 @@ public final class BuildDB {
         }
         
         let errorPtr = MutableStringPointer()
-        guard let database = llb_database_open(strdup(path), clientSchemaVersion, &errorPtr.ptr) else {
+        let openedDatabase = readOnly
+            ? llb_database_open_snapshot(strdup(path), clientSchemaVersion, &errorPtr.ptr)
+            : llb_database_open_with_durability(strdup(path), clientSchemaVersion, durability, &errorPtr.ptr)
+        guard let database = openedDatabase else {
             throw Error.couldNotOpenDB(error: errorPtr.msg ?? "Unknown error.")
         }
         
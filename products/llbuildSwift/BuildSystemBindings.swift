@@ -718,7 +718,7 @@ public final class BuildSystem {
     /// The C environment, if used.
     private let _cEnvironment: CStyleEnvironment
 
-    public init(buildFile: String, databaseFile: String, delegate: BuildSystemDelegate, environment: [String: String]? = nil, serial: Bool = false, traceFile: String? = nil, schedulerAlgorithm: SchedulerAlgorithm = .commandNamePriority, schedulerLanes: UInt32 = 0) {
+    public init(buildFile: String, databaseFile: String, delegate: BuildSystemDelegate, environment: [String: String]? = nil, serial: Bool = false, traceFile: String? = nil, schedulerAlgorithm: SchedulerAlgorithm = .commandNamePriority, schedulerLanes: UInt32 = 0, partitionLanesByNUMANode: Bool = false, pinEngineThread: Bool = false, resultMemoryBudget: UInt64 = 0, useJobServer: Bool = false) {
 
         // Safety check that we have linked against a compatibile llbuild framework version
         if llb_get_api_version() != LLBUILD_C_API_VERSION {
@@ -751,6 +751,10 @@ public final class BuildSystem {
             _invocation.useSerialBuild = serial
             _invocation.schedulerAlgorithm = schedulerAlgorithm
             _invocation.schedulerLanes = schedulerLanes
+            _invocation.partitionLanesByNUMANode = partitionLanesByNUMANode
+            _invocation.pinEngineThread = pinEngineThread
+            _invocation.resultMemoryBudget = resultMemoryBudget
+            _invocation.useJobServer = useJobServer
 
             // Construct the system delegate.
             var _delegate = llb_buildsystem_delegate_t()
@@ -434,6 +434,17 @@ public class BuildEngine {
         }
     }
 
+    /// Limit the memory used by rule results kept between builds.
+    ///
+    /// When a database is attached, the values and dependencies of the least
+    /// recently built rules are paged out at the start of each build, and are
+    /// reloaded from the database on demand.
+    ///
+    /// - Parameter bytes: The memory budget, or zero for no limit.
+    public func setResultMemoryBudget(bytes: UInt64) {
+        llb_buildengine_set_result_memory_budget(_engine, bytes)
+    }
+
     /// MARK: Internal Delegate Implementation
 
     /// Helper function for getting the engine from the delegate context.
@@ -0,0 +1,292 @@
+//===- unittests/Basic/ArchiveTest.cpp ------------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2020 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "../BuildSystem/TempDir.h"
+
+#include "llbuild/Basic/Archive.h"
+#include "llbuild/Basic/LLVM.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "gtest/gtest.h"
+
+using namespace llbuild;
+using namespace llbuild::basic;
+
+namespace {
+
+static std::string writeFile(const TmpDir& dir, StringRef name,
+                             StringRef contents) {
+  SmallString<256> path{ dir.str() };
+  llvm::sys::path::append(path, name);
+  std::error_code ec;
+  llvm::raw_fd_ostream os(path.str(), ec, llvm::sys::fs::F_None);
+  EXPECT_FALSE(ec);
+  os << contents;
+  os.close();
+  return path.str();
+}
+
+static std::string readFile(StringRef path) {
+  auto buffer = llvm::MemoryBuffer::getFile(path);
+  EXPECT_TRUE(bool(buffer));
+  return buffer ? (*buffer)->getBuffer().str() : std::string();
+}
+
+static void appendLE(std::string& out, uint64_t value, unsigned size) {
+  for (unsigned i = 0; i != size; ++i)
+    out.push_back(char((value >> (8 * i)) & 0xFF));
+}
+
+/// Create a minimal relocatable ELF64 object defining the global symbol "foo",
+/// referencing the undefined symbol "bar" and defining the local "local".
+static std::string makeELFObject() {
+  std::string strtab("\0foo\0bar\0local\0\0", 16);
+
+  std::string symtab;
+  auto appendSymbol = [&](uint32_t name, uint8_t info, uint16_t shndx) {
+    appendLE(symtab, name, 4);
+    appendLE(symtab, info, 1);
+    appendLE(symtab, 0, 1);
+    appendLE(symtab, shndx, 2);
+    appendLE(symtab, 0, 8);
+    appendLE(symtab, 0, 8);
+  };
+  appendSymbol(0, 0, 0);
+  appendSymbol(1, 0x12, 1);
+  appendSymbol(5, 0x10, 0);
+  appendSymbol(9, 0x02, 1);
+
+  uint64_t strtabOffset = 64;
+  uint64_t symtabOffset = strtabOffset + strtab.size();
+  uint64_t shoff = symtabOffset + symtab.size();
+
+  std::string object("\x7f" "ELF\x02\x01\x01", 7);
+  object.resize(16, '\0');
+  appendLE(object, 1, 2);       // e_type
+  appendLE(object, 62, 2);      // e_machine
+  appendLE(object, 1, 4);       // e_version
+  appendLE(object, 0, 8);       // e_entry
+  appendLE(object, 0, 8);       // e_phoff
+  appendLE(object, shoff, 8);   // e_shoff
+  appendLE(object, 0, 4);       // e_flags
+  appendLE(object, 64, 2);      // e_ehsize
+  appendLE(object, 0, 2);       // e_phentsize
+  appendLE(object, 0, 2);       // e_phnum
+  appendLE(object, 64, 2);      // e_shentsize
+  appendLE(object, 3, 2);       // e_shnum
+  appendLE(object, 0, 2);       // e_shstrndx
+  object += strtab;
+  object += symtab;
+
+  auto appendSection = [&](uint32_t type, uint64_t offset, uint64_t size,
+                           uint32_t link) {
+    appendLE(object, 0, 4);
+    appendLE(object, type, 4);
+    appendLE(object, 0, 8);
+    appendLE(object, 0, 8);
+    appendLE(object, offset, 8);
+    appendLE(object, size, 8);
+    appendLE(object, link, 4);
+    appendLE(object, 0, 4);
+    appendLE(object, 0, 8);
+    appendLE(object, 0, 8);
+  };
+  appendSection(0, 0, 0, 0);
+  appendSection(2, symtabOffset, symtab.size(), 2);
+  appendSection(3, strtabOffset, strtab.size(), 0);
+  return object;
+}
+
+/// Create a minimal 64-bit Mach-O object defining the external symbol "_foo",
+/// referencing the undefined symbol "_bar" and defining the private "_local".
+static std::string makeMachOObject() {
+  std::string strtab("\0_foo\0_bar\0_local\0", 19);
+
+  std::string symtab;
+  auto appendSymbol = [&](uint32_t name, uint8_t type, uint8_t sect) {
+    appendLE(symtab, name, 4);
+    appendLE(symtab, type, 1);
+    appendLE(symtab, sect, 1);
+    appendLE(symtab, 0, 2);
+    appendLE(symtab, 0, 8);
+  };
+  appendSymbol(1, 0x0f, 1);
+  appendSymbol(6, 0x01, 0);
+  appendSymbol(11, 0x0e, 1);
+
+  uint64_t symoff = 32 + 24;
+  uint64_t stroff = symoff + symtab.size();
+
+  std::string object;
+  appendLE(object, 0xfeedfacf, 4); // magic
+  appendLE(object, 0x01000007, 4); // cputype
+  appendLE(object, 3, 4);          // cpusubtype
+  appendLE(object, 1, 4);          // filetype
+  appendLE(object, 1, 4);          // ncmds
+  appendLE(object, 24, 4);         // sizeofcmds
+  appendLE(object, 0, 4);          // flags
+  appendLE(object, 0, 4);          // reserved
+  appendLE(object, 2, 4);          // LC_SYMTAB
+  appendLE(object, 24, 4);         // cmdsize
+  appendLE(object, symoff, 4);
+  appendLE(object, 3, 4);          // nsyms
+  appendLE(object, stroff, 4);
+  appendLE(object, strtab.size(), 4);
+  object += symtab;
+  object += strtab;
+  return object;
+}
+
+TEST(ArchiveTest, gnuLayout) {
+  TmpDir tempDir(__func__);
+  auto a = writeFile(tempDir, "a.txt", "abc");
+  auto b = writeFile(tempDir, "a-long-member-name.txt", "hello");
+  auto archive = tempDir.str() + "/lib.a";
+
+  std::string error;
+  EXPECT_EQ(ArchiveWriteStatus::Written,
+            writeArchive(archive, {a, b}, ArchiveFormat::GNU, &error));
+  EXPECT_EQ("", error);
+
+  std::string expected = "!<arch>\n";
+  expected += "//              0           0     0     644     24        `\n";
+  expected += "a-long-member-name.txt/\n";
+  expected += "a.txt/          0           0     0     644     3         `\n";
+  expected += "abc\n";
+  expected += "/0              0           0     0     644     5         `\n";
+  expected += "hello\n";
+  EXPECT_EQ(expected, readFile(archive));
+
+  // Writing the same archive again leaves it untouched.
+  EXPECT_EQ(ArchiveWriteStatus::Unchanged,
+            writeArchive(archive, {a, b}, ArchiveFormat::GNU, &error));
+
+  // A member with the same size is updated in a copy of the archive, which
+  // replaces it (so another link to the old archive is left untouched).
+  auto oldArchive = tempDir.str() + "/old.a";
+  EXPECT_FALSE(llvm::sys::fs::create_hard_link(archive, oldArchive));
+  writeFile(tempDir, "a.txt", "xyz");
+  EXPECT_EQ(ArchiveWriteStatus::Updated,
+            writeArchive(archive, {a, b}, ArchiveFormat::GNU, &error));
+  EXPECT_NE(std::string::npos, readFile(archive).find("xyz\n"));
+  EXPECT_EQ(expected, readFile(oldArchive));
+
+  // Otherwise, the archive is rewritten.
+  writeFile(tempDir, "a.txt", "abcd");
+  EXPECT_EQ(ArchiveWriteStatus::Written,
+            writeArchive(archive, {a, b}, ArchiveFormat::GNU, &error));
+  EXPECT_NE(std::string::npos, readFile(archive).find("abcd/"));
+}
+
+TEST(ArchiveTest, gnuSymbolIndex) {
+  TmpDir tempDir(__func__);
+  auto object = writeFile(tempDir, "foo.o", makeELFObject());
+  auto archive = tempDir.str() + "/lib.a";
+
+  std::string error;
+  EXPECT_EQ(ArchiveWriteStatus::Written,
+            writeArchive(archive, {object}, ArchiveFormat::GNU, &error));
+  EXPECT_EQ("", error);
+
+  // The index has one symbol, pointing at the member header which follows the
+  // index itself.
+  std::string contents = readFile(archive);
+  std::string expected = "!<arch>\n";
+  expected += "/               0           0     0     644     12        `\n";
+  expected += std::string("\0\0\0\x01\0\0\0\x50" "foo\0", 12);
+  expected += "foo.o/          0           0     0     644     ";
+  EXPECT_EQ(expected, contents.substr(0, expected.size()));
+}
+
+TEST(ArchiveTest, bsdLayout) {
+  TmpDir tempDir(__func__);
+  auto a = writeFile(tempDir, "a.txt", "abc");
+  auto b = writeFile(tempDir, "a-long-member-name.txt", "hello");
+  auto archive = tempDir.str() + "/lib.a";
+
+  std::string error;
+  EXPECT_EQ(ArchiveWriteStatus::Written,
+            writeArchive(archive, {a, b}, ArchiveFormat::BSD, &error));
+  EXPECT_EQ("", error);
+
+  // Every name is stored inline after its header ("#1/<length>"), padded so
+  // the member contents are 8 byte aligned, and there is no symbol index.
+  std::string expected = "!<arch>\n";
+  expected += "#1/12           0           0     0     644     20        `\n";
+  expected += std::string("a.txt\0\0\0\0\0\0\0", 12);
+  expected += "abc\n\n\n\n\n";
+  expected += "#1/28           0           0     0     644     36        `\n";
+  expected += std::string("a-long-member-name.txt\0\0\0\0\0\0", 28);
+  expected += "hello\n\n\n";
+  EXPECT_EQ(expected, readFile(archive));
+
+  // Writing the same archive again leaves it untouched.
+  EXPECT_EQ(ArchiveWriteStatus::Unchanged,
+            writeArchive(archive, {a, b}, ArchiveFormat::BSD, &error));
+
+  // A member with the same size is updated.
+  writeFile(tempDir, "a-long-member-name.txt", "world");
+  EXPECT_EQ(ArchiveWriteStatus::Updated,
+            writeArchive(archive, {a, b}, ArchiveFormat::BSD, &error));
+  EXPECT_NE(std::string::npos, readFile(archive).find("world\n"));
+}
+
+TEST(ArchiveTest, bsdSymbolIndex) {
+  TmpDir tempDir(__func__);
+  auto object = writeFile(tempDir, "foo.o", makeMachOObject());
+  auto archive = tempDir.str() + "/lib.a";
+
+  std::string error;
+  EXPECT_EQ(ArchiveWriteStatus::Written,
+            writeArchive(archive, {object}, ArchiveFormat::BSD, &error));
+  EXPECT_EQ("", error);
+
+  // The index lists the one external symbol, pointing at the member header
+  // which follows the index itself, with its string table padded so the index
+  // ends 8 byte aligned.
+  std::string contents = readFile(archive);
+  std::string expected = "!<arch>\n";
+  expected += "#1/20           0           0     0     644     48        `\n";
+  expected += std::string("__.SYMDEF SORTED\0\0\0\0", 20);
+  expected += std::string("\x08\0\0\0" "\0\0\0\0" "\x74\0\0\0", 12);
+  expected += std::string("\x0c\0\0\0" "_foo\0\0\0\0\0\0\0\0", 16);
+  expected += "#1/8            0           0     0     644     ";
+  EXPECT_EQ(expected, contents.substr(0, expected.size()));
+
+  // The member name follows its header, and the object is 8 byte aligned.
+  EXPECT_EQ(std::string("foo.o\0\0\0", 8), contents.substr(176, 8));
+  EXPECT_EQ(makeMachOObject(), contents.substr(184, makeMachOObject().size()));
+}
+
+TEST(ArchiveTest, unsupportedMembers) {
+  TmpDir tempDir(__func__);
+  auto bitcode = writeFile(tempDir, "foo.bc", "BC\xC0\xDE");
+  auto elf = writeFile(tempDir, "foo.o", makeELFObject());
+  auto archive = tempDir.str() + "/lib.a";
+
+  std::string error;
+  EXPECT_EQ(ArchiveWriteStatus::Unsupported,
+            writeArchive(archive, {bitcode}, ArchiveFormat::GNU, &error));
+  EXPECT_EQ(ArchiveWriteStatus::Unsupported,
+            writeArchive(archive, {elf}, ArchiveFormat::BSD, &error));
+  EXPECT_EQ(ArchiveWriteStatus::Unsupported,
+            writeArchive(archive, {writeFile(tempDir, "foo.macho",
+                                             makeMachOObject())},
+                         ArchiveFormat::GNU, &error));
+  EXPECT_FALSE(llvm::sys::fs::exists(archive));
+}
+
+}
@@ -0,0 +1,93 @@
+//===- unittests/Basic/CompressionTest.cpp --------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Basic/Compression.h"
+
+#include "gtest/gtest.h"
+
+#include <random>
+
+using namespace llbuild;
+using namespace llbuild::basic;
+
+namespace {
+
+static std::string roundTrip(StringRef data) {
+  std::string decompressed;
+  EXPECT_TRUE(decompressData(compressData(data), &decompressed));
+  return decompressed;
+}
+
+TEST(CompressionTest, roundTrip) {
+  EXPECT_EQ(roundTrip(""), "");
+  EXPECT_EQ(roundTrip("a"), "a");
+  EXPECT_EQ(roundTrip("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"),
+            "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
+  EXPECT_EQ(roundTrip(std::string("a\0b\0a\0b\0a\0b\0a\0b", 16)),
+            std::string("a\0b\0a\0b\0a\0b\0a\0b", 16));
+
+  // Check repetitive diagnostics compress well.
+  std::string diagnostics;
+  for (int i = 0; i != 100; ++i) {
+    diagnostics += "/src/lib/module/file.c:" + std::to_string(i) +
+      ":5: warning: unused variable 'x' [-Wunused-variable]\n";
+  }
+  auto compressed = compressData(diagnostics);
+  EXPECT_LT(compressed.size(), diagnostics.size() / 4);
+  EXPECT_EQ(roundTrip(diagnostics), diagnostics);
+
+  // Check incompressible data is stored with a single byte of overhead.
+  std::mt19937 generator(42);
+  std::string noise;
+  for (int i = 0; i != 1000; ++i)
+    noise.push_back(char(generator()));
+  EXPECT_EQ(compressData(noise).size(), noise.size() + 1);
+  EXPECT_EQ(roundTrip(noise), noise);
+}
+
+TEST(CompressionTest, longRuns) {
+  // Check runs which compress far beyond any fixed ratio still round trip
+  // (e.g., the output of `yes warning`).
+  std::string run;
+  while (run.size() < 200 * 1024)
+    run += "warning\n";
+  auto compressed = compressData(run);
+  EXPECT_LT(compressed.size() * 1024, run.size());
+  EXPECT_EQ(roundTrip(run), run);
+
+  std::string bytes(1 << 20, 'x');
+  EXPECT_EQ(roundTrip(bytes), bytes);
+
+  // Check a corrupt size is still rejected, without matching its allocation.
+  std::string result;
+  EXPECT_FALSE(decompressData(StringRef("\x01\xff\xff\xff\xff\x0f\x01x", 8),
+                              &result));
+}
+
+TEST(CompressionTest, invalidData) {
+  std::string result;
+  EXPECT_FALSE(decompressData("", &result));
+  EXPECT_FALSE(decompressData("\x07", &result));
+
+  // Check truncated and extended blocks are rejected.
+  std::string diagnostics;
+  for (int i = 0; i != 10; ++i)
+    diagnostics += "warning: unused variable\n";
+  auto compressed = compressData(diagnostics);
+  EXPECT_FALSE(decompressData(StringRef(compressed).drop_back(), &result));
+  EXPECT_FALSE(decompressData(compressed + "x", &result));
+
+  // Check a match before the start of the output is rejected.
+  EXPECT_FALSE(decompressData(StringRef("\x01\x08\x00\x04\x01", 5), &result));
+}
+
+}
@@ -154,6 +154,51 @@ TEST(FileSystemTest, testRecursiveRemovalDoesNotFollowSymlinks) {
   EXPECT_EQ(0, sys::stat(otherFile.c_str(), &statbuf));
 }
 
+TEST(FileSystemTest, testCopyFile) {
+  TmpDir tempDir(__func__);
+
+  SmallString<256> source{ tempDir.str() };
+  llvm::sys::path::append(source, "source.txt");
+  {
+    std::error_code ec;
+    llvm::raw_fd_ostream os(source.str(), ec, llvm::sys::fs::F_Text);
+    EXPECT_FALSE(ec);
+    os << "Hello, world!";
+    os.close();
+  }
+  EXPECT_FALSE(llvm::sys::fs::setPermissions(
+      source.str(), llvm::sys::fs::perms(0750)));
+
+  SmallString<256> target{ tempDir.str() };
+  llvm::sys::path::append(target, "target.txt");
+  {
+    std::error_code ec;
+    llvm::raw_fd_ostream os(target.str(), ec, llvm::sys::fs::F_Text);
+    EXPECT_FALSE(ec);
+    os << "Stale contents";
+    os.close();
+  }
+
+  auto fs = createLocalFileSystem();
+  EXPECT_TRUE(fs->copyFile(source.str(), target.str()));
+  auto contents = fs->getFileContents(target.str());
+  ASSERT_NE(contents.get(), nullptr);
+  EXPECT_EQ(contents->getBuffer().str(), "Hello, world!");
+  EXPECT_EQ(fs->getFileInfo(source.str()).mode,
+            fs->getFileInfo(target.str()).mode);
+
+  // Copying a missing file fails, and leaves no temporary files behind.
+  SmallString<256> missing{ tempDir.str() };
+  llvm::sys::path::append(missing, "missing.txt");
+  EXPECT_FALSE(fs->copyFile(missing.str(), target.str()));
+  std::error_code ec;
+  unsigned numEntries = 0;
+  for (llvm::sys::fs::directory_iterator it(tempDir.str(), ec), end;
+       it != end && !ec; it.increment(ec))
+    ++numEntries;
+  EXPECT_EQ(2u, numEntries);
+}
+
 TEST(DeviceAgnosticFileSystemTest, basic) {
   // Check basic sanity of the local filesystem object.
   auto fs = DeviceAgnosticFileSystem::from(createLocalFileSystem());
@@ -47,10 +47,12 @@ namespace {
   };
 
   class DummyCommand : public JobDescriptor {
+    std::string name;
+
   public:
-    DummyCommand() {}
+    DummyCommand(StringRef name = "") : name(name) {}
 
-    virtual StringRef getOrdinalName() const { return StringRef(""); }
+    virtual StringRef getOrdinalName() const { return StringRef(name); }
     virtual void getShortDescription(SmallVectorImpl<char> &result) const {}
     virtual void getVerboseDescription(SmallVectorImpl<char> &result) const {}
   };
@@ -185,4 +187,43 @@ namespace {
     EXPECT_EQ(executions, 2);
   }
 
+  TEST(LaneBasedExecutionQueueTest, priorityOrdering) {
+    DummyDelegate delegate;
+    auto queue = std::unique_ptr<ExecutionQueue>(
+        createLaneBasedExecutionQueue(delegate, 1,
+                                      SchedulerAlgorithm::NamePriority,
+                                      /*environment=*/nullptr));
+
+    // Occupy the only lane until all of the other jobs are queued.
+    std::promise<void> queued;
+    auto queuedFuture = queued.get_future().share();
+    DummyCommand blocker("blocker");
+    queue->addJob(QueueJob(&blocker, [queuedFuture](QueueJobContext*) {
+          queuedFuture.wait();
+        }));
+
+    std::mutex orderMutex;
+    std::vector<std::string> order;
+    DummyCommand a("a"), b("b"), c("c"), z("z");
+    auto addJob = [&](DummyCommand& command, uint32_t priority) {
+      QueueJob job(&command, [&](QueueJobContext*) {
+          std::lock_guard<std::mutex> lock(orderMutex);
+          order.push_back(command.getOrdinalName());
+        });
+      job.setPriority(priority);
+      queue->addJob(job);
+    };
+    addJob(a, 0);
+    addJob(b, 5);
+    addJob(z, 1);
+    addJob(c, 5);
+    queued.set_value();
+
+    // Destroying the queue waits for the jobs to complete.
+    queue.reset();
+
+    // Higher priorities run first, ties are ordered by name.
+    EXPECT_EQ(std::vector<std::string>({ "c", "b", "z", "a" }), order);
+  }
+
 }
@@ -0,0 +1,67 @@
+//===- unittests/Basic/PlatformUtilityTest.cpp ----------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2020 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Basic/PlatformUtility.h"
+
+#include "gtest/gtest.h"
+
+using namespace llbuild;
+using namespace llbuild::basic;
+
+namespace {
+
+TEST(PlatformUtilityTest, parseCPUList) {
+  std::vector<unsigned> cpus;
+  EXPECT_TRUE(sys::parseCPUList("0-3,8,10-11\n", cpus));
+  EXPECT_EQ(std::vector<unsigned>({0, 1, 2, 3, 8, 10, 11}), cpus);
+
+  EXPECT_TRUE(sys::parseCPUList("5", cpus));
+  EXPECT_EQ(std::vector<unsigned>({5}), cpus);
+
+  // An empty list is valid, e.g. for a memory-only node.
+  EXPECT_TRUE(sys::parseCPUList("\n", cpus));
+  EXPECT_TRUE(cpus.empty());
+
+  EXPECT_FALSE(sys::parseCPUList("3-1", cpus));
+  EXPECT_FALSE(sys::parseCPUList("a-b", cpus));
+  EXPECT_FALSE(sys::parseCPUList("1-", cpus));
+}
+
+TEST(PlatformUtilityTest, currentThreadAffinity) {
+  std::vector<unsigned> cpus;
+  if (!sys::getCurrentThreadAffinity(cpus))
+    return;
+  ASSERT_FALSE(cpus.empty());
+
+  // Restricting the thread to the CPUs it already has is always valid.
+  EXPECT_TRUE(sys::setCurrentThreadAffinity(cpus));
+  std::vector<unsigned> current;
+  EXPECT_TRUE(sys::getCurrentThreadAffinity(current));
+  EXPECT_EQ(cpus, current);
+}
+
+TEST(PlatformUtilityTest, numaNodeCPUsWithinAffinity) {
+  std::vector<unsigned> allowed;
+  if (!sys::getCurrentThreadAffinity(allowed) || allowed.empty())
+    return;
+
+  // Run on a single CPU, nodes should only report CPUs we may use.
+  ASSERT_TRUE(sys::setCurrentThreadAffinity(allowed.front()));
+  auto nodes = sys::getNUMANodeCPUs();
+  EXPECT_TRUE(sys::setCurrentThreadAffinity(allowed));
+
+  EXPECT_LE(nodes.size(), 1u);
+  for (const auto& node: nodes)
+    EXPECT_EQ(std::vector<unsigned>({allowed.front()}), node);
+}
+
+}
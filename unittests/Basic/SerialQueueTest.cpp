@@ -14,6 +14,10 @@
 
 #include "gtest/gtest.h"
 
+#include <memory>
+#include <thread>
+#include <vector>
+
 using namespace llbuild;
 using namespace llbuild::basic;
 
@@ -45,4 +49,47 @@ TEST(SerialQueueTest, basic) {
   EXPECT_EQ(c, 1);
 }
 
+TEST(SerialQueueTest, moveOnlyOperations) {
+  int value = 0;
+  {
+    SerialQueue q;
+    auto ptr = std::unique_ptr<int>(new int(42));
+    q.async([&value, ptr=std::move(ptr)]() {
+        value = *ptr;
+      });
+  }
+  EXPECT_EQ(value, 42);
+}
+
+TEST(SerialQueueTest, orderingWithConcurrentProducers) {
+  // Check that operations are executed one at a time, and in the order each
+  // producer added them.
+  const int numProducers = 4;
+  const int numOperations = 10000;
+  std::vector<int> lastSeen(numProducers, -1);
+  bool isOrdered = true;
+  int numExecuted = 0;
+  {
+    SerialQueue q;
+    std::vector<std::thread> producers;
+    for (int p = 0; p != numProducers; ++p) {
+      producers.emplace_back([&, p]() {
+          for (int i = 0; i != numOperations; ++i) {
+            q.async([&, p, i]() {
+                isOrdered = isOrdered && lastSeen[p] == i - 1;
+                lastSeen[p] = i;
+                ++numExecuted;
+              });
+          }
+          q.sync([]() {});
+        });
+    }
+    for (auto& producer: producers) {
+      producer.join();
+    }
+  }
+  EXPECT_TRUE(isOrdered);
+  EXPECT_EQ(numExecuted, numProducers * numOperations);
+}
+
 }
@@ -81,4 +81,25 @@ TEST(UtilityTest, basic) {
 #endif
 }
 
+TEST(UtilityTest, replacePathInCommandLine) {
+  std::string result;
+  EXPECT_TRUE(replacePathInCommandLine("cc -MF out.d -c a.c", "out.d",
+                                       "/dev/fd/3", result));
+  EXPECT_EQ(result, "cc -MF /dev/fd/3 -c a.c");
+
+  // Occurrences bounded by quotes, '=' or the ends of the string are replaced.
+  EXPECT_TRUE(replacePathInCommandLine("out.d --deps=out.d 'out.d' out.d",
+                                       "out.d", "X", result));
+  EXPECT_EQ(result, "X --deps=X 'X' X");
+
+  // Occurrences within a longer word are not.
+  EXPECT_FALSE(replacePathInCommandLine("cc -MF dir/out.d -o out.d.o",
+                                        "out.d", "X", result));
+  EXPECT_EQ(result, "cc -MF dir/out.d -o out.d.o");
+  EXPECT_TRUE(replacePathInCommandLine("cat aout.d out.d", "out.d", "X",
+                                       result));
+  EXPECT_EQ(result, "cat aout.d X");
+  EXPECT_FALSE(replacePathInCommandLine("cc", "", "X", result));
+}
+
 }
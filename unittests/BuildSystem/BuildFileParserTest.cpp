@@ -0,0 +1,179 @@
+//===- BuildFileParserTest.cpp --------------------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/BuildSystem/BuildFileParser.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "gtest/gtest.h"
+
+using namespace llvm;
+using namespace llbuild;
+using namespace llbuild::buildsystem;
+
+namespace {
+
+/// Describe the nodes of a document, with their ranges as buffer offsets.
+void describe(StringRef buffer, const buildfile::Node* node,
+              raw_ostream& os) {
+  auto range = node->getSourceRange();
+  os << "[" << (range.Start.getPointer() - buffer.begin()) << ","
+     << (range.End.getPointer() - buffer.begin()) << ")";
+  switch (node->getType()) {
+  case buildfile::Node::NK_Scalar: {
+    SmallString<32> storage;
+    os << "'" << node->getValue(storage) << "'";
+    break;
+  }
+  case buildfile::Node::NK_KeyValue:
+    describe(buffer, node->getKey(), os);
+    os << ": ";
+    describe(buffer, node->getValue(), os);
+    break;
+  case buildfile::Node::NK_Mapping:
+  case buildfile::Node::NK_Sequence:
+    os << (node->getType() == buildfile::Node::NK_Mapping ? "{" : "[");
+    for (auto& child: *node) {
+      describe(buffer, &child, os);
+      os << ", ";
+    }
+    os << (node->getType() == buildfile::Node::NK_Mapping ? "}" : "]");
+    break;
+  default:
+    os << "kind " << unsigned(node->getType());
+    break;
+  }
+}
+
+/// Parse \p input with both parsers, and check the documents are identical.
+void checkParsersAgree(StringRef input) {
+  auto buffer = MemoryBuffer::getMemBuffer(input, "<input>");
+
+  buildfile::Document document;
+  ASSERT_TRUE(document.parse(buffer->getBuffer())) << input.str();
+
+  buildfile::Document yamlDocument;
+  SourceMgr sourceMgr;
+  yamlDocument.parseYAML(buffer->getMemBufferRef(), sourceMgr);
+  ASSERT_NE(yamlDocument.getRoot(), nullptr);
+
+  std::string description, yamlDescription;
+  raw_string_ostream os(description), yamlOS(yamlDescription);
+  describe(buffer->getBuffer(), document.getRoot(), os);
+  describe(buffer->getBuffer(), yamlDocument.getRoot(), yamlOS);
+  EXPECT_EQ(os.str(), yamlOS.str()) << input.str();
+  EXPECT_EQ(document.size(), yamlDocument.size());
+}
+
+TEST(BuildFileParserTest, matchesYAMLParser) {
+  checkParsersAgree(R"(client:
+  name: basic
+  version: 0
+
+# A comment.
+tools:
+  shell: {}
+
+targets:
+  "": ["<all>"]
+  all: [ "a" ,  'b''s',c d , [], [[x]] ]
+
+commands:
+  C1:
+    tool: shell   # trailing comment
+    inputs: ["a\tb\x41\u00e9\\", "\"quoted\""]
+    outputs: ["<all>"]
+    description: a:b#c [d] {e}, f
+    args: echo "wonky %INPUT1%\"&echo next"
+    env:
+      A: 1
+      "B C": 'two words'
+    empty:
+  ["seq", "key"]: value
+  C2:
+        tool: shell
+)");
+
+  // Flow sequences continued onto following lines.
+  checkParsersAgree("a: [\"b\",  # comment\n\n\"c\", 'd'\n    ]\ne: f\n");
+
+  // Nodes at the end of the input.
+  checkParsersAgree("a:\n  b: c  ");
+  checkParsersAgree("a: b\nc:\n");
+  checkParsersAgree("  indented: root\n  other: key\n");
+}
+
+TEST(BuildFileParserTest, fallsBackOutsideSubset) {
+  const char* inputs[] = {
+    // Block sequences, block scalars, anchors, tags, explicit keys and flow
+    // mappings.
+    "a:\n  - b\n",
+    "a: |\n  b\n",
+    "a: &anchor b\n",
+    "a: !tag b\n",
+    "a: ?b\n",
+    "a: {b: c}\n",
+    // Multiple documents.
+    "a: b\n---\nc: d\n",
+    // Multi-line scalars and flows.
+    "a: b\n  c\n",
+    "a: b\n    # comment\n",
+    "a: \"b\n  c\"\n",
+    "a: [b\n  , c]\n",
+    "[a,\n  b]: c\n",
+    // Tabs, and line endings the subset does not use.
+    "a:\tb\n",
+    "a: b\r\n",
+    // Malformed documents, which the YAML parser diagnoses.
+    "a: b: c\n",
+    "a: \"b\\q\"\n",
+    "a: [b\n",
+    "a: b\nc:",
+    "a:\n    b: c\n  d: e\n",
+    "",
+  };
+  for (auto input: inputs) {
+    buildfile::Document document;
+    EXPECT_FALSE(document.parse(input)) << input;
+    EXPECT_EQ(document.getRoot(), nullptr);
+  }
+}
+
+TEST(BuildFileParserTest, valuesAreUnescapedOnDemand) {
+  StringRef input = "plain: a b  \nquoted: \"a b\"\nescaped: \"a\\nb\"\n";
+  buildfile::Document document;
+  ASSERT_TRUE(document.parse(input));
+
+  std::vector<const buildfile::Node*> values;
+  for (auto& entry: *document.getRoot())
+    values.push_back(entry.getValue());
+  ASSERT_EQ(values.size(), 3U);
+
+  // Values which need no unescaping refer directly into the input.
+  SmallString<32> storage;
+  auto plain = values[0]->getValue(storage);
+  EXPECT_EQ(plain, "a b");
+  EXPECT_EQ(plain.begin(), input.begin() + 7);
+  auto quoted = values[1]->getValue(storage);
+  EXPECT_EQ(quoted, "a b");
+  EXPECT_EQ(quoted.begin(), input.begin() + 22);
+  EXPECT_TRUE(storage.empty());
+
+  auto escaped = values[2]->getValue(storage);
+  EXPECT_EQ(escaped, "a\nb");
+  EXPECT_EQ(escaped.begin(), storage.begin());
+}
+
+}
@@ -0,0 +1,276 @@
+//===- BuildFileTest.cpp --------------------------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "TempDir.h"
+
+#include "llbuild/Basic/FileSystem.h"
+#include "llbuild/Basic/LLVM.h"
+#include "llbuild/BuildSystem/BuildDescription.h"
+#include "llbuild/BuildSystem/BuildFile.h"
+#include "llbuild/BuildSystem/BuildNode.h"
+#include "llbuild/BuildSystem/ShellCommand.h"
+#include "llbuild/BuildSystem/Tool.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "gtest/gtest.h"
+
+using namespace llvm;
+using namespace llbuild;
+using namespace llbuild::basic;
+using namespace llbuild::buildsystem;
+
+namespace {
+
+class TestShellTool : public Tool {
+public:
+  using Tool::Tool;
+
+  virtual bool configureAttribute(const ConfigureContext&, StringRef name,
+                                  StringRef value) override {
+    return false;
+  }
+  virtual bool configureAttribute(const ConfigureContext&, StringRef name,
+                                  ArrayRef<StringRef> values) override {
+    return false;
+  }
+  virtual bool configureAttribute(
+      const ConfigureContext&, StringRef name,
+      ArrayRef<std::pair<StringRef, StringRef>> values) override {
+    return false;
+  }
+
+  virtual std::unique_ptr<Command> createCommand(StringRef name) override {
+    return llvm::make_unique<ShellCommand>(name, /*controlEnabled=*/false);
+  }
+};
+
+/// A delegate which records the errors and loaded commands, in order.
+class TestBuildFileDelegate : public BuildFileDelegate {
+  std::unique_ptr<FileSystem> fileSystem = createLocalFileSystem();
+  llvm::StringMap<bool> internedStrings;
+
+public:
+  std::vector<std::string> messages;
+
+  virtual StringRef getInternedString(StringRef value) override {
+    auto entry = internedStrings.insert(std::make_pair(value, true));
+    return entry.first->getKey();
+  }
+
+  virtual FileSystem& getFileSystem() override { return *fileSystem; }
+
+  virtual void setFileContentsBeingParsed(StringRef buffer) override {}
+
+  virtual void error(StringRef filename, const BuildFileToken& at,
+                     const Twine& message) override {
+    messages.push_back("error: " + message.str());
+  }
+
+  virtual bool configureClient(const ConfigureContext&, StringRef name,
+                               uint32_t version,
+                               const property_list_type& properties) override {
+    return true;
+  }
+
+  virtual std::unique_ptr<Tool> lookupTool(StringRef name) override {
+    if (name == "shell")
+      return llvm::make_unique<TestShellTool>(name);
+    return nullptr;
+  }
+
+  virtual void loadedTarget(StringRef name, const Target& target) override {}
+
+  virtual void loadedDefaultTarget(StringRef target) override {}
+
+  virtual void loadedCommand(StringRef name, const Command& command) override {
+    messages.push_back("loaded: " + name.str());
+  }
+
+  virtual std::unique_ptr<Node> lookupNode(StringRef name,
+                                           bool isImplicit) override {
+    return BuildNode::makePlain(name);
+  }
+};
+
+/// Summarize a loaded description, in the order of its maps.
+std::vector<std::string> describe(const BuildDescription& description) {
+  std::vector<std::string> result;
+  for (const auto& entry: description.getNodes()) {
+    std::string line = "node " + entry.getKey().str() + ":";
+    for (auto* producer: entry.getValue()->getProducers())
+      line += " " + producer->getName().str();
+    result.push_back(line);
+  }
+  for (const auto& entry: description.getCommands()) {
+    SmallString<256> verbose;
+    entry.getValue()->getVerboseDescription(verbose);
+    result.push_back("command " + entry.getKey().str() + ": " +
+                     verbose.str().str());
+  }
+  return result;
+}
+
+/// Check that errors in command attributes are reported in the order of the
+/// file, interleaved with the commands which loaded.
+TEST(BuildFileTest, commandDiagnosticsOrder) {
+  TmpDir tempDir(__func__);
+  SmallString<256> manifest{ tempDir.str() };
+  sys::path::append(manifest, "build.llbuild");
+
+  auto writeManifest = [&](bool withFatalError) {
+    std::error_code ec;
+    llvm::raw_fd_ostream os(manifest, ec, llvm::sys::fs::F_Text);
+    ASSERT_FALSE(ec);
+    os << "client:\n  name: test\n\ncommands:\n";
+    for (unsigned i = 0; i != 3; ++i) {
+      os << "  C" << i << ":\n"
+         << "    tool: shell\n"
+         << "    inputs: [\"N" << i << "\"]\n"
+         << "    outputs: [\"N" << (i + 1) << "\"]\n"
+         << "    args: [\"echo\", \"" << i << "\"]\n";
+      if (i == 0) {
+        os << "  C" << i << ":\n"
+           << "    tool: shell\n";
+        os << "  D" << i << ":\n"
+           << "    tool: shell\n"
+           << "    outputs: [[\"nested\"]]\n"
+           << "    args: \"true\"\n";
+      }
+      if (withFatalError && i == 1) {
+        os << "  F" << i << ":\n"
+           << "    tool: shell\n"
+           << "    outputs: [\"N" << i << "\"]\n"
+           << "    bogus-attribute: \"value\"\n";
+      }
+    }
+  };
+
+  writeManifest(/*withFatalError=*/false);
+  TestBuildFileDelegate delegate;
+  auto description = BuildFile(manifest, delegate).load();
+  ASSERT_NE(description, nullptr);
+  EXPECT_EQ(delegate.messages, (std::vector<std::string>{
+        "loaded: C0",
+        "error: duplicate command in 'commands' map",
+        "error: invalid node type in 'outputs' command key",
+        "loaded: D0",
+        "loaded: C1",
+        "loaded: C2" }));
+  EXPECT_EQ(description->getCommands().size(), 4U);
+  auto& producers = description->getNodes()["N1"]->getProducers();
+  ASSERT_EQ(producers.size(), 1U);
+  EXPECT_EQ(producers[0]->getName(), "C0");
+
+  // Loading stops at the first command which fails to configure.
+  writeManifest(/*withFatalError=*/true);
+  TestBuildFileDelegate fatalDelegate;
+  EXPECT_EQ(BuildFile(manifest, fatalDelegate).load(), nullptr);
+  EXPECT_EQ(fatalDelegate.messages.back(),
+            "error: unexpected attribute: 'bogus-attribute'");
+  EXPECT_EQ(std::count(fatalDelegate.messages.begin(),
+                       fatalDelegate.messages.end(), "loaded: C2"), 0);
+}
+
+/// Check that reloading a description reuses the commands and nodes whose
+/// definitions are unchanged, and reports what changed.
+TEST(BuildFileTest, reloadReusesUnchangedDefinitions) {
+  TmpDir tempDir(__func__);
+  SmallString<256> manifest{ tempDir.str() };
+  sys::path::append(manifest, "build.llbuild");
+
+  auto writeManifest = [&](StringRef commands) {
+    std::error_code ec;
+    llvm::raw_fd_ostream os(manifest, ec, llvm::sys::fs::F_Text);
+    ASSERT_FALSE(ec);
+    os << "client:\n  name: test\n\ntargets:\n  all: [\"N2\"]\n\n"
+       << "commands:\n" << commands;
+  };
+
+  writeManifest(R"END(  A:
+    tool: shell
+    inputs: ["N0"]
+    outputs: ["N1"]
+    args: "echo A"
+  B:
+    tool: shell
+    inputs: ["N1"]
+    outputs: ["N2"]
+    args: "echo B"
+  C:
+    tool: shell
+    outputs: ["N3"]
+    args: "echo C"
+)END");
+  TestBuildFileDelegate delegate;
+  auto previous = BuildFile(manifest, delegate).load();
+  ASSERT_NE(previous, nullptr);
+  Command* previousA = previous->getCommands()["A"].get();
+  Node* previousN1 = previous->getNodes()["N1"].get();
+
+  writeManifest(R"END(  A:
+    tool: shell
+    inputs: ["N0"]
+    outputs: ["N1"]
+    args: "echo A"
+  B:
+    tool: shell
+    inputs: ["N1"]
+    outputs: ["N2"]
+    args: "echo B again"
+  D:
+    tool: shell
+    inputs: ["N2"]
+    outputs: ["N4"]
+    args: "echo D"
+)END");
+  BuildDescriptionDiff diff;
+  auto reloaded = BuildFile(manifest, delegate).reload(*previous, &diff);
+  ASSERT_NE(reloaded, nullptr);
+
+  EXPECT_EQ(reloaded->getCommands()["A"].get(), previousA);
+  EXPECT_EQ(reloaded->getNodes()["N1"].get(), previousN1);
+  EXPECT_FALSE(diff.toolsChanged);
+  EXPECT_EQ(diff.addedCommands, std::vector<std::string>{ "D" });
+  EXPECT_EQ(diff.removedCommands, std::vector<std::string>{ "C" });
+  EXPECT_EQ(diff.changedCommands, std::vector<std::string>{ "B" });
+  std::sort(diff.changedNodes.begin(), diff.changedNodes.end());
+  EXPECT_EQ(diff.changedNodes, (std::vector<std::string>{ "N3", "N4" }));
+
+  // The reloaded description must match one loaded from scratch.
+  TestBuildFileDelegate freshDelegate;
+  auto fresh = BuildFile(manifest, freshDelegate).load();
+  ASSERT_NE(fresh, nullptr);
+  EXPECT_EQ(describe(*reloaded), describe(*fresh));
+
+  // A change to the client reconstructs everything.
+  {
+    std::error_code ec;
+    llvm::raw_fd_ostream os(manifest, ec, llvm::sys::fs::F_Text);
+    ASSERT_FALSE(ec);
+    os << "client:\n  name: test\n  version: 1\n\ncommands:\n"
+       << "  A:\n    tool: shell\n    inputs: [\"N0\"]\n"
+       << "    outputs: [\"N1\"]\n    args: \"echo A\"\n";
+  }
+  BuildDescriptionDiff clientDiff;
+  auto reconfigured = BuildFile(manifest, delegate).reload(*reloaded,
+                                                           &clientDiff);
+  ASSERT_NE(reconfigured, nullptr);
+  EXPECT_TRUE(clientDiff.toolsChanged);
+  EXPECT_EQ(clientDiff.changedCommands, std::vector<std::string>{ "A" });
+  EXPECT_NE(reconfigured->getCommands()["A"].get(), previousA);
+}
+
+}
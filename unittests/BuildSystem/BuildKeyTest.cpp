@@ -0,0 +1,45 @@
+//===- unittests/BuildSystem/BuildKeyTest.cpp -----------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2020 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/BuildSystem/BuildKey.h"
+
+#include "gtest/gtest.h"
+
+#include <string>
+
+using namespace llbuild;
+using namespace llbuild::buildsystem;
+using namespace llvm;
+
+namespace {
+
+/// Check that inline keys are encoded identically to the equivalent keys.
+TEST(BuildKeyTest, inlineKeyEncoding) {
+  auto check = [](const BuildKey& key, const InlineBuildKey& inlineKey) {
+    EXPECT_EQ(key.toKeyRef().str(), inlineKey.toKeyRef().str());
+    EXPECT_EQ(key.toKeyRef().getHash(), inlineKey.toKeyRef().getHash());
+  };
+  check(BuildKey::makeCommand("cmd"), InlineBuildKey::makeCommand("cmd"));
+  check(BuildKey::makeDirectoryContents("/a"),
+        InlineBuildKey::makeDirectoryContents("/a"));
+  check(BuildKey::makeDirectoryTreeStructureSignature("/a"),
+        InlineBuildKey::makeDirectoryTreeStructureSignature("/a"));
+  check(BuildKey::makeNode("/a/b"), InlineBuildKey::makeNode("/a/b"));
+  check(BuildKey::makeStat("/a/b"), InlineBuildKey::makeStat("/a/b"));
+  check(BuildKey::makeTarget("all"), InlineBuildKey::makeTarget("all"));
+
+  // Names which don't fit the inline storage are still encoded correctly.
+  std::string longPath(1024, 'x');
+  check(BuildKey::makeNode(longPath), InlineBuildKey::makeNode(longPath));
+}
+
+}
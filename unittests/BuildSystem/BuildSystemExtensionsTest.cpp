@@ -0,0 +1,145 @@
+//===- unittests/BuildSystem/BuildSystemExtensionsTest.cpp ----------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2020 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "TempDir.h"
+
+#include "llbuild/Basic/LLVM.h"
+#include "llbuild/BuildSystem/BuildSystemExtensions.h"
+#include "llbuild/Core/BuildDB.h"
+
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "gtest/gtest.h"
+
+#include <thread>
+#include <vector>
+
+using namespace llvm;
+using namespace llbuild;
+using namespace llbuild::buildsystem;
+
+namespace {
+
+/// Write an executable "-for-llbuild" tool next to \p commandPath which
+/// appends a line to \p markerPath each time it is run, and then fails.
+static void writeCountingInfoTool(StringRef commandPath, StringRef markerPath) {
+  std::string infoPath = (commandPath + "-for-llbuild").str();
+  {
+    std::error_code ec;
+    raw_fd_ostream os(infoPath, ec, sys::fs::F_Text);
+    ASSERT_FALSE(ec);
+    os << "#!/bin/sh\necho run >> '" << markerPath << "'\nexit 1\n";
+  }
+  ASSERT_FALSE(sys::fs::setPermissions(infoPath, sys::fs::all_exe |
+                                       sys::fs::owner_read |
+                                       sys::fs::owner_write));
+}
+
+/// Count the number of times the counting info tool has run.
+static unsigned countToolRuns(StringRef markerPath) {
+  auto buffer = MemoryBuffer::getFile(markerPath);
+  if (!buffer)
+    return 0;
+  return (*buffer)->getBuffer().count('\n');
+}
+
+TEST(BuildSystemExtensionsTest, ignoresUndecodableCachedInfo) {
+  TmpDir tempDir(__func__);
+  std::string commandPath = tempDir.str() + "/tool";
+  std::string infoPath = commandPath + "-for-llbuild";
+  {
+    std::error_code ec;
+    raw_fd_ostream os(infoPath, ec, sys::fs::F_Text);
+    ASSERT_FALSE(ec);
+    os << "#!/bin/sh\nexit 1\n";
+  }
+  ASSERT_FALSE(sys::fs::setPermissions(infoPath, sys::fs::all_exe |
+                                       sys::fs::owner_read |
+                                       sys::fs::owner_write));
+
+  std::string error;
+  auto db = core::createSQLiteBuildDB(tempDir.str() + "/build.db", 1,
+                                      /*recreateUnmatchedVersion=*/true,
+                                      &error);
+  ASSERT_TRUE(db != nullptr);
+  std::string cacheKey = "extension-info:" + infoPath;
+
+  // Check truncated values, and values from an older encoding, are treated as
+  // a miss and replaced by the result of querying the tool.
+  std::vector<std::string> values = {
+    std::string("\x01", 1), std::string("\0\0\0\0", 4),
+    std::string(64, '\xff') };
+  for (const auto& value: values) {
+    ASSERT_TRUE(db->buildStarted(&error));
+    ASSERT_TRUE(db->setAuxiliaryValue(cacheKey, value, &error));
+    BuildSystemExtensionManager manager;
+    EXPECT_EQ(nullptr, manager.lookupByCommandPath(commandPath, db.get()));
+    std::string persisted;
+    EXPECT_TRUE(db->lookupAuxiliaryValue(cacheKey, &persisted, &error));
+    EXPECT_NE(value, persisted);
+    db->buildComplete();
+  }
+}
+
+TEST(BuildSystemExtensionsTest, reusesCachedInfo) {
+  TmpDir tempDir(__func__);
+  std::string commandPath = tempDir.str() + "/tool";
+  std::string markerPath = tempDir.str() + "/runs";
+  writeCountingInfoTool(commandPath, markerPath);
+
+  std::string error;
+  auto db = core::createSQLiteBuildDB(tempDir.str() + "/build.db", 1,
+                                      /*recreateUnmatchedVersion=*/true,
+                                      &error);
+  ASSERT_TRUE(db != nullptr);
+
+  // The first lookup queries the tool and persists the result.
+  {
+    ASSERT_TRUE(db->buildStarted(&error));
+    BuildSystemExtensionManager manager;
+    EXPECT_EQ(nullptr, manager.lookupByCommandPath(commandPath, db.get()));
+    db->buildComplete();
+  }
+  EXPECT_EQ(1U, countToolRuns(markerPath));
+
+  // A later lookup, from a fresh manager, uses the persisted result.
+  {
+    ASSERT_TRUE(db->buildStarted(&error));
+    BuildSystemExtensionManager manager;
+    EXPECT_EQ(nullptr, manager.lookupByCommandPath(commandPath, db.get()));
+    db->buildComplete();
+  }
+  EXPECT_EQ(1U, countToolRuns(markerPath));
+}
+
+TEST(BuildSystemExtensionsTest, coalescesConcurrentLookups) {
+  TmpDir tempDir(__func__);
+  std::string commandPath = tempDir.str() + "/tool";
+  std::string markerPath = tempDir.str() + "/runs";
+  writeCountingInfoTool(commandPath, markerPath);
+
+  BuildSystemExtensionManager manager;
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i != 8; ++i) {
+    threads.emplace_back([&]() {
+        EXPECT_EQ(nullptr, manager.lookupByCommandPath(commandPath, nullptr));
+      });
+  }
+  for (auto& thread: threads)
+    thread.join();
+  EXPECT_EQ(1U, countToolRuns(markerPath));
+}
+
+}
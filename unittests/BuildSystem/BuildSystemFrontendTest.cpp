@@ -318,6 +318,65 @@ commandFinished: 3: 0
 }
 
 
+// A frontend reused across builds picks up changes to the build file, and
+// only runs the commands which changed.
+TEST_F(BuildSystemFrontendTest, reloadChangedBuildFile) {
+  writeBuildFile(R"END(
+client:
+    name: client
+
+targets:
+    "": ["2"]
+
+commands:
+    1:
+        tool: shell
+        outputs: ["1"]
+        args: touch 1
+
+    2:
+        tool: shell
+        inputs: ["1"]
+        outputs: ["2"]
+        args: touch 2
+)END");
+
+  TestBuildSystemFrontendDelegate delegate(sourceMgr);
+  BuildSystemFrontend frontend(delegate, invocation, createLocalFileSystem());
+  ASSERT_TRUE(frontend.build(""));
+
+  writeBuildFile(R"END(
+client:
+    name: client
+
+targets:
+    "": ["2"]
+
+commands:
+    1:
+        tool: shell
+        outputs: ["1"]
+        args: touch 1
+
+    2:
+        tool: shell
+        inputs: ["1"]
+        outputs: ["2"]
+        args: touch 2 && true
+)END");
+
+  delegate.clearTrace();
+  ASSERT_TRUE(frontend.build(""));
+  ASSERT_TRUE(delegate.checkTrace(R"END(
+commandPreparing: 2
+shouldCommandStart: 2
+commandStarted: 2
+commandProcessStarted: 2
+commandProcessFinished: 2: 0
+commandFinished: 2: 0
+)END"));
+}
+
 TEST_F(BuildSystemFrontendTest, missingShellArguments) {
   writeBuildFile(R"END(
 client:
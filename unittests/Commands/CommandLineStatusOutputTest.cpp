@@ -0,0 +1,145 @@
+//===- unittests/Commands/CommandLineStatusOutputTest.cpp -----------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "../../lib/Commands/CommandLineStatusOutput.h"
+
+#include "gtest/gtest.h"
+
+#include <cassert>
+#include <cstdio>
+
+using namespace llbuild;
+using namespace llbuild::commands;
+
+namespace {
+
+/// A temporary stream, whose contents can be read back.
+class TempStream {
+  FILE* fp;
+  long offset = 0;
+
+public:
+  TempStream() : fp(tmpfile()) { assert(fp); }
+  ~TempStream() { fclose(fp); }
+
+  FILE* get() { return fp; }
+
+  /// Get the contents written since the last call.
+  std::string take() {
+    fflush(fp);
+    long end = ftell(fp);
+    std::string result(end - offset, '\0');
+    fseek(fp, offset, SEEK_SET);
+    if (!result.empty())
+      EXPECT_EQ(fread(&result[0], 1, result.size(), fp), result.size());
+    fseek(fp, end, SEEK_SET);
+    offset = end;
+    return result;
+  }
+};
+
+TEST(CommandLineStatusOutputTest, writesLinesWithoutLineUpdates) {
+  TempStream stream;
+  CommandLineStatusOutput output;
+  std::string error;
+  ASSERT_TRUE(output.open(stream.get(), /*canUpdateCurrentLine=*/false,
+                          &error));
+  EXPECT_FALSE(output.canUpdateCurrentLine());
+
+  // Every line is written, even when they are coalesced.
+  output.setOrWriteLine("[1/3] one");
+  output.setOrWriteLineCoalesced("[2/3] two");
+  output.setOrWriteLineCoalesced("[3/3] three");
+  EXPECT_FALSE(output.hasPendingLine());
+  EXPECT_EQ(stream.take(), "[1/3] one\n[2/3] two\n[3/3] three\n");
+
+  // Colors are stripped, and finishing a line writes nothing.
+  output.writeText("\033[1mbold\033[0m\n");
+  output.finishLine();
+  ASSERT_TRUE(output.close(&error));
+  EXPECT_EQ(stream.take(), "bold\n");
+}
+
+TEST(CommandLineStatusOutputTest, updatesAndClearsCurrentLine) {
+  TempStream stream;
+  CommandLineStatusOutput output;
+  std::string error;
+  ASSERT_TRUE(output.open(stream.get(), /*canUpdateCurrentLine=*/true,
+                          &error));
+
+  // The previous line is cleared before each update.
+  output.setCurrentLine("first");
+  EXPECT_EQ(stream.take(), "first");
+  output.setCurrentLine("2nd");
+  EXPECT_EQ(stream.take(), "\r     \r2nd");
+  output.clearOutput();
+  EXPECT_EQ(stream.take(), "\r   \r");
+
+  // Clearing or finishing an empty line writes nothing.
+  output.clearOutput();
+  output.finishLine();
+  EXPECT_EQ(stream.take(), "");
+
+  // Text written over the current line clears it, and is left in place.
+  output.setCurrentLine("status");
+  output.writeText("text\n");
+  output.setCurrentLine("next");
+  output.finishLine();
+  EXPECT_EQ(stream.take(), "status\r      \rtext\nnext\n");
+  ASSERT_TRUE(output.close(&error));
+  EXPECT_EQ(stream.take(), "");
+}
+
+TEST(CommandLineStatusOutputTest, coalescesLineUpdates) {
+  TempStream stream;
+  CommandLineStatusOutput output;
+  std::string error;
+  ASSERT_TRUE(output.open(stream.get(), /*canUpdateCurrentLine=*/true,
+                          &error));
+  auto now = std::chrono::steady_clock::time_point() + std::chrono::hours(1);
+  output.setClock([&]() { return now; });
+
+  // The first update is written, the later ones within the redraw interval
+  // only replace the pending text.
+  output.setOrWriteLineCoalesced("[1/4] a");
+  output.setOrWriteLineCoalesced("[2/4] b");
+  output.setOrWriteLineCoalesced("[3/4] c");
+  EXPECT_TRUE(output.hasPendingLine());
+  EXPECT_EQ(stream.take(), "[1/4] a");
+  output.flushPendingLine();
+  EXPECT_FALSE(output.hasPendingLine());
+  EXPECT_EQ(stream.take(), "\r       \r[3/4] c");
+  output.flushPendingLine();
+  EXPECT_EQ(stream.take(), "");
+
+  // Finishing the line writes the pending text first.
+  output.setOrWriteLineCoalesced("[4/4] d");
+  EXPECT_TRUE(output.hasPendingLine());
+  output.finishLine();
+  EXPECT_EQ(stream.take(), "\r       \r[4/4] d\n");
+
+  // An update after the redraw interval is written immediately.
+  now += output.getRedrawInterval() - std::chrono::milliseconds(1);
+  output.setOrWriteLineCoalesced("early");
+  EXPECT_TRUE(output.hasPendingLine());
+  now += std::chrono::milliseconds(1);
+  output.setOrWriteLineCoalesced("done");
+  EXPECT_FALSE(output.hasPendingLine());
+  EXPECT_EQ(stream.take(), "done");
+
+  // Closing writes any pending text.
+  output.setOrWriteLineCoalesced("closing");
+  ASSERT_TRUE(output.close(&error));
+  EXPECT_EQ(stream.take(), "\r    \rclosing\n");
+}
+
+}
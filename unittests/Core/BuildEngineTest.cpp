@@ -23,6 +23,7 @@
 
 #include <future>
 #include <condition_variable>
+#include <map>
 #include <unordered_map>
 #include <vector>
 
@@ -213,6 +214,54 @@ TEST(BuildEngineTest, basic) {
 }
 
 
+TEST(BuildEngineTest, keyRefRequests) {
+  // Check that requests made through a key view resolve to the same rules as
+  // owned keys, even when the view is not null terminated.
+  class KeyRefTask : public Task {
+    std::vector<int> inputValues = std::vector<int>(2);
+
+    void start(TaskInterface ti) override {
+      StringRef buffer = "value-A:value-B";
+      ti.request(KeyRef(buffer.substr(0, 7)), 0);
+      StringRef keyB = buffer.substr(8);
+      ti.request(KeyRef(keyB, KeyRef::hash(keyB)), 1);
+    }
+    void provideValue(TaskInterface, uintptr_t inputID,
+                      const ValueType& value) override {
+      inputValues[inputID] = intFromValue(value);
+    }
+    void inputsAvailable(TaskInterface ti) override {
+      ti.complete(intToValue(inputValues[0] * inputValues[1]));
+    }
+  };
+  class KeyRefRule : public Rule {
+  public:
+    KeyRefRule() : Rule("result") {}
+    Task* createTask(BuildEngine&) override { return new KeyRefTask(); }
+    bool isResultValid(BuildEngine&, const ValueType&) override {
+      return true;
+    }
+  };
+
+  std::vector<std::string> builtKeys;
+  SimpleBuildEngineDelegate delegate;
+  core::BuildEngine engine(delegate);
+  engine.addRule(std::unique_ptr<core::Rule>(new SimpleRule(
+    "value-A", {}, [&] (const std::vector<int>& inputs) {
+          builtKeys.push_back("value-A");
+          return 2; })));
+  engine.addRule(std::unique_ptr<core::Rule>(new SimpleRule(
+      "value-B", {}, [&] (const std::vector<int>& inputs) {
+          builtKeys.push_back("value-B");
+          return 3; })));
+  engine.addRule(std::unique_ptr<core::Rule>(new KeyRefRule()));
+
+  EXPECT_EQ(2 * 3, intFromValue(engine.build("result")));
+  EXPECT_EQ(2U, builtKeys.size());
+  EXPECT_EQ(KeyRef::hash("value-A"), KeyRef(KeyType("value-A")).getHash());
+}
+
+
 TEST(BuildEngineTest, duplicateRule) {
   SimpleBuildEngineDelegate delegate;
   delegate.expectedError = true;
@@ -956,6 +1005,195 @@ TEST(BuildEngineTest, basicIncrementalSignatureChange) {
   EXPECT_EQ(0U, builtKeys.size());
 }
 
+TEST(BuildEngineTest, predict) {
+  // Check the rules predicted to run match those a build runs, without
+  // running any of them.
+  //
+  // Dependencies:
+  //   value-C: (value-A, value-B)
+  //   value-R: (value-A, value-C)
+  std::vector<std::string> builtKeys;
+  SimpleBuildEngineDelegate delegate;
+  core::BuildEngine engine(delegate);
+  int valueA = 2;
+  int valueB = 3;
+  engine.addRule(std::unique_ptr<core::Rule>(new SimpleRule(
+      "value-A", {}, [&] (const std::vector<int>& inputs) {
+          builtKeys.push_back("value-A");
+          return valueA; },
+      [&](const ValueType& value) {
+        return valueA == intFromValue(value);
+      })));
+  engine.addRule(std::unique_ptr<core::Rule>(new SimpleRule(
+      "value-B", {}, [&] (const std::vector<int>& inputs) {
+          builtKeys.push_back("value-B");
+          return valueB; },
+      [&](const ValueType& value) {
+        return valueB == intFromValue(value);
+      })));
+  engine.addRule(std::unique_ptr<core::Rule>(new SimpleRule(
+      "value-C", {"value-A", "value-B"},
+                   [&] (const std::vector<int>& inputs) {
+                     builtKeys.push_back("value-C");
+                     return inputs[0] * inputs[1] * 5;
+                   })));
+  engine.addRule(std::unique_ptr<core::Rule>(new SimpleRule(
+      "value-R", {"value-A", "value-C"},
+                   [&] (const std::vector<int>& inputs) {
+                     builtKeys.push_back("value-R");
+                     return inputs[0] * inputs[1] * 7;
+                   })));
+
+  auto describe = [](const std::vector<PredictedRule>& predicted) {
+    std::string result;
+    for (const auto& rule: predicted) {
+      if (!result.empty())
+        result += ", ";
+      result += rule.key.str();
+      switch (rule.reason) {
+      case PredictedRule::Reason::NeverBuilt:
+        result += " (never built)";
+        break;
+      case PredictedRule::Reason::SignatureChanged:
+        result += " (signature changed)";
+        break;
+      case PredictedRule::Reason::InvalidValue:
+        result += " (invalid value)";
+        break;
+      case PredictedRule::Reason::InputRebuilt:
+        result += " (input " + rule.input.str() + ")";
+        break;
+      }
+    }
+    return result;
+  };
+
+  // Without a prior result, the inputs of a rule are not known.
+  EXPECT_EQ("value-R (never built)", describe(engine.predict("value-R")));
+  EXPECT_EQ(0U, builtKeys.size());
+
+  // Nothing is predicted once built.
+  EXPECT_EQ(valueA * valueA * valueB * 5 * 7,
+            intFromValue(engine.build("value-R")));
+  EXPECT_EQ("", describe(engine.predict("value-R")));
+
+  // Check a change is propagated to the dependents, and that the prediction
+  // matches the following build.
+  valueB = 5;
+  builtKeys.clear();
+  EXPECT_EQ("value-B (invalid value), value-C (input value-B), "
+            "value-R (input value-C)", describe(engine.predict("value-R")));
+  EXPECT_EQ(0U, builtKeys.size());
+  EXPECT_EQ(valueA * valueA * valueB * 5 * 7,
+            intFromValue(engine.build("value-R")));
+  EXPECT_EQ(3U, builtKeys.size());
+  EXPECT_EQ("value-B", builtKeys[0]);
+  EXPECT_EQ("value-C", builtKeys[1]);
+  EXPECT_EQ("value-R", builtKeys[2]);
+}
+
+TEST(BuildEngineTest, resultPaging) {
+  // Check that results paged out under a memory budget are reloaded from the
+  // database when next used.
+  //
+  // Dependencies:
+  //   value-R: (value-A)
+  //   value-B: ()
+
+  class PagingDB : public BuildDB {
+  public:
+    std::unordered_map<KeyType, Result> ruleResults;
+    int numLookups = 0;
+
+    virtual void attachDelegate(BuildDBDelegate* delegate) override { ; }
+    virtual uint64_t getCurrentEpoch(bool* success_out, std::string* error_out) override {
+      *success_out = true;
+      return 0;
+    }
+    virtual bool setCurrentIteration(uint64_t value, std::string* error_out) override { return true; }
+    virtual bool lookupRuleResult(KeyID keyID,
+                                  const KeyType& key,
+                                  Result* result_out,
+                                  std::string* error_out) override {
+      ++numLookups;
+      auto it = ruleResults.find(key);
+      if (it == ruleResults.end())
+        return false;
+      *result_out = it->second;
+      return true;
+    }
+    virtual bool setRuleResult(KeyID key,
+                               const Rule& rule,
+                               const Result& result,
+                               std::string* error_out) override {
+      ruleResults[rule.key] = result;
+      return true;
+    }
+    virtual bool buildStarted(std::string* error_out) override { return true; }
+    virtual void buildComplete() override {}
+    virtual bool getKeys(std::vector<KeyType>& keys_out, std::string* error_out) override { return false; }
+    virtual bool getKeysWithResult(std::vector<KeyType> &keys_out, std::vector<Result> &results_out, std::string* error_out) override { return false; };
+  };
+
+  std::vector<std::string> builtKeys;
+  SimpleBuildEngineDelegate delegate;
+  core::BuildEngine engine(delegate);
+  PagingDB *db = new PagingDB();
+  std::string error;
+  EXPECT_TRUE(engine.attachDB(std::unique_ptr<PagingDB>(db), &error));
+  engine.setResultMemoryBudget(1);
+
+  int valueA = 2;
+  engine.addRule(std::unique_ptr<core::Rule>(new SimpleRule(
+      "value-A", {}, [&] (const std::vector<int>& inputs) {
+          builtKeys.push_back("value-A");
+          return valueA; },
+      [&](const ValueType& value) {
+        return valueA == intFromValue(value);
+      })));
+  engine.addRule(std::unique_ptr<core::Rule>(new SimpleRule(
+      "value-B", {}, [&] (const std::vector<int>& inputs) {
+          builtKeys.push_back("value-B");
+          return 7; })));
+  engine.addRule(std::unique_ptr<core::Rule>(new SimpleRule(
+      "value-R", {"value-A"},
+                   [&] (const std::vector<int>& inputs) {
+                     builtKeys.push_back("value-R");
+                     return inputs[0] * 3;
+                   })));
+  EXPECT_EQ(3, db->numLookups);
+
+  // Build the first result.
+  auto resultR = engine.build("value-R");
+  EXPECT_EQ(valueA * 3, intFromValue(resultR));
+  EXPECT_EQ(2U, builtKeys.size());
+
+  // Building an unrelated key pages out the prior results, but not the value
+  // returned to the client.
+  builtKeys.clear();
+  EXPECT_EQ(7, intFromValue(engine.build("value-B")));
+  EXPECT_EQ(1U, builtKeys.size());
+  EXPECT_EQ(3, db->numLookups);
+  EXPECT_EQ(valueA * 3, intFromValue(resultR));
+
+  // A null build reloads the paged out results (including the value checked by
+  // value-A and the dependencies of value-R).
+  builtKeys.clear();
+  EXPECT_EQ(valueA * 3, intFromValue(engine.build("value-R")));
+  EXPECT_EQ(0U, builtKeys.size());
+  EXPECT_EQ(5, db->numLookups);
+
+  // An incremental build after paging out still rebuilds the dependents.
+  builtKeys.clear();
+  EXPECT_EQ(7, intFromValue(engine.build("value-B")));
+  valueA = 5;
+  builtKeys.clear();
+  EXPECT_EQ(valueA * 3, intFromValue(engine.build("value-R")));
+  EXPECT_EQ(2U, builtKeys.size());
+  EXPECT_EQ("value-A", builtKeys[0]);
+  EXPECT_EQ("value-R", builtKeys[1]);
+}
+
 TEST(BuildEngineTest, concurrentProtection) {
   // Cross thread coordination
   std::mutex mutex;
@@ -1013,4 +1251,107 @@ TEST(BuildEngineTest, concurrentProtection) {
   EXPECT_EQ(0U, delegate.errors.size());
 }
 
+TEST(BuildEngineTest, jobPriorityFromWaiters) {
+  // Check that spawned jobs are prioritized by the number of tasks transitively
+  // waiting on the spawning task, counted along each path.
+  //
+  // Dependencies:
+  //   link: (compile-1, compile-2, compile-3, leaf)
+  //   compile-N: (gen)
+  class RecordingDelegate : public SimpleBuildEngineDelegate {
+    /// Execution queue which records the priority of each job.
+    class RecordingQueue : public basic::ExecutionQueue {
+      std::unique_ptr<basic::ExecutionQueue> queue;
+      std::map<std::string, uint32_t>& priorities;
+
+    public:
+      RecordingQueue(basic::ExecutionQueueDelegate& delegate,
+                     std::map<std::string, uint32_t>& priorities)
+        : ExecutionQueue(delegate),
+          queue(basic::createSerialQueue(delegate, nullptr)),
+          priorities(priorities) {}
+
+      void addJob(basic::QueueJob job) override {
+        priorities[job.getDescriptor()->getOrdinalName()] = job.getPriority();
+        queue->addJob(job);
+      }
+      void cancelAllJobs() override { queue->cancelAllJobs(); }
+      void executeProcess(
+          basic::QueueJobContext* context, ArrayRef<StringRef> commandLine,
+          ArrayRef<std::pair<StringRef, StringRef>> environment,
+          basic::ProcessAttributes attributes,
+          llvm::Optional<basic::ProcessCompletionFn> completionFn,
+          basic::ProcessDelegate* delegate) override {
+        queue->executeProcess(context, commandLine, environment, attributes,
+                              completionFn, delegate);
+      }
+    };
+
+  public:
+    std::map<std::string, uint32_t> priorities;
+
+    std::unique_ptr<basic::ExecutionQueue> createExecutionQueue() override {
+      return std::unique_ptr<basic::ExecutionQueue>(
+          new RecordingQueue(*this, priorities));
+    }
+  };
+
+  /// Task which computes its value in a spawned job.
+  class SpawningTask : public Task, public basic::JobDescriptor {
+    std::string name;
+    std::vector<KeyType> inputs;
+
+  public:
+    SpawningTask(StringRef name, const std::vector<KeyType>& inputs)
+      : name(name), inputs(inputs) {}
+
+    void start(TaskInterface ti) override {
+      for (int i = 0, e = inputs.size(); i != e; ++i)
+        ti.request(inputs[i], i);
+    }
+    void provideValue(TaskInterface, uintptr_t, const ValueType&) override {}
+    void inputsAvailable(TaskInterface ti) override {
+      ti.spawn({ this, [ti](basic::QueueJobContext*) mutable {
+            ti.complete(intToValue(1));
+          }});
+    }
+
+    StringRef getOrdinalName() const override { return name; }
+    void getShortDescription(SmallVectorImpl<char>&) const override {}
+    void getVerboseDescription(SmallVectorImpl<char>&) const override {}
+  };
+
+  class SpawningRule : public Rule {
+    std::vector<KeyType> inputs;
+
+  public:
+    SpawningRule(const KeyType& key, const std::vector<KeyType>& inputs)
+      : Rule(key), inputs(inputs) {}
+
+    Task* createTask(BuildEngine&) override {
+      return new SpawningTask(key.str(), inputs);
+    }
+    bool isResultValid(BuildEngine&, const ValueType&) override {
+      return false;
+    }
+  };
+
+  RecordingDelegate delegate;
+  core::BuildEngine engine(delegate);
+  engine.addRule(std::unique_ptr<core::Rule>(new SpawningRule("gen", {})));
+  engine.addRule(std::unique_ptr<core::Rule>(new SpawningRule("leaf", {})));
+  for (int i = 1; i <= 3; ++i) {
+    engine.addRule(std::unique_ptr<core::Rule>(new SpawningRule(
+        "compile-" + std::to_string(i), {"gen"})));
+  }
+  engine.addRule(std::unique_ptr<core::Rule>(new SpawningRule(
+      "link", {"compile-1", "compile-2", "compile-3", "leaf"})));
+
+  EXPECT_EQ(1, intFromValue(engine.build("link")));
+  EXPECT_EQ(0U, delegate.priorities["link"]);
+  EXPECT_EQ(1U, delegate.priorities["leaf"]);
+  EXPECT_EQ(1U, delegate.priorities["compile-1"]);
+  EXPECT_EQ(6U, delegate.priorities["gen"]);
+}
+
 }
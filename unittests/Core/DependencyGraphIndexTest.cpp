@@ -0,0 +1,184 @@
+//===- unittests/Core/DependencyGraphIndexTest.cpp ------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Core/DependencyGraphIndex.h"
+
+#include "llbuild/Core/BuildDB.h"
+#include "llbuild/Core/BuildEngine.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "gtest/gtest.h"
+
+#include <mutex>
+#include <vector>
+
+using namespace llbuild;
+using namespace llbuild::core;
+
+namespace {
+
+class SimpleDBDelegate : public BuildDBDelegate {
+  llvm::StringMap<bool> keyTable;
+  std::mutex keyTableMutex;
+
+public:
+  virtual const KeyID getKeyID(const KeyType& key) override {
+    std::lock_guard<std::mutex> guard(keyTableMutex);
+    auto it = keyTable.insert(std::make_pair(key.str(), false)).first;
+    return KeyID(it->getKey().data());
+  }
+
+  virtual KeyType getKeyForID(const KeyID key) override {
+    return llvm::StringMapEntry<bool>::GetStringMapEntryFromKeyData(
+      (const char*)(uintptr_t)key).getKey();
+  }
+};
+
+class NullRule : public Rule {
+public:
+  NullRule(const KeyType& key) : Rule(key) {}
+  Task* createTask(BuildEngine&) override { return nullptr; }
+  bool isResultValid(BuildEngine&, const ValueType&) override { return true; }
+};
+
+/// Get the keys of a list of nodes, separated by spaces.
+std::string describe(const DependencyGraphIndex& index,
+                     ArrayRef<DependencyGraphIndex::NodeID> nodes) {
+  std::string result;
+  for (auto node: nodes) {
+    if (!result.empty())
+      result += " ";
+    result += index.getKey(node);
+  }
+  return result;
+}
+
+TEST(DependencyGraphIndexTest, basic) {
+  llvm::SmallString<256> dbPath;
+  auto ec = llvm::sys::fs::createTemporaryFile("build", "db", dbPath);
+  EXPECT_EQ(bool(ec), false);
+
+  // Record the graph:
+  //
+  //   all -> app -> {lib, main.o}, lib -> {a.o, b.o, a.o}, a.o -> a.c,
+  //   b.o -> b.c, main.o -> main.c, test -> lib
+  //
+  // where the source files have no results of their own.
+  std::vector<std::pair<std::string, std::vector<std::string>>> rules = {
+    { "all", { "app" } },
+    { "app", { "lib", "main.o" } },
+    { "lib", { "a.o", "b.o", "a.o" } },
+    { "a.o", { "a.c" } },
+    { "b.o", { "b.c" } },
+    { "main.o", { "main.c" } },
+    { "test", { "lib" } },
+  };
+  SimpleDBDelegate delegate;
+  std::string error;
+  auto buildDB = createSQLiteBuildDB(dbPath, 1,
+                                     /* recreateUnmatchedVersion = */ true,
+                                     &error);
+  ASSERT_TRUE(buildDB != nullptr);
+  buildDB->attachDelegate(&delegate);
+  EXPECT_TRUE(buildDB->buildStarted(&error));
+  EXPECT_TRUE(buildDB->setCurrentIteration(3, &error));
+  for (const auto& entry: rules) {
+    NullRule rule(entry.first);
+    Result result;
+    result.builtAt = result.computedAt = 3;
+    for (const auto& dependency: entry.second)
+      result.dependencies.push_back(delegate.getKeyID(dependency), false);
+    EXPECT_TRUE(buildDB->setRuleResult(delegate.getKeyID(entry.first), rule,
+                                       result, &error));
+    EXPECT_EQ(error, "");
+  }
+  buildDB->buildComplete();
+
+  buildDB = createReadOnlySQLiteBuildDB(dbPath, 1, &error);
+  ASSERT_TRUE(buildDB != nullptr);
+  auto index = DependencyGraphIndex::build(*buildDB, &error);
+  ASSERT_TRUE(index != nullptr) << error;
+  EXPECT_EQ(index->getEpoch(), 3U);
+  EXPECT_EQ(index->getNumNodes(), 10U);
+  EXPECT_EQ(index->getNumEdges(), 9U);
+
+  auto lookup = [&](StringRef key) {
+    DependencyGraphIndex::NodeID node = ~0U;
+    EXPECT_TRUE(index->lookup(key, &node)) << key.str();
+    return node;
+  };
+  DependencyGraphIndex::NodeID node;
+  EXPECT_FALSE(index->lookup("missing", &node));
+  EXPECT_FALSE(index->lookup("", &node));
+  EXPECT_FALSE(index->lookup("zzz", &node));
+
+  // Duplicate dependencies are dropped, and the order is otherwise kept.
+  EXPECT_EQ(describe(*index, index->getDependencies(lookup("lib"))), "a.o b.o");
+  EXPECT_EQ(describe(*index, index->getDependencies(lookup("app"))),
+            "lib main.o");
+  EXPECT_EQ(describe(*index, index->getDependencies(lookup("a.c"))), "");
+  EXPECT_EQ(describe(*index, index->getDependents(lookup("lib"))), "app test");
+  EXPECT_EQ(describe(*index, index->getDependents(lookup("a.c"))), "a.o");
+
+  std::vector<DependencyGraphIndex::NodeID> roots{ lookup("app") };
+  EXPECT_EQ(describe(*index, index->getTransitiveDependencies(roots)),
+            "a.c a.o b.c b.o lib main.c main.o");
+  roots = { lookup("a.c") };
+  EXPECT_EQ(describe(*index, index->getTransitiveDependents(roots)),
+            "a.o all app lib test");
+  roots = { lookup("main.c"), lookup("b.c") };
+  EXPECT_EQ(describe(*index, index->getTransitiveDependents(roots)),
+            "all app b.o lib main.o test");
+
+  EXPECT_EQ(describe(*index, index->findPath(lookup("all"), lookup("b.c"))),
+            "all app lib b.o b.c");
+  EXPECT_EQ(describe(*index, index->findPath(lookup("a.o"), lookup("a.o"))),
+            "a.o");
+  EXPECT_TRUE(index->findPath(lookup("test"), lookup("main.c")).empty());
+
+  // Check the index survives being persisted.
+  llvm::SmallString<256> indexPath(dbPath);
+  indexPath += ".graph-index";
+  EXPECT_TRUE(index->write(indexPath, &error)) << error;
+  auto loaded = DependencyGraphIndex::load(indexPath, &error);
+  ASSERT_TRUE(loaded != nullptr) << error;
+  EXPECT_EQ(loaded->getEpoch(), 3U);
+  ASSERT_EQ(loaded->getNumNodes(), index->getNumNodes());
+  for (unsigned i = 0; i != index->getNumNodes(); ++i) {
+    EXPECT_EQ(loaded->getKey(i), index->getKey(i));
+    EXPECT_EQ(describe(*loaded, loaded->getDependencies(i)),
+              describe(*index, index->getDependencies(i)));
+    EXPECT_EQ(describe(*loaded, loaded->getDependents(i)),
+              describe(*index, index->getDependents(i)));
+  }
+
+  // Check a damaged index is rejected.
+  {
+    std::error_code ec;
+    llvm::raw_fd_ostream os(indexPath, ec, llvm::sys::fs::F_Append);
+    os << "x";
+  }
+  EXPECT_TRUE(DependencyGraphIndex::load(indexPath, &error) == nullptr);
+  EXPECT_EQ(error, "invalid index file");
+
+  buildDB = nullptr;
+  ec = llvm::sys::fs::remove(dbPath.str());
+  EXPECT_EQ(bool(ec), false);
+  ec = llvm::sys::fs::remove(indexPath.str());
+  EXPECT_EQ(bool(ec), false);
+}
+
+}
@@ -12,11 +12,16 @@
 
 #include "llbuild/Core/BuildDB.h"
 
+#include "llbuild/Core/BuildEngine.h"
+
 #include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Support/FileSystem.h"
 
 #include "gtest/gtest.h"
 
+#include <mutex>
+
 #include <sqlite3.h>
 
 using namespace llbuild;
@@ -128,3 +133,489 @@ TEST(SQLiteBuildDBTest, CloseDBConnectionAfterCloseCall) {
   
   buildDB->buildComplete();
 }
+
+TEST(SQLiteBuildDBTest, AuxiliaryValues) {
+  // Create a temporary file.
+  llvm::SmallString<256> dbPath;
+  auto ec = llvm::sys::fs::createTemporaryFile("build", "db", dbPath);
+  EXPECT_EQ(bool(ec), false);
+
+  std::string error;
+  std::unique_ptr<BuildDB> buildDB = createSQLiteBuildDB(dbPath, 1, /* recreateUnmatchedVersion = */ true, &error);
+  EXPECT_TRUE(buildDB != nullptr);
+  EXPECT_EQ(error, "");
+
+  std::string value;
+  EXPECT_FALSE(buildDB->lookupAuxiliaryValue("key", &value, &error));
+  EXPECT_EQ(error, "");
+
+  EXPECT_TRUE(buildDB->buildStarted(&error));
+  EXPECT_TRUE(buildDB->setAuxiliaryValue("key", StringRef("a\0b", 3), &error));
+  EXPECT_EQ(error, "");
+  buildDB->buildComplete();
+
+  // Check the value is persisted across connections.
+  buildDB = createSQLiteBuildDB(dbPath, 1, /* recreateUnmatchedVersion = */ true, &error);
+  EXPECT_TRUE(buildDB->lookupAuxiliaryValue("key", &value, &error));
+  EXPECT_EQ(error, "");
+  EXPECT_EQ(value, std::string("a\0b", 3));
+  buildDB = nullptr;
+
+  ec = llvm::sys::fs::remove(dbPath.str());
+  EXPECT_EQ(bool(ec), false);
+}
+
+namespace {
+
+class SimpleDBDelegate : public BuildDBDelegate {
+  llvm::StringMap<bool> keyTable;
+  std::mutex keyTableMutex;
+
+public:
+  virtual const KeyID getKeyID(const KeyType& key) override {
+    std::lock_guard<std::mutex> guard(keyTableMutex);
+    auto it = keyTable.insert(std::make_pair(key.str(), false)).first;
+    return KeyID(it->getKey().data());
+  }
+
+  virtual KeyType getKeyForID(const KeyID key) override {
+    return llvm::StringMapEntry<bool>::GetStringMapEntryFromKeyData(
+      (const char*)(uintptr_t)key).getKey();
+  }
+};
+
+class NullRule : public Rule {
+public:
+  NullRule(const KeyType& key) : Rule(key) {}
+  Task* createTask(BuildEngine&) override { return nullptr; }
+  bool isResultValid(BuildEngine&, const ValueType&) override { return true; }
+};
+
+}
+
+TEST(SQLiteBuildDBTest, Sharded) {
+  llvm::SmallString<256> dbPath;
+  auto ec = llvm::sys::fs::createTemporaryFile("build", "db", dbPath);
+  EXPECT_EQ(bool(ec), false);
+
+  // Write a chain of results, each depending on the previous one, so that
+  // most dependencies cross shards.
+  std::vector<std::string> names = { "a", "b", "c", "d", "e", "f", "g", "h" };
+  SimpleDBDelegate delegate;
+  std::string error;
+  auto buildDB = createShardedSQLiteBuildDB(
+      dbPath, 3, 1, /* recreateUnmatchedVersion = */ true, &error);
+  ASSERT_TRUE(buildDB != nullptr);
+  buildDB->attachDelegate(&delegate);
+  EXPECT_TRUE(buildDB->buildStarted(&error));
+  EXPECT_TRUE(buildDB->setCurrentIteration(7, &error));
+  for (unsigned i = 0; i != names.size(); ++i) {
+    NullRule rule(names[i]);
+    Result result;
+    result.value = { uint8_t(i) };
+    result.builtAt = result.computedAt = 7;
+    if (i != 0)
+      result.dependencies.push_back(delegate.getKeyID(names[i - 1]), false);
+    EXPECT_TRUE(buildDB->setRuleResult(delegate.getKeyID(names[i]), rule,
+                                       result, &error));
+    EXPECT_EQ(error, "");
+  }
+  buildDB->buildComplete();
+
+  // Check the results are read back from a new connection.
+  buildDB = createShardedSQLiteBuildDB(
+      dbPath, 3, 1, /* recreateUnmatchedVersion = */ true, &error);
+  buildDB->attachDelegate(&delegate);
+  bool success = false;
+  EXPECT_EQ(buildDB->getCurrentEpoch(&success, &error), 7U);
+  EXPECT_TRUE(success);
+  for (unsigned i = 0; i != names.size(); ++i) {
+    Result result;
+    EXPECT_TRUE(buildDB->lookupRuleResult(delegate.getKeyID(names[i]),
+                                          names[i], &result, &error));
+    EXPECT_EQ(error, "");
+    EXPECT_EQ(result.value, ValueType{ uint8_t(i) });
+    EXPECT_EQ(result.dependencies.size(), i == 0 ? 0U : 1U);
+    if (i != 0) {
+      EXPECT_EQ(delegate.getKeyForID(result.dependencies[0].keyID).str(),
+                names[i - 1]);
+    }
+  }
+
+  std::vector<KeyType> keys;
+  std::vector<Result> results;
+  EXPECT_TRUE(buildDB->getKeysWithResult(keys, results, &error));
+  EXPECT_EQ(keys.size(), names.size());
+  keys.clear();
+  EXPECT_TRUE(buildDB->getKeys(keys, &error));
+  EXPECT_EQ(keys.size(), names.size());
+  buildDB = nullptr;
+
+  for (unsigned i = 0; i != 3; ++i) {
+    ec = llvm::sys::fs::remove(dbPath + ".shard-" + Twine(i) + "-of-3");
+    EXPECT_EQ(bool(ec), false);
+  }
+  llvm::sys::fs::remove(dbPath.str());
+}
+
+namespace {
+
+/// A shard which forwards to a SQLite database, but can drop its commit to
+/// simulate a build interrupted after only some shards were committed.
+class InterruptibleDB : public BuildDB {
+  std::unique_ptr<BuildDB> db;
+  unsigned index;
+  std::vector<unsigned>& commitOrder;
+
+public:
+  bool dropCommit = false;
+
+  InterruptibleDB(std::unique_ptr<BuildDB> db, unsigned index,
+                  std::vector<unsigned>& commitOrder)
+      : db(std::move(db)), index(index), commitOrder(commitOrder) {}
+
+  virtual void attachDelegate(BuildDBDelegate* delegate) override {
+    db->attachDelegate(delegate);
+  }
+  virtual Epoch getCurrentEpoch(bool* success_out,
+                                std::string* error_out) override {
+    return db->getCurrentEpoch(success_out, error_out);
+  }
+  virtual bool setCurrentIteration(uint64_t value,
+                                   std::string* error_out) override {
+    return db->setCurrentIteration(value, error_out);
+  }
+  virtual bool lookupRuleResult(KeyID keyID, const KeyType& key,
+                                Result* result_out,
+                                std::string* error_out) override {
+    return db->lookupRuleResult(keyID, key, result_out, error_out);
+  }
+  virtual bool setRuleResult(KeyID keyID, const Rule& rule,
+                             const Result& result,
+                             std::string* error_out) override {
+    return db->setRuleResult(keyID, rule, result, error_out);
+  }
+  virtual bool buildStarted(std::string* error_out) override {
+    return db->buildStarted(error_out);
+  }
+  virtual void buildComplete() override {
+    commitOrder.push_back(index);
+    // Closing the connection without committing rolls the build back.
+    if (dropCommit)
+      db = nullptr;
+    else
+      db->buildComplete();
+  }
+  virtual bool getKeys(std::vector<KeyType>& keys_out,
+                       std::string* error_out) override {
+    return db->getKeys(keys_out, error_out);
+  }
+  virtual bool getKeysWithResult(std::vector<KeyType>& keys_out,
+                                 std::vector<Result>& results_out,
+                                 std::string* error_out) override {
+    return db->getKeysWithResult(keys_out, results_out, error_out);
+  }
+  virtual bool lookupAuxiliaryValue(StringRef key, std::string* value_out,
+                                    std::string* error_out) override {
+    return db->lookupAuxiliaryValue(key, value_out, error_out);
+  }
+  virtual bool setAuxiliaryValue(StringRef key, StringRef value,
+                                 std::string* error_out) override {
+    return db->setAuxiliaryValue(key, value, error_out);
+  }
+  virtual bool lookupCommandOutput(const KeyType& key, std::string* output_out,
+                                   std::string* error_out) override {
+    return db->lookupCommandOutput(key, output_out, error_out);
+  }
+  virtual bool setCommandOutput(const KeyType& key, StringRef output,
+                                std::string* error_out) override {
+    return db->setCommandOutput(key, output, error_out);
+  }
+};
+
+}
+
+TEST(SQLiteBuildDBTest, ShardedInterruptedCommit) {
+  llvm::SmallString<256> dbPath;
+  auto ec = llvm::sys::fs::createTemporaryFile("build", "db", dbPath);
+  EXPECT_EQ(bool(ec), false);
+
+  std::vector<unsigned> commitOrder;
+  std::vector<InterruptibleDB*> shards;
+  std::string error;
+  auto openDB = [&]() -> std::unique_ptr<BuildDB> {
+    std::vector<std::unique_ptr<BuildDB>> dbs;
+    shards.clear();
+    for (unsigned i = 0; i != 2; ++i) {
+      auto db = createSQLiteBuildDB((dbPath + ".shard-" + Twine(i)).str(), 1,
+                                    /* recreateUnmatchedVersion = */ true,
+                                    &error);
+      EXPECT_TRUE(db != nullptr);
+      shards.push_back(new InterruptibleDB(std::move(db), i, commitOrder));
+      dbs.emplace_back(shards.back());
+    }
+    return createShardedBuildDB(std::move(dbs));
+  };
+
+  std::vector<std::string> names = { "a", "b", "c", "d", "e", "f", "g", "h" };
+  SimpleDBDelegate delegate;
+  auto writeBuild = [&](BuildDB& buildDB, Epoch iteration) {
+    EXPECT_TRUE(buildDB.buildStarted(&error));
+    EXPECT_TRUE(buildDB.setCurrentIteration(iteration, &error));
+    for (auto& name: names) {
+      NullRule rule(name);
+      Result result;
+      result.builtAt = result.computedAt = iteration;
+      EXPECT_TRUE(buildDB.setRuleResult(delegate.getKeyID(name), rule, result,
+                                        &error));
+    }
+    EXPECT_EQ(error, "");
+    buildDB.buildComplete();
+  };
+
+  // Check the shard holding the iteration is committed first.
+  auto buildDB = openDB();
+  buildDB->attachDelegate(&delegate);
+  writeBuild(*buildDB, 1);
+  EXPECT_EQ(commitOrder, (std::vector<unsigned>{ 0, 1 }));
+
+  // Interrupt the next build after the other shard was committed, but before
+  // the iteration was.
+  shards[0]->dropCommit = true;
+  writeBuild(*buildDB, 2);
+  buildDB = nullptr;
+
+  // Check the next build resumes after the newest committed result, rather
+  // than reusing its epoch.
+  buildDB = openDB();
+  buildDB->attachDelegate(&delegate);
+  bool success = false;
+  Epoch epoch = buildDB->getCurrentEpoch(&success, &error);
+  EXPECT_TRUE(success);
+  Epoch newestResult = 0;
+  for (auto& name: names) {
+    Result result;
+    EXPECT_TRUE(buildDB->lookupRuleResult(delegate.getKeyID(name), name,
+                                          &result, &error));
+    newestResult = std::max(newestResult, result.builtAt);
+  }
+  EXPECT_EQ(newestResult, 2U);
+  EXPECT_EQ(epoch, 2U);
+  buildDB = nullptr;
+
+  for (unsigned i = 0; i != 2; ++i) {
+    ec = llvm::sys::fs::remove(dbPath + ".shard-" + Twine(i));
+    EXPECT_EQ(bool(ec), false);
+  }
+  llvm::sys::fs::remove(dbPath.str());
+}
+
+TEST(SQLiteBuildDBTest, CommandOutputs) {
+  llvm::SmallString<256> dbPath;
+  auto ec = llvm::sys::fs::createTemporaryFile("build", "db", dbPath);
+  EXPECT_EQ(bool(ec), false);
+
+  auto countBlobs = [&]() -> int {
+    sqlite3 *db = nullptr;
+    sqlite3_open(dbPath.c_str(), &db);
+    sqlite3_stmt* stmt = nullptr;
+    sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM output_blobs;", -1, &stmt,
+                       nullptr);
+    int count = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+      count = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    return count;
+  };
+
+  std::string warning = "a.h:1:1: warning: something is off\n";
+  SimpleDBDelegate delegate;
+  std::string error;
+  auto buildDB = createSQLiteBuildDB(dbPath, 1,
+                                     /* recreateUnmatchedVersion = */ true,
+                                     &error);
+  ASSERT_TRUE(buildDB != nullptr);
+  buildDB->attachDelegate(&delegate);
+  EXPECT_TRUE(buildDB->buildStarted(&error));
+  EXPECT_TRUE(buildDB->setCommandOutput("a", warning, &error));
+  EXPECT_TRUE(buildDB->setCommandOutput("b", warning, &error));
+  EXPECT_TRUE(buildDB->setCommandOutput("c", "other output", &error));
+  EXPECT_TRUE(buildDB->setCommandOutput("d", "", &error));
+  EXPECT_EQ(error, "");
+  buildDB->buildComplete();
+
+  // Check identical outputs are stored once.
+  EXPECT_EQ(countBlobs(), 2);
+
+  std::string output;
+  EXPECT_TRUE(buildDB->lookupCommandOutput("a", &output, &error));
+  EXPECT_EQ(output, warning);
+  EXPECT_TRUE(buildDB->lookupCommandOutput("b", &output, &error));
+  EXPECT_EQ(output, warning);
+  EXPECT_TRUE(buildDB->lookupCommandOutput("c", &output, &error));
+  EXPECT_EQ(output, "other output");
+  EXPECT_FALSE(buildDB->lookupCommandOutput("d", &output, &error));
+  EXPECT_FALSE(buildDB->lookupCommandOutput("missing", &output, &error));
+  EXPECT_EQ(error, "");
+
+  // Check replaced and removed outputs are dropped once unreferenced.
+  EXPECT_TRUE(buildDB->buildStarted(&error));
+  EXPECT_TRUE(buildDB->setCommandOutput("a", "", &error));
+  EXPECT_TRUE(buildDB->setCommandOutput("c", warning, &error));
+  buildDB->buildComplete();
+  EXPECT_EQ(countBlobs(), 1);
+  EXPECT_FALSE(buildDB->lookupCommandOutput("a", &output, &error));
+  EXPECT_TRUE(buildDB->lookupCommandOutput("c", &output, &error));
+  EXPECT_EQ(output, warning);
+
+  // Check unchanged outputs, and removing absent ones, don't modify the
+  // database, by planting an unreferenced blob which is only dropped after a
+  // change.
+  buildDB = nullptr;
+  {
+    sqlite3 *db = nullptr;
+    sqlite3_open(dbPath.c_str(), &db);
+    EXPECT_EQ(sqlite3_exec(db, ("INSERT INTO output_blobs(hash, data) "
+                                "VALUES (0, x'00');"),
+                           nullptr, nullptr, nullptr), SQLITE_OK);
+    sqlite3_close(db);
+  }
+  buildDB = createSQLiteBuildDB(dbPath, 1,
+                                /* recreateUnmatchedVersion = */ true, &error);
+  ASSERT_TRUE(buildDB != nullptr);
+  buildDB->attachDelegate(&delegate);
+  EXPECT_TRUE(buildDB->buildStarted(&error));
+  EXPECT_TRUE(buildDB->setCommandOutput("c", warning, &error));
+  EXPECT_TRUE(buildDB->setCommandOutput("d", "", &error));
+  buildDB->buildComplete();
+  EXPECT_EQ(countBlobs(), 2);
+  EXPECT_TRUE(buildDB->lookupCommandOutput("c", &output, &error));
+  EXPECT_EQ(output, warning);
+  buildDB = nullptr;
+
+  ec = llvm::sys::fs::remove(dbPath.str());
+  EXPECT_EQ(bool(ec), false);
+}
+
+TEST(SQLiteBuildDBTest, Durability) {
+  llvm::SmallString<256> dbPath;
+  auto ec = llvm::sys::fs::createTemporaryFile("build", "db", dbPath);
+  EXPECT_EQ(bool(ec), false);
+
+  auto getJournalMode = [&]() -> std::string {
+    sqlite3 *db = nullptr;
+    sqlite3_open(dbPath.c_str(), &db);
+    sqlite3_stmt* stmt = nullptr;
+    sqlite3_prepare_v2(db, "PRAGMA journal_mode;", -1, &stmt, nullptr);
+    std::string mode;
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+      mode = (const char*)sqlite3_column_text(stmt, 0);
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    return mode;
+  };
+
+  SQLiteBuildDBDurability durability;
+  EXPECT_FALSE(parseSQLiteBuildDBDurability("bogus", &durability));
+  EXPECT_TRUE(parseSQLiteBuildDBDurability("fast", &durability));
+  EXPECT_EQ(durability, SQLiteBuildDBDurability::Fast);
+
+  // Check the fast policy switches the database to a write-ahead log, and
+  // that the value written through it persists.
+  std::string error;
+  auto buildDB = createSQLiteBuildDB(
+      dbPath, 1, /* recreateUnmatchedVersion = */ true, &error, durability);
+  EXPECT_TRUE(buildDB->buildStarted(&error));
+  EXPECT_TRUE(buildDB->setAuxiliaryValue("key", "value", &error));
+  buildDB->buildComplete();
+  buildDB = nullptr;
+  EXPECT_EQ(getJournalMode(), "wal");
+
+  // Check the strict policy switches it back.
+  buildDB = createSQLiteBuildDB(
+      dbPath, 1, /* recreateUnmatchedVersion = */ true, &error,
+      SQLiteBuildDBDurability::Strict);
+  std::string value;
+  EXPECT_TRUE(buildDB->lookupAuxiliaryValue("key", &value, &error));
+  EXPECT_EQ(value, "value");
+  buildDB = nullptr;
+  EXPECT_EQ(getJournalMode(), "delete");
+
+  ec = llvm::sys::fs::remove(dbPath.str());
+  EXPECT_EQ(bool(ec), false);
+}
+
+TEST(SQLiteBuildDBTest, ReadOnlySnapshot) {
+  llvm::SmallString<256> dbPath;
+  auto ec = llvm::sys::fs::createTemporaryFile("build", "db", dbPath);
+  EXPECT_EQ(bool(ec), false);
+
+  std::string error;
+  auto buildDB = createSQLiteBuildDB(
+      dbPath, 1, /* recreateUnmatchedVersion = */ true, &error,
+      SQLiteBuildDBDurability::Normal);
+  EXPECT_TRUE(buildDB->buildStarted(&error));
+  EXPECT_TRUE(buildDB->setAuxiliaryValue("key", "old", &error));
+  buildDB->buildComplete();
+
+  // Start a build which writes a new value, but do not complete it.
+  EXPECT_TRUE(buildDB->buildStarted(&error));
+  EXPECT_TRUE(buildDB->setAuxiliaryValue("key", "new", &error));
+
+  // Check a reader sees the last committed value without blocking.
+  auto snapshotDB = createReadOnlySQLiteBuildDB(dbPath, 1, &error);
+  EXPECT_TRUE(snapshotDB != nullptr);
+  std::string value;
+  EXPECT_TRUE(snapshotDB->lookupAuxiliaryValue("key", &value, &error));
+  EXPECT_EQ(error, "");
+  EXPECT_EQ(value, "old");
+
+  // Check the snapshot rejects writes.
+  EXPECT_FALSE(snapshotDB->setAuxiliaryValue("key", "other", &error));
+  EXPECT_NE(error, "");
+  snapshotDB = nullptr;
+
+  buildDB->buildComplete();
+  buildDB = nullptr;
+
+  ec = llvm::sys::fs::remove(dbPath.str());
+  EXPECT_EQ(bool(ec), false);
+}
+
+TEST(SQLiteBuildDBTest, ReadOnlySnapshotWithRollbackJournal) {
+  llvm::SmallString<256> dbPath;
+  auto ec = llvm::sys::fs::createTemporaryFile("build", "db", dbPath);
+  EXPECT_EQ(bool(ec), false);
+
+  // The default durability does not use a write-ahead log.
+  std::string error;
+  auto buildDB = createSQLiteBuildDB(
+      dbPath, 1, /* recreateUnmatchedVersion = */ true, &error);
+  EXPECT_TRUE(buildDB->buildStarted(&error));
+  EXPECT_TRUE(buildDB->setAuxiliaryValue("key", "old", &error));
+  buildDB->buildComplete();
+
+  // A snapshot can be read between builds.
+  auto snapshotDB = createReadOnlySQLiteBuildDB(dbPath, 1, &error);
+  EXPECT_TRUE(snapshotDB != nullptr);
+  std::string value;
+  EXPECT_TRUE(snapshotDB->lookupAuxiliaryValue("key", &value, &error));
+  EXPECT_EQ(error, "");
+  EXPECT_EQ(value, "old");
+  snapshotDB = nullptr;
+
+  // But not while a build holds the database, and the error says why.
+  EXPECT_TRUE(buildDB->buildStarted(&error));
+  snapshotDB = createReadOnlySQLiteBuildDB(dbPath, 1, &error);
+  EXPECT_TRUE(snapshotDB != nullptr);
+  EXPECT_FALSE(snapshotDB->lookupAuxiliaryValue("key", &value, &error));
+  EXPECT_NE(error.find("write-ahead log"), std::string::npos);
+  snapshotDB = nullptr;
+
+  buildDB->buildComplete();
+  buildDB = nullptr;
+
+  ec = llvm::sys::fs::remove(dbPath.str());
+  EXPECT_EQ(bool(ec), false);
+}
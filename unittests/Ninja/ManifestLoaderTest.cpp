@@ -0,0 +1,171 @@
+//===- unittests/Ninja/ManifestLoaderTest.cpp -----------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Ninja/ManifestLoader.h"
+
+#include "llvm/ADT/StringMap.h"
+
+#include "gtest/gtest.h"
+
+#include <cstring>
+
+using namespace llvm;
+using namespace llbuild::ninja;
+
+namespace {
+
+/// Loader actions which read files from memory.
+class InMemoryActions : public ManifestLoaderActions {
+public:
+  StringMap<std::string> files;
+  StringMap<unsigned> numReads;
+  std::vector<std::string> errors;
+
+  virtual void initialize(ManifestLoader*) override {}
+
+  virtual void error(std::string filename, std::string message,
+                     const Token&) override {
+    errors.push_back(filename + ": " + message);
+  }
+
+  virtual bool readFileContents(const std::string&,
+                                const std::string& filename,
+                                const Token*,
+                                std::unique_ptr<char[]>* data_out,
+                                uint64_t* length_out) override {
+    ++numReads[filename];
+    auto it = files.find(filename);
+    if (it == files.end()) {
+      errors.push_back(filename + ": missing");
+      return false;
+    }
+    data_out->reset(new char[it->second.size()]);
+    memcpy(data_out->get(), it->second.data(), it->second.size());
+    *length_out = it->second.size();
+    return true;
+  }
+};
+
+std::vector<std::string> getOutputs(const Manifest& manifest) {
+  std::vector<std::string> result;
+  for (const auto* command: manifest.getCommands())
+    result.push_back(command->getOutputs()[0]->getScreenPath());
+  return result;
+}
+
+TEST(ManifestLoaderTest, reloadReparsesChangedSubninja) {
+  InMemoryActions actions;
+  actions.files["build.ninja"] =
+    "rule CAT\n  command = cat $in > $out\n"
+    "build a: CAT x\n"
+    "subninja sub1.ninja\n"
+    "subninja sub2.ninja\n"
+    "build z: CAT y\n";
+  actions.files["sub1.ninja"] =
+    "flags = -O0\n"
+    "rule CC\n  command = cc $flags $in -o $out\n"
+    "build b: CC x\n"
+    "include sub1-inc.ninja\n";
+  actions.files["sub1-inc.ninja"] = "build b-inc: CC x\n";
+  actions.files["sub2.ninja"] =
+    "rule CC\n  command = cc $in -o $out\n"
+    "build c: CC x\n";
+
+  ManifestLoader loader("/tmp", "build.ninja", actions);
+  auto manifest = loader.load();
+  ASSERT_TRUE(manifest);
+  ASSERT_TRUE(actions.errors.empty());
+  EXPECT_EQ(getOutputs(*manifest),
+            (std::vector<std::string>{"a", "b", "b-inc", "c", "z"}));
+  auto previousCommands = manifest->getCommands();
+  const Manifest* previousManifest = manifest.get();
+
+  // Change a file included by the first subninja.
+  actions.files["sub1.ninja"] =
+    "flags = -O2\n"
+    "rule CC\n  command = cc $flags $in -o $out\n"
+    "build b: CC x\n"
+    "include sub1-inc.ninja\n";
+  actions.files["sub1-inc.ninja"] = "build b-inc: CC x\nbuild b-new: CC x\n";
+  actions.numReads.clear();
+  manifest = loader.reload(std::move(manifest));
+  ASSERT_TRUE(manifest);
+  ASSERT_TRUE(actions.errors.empty());
+  EXPECT_EQ(manifest.get(), previousManifest);
+  EXPECT_EQ(getOutputs(*manifest),
+            (std::vector<std::string>{"a", "b", "b-inc", "b-new", "c", "z"}));
+  EXPECT_EQ(manifest->getCommands()[1]->getCommandString(), "cc -O2 x -o b");
+
+  // Only the changed unit is parsed again.
+  EXPECT_EQ(actions.numReads["build.ninja"], 1U);
+  EXPECT_EQ(actions.numReads["sub1.ninja"], 2U);
+  EXPECT_EQ(actions.numReads["sub1-inc.ninja"], 2U);
+  EXPECT_EQ(actions.numReads["sub2.ninja"], 1U);
+  EXPECT_EQ(manifest->getCommands()[0], previousCommands[0]);
+  EXPECT_NE(manifest->getCommands()[1], previousCommands[1]);
+  EXPECT_EQ(manifest->getCommands()[4], previousCommands[3]);
+  EXPECT_EQ(manifest->getCommands()[5], previousCommands[4]);
+
+  // The second subninja is reloaded against the updated command ranges.
+  actions.files["sub2.ninja"] = "rule CC\n  command = cc $in -o $out\n";
+  manifest = loader.reload(std::move(manifest));
+  ASSERT_TRUE(manifest);
+  EXPECT_EQ(manifest.get(), previousManifest);
+  EXPECT_EQ(getOutputs(*manifest),
+            (std::vector<std::string>{"a", "b", "b-inc", "b-new", "z"}));
+}
+
+TEST(ManifestLoaderTest, reloadLoadsDependentChanges) {
+  InMemoryActions actions;
+  actions.files["build.ninja"] =
+    "subninja sub.ninja\n"
+    "pool link\n  depth = 1\n";
+  actions.files["sub.ninja"] =
+    "rule CC\n  command = cc $in -o $out\n"
+    "build b: CC x\n";
+
+  ManifestLoader loader("/tmp", "build.ninja", actions);
+  auto manifest = loader.load();
+  ASSERT_TRUE(manifest);
+  ASSERT_TRUE(actions.errors.empty());
+  const Manifest* previousManifest = manifest.get();
+
+  // The subninja was loaded before a pool it could not see, so it is not
+  // parsed on its own.
+  actions.files["sub.ninja"] =
+    "rule CC\n  command = cc $in -o $out\n"
+    "build c: CC x\n";
+  manifest = loader.reload(std::move(manifest));
+  ASSERT_TRUE(manifest);
+  ASSERT_TRUE(actions.errors.empty());
+  EXPECT_NE(manifest.get(), previousManifest);
+  EXPECT_EQ(getOutputs(*manifest), std::vector<std::string>{"c"});
+
+  // A change to the main file loads the manifest again.
+  actions.files["build.ninja"] = "pool link\n  depth = 1\nsubninja sub.ninja\n";
+  manifest = loader.reload(std::move(manifest));
+  ASSERT_TRUE(manifest);
+  previousManifest = manifest.get();
+
+  // A subninja which declares globals is loaded again.
+  actions.files["sub.ninja"] =
+    "rule CC\n  command = cc $in -o $out\n"
+    "build c: CC x\n"
+    "pool compile\n  depth = 2\n";
+  manifest = loader.reload(std::move(manifest));
+  ASSERT_TRUE(manifest);
+  ASSERT_TRUE(actions.errors.empty());
+  EXPECT_NE(manifest.get(), previousManifest);
+  EXPECT_EQ(manifest->getPools().count("compile"), 1U);
+}
+
+}